@@ -44,4 +44,10 @@
  */
 @property NSArray<NSString *> *forwardingCurve25519KeyChain;
 
+/**
+ The error if the event could not be decrypted. `clearEvent` is then nil.
+ Only results of [MXCrypto decryptEvents:inTimeline:queue:onComplete:] can have an error.
+ */
+@property (nonatomic) NSError *error;
+
 @end
@@ -27,14 +27,91 @@
 #import "MXQueuedEncryption.h"
 #import "MXTools.h"
 
-@interface MXOutboundSessionInfo : NSObject
+// The maximum estimated size in bytes of the messages sent in one /sendToDevice request
+static NSUInteger const kMXMegolmEncryptionToDeviceChunkMaxSize = 100 * 1024;
+
+// The maximum number of /sendToDevice requests run at the same time to share a key
+static NSUInteger const kMXMegolmEncryptionToDeviceMaxConcurrentRequests = 3;
+
+/**
+ The operation of a key share.
+
+ Its to-device requests run in parallel lanes. Cancelling it cancels the request of every lane.
+ */
+@interface MXMegolmShareKeyOperation : MXHTTPOperation
+
+/**
+ Set the request currently run by a lane.
+
+ @param operation the request. It is cancelled at once if the share is already cancelled.
+ @param lane the lane index.
+ */
+- (void)setOperation:(MXHTTPOperation*)operation forLane:(NSUInteger)lane;
+
+@end
+
+@interface MXMegolmShareKeyOperation ()
 {
-    // When the session was created
-    NSDate  *creationTime;
+    // The current request of each lane, by lane index
+    NSMutableDictionary<NSNumber*, MXHTTPOperation*> *laneOperations;
 }
+@end
+
+@implementation MXMegolmShareKeyOperation
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        laneOperations = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)setOperation:(MXHTTPOperation*)operation forLane:(NSUInteger)lane
+{
+    @synchronized (laneOperations)
+    {
+        laneOperations[@(lane)] = operation;
+    }
+
+    if (self.isCancelled)
+    {
+        [operation cancel];
+    }
+}
+
+- (void)cancel
+{
+    [super cancel];
+
+    NSArray<MXHTTPOperation*> *operations;
+    @synchronized (laneOperations)
+    {
+        operations = laneOperations.allValues;
+    }
+
+    for (MXHTTPOperation *operation in operations)
+    {
+        [operation cancel];
+    }
+}
+
+@end
+
+
+@interface MXOutboundSessionInfo : NSObject
 
 - (instancetype)initWithSessionID:(NSString*)sessionId;
 
+/**
+ Resume a session from the store.
+
+ @param storedSession the session as stored.
+ */
+- (instancetype)initWithStoredSession:(MXOlmOutboundGroupSession*)storedSession;
+
 /**
  Check if it's time to rotate the session.
 
@@ -56,6 +133,9 @@
 // The id of the session
 @property (nonatomic, readonly) NSString *sessionId;
 
+// When the session was created
+@property (nonatomic, readonly) NSDate *creationTime;
+
 // Number of times this session has been used
 @property (nonatomic) NSUInteger useCount;
 
@@ -123,6 +203,19 @@
         // TODO: Make it configurable via parameters
         sessionRotationPeriodMsgs = 100;
         sessionRotationPeriodMs = 7 * 24 * 3600 * 1000;
+
+        // Resume the session used before the last restart, if any.
+        // It will be rotated as usual if it is too old or too used
+        MXOlmOutboundGroupSession *storedSession = [crypto.store outboundGroupSessionWithRoomId:roomId];
+        if (storedSession)
+        {
+            NSLog(@"[MXMegolmEncryption] initWithCrypto: Resume outbound session %@ in room %@", storedSession.sessionId, roomId);
+
+            [crypto.olmDevice addOutboundGroupSession:storedSession.session];
+
+            outboundSession = [[MXOutboundSessionInfo alloc] initWithStoredSession:storedSession];
+            outboundSessions[outboundSession.sessionId] = outboundSession;
+        }
     }
     return self;
 }
@@ -320,14 +413,20 @@
         }
     }
 
+    MXWeakify(self);
     session.shareOperation = [self shareKey:session withDevices:shareMap success:^{
+        MXStrongifyAndReturnIfNil(self);
 
         session.shareOperation = nil;
+        [self storeOutboundSession:session];
         success(session);
 
     } failure:^(NSError *error) {
+        MXStrongifyAndReturnIfNil(self);
 
+        // Keep track of devices that got the key before the failure
         session.shareOperation = nil;
+        [self storeOutboundSession:session];
         failure(error);
     }];
 
@@ -351,7 +450,32 @@
 
     [crypto.backup maybeSendKeyBackup];
 
-    return [[MXOutboundSessionInfo alloc] initWithSessionID:sessionId];
+    MXOutboundSessionInfo *session = [[MXOutboundSessionInfo alloc] initWithSessionID:sessionId];
+    [self storeOutboundSession:session];
+
+    return session;
+}
+
+/**
+ Save the outbound session and its sharing state so that it can be resumed after a restart.
+
+ @param session the outbound session.
+ */
+- (void)storeOutboundSession:(MXOutboundSessionInfo*)session
+{
+    OLMOutboundGroupSession *olmSession = [crypto.olmDevice outboundGroupSessionWithId:session.sessionId];
+    if (!olmSession)
+    {
+        NSLog(@"[MXMegolmEncryption] storeOutboundSession: ERROR: Unknown outbound session %@", session.sessionId);
+        return;
+    }
+
+    MXOlmOutboundGroupSession *storedSession = [[MXOlmOutboundGroupSession alloc] initWithSession:olmSession roomId:roomId];
+    storedSession.creationTime = session.creationTime.timeIntervalSince1970;
+    storedSession.useCount = session.useCount;
+    storedSession.sharedWithDevices = session.sharedWithDevices;
+
+    [crypto.store storeOutboundGroupSession:storedSession];
 }
 
 - (MXHTTPOperation*)shareKey:(MXOutboundSessionInfo*)session
@@ -376,16 +500,16 @@
 
     NSLog(@"[MXMegolmEncryption] shareKey: with %tu users: %@", devicesByUser.count, devicesByUser);
 
-    MXHTTPOperation *operation;
+    // Created first so that the to-device requests can be chained to it even if
+    // olm sessions are already available
+    MXMegolmShareKeyOperation *operation = [MXMegolmShareKeyOperation new];
     MXWeakify(self);
-    operation = [crypto ensureOlmSessionsForDevices:devicesByUser force:NO success:^(MXUsersDevicesMap<MXOlmSessionResult *> *results) {
+    MXHTTPOperation *ensureOlmSessionsOperation = [crypto ensureOlmSessionsForDevices:devicesByUser force:NO success:^(MXUsersDevicesMap<MXOlmSessionResult *> *results) {
         MXStrongifyAndReturnIfNil(self);
 
         NSLog(@"[MXMegolmEncryption] shareKey: ensureOlmSessionsForDevices result (users: %tu - devices: %tu): %@", results.map.count,  results.count, results);
 
-        MXUsersDevicesMap<NSDictionary*> *contentMap = [[MXUsersDevicesMap alloc] init];
-        BOOL haveTargets = NO;
-
+        NSMutableArray<MXDeviceInfo*> *devicesToEncryptFor = [NSMutableArray array];
         for (NSString *userId in devicesByUser.allKeys)
         {
             NSArray<MXDeviceInfo*> *devicesToShareWith = devicesByUser[userId];
@@ -413,21 +537,37 @@
 
                 NSLog(@"[MXMegolmEncryption] shareKey: Sharing keys with device %@:%@", userId, deviceID);
 
-                MXDeviceInfo *deviceInfo = sessionResult.device;
-
-                [contentMap setObject:[self->crypto encryptMessage:payload forDevices:@[deviceInfo]]
-                              forUser:userId andDevice:deviceID];
-
-                haveTargets = YES;
+                [devicesToEncryptFor addObject:sessionResult.device];
             }
         }
 
-        if (haveTargets)
+        MXUsersDevicesMap<NSDictionary*> *contentMap = [self->crypto encryptMessage:payload forEachDevice:devicesToEncryptFor];
+
+        if (contentMap.count)
         {
             //NSLog(@"[MXMegolmEncryption] shareKey. Actually share with %tu users and %tu devices: %@", contentMap.userIds.count, contentMap.count, contentMap);
-            NSLog(@"[MXMegolmEncryption] shareKey: Actually share with %tu users and %tu devices", contentMap.userIds.count, contentMap.count);
+            [self sendToDeviceContentMap:contentMap operation:operation onChunkSent:^(MXUsersDevicesMap<NSDictionary *> *chunk) {
+
+                // Devices that got the key will not need it again if another chunk fails
+                for (NSString *userId in chunk.userIds)
+                {
+                    for (NSString *deviceId in [chunk deviceIdsForUser:userId])
+                    {
+                        [session.sharedWithDevices setObject:@(chainIndex) forUser:userId andDevice:deviceId];
+                    }
+                }
+
+            } onComplete:^(NSError *shareError) {
 
-            MXHTTPOperation *operation2 = [self->crypto.matrixRestClient sendToDevice:kMXEventTypeStringRoomEncrypted contentMap:contentMap txnId:nil success:^{
+                if (shareError)
+                {
+                    NSLog(@"[MXMegolmEncryption] shareKey: request failed. Error: %@", shareError);
+                    if (failure)
+                    {
+                        failure(shareError);
+                    }
+                    return;
+                }
 
                 NSLog(@"[MXMegolmEncryption] shareKey: request succeeded");
 
@@ -447,9 +587,7 @@
                 }
 
                 success();
-
-            } failure:failure];
-            [operation mutateTo:operation2];
+            }];
         }
         else
         {
@@ -464,10 +602,172 @@
             failure(error);
         }
     }];
+    [operation mutateTo:ensureOlmSessionsOperation];
 
     return operation;
 }
 
+/**
+ Split a to-device content map into maps whose estimated request size is bounded.
+
+ @param contentMap the olm encrypted contents by user and device.
+ @return chunks of the map.
+ */
+- (NSArray<MXUsersDevicesMap<NSDictionary*>*>*)splitToDeviceContentMap:(MXUsersDevicesMap<NSDictionary*>*)contentMap
+{
+    NSMutableArray<MXUsersDevicesMap<NSDictionary*>*> *chunks = [NSMutableArray array];
+
+    MXUsersDevicesMap<NSDictionary*> *chunk;
+    NSUInteger chunkSize = 0;
+
+    for (NSString *userId in contentMap.userIds)
+    {
+        for (NSString *deviceId in [contentMap deviceIdsForUser:userId])
+        {
+            NSDictionary *content = [contentMap objectForDevice:deviceId forUser:userId];
+
+            // Olm ciphertexts make the most of the size. Count ids and keys roughly
+            NSUInteger contentSize = userId.length + deviceId.length + 128;
+            NSDictionary<NSString*, NSDictionary*> *ciphertext = content[@"ciphertext"];
+            for (NSString *identityKey in ciphertext)
+            {
+                NSString *body = ciphertext[identityKey][@"body"];
+                contentSize += identityKey.length + body.length;
+            }
+
+            if (!chunk || (chunk.count && chunkSize + contentSize > kMXMegolmEncryptionToDeviceChunkMaxSize))
+            {
+                chunk = [[MXUsersDevicesMap alloc] init];
+                chunkSize = 0;
+                [chunks addObject:chunk];
+            }
+
+            [chunk setObject:content forUser:userId andDevice:deviceId];
+            chunkSize += contentSize;
+        }
+    }
+
+    return chunks;
+}
+
+/**
+ Send a to-device content map in chunks, over a few parallel lanes.
+
+ A lane sends its next chunk once the previous one is sent.
+
+ @param contentMap the olm encrypted contents by user and device.
+ @param operation the operation of the key share. It tracks the request of each lane.
+ @param onChunkSent a block called when a chunk has been sent.
+ @param onComplete a block called once all lanes have stopped, with the first error if any.
+                   It gets an error if the operation has been cancelled before all chunks were sent.
+ */
+- (void)sendToDeviceContentMap:(MXUsersDevicesMap<NSDictionary*>*)contentMap
+                     operation:(MXMegolmShareKeyOperation*)operation
+                   onChunkSent:(void (^)(MXUsersDevicesMap<NSDictionary*> *chunk))onChunkSent
+                    onComplete:(void (^)(NSError *error))onComplete
+{
+    NSArray<MXUsersDevicesMap<NSDictionary*>*> *chunks = [self splitToDeviceContentMap:contentMap];
+    NSLog(@"[MXMegolmEncryption] shareKey: Actually share with %tu users and %tu devices in %tu requests", contentMap.userIds.count, contentMap.count, chunks.count);
+
+    NSMutableArray<MXUsersDevicesMap<NSDictionary*>*> *pendingChunks = [chunks mutableCopy];
+    NSUInteger lanesCount = MIN(kMXMegolmEncryptionToDeviceMaxConcurrentRequests, chunks.count);
+    if (!lanesCount)
+    {
+        onComplete(nil);
+        return;
+    }
+
+    // Lanes complete on the queue of the requests callbacks
+    __block NSUInteger runningLanesCount = lanesCount;
+    __block NSUInteger sentChunksCount = 0;
+    __block NSError *shareError;
+
+    for (NSUInteger lane = 0; lane < lanesCount; lane++)
+    {
+        [self sendToDeviceChunks:pendingChunks lane:lane operation:operation onChunkSent:^(MXUsersDevicesMap<NSDictionary *> *chunk) {
+
+            sentChunksCount++;
+            onChunkSent(chunk);
+
+        } onComplete:^(NSError *error) {
+
+            if (error && !shareError)
+            {
+                shareError = error;
+            }
+
+            if (--runningLanesCount == 0)
+            {
+                if (!shareError && sentChunksCount < chunks.count)
+                {
+                    // Lanes stopped because the operation has been cancelled
+                    shareError = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil];
+                }
+                onComplete(shareError);
+            }
+        }];
+    }
+}
+
+/**
+ Send pending to-device chunks one after the other.
+
+ Several lanes share the same `chunks` array to send them in parallel.
+
+ @param chunks the chunks to send. They are removed from the array when sent. All are
+               removed on failure so that other lanes stop.
+ @param lane the index of the lane.
+ @param operation the operation of the key share. Sending stops if it is cancelled.
+ @param onChunkSent a block called when a chunk has been sent.
+ @param onComplete a block called when there is no more chunk to send, with the error if any.
+ */
+- (void)sendToDeviceChunks:(NSMutableArray<MXUsersDevicesMap<NSDictionary*>*>*)chunks
+                      lane:(NSUInteger)lane
+                 operation:(MXMegolmShareKeyOperation*)operation
+               onChunkSent:(void (^)(MXUsersDevicesMap<NSDictionary*> *chunk))onChunkSent
+                onComplete:(void (^)(NSError *error))onComplete
+{
+    MXUsersDevicesMap<NSDictionary*> *chunk = chunks.firstObject;
+    if (!chunk || operation.isCancelled)
+    {
+        onComplete(nil);
+        return;
+    }
+    [chunks removeObjectAtIndex:0];
+
+    MXWeakify(self);
+    MXHTTPOperation *chunkOperation = [self sendToDeviceChunk:chunk success:^{
+        MXStrongifyAndReturnIfNil(self);
+
+        onChunkSent(chunk);
+        [self sendToDeviceChunks:chunks lane:lane operation:operation onChunkSent:onChunkSent onComplete:onComplete];
+
+    } failure:^(NSError *error) {
+
+        [chunks removeAllObjects];
+        onComplete(error);
+    }];
+
+    [operation setOperation:chunkOperation forLane:lane];
+}
+
+/**
+ Send a chunk of olm encrypted contents in a /sendToDevice request.
+
+ Each chunk has its own transaction id. MXHTTPClient retries it independently.
+
+ @param chunk the olm encrypted contents by user and device.
+ @param success a block called on success.
+ @param failure a block called on failure.
+ @return the HTTP operation.
+ */
+- (MXHTTPOperation*)sendToDeviceChunk:(MXUsersDevicesMap<NSDictionary*>*)chunk
+                              success:(void (^)(void))success
+                              failure:(void (^)(NSError *error))failure
+{
+    return [crypto.matrixRestClient sendToDevice:kMXEventTypeStringRoomEncrypted contentMap:chunk txnId:nil success:success failure:failure];
+}
+
 - (MXHTTPOperation*)reshareKey:(NSString*)sessionId
                       withUser:(NSString*)userId
                      andDevice:(NSString*)deviceId
@@ -570,6 +870,12 @@
 
             session.useCount++;
         }
+
+        // The session ratchet has advanced. Message indexes must not be reused after a restart
+        if (pendingEncryptions.count)
+        {
+            [self storeOutboundSession:session];
+        }
     }
     else
     {
@@ -596,7 +902,19 @@
     {
         _sessionId = sessionId;
         _sharedWithDevices = [[MXUsersDevicesMap alloc] init];
-        creationTime = [NSDate date];
+        _creationTime = [NSDate date];
+    }
+    return self;
+}
+
+- (instancetype)initWithStoredSession:(MXOlmOutboundGroupSession *)storedSession
+{
+    self = [self initWithSessionID:storedSession.sessionId];
+    if (self)
+    {
+        _creationTime = [NSDate dateWithTimeIntervalSince1970:storedSession.creationTime];
+        _useCount = storedSession.useCount;
+        _sharedWithDevices = storedSession.sharedWithDevices;
     }
     return self;
 }
@@ -604,7 +922,7 @@
 - (BOOL)needsRotation:(NSUInteger)rotationPeriodMsgs rotationPeriodMs:(NSUInteger)rotationPeriodMs
 {
     BOOL needsRotation = NO;
-    NSUInteger sessionLifetime = [[NSDate date] timeIntervalSinceDate:creationTime] * 1000;
+    NSUInteger sessionLifetime = [[NSDate date] timeIntervalSinceDate:_creationTime] * 1000;
 
     if (_useCount >= rotationPeriodMsgs || sessionLifetime >= rotationPeriodMs)
     {
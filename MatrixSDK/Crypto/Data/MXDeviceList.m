@@ -32,6 +32,9 @@
     // userId -> MXDeviceTrackingStatus*
     NSMutableDictionary<NSString*, NSNumber*> *deviceTrackingStatus;
 
+    // Users whose tracking status has changed since the last `persistDeviceTrackingStatus`.
+    NSMutableSet<NSString*> *deviceTrackingStatusChangedUserIds;
+
     // The current request for each user.
     // userId -> MXDeviceListOperation
     NSMutableDictionary<NSString*, MXDeviceListOperation*> *keyDownloadsInProgressByUser;
@@ -66,6 +69,7 @@
 
         // Retrieve tracking status from the store
         deviceTrackingStatus = [NSMutableDictionary dictionaryWithDictionary:[crypto.store deviceTrackingStatus]];
+        deviceTrackingStatusChangedUserIds = [NSMutableSet set];
 
         keyDownloadsInProgressByUser = [NSMutableDictionary dictionary];
 
@@ -76,7 +80,7 @@
             if (trackingStatus == MXDeviceTrackingStatusDownloadInProgress
                 || trackingStatus == MXDeviceTrackingStatusUnreachableServer)
             {
-                deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusPendingDownload);
+                [self setTrackingStatus:MXDeviceTrackingStatusPendingDownload forUser:userId];
             }
         }
     }
@@ -134,7 +138,7 @@
 
         for (NSString *userId in usersToDownload)
         {
-            deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusDownloadInProgress);
+            [self setTrackingStatus:MXDeviceTrackingStatusDownloadInProgress forUser:userId];
         }
 
         // Persist the tracking status before launching download
@@ -163,7 +167,7 @@
                 {
                     // we didn't get any new invalidations since this download started:
                     // this user's device list is now up to date.
-                    self->deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusUpToDate);
+                    [self setTrackingStatus:MXDeviceTrackingStatusUpToDate forUser:userId];
                 }
             }
 
@@ -176,7 +180,7 @@
                     MXDeviceTrackingStatus trackingStatus = MXDeviceTrackingStatusFromNSNumber(self->deviceTrackingStatus[userId]);
                     if (trackingStatus == MXDeviceTrackingStatusDownloadInProgress)
                     {
-                        self->deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusUnreachableServer);
+                        [self setTrackingStatus:MXDeviceTrackingStatusUnreachableServer forUser:userId];
                     }
                 }
             }
@@ -269,7 +273,7 @@
     if (!trackingStatus)
     {
         NSLog(@"[MXDeviceList] Now tracking device list for %@", userId);
-        deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusPendingDownload);
+        [self setTrackingStatus:MXDeviceTrackingStatusPendingDownload forUser:userId];
     }
     // we don't yet persist the tracking status, since there may be a lot
     // of calls; instead we wait for the forthcoming
@@ -283,7 +287,7 @@
     if (trackingStatus)
     {
         NSLog(@"[MXDeviceList] No longer tracking device list for %@", userId);
-        deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusNotTracked);
+        [self setTrackingStatus:MXDeviceTrackingStatusNotTracked forUser:userId];
     }
     // we don't yet persist the tracking status, since there may be a lot
     // of calls; instead we wait for the forthcoming
@@ -297,7 +301,7 @@
     if (trackingStatus)
     {
         NSLog(@"[MXDeviceList] Marking device list outdated for %@", userId);
-        deviceTrackingStatus[userId] = @(MXDeviceTrackingStatusPendingDownload);
+        [self setTrackingStatus:MXDeviceTrackingStatusPendingDownload forUser:userId];
     }
     // we don't yet persist the tracking status, since there may be a lot
     // of calls; instead we wait for the forthcoming
@@ -336,9 +340,23 @@
     }
 }
 
+- (void)setTrackingStatus:(MXDeviceTrackingStatus)trackingStatus forUser:(NSString*)userId
+{
+    deviceTrackingStatus[userId] = @(trackingStatus);
+    [deviceTrackingStatusChangedUserIds addObject:userId];
+}
+
 - (void)persistDeviceTrackingStatus
 {
-    [crypto.store storeDeviceTrackingStatus:deviceTrackingStatus];
+    // Write only users whose status has changed
+    NSMutableDictionary<NSString*, NSNumber*> *changedDeviceTrackingStatus = [NSMutableDictionary dictionaryWithCapacity:deviceTrackingStatusChangedUserIds.count];
+    for (NSString *userId in deviceTrackingStatusChangedUserIds)
+    {
+        changedDeviceTrackingStatus[userId] = deviceTrackingStatus[userId];
+    }
+    [deviceTrackingStatusChangedUserIds removeAllObjects];
+
+    [crypto.store storeDeviceTrackingStatusOfUsers:changedDeviceTrackingStatus];
 }
 
 /**
@@ -22,6 +22,7 @@
 #import "MXDeviceListOperation.h"
 
 @class MXCrypto;
+@class MXKeysQueryResponse;
 
 /**
  `MXDeviceListOperationsPool` manages a pool of `MXDeviceListOperation` operations
@@ -74,6 +75,18 @@
  */
 - (void)downloadKeys:(NSString *)token complete:(void (^)(NSDictionary<NSString *, NSDictionary *> *failedUserIds))complete;
 
+/**
+ Validate and store the devices received in a /keys/query response.
+
+ Device signatures are checked in parallel. All changes are written to the crypto
+ store in a single transaction.
+
+ @param keysQueryResponse the /keys/query response.
+ @param users the users that were requested.
+ @return the devices of users whose devices have changed.
+ */
+- (NSDictionary<NSString* /* userId */, NSArray<MXDeviceInfo*>*> *)handleKeysQueryResponse:(MXKeysQueryResponse*)keysQueryResponse forUsers:(NSArray<NSString*>*)users;
+
 @end
 
 #endif
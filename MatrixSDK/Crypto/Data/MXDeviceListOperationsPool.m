@@ -104,87 +104,9 @@
         NSLog(@"[MXDeviceListOperationsPool] doKeyDownloadForUsers(pool: %p) -> DONE. Got keys for %@ users and %@ devices. Got cross-signing keys for %@ users", self, @(keysQueryResponse.deviceKeys.map.count), @(keysQueryResponse.deviceKeys.count), @(keysQueryResponse.crossSigningKeys.count));
 
         self->_httpOperation = nil;
-        
-        NSMutableDictionary<NSString* /* userId */, NSArray<MXDeviceInfo*>*> *usersDevices = [NSMutableDictionary new];
-        NSMutableDictionary<NSString* /* userId */, NSArray<MXDeviceInfo*>*> *updatedUsersDevices = [NSMutableDictionary new];
-
-        for (NSString *userId in users)
-        {
-            // Handle user cross-signing keys
-            MXCrossSigningInfo *crossSigningKeys = keysQueryResponse.crossSigningKeys[userId];
-            if (crossSigningKeys)
-            {
-                NSLog(@"[MXDeviceListOperationsPool] doKeyDownloadForUsers: Got cross-signing keys for %@: %@", userId, crossSigningKeys);
-
-                // Compute trust on this user
-                // Note this overwrites the previous value
-                BOOL isCrossSigningVerified = [self->crypto.crossSigning isUserWithCrossSigningKeysVerified:crossSigningKeys];
-                [crossSigningKeys updateTrustLevel:[MXUserTrustLevel trustLevelWithCrossSigningVerified:isCrossSigningVerified]];
-                
-                // Note that keys which aren't in the response will be removed from the store
-                [self->crypto.store storeCrossSigningKeys:crossSigningKeys];
-            }
-
-
-            // Handle user devices keys
-            NSDictionary<NSString*, MXDeviceInfo*> *devices = keysQueryResponse.deviceKeys.map[userId];
-
-            NSLog(@"[MXDeviceListOperationsPool] doKeyDownloadForUsers: Got keys for %@: %@ devices: %@", userId, @(devices.count), devices);
-
-            if (devices)
-            {
-                NSMutableDictionary<NSString*, MXDeviceInfo*> *mutabledevices = [NSMutableDictionary dictionaryWithDictionary:devices];
-                
-                NSDictionary<NSString*, MXDeviceInfo*> *storedDevices = [self->crypto.store devicesForUser:userId];
-
-                for (NSString *deviceId in mutabledevices.allKeys)
-                {
-                    // Get the potential previously store device keys for this device
-                    MXDeviceInfo *previouslyStoredDeviceKeys = storedDevices[deviceId];
-
-                    MXDeviceVerification previousLocalState = MXDeviceUnknown;
-                    
-                    // Validate received keys
-                    if (![self validateDeviceKeys:mutabledevices[deviceId] forUser:userId andDevice:deviceId previouslyStoredDeviceKeys:previouslyStoredDeviceKeys])
-                    {
-                        // New device keys are not valid. Do not store them
-                        [mutabledevices removeObjectForKey:deviceId];
 
-                        if (previouslyStoredDeviceKeys)
-                        {
-                            // But keep old validated ones if any
-                            mutabledevices[deviceId] = previouslyStoredDeviceKeys;
-                        }
-                    }
-                    else if (previouslyStoredDeviceKeys)
-                    {
-                        // The verified status is not sync'ed with hs.
-                        // This is a client side information, valid only for this client.
-                        // So, transfer its previous value
-                        previousLocalState = previouslyStoredDeviceKeys.trustLevel.localVerificationStatus;
-                    }
+        NSDictionary<NSString* /* userId */, NSArray<MXDeviceInfo*>*> *updatedUsersDevices = [self handleKeysQueryResponse:keysQueryResponse forUsers:users];
 
-                    BOOL crossSigningVerified = [self->crypto.crossSigning isDeviceVerified:mutabledevices[deviceId]];
-                    MXDeviceTrustLevel *trustLevel = [MXDeviceTrustLevel trustLevelWithLocalVerificationStatus:previousLocalState
-                                                                                          crossSigningVerified:crossSigningVerified];
-
-                    [mutabledevices[deviceId] updateTrustLevel:trustLevel];
-                }
-
-                usersDevices[userId] = mutabledevices.allValues;
-                
-                if (![mutabledevices isEqualToDictionary:storedDevices])
-                {
-                    updatedUsersDevices[userId] = usersDevices[userId];
-                    
-                    // Update the store
-                    // Note that devices which aren't in the response will be removed from the store
-                    [self->crypto.store storeDevicesForUser:userId devices:mutabledevices];
-                }
-
-            }
-        }
-        
         if (updatedUsersDevices.count)
         {
             // Post notification using MXCrypto instance as MXDeviceListOperationsPool is an internal class.
@@ -255,6 +177,137 @@
     }];
 }
 
+- (NSDictionary<NSString*, NSArray<MXDeviceInfo*>*> *)handleKeysQueryResponse:(MXKeysQueryResponse*)keysQueryResponse forUsers:(NSArray<NSString*>*)users
+{
+    NSDate *startDate = [NSDate date];
+
+    NSMutableArray<NSString*> *usersWithDevices = [NSMutableArray arrayWithCapacity:users.count];
+    for (NSString *userId in users)
+    {
+        // Handle user cross-signing keys
+        // They must be stored before computing the trust of the user devices
+        MXCrossSigningInfo *crossSigningKeys = keysQueryResponse.crossSigningKeys[userId];
+        if (crossSigningKeys)
+        {
+            NSLog(@"[MXDeviceListOperationsPool] handleKeysQueryResponse: Got cross-signing keys for %@: %@", userId, crossSigningKeys);
+
+            // Compute trust on this user
+            // Note this overwrites the previous value
+            BOOL isCrossSigningVerified = [crypto.crossSigning isUserWithCrossSigningKeysVerified:crossSigningKeys];
+            [crossSigningKeys updateTrustLevel:[MXUserTrustLevel trustLevelWithCrossSigningVerified:isCrossSigningVerified]];
+
+            // Note that keys which aren't in the response will be removed from the store
+            [crypto.store storeCrossSigningKeys:crossSigningKeys];
+        }
+
+        if (keysQueryResponse.deviceKeys.map[userId])
+        {
+            [usersWithDevices addObject:userId];
+        }
+    }
+
+    // Read the stored devices on this thread. The store must not be opened on each
+    // worker thread of the validation below
+    NSMutableDictionary<NSString*, NSDictionary<NSString*, MXDeviceInfo*>*> *storedUsersDevices = [NSMutableDictionary dictionaryWithCapacity:usersWithDevices.count];
+    for (NSString *userId in usersWithDevices)
+    {
+        storedUsersDevices[userId] = [crypto.store devicesForUser:userId];
+    }
+
+    // Validate the received device keys of all users in parallel.
+    // This is where device signatures are checked
+    NSMutableDictionary<NSString*, NSDictionary<NSString*, MXDeviceInfo*>*> *validUsersDevices = [NSMutableDictionary dictionaryWithCapacity:usersWithDevices.count];
+    NSMutableDictionary<NSString*, NSDictionary<NSString*, NSNumber*>*> *usersPreviousLocalStates = [NSMutableDictionary dictionaryWithCapacity:usersWithDevices.count];
+
+    dispatch_apply(usersWithDevices.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+        @autoreleasepool
+        {
+            NSString *userId = usersWithDevices[index];
+            NSDictionary<NSString*, MXDeviceInfo*> *devices = keysQueryResponse.deviceKeys.map[userId];
+            NSDictionary<NSString*, MXDeviceInfo*> *storedDevices = storedUsersDevices[userId];
+
+            NSMutableDictionary<NSString*, MXDeviceInfo*> *validDevices = [NSMutableDictionary dictionaryWithCapacity:devices.count];
+            NSMutableDictionary<NSString*, NSNumber*> *previousLocalStates = [NSMutableDictionary dictionaryWithCapacity:devices.count];
+
+            for (NSString *deviceId in devices)
+            {
+                // Get the potential previously store device keys for this device
+                MXDeviceInfo *previouslyStoredDeviceKeys = storedDevices[deviceId];
+
+                MXDeviceVerification previousLocalState = MXDeviceUnknown;
+
+                // Validate received keys
+                if ([self validateDeviceKeys:devices[deviceId] forUser:userId andDevice:deviceId previouslyStoredDeviceKeys:previouslyStoredDeviceKeys])
+                {
+                    validDevices[deviceId] = devices[deviceId];
+
+                    if (previouslyStoredDeviceKeys)
+                    {
+                        // The verified status is not sync'ed with hs.
+                        // This is a client side information, valid only for this client.
+                        // So, transfer its previous value
+                        previousLocalState = previouslyStoredDeviceKeys.trustLevel.localVerificationStatus;
+                    }
+                }
+                else if (previouslyStoredDeviceKeys)
+                {
+                    // New device keys are not valid. Do not store them
+                    // But keep old validated ones if any
+                    validDevices[deviceId] = previouslyStoredDeviceKeys;
+                }
+
+                previousLocalStates[deviceId] = @(previousLocalState);
+            }
+
+            @synchronized (validUsersDevices)
+            {
+                validUsersDevices[userId] = validDevices;
+                usersPreviousLocalStates[userId] = previousLocalStates;
+            }
+        }
+    });
+
+    // Compute devices trust and keep only users whose devices have changed
+    NSMutableDictionary<NSString* /* userId */, NSArray<MXDeviceInfo*>*> *updatedUsersDevices = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString* /* userId */, NSDictionary<NSString*, MXDeviceInfo*>*> *devicesToStore = [NSMutableDictionary dictionary];
+
+    for (NSString *userId in usersWithDevices)
+    {
+        NSDictionary<NSString*, MXDeviceInfo*> *devices = validUsersDevices[userId];
+
+        NSLog(@"[MXDeviceListOperationsPool] handleKeysQueryResponse: Got keys for %@: %@ devices: %@", userId, @(devices.count), devices);
+
+        for (NSString *deviceId in devices)
+        {
+            MXDeviceVerification previousLocalState = [usersPreviousLocalStates[userId][deviceId] integerValue];
+
+            BOOL crossSigningVerified = [crypto.crossSigning isDeviceVerified:devices[deviceId]];
+            MXDeviceTrustLevel *trustLevel = [MXDeviceTrustLevel trustLevelWithLocalVerificationStatus:previousLocalState
+                                                                                  crossSigningVerified:crossSigningVerified];
+
+            [devices[deviceId] updateTrustLevel:trustLevel];
+        }
+
+        if (![devices isEqualToDictionary:storedUsersDevices[userId]])
+        {
+            updatedUsersDevices[userId] = devices.allValues;
+
+            // Note that devices which aren't in the response will be removed from the store
+            devicesToStore[userId] = devices;
+        }
+    }
+
+    // Update the store in one go
+    if (devicesToStore.count)
+    {
+        [crypto.store storeDevicesForUsers:devicesToStore];
+    }
+
+    NSLog(@"[MXDeviceListOperationsPool] handleKeysQueryResponse: Handled devices of %tu users (%tu updated) in %.0fms", usersWithDevices.count, updatedUsersDevices.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+
+    return updatedUsersDevices;
+}
+
 /**
  Validate device keys.
 
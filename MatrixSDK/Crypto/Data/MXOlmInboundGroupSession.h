@@ -59,13 +59,38 @@
 /**
  Devices which forwarded this session to us.
  */
-@property NSArray<NSString *> *forwardingCurve25519KeyChain;
+@property (nonatomic) NSArray<NSString *> *forwardingCurve25519KeyChain;
 
 /**
  Other keys the sender claims.
  */
 @property (nonatomic) NSDictionary<NSString*, NSString*> *keysClaimed;
 
+/**
+ YES if the session has changes that are not persisted yet.
+
+ New sessions and sessions modified since they were loaded are dirty. The store resets
+ the flag once the session is saved.
+ */
+@property (nonatomic, getter=isDirty) BOOL dirty;
+
+
+#pragma mark - Decryption
+
+/**
+ Decrypt a message with the olm session.
+
+ The session becomes dirty only on its first successful decryption, which verifies its
+ signing key. The advance of the latest ratchet done by next decryptions is not worth a
+ store write: the ratchet can always be derived again from the initial one.
+
+ @param message the base64-encoded message.
+ @param messageIndex the index of the message in the session.
+ @param error the error if the decryption failed.
+ @return the decrypted payload. nil on failure.
+ */
+- (NSString*)decryptMessage:(NSString*)message messageIndex:(NSUInteger*)messageIndex error:(NSError**)error;
+
 
 #pragma mark - import/export
 
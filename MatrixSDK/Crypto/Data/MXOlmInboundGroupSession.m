@@ -20,6 +20,14 @@
 
 #import "MXCryptoConstants.h"
 
+@interface MXOlmInboundGroupSession ()
+{
+    // YES once a message has been successfully decrypted with the session.
+    // It is persisted so that the first decryption is saved only once
+    BOOL hasDecrypted;
+}
+@end
+
 @implementation MXOlmInboundGroupSession
 
 - (instancetype)initWithSessionKey:(NSString *)sessionKey
@@ -32,10 +40,68 @@
         {
             return nil;
         }
+        _dirty = YES;
     }
     return self;
 }
 
+- (void)setRoomId:(NSString *)roomId
+{
+    if (roomId != _roomId && ![roomId isEqualToString:_roomId])
+    {
+        _roomId = roomId;
+        _dirty = YES;
+    }
+}
+
+- (void)setSenderKey:(NSString *)senderKey
+{
+    if (senderKey != _senderKey && ![senderKey isEqualToString:_senderKey])
+    {
+        _senderKey = senderKey;
+        _dirty = YES;
+    }
+}
+
+- (void)setForwardingCurve25519KeyChain:(NSArray<NSString *> *)forwardingCurve25519KeyChain
+{
+    if (forwardingCurve25519KeyChain != _forwardingCurve25519KeyChain && ![forwardingCurve25519KeyChain isEqualToArray:_forwardingCurve25519KeyChain])
+    {
+        _forwardingCurve25519KeyChain = forwardingCurve25519KeyChain;
+        _dirty = YES;
+    }
+}
+
+- (void)setKeysClaimed:(NSDictionary<NSString *,NSString *> *)keysClaimed
+{
+    if (keysClaimed != _keysClaimed && ![keysClaimed isEqualToDictionary:_keysClaimed])
+    {
+        _keysClaimed = keysClaimed;
+        _dirty = YES;
+    }
+}
+
+
+#pragma mark - Decryption
+- (NSString *)decryptMessage:(NSString *)message messageIndex:(NSUInteger *)messageIndex error:(NSError **)error
+{
+    NSString *payloadString = [_session decryptMessage:message messageIndex:messageIndex error:error];
+
+    // A decryption changes the pickled session in two ways:
+    // - libolm flags the signing key as verified on the first success. This must be stored.
+    // - libolm advances the latest ratchet to the message index if it is not behind it.
+    //   This is only a cache: the initial ratchet is never modified and any index after it
+    //   can be derived again from it or from an older latest ratchet.
+    // So, only the first decryption makes the session dirty
+    if (payloadString && !hasDecrypted)
+    {
+        hasDecrypted = YES;
+        _dirty = YES;
+    }
+
+    return payloadString;
+}
+
 
 #pragma mark - import/export
 - (MXMegolmSessionData *)exportSessionDataAtMessageIndex:(NSUInteger)messageIndex
@@ -82,6 +148,7 @@
             NSLog(@"[MXOlmInboundGroupSession] initWithImportedSessionKey failed. Error: %@", error);
             return nil;
         }
+        _dirty = YES;
     }
 
     return self;
@@ -112,6 +179,7 @@
         _senderKey = [aDecoder decodeObjectForKey:@"senderKey"];
         _forwardingCurve25519KeyChain = [aDecoder decodeObjectForKey:@"forwardingCurve25519KeyChain"];
         _keysClaimed = [aDecoder decodeObjectForKey:@"keysClaimed"];
+        hasDecrypted = [aDecoder decodeBoolForKey:@"hasDecrypted"];
     }
     return self;
 }
@@ -123,6 +191,7 @@
     [aCoder encodeObject:_senderKey forKey:@"senderKey"];
     [aCoder encodeObject:_keysClaimed forKey:@"keysClaimed"];
     [aCoder encodeObject:_forwardingCurve25519KeyChain forKey:@"forwardingCurve25519KeyChain"];
+    [aCoder encodeBool:hasDecrypted forKey:@"hasDecrypted"];
 }
 
 @end
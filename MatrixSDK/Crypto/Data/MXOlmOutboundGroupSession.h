@@ -0,0 +1,78 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "MXSDKOptions.h"
+
+#ifdef MX_CRYPTO
+
+#import <OLMKit/OLMKit.h>
+
+#import "MXUsersDevicesMap.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The 'MXOlmOutboundGroupSession' class stores an OLMOutboundGroupSession object from OLMKit
+ with the state of its sharing in a room.
+ */
+@interface MXOlmOutboundGroupSession : NSObject
+
+/**
+ Create the model.
+
+ @param session the olm outbound group session.
+ @param roomId the room where the session is used.
+ */
+- (instancetype)initWithSession:(OLMOutboundGroupSession*)session roomId:(NSString*)roomId;
+
+/**
+ The associated olm outbound group session.
+ */
+@property (nonatomic, readonly) OLMOutboundGroupSession *session;
+
+/**
+ The session id.
+ */
+@property (nonatomic, readonly) NSString *sessionId;
+
+/**
+ The room where the session is used.
+ */
+@property (nonatomic, readonly) NSString *roomId;
+
+/**
+ Timestamp at which the session was created.
+ */
+@property (nonatomic) NSTimeInterval creationTime;
+
+/**
+ Number of times the session has been used to encrypt a message.
+ */
+@property (nonatomic) NSUInteger useCount;
+
+/**
+ Devices with which the session key has been shared.
+ userId -> {deviceId -> message index}
+ */
+@property (nonatomic) MXUsersDevicesMap<NSNumber*> *sharedWithDevices;
+
+@end
+
+NS_ASSUME_NONNULL_END
+
+#endif
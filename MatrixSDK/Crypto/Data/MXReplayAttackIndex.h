@@ -0,0 +1,69 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXReplayAttackIndex` stores the megolm message indexes that have been decrypted in
+ each timeline in order to detect replay attacks, where a MITM resends a group message
+ into the room.
+
+ The indexes of a session are stored as ranges in a `NSIndexSet`. Message indexes of a
+ session are mostly consecutive so a session usually costs a single range.
+
+ Timelines are not forgotten while they are open, otherwise their replay attack check
+ would silently stop. They must be removed with `removeTimeline:` once closed.
+
+ This class is thread safe.
+ */
+@interface MXReplayAttackIndex : NSObject
+
+/**
+ Record that a message has been decrypted in a timeline.
+
+ @param messageIndex the megolm message index.
+ @param sessionId the megolm session id.
+ @param senderKey the sender key of the session.
+ @param timeline the id of the timeline.
+ @return NO if this message index has already been recorded in this timeline.
+ */
+- (BOOL)addMessageIndex:(NSUInteger)messageIndex ofSession:(NSString*)sessionId senderKey:(NSString*)senderKey inTimeline:(NSString*)timeline;
+
+/**
+ Forget the messages decrypted in a timeline.
+
+ @param timeline the id of the timeline.
+ */
+- (void)removeTimeline:(NSString*)timeline;
+
+/**
+ The number of tracked timelines.
+ */
+@property (nonatomic, readonly) NSUInteger timelinesCount;
+
+/**
+ The number of tracked sessions in a timeline.
+
+ @param timeline the id of the timeline.
+ @return the number of sessions.
+ */
+- (NSUInteger)sessionsCountInTimeline:(NSString*)timeline;
+
+@end
+
+NS_ASSUME_NONNULL_END
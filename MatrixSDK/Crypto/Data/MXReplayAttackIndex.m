@@ -0,0 +1,132 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXReplayAttackIndex.h"
+
+
+#pragma mark - MXReplayAttackTimelineIndex
+
+/**
+ The message indexes decrypted in a timeline.
+ */
+@interface MXReplayAttackTimelineIndex : NSObject
+{
+    @public
+    // senderKey -> sessionId -> decrypted message indexes
+    // The two levels avoid building a key string for each decrypted message
+    NSMutableDictionary<NSString*, NSMutableDictionary<NSString*, NSMutableIndexSet*>*> *sessions;
+    NSUInteger sessionsCount;
+}
+@end
+
+@implementation MXReplayAttackTimelineIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        sessions = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+@end
+
+
+#pragma mark - MXReplayAttackIndex
+
+@interface MXReplayAttackIndex ()
+{
+    // timeline id -> timeline index
+    NSMutableDictionary<NSString*, MXReplayAttackTimelineIndex*> *timelines;
+}
+@end
+
+@implementation MXReplayAttackIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        timelines = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (BOOL)addMessageIndex:(NSUInteger)messageIndex ofSession:(NSString*)sessionId senderKey:(NSString*)senderKey inTimeline:(NSString*)timeline
+{
+    @synchronized (self)
+    {
+        MXReplayAttackTimelineIndex *timelineIndex = timelines[timeline];
+        if (!timelineIndex)
+        {
+            timelineIndex = [[MXReplayAttackTimelineIndex alloc] init];
+            timelines[timeline] = timelineIndex;
+        }
+
+        NSMutableDictionary<NSString*, NSMutableIndexSet*> *senderSessions = timelineIndex->sessions[senderKey];
+        if (!senderSessions)
+        {
+            senderSessions = [NSMutableDictionary dictionary];
+            timelineIndex->sessions[senderKey] = senderSessions;
+        }
+
+        NSMutableIndexSet *messageIndexes = senderSessions[sessionId];
+        if (!messageIndexes)
+        {
+            messageIndexes = [NSMutableIndexSet indexSet];
+            senderSessions[sessionId] = messageIndexes;
+            timelineIndex->sessionsCount++;
+        }
+
+        if ([messageIndexes containsIndex:messageIndex])
+        {
+            return NO;
+        }
+        [messageIndexes addIndex:messageIndex];
+
+        return YES;
+    }
+}
+
+- (void)removeTimeline:(NSString*)timeline
+{
+    @synchronized (self)
+    {
+        [timelines removeObjectForKey:timeline];
+    }
+}
+
+- (NSUInteger)timelinesCount
+{
+    @synchronized (self)
+    {
+        return timelines.count;
+    }
+}
+
+- (NSUInteger)sessionsCountInTimeline:(NSString*)timeline
+{
+    @synchronized (self)
+    {
+        MXReplayAttackTimelineIndex *timelineIndex = timelines[timeline];
+        return timelineIndex ? timelineIndex->sessionsCount : 0;
+    }
+}
+
+@end
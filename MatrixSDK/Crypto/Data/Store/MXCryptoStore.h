@@ -27,6 +27,7 @@
 #import <OLMKit/OLMKit.h>
 #import "MXOlmSession.h"
 #import "MXOlmInboundGroupSession.h"
+#import "MXOlmOutboundGroupSession.h"
 #import "MXDeviceInfo.h"
 #import "MXCrossSigningInfo.h"
 #import "MXOutgoingRoomKeyRequest.h"
@@ -78,6 +79,20 @@
  */
 - (void)open:(void (^)(void))onComplete failure:(void (^)(NSError *error))failure;
 
+/**
+ Group the writes made on the current thread by a block.
+
+ Writes are committed together once the block returns, instead of one by one. Reads
+ made by the block see its pending writes. Nested calls join the outer batch.
+
+ Other threads cannot write to the store until the batch is committed. So, the block
+ must be short and must not wait synchronously for another thread. Compute the data to
+ store before calling this method.
+
+ @param writes the block making store writes.
+ */
+- (void)performBatchWrites:(void (^)(void))writes;
+
 /**
  Store the device id.
  */
@@ -148,6 +163,16 @@
  */
 - (void)storeDevicesForUser:(NSString*)userId devices:(NSDictionary<NSString*, MXDeviceInfo*>*)devices;
 
+/**
+ Store the known devices of several users in a single transaction.
+
+ Devices equal to the stored ones are not rewritten. Stored devices that are not
+ in the new list of their user are removed.
+
+ @param usersDevices a map from user id to a map from device id to device.
+ */
+- (void)storeDevicesForUsers:(NSDictionary<NSString*, NSDictionary<NSString*, MXDeviceInfo*>*>*)usersDevices;
+
 /**
  Retrieve the known devices for a user.
 
@@ -167,10 +192,21 @@
 /**
  Store the device tracking status.
 
+ It replaces the status of all users.
+
  @param statusMap A map from user id to MXDeviceTrackingStatus.
  */
 - (void)storeDeviceTrackingStatus:(NSDictionary<NSString*, NSNumber*>*)statusMap;
 
+/**
+ Store the device tracking status of some users.
+
+ The status of other users is not modified.
+
+ @param statusMap A map from user id to MXDeviceTrackingStatus.
+ */
+- (void)storeDeviceTrackingStatusOfUsers:(NSDictionary<NSString*, NSNumber*>*)statusMap;
+
 
 #pragma mark - Cross-signing keys
 
@@ -264,6 +300,26 @@
 - (NSArray<MXOlmInboundGroupSession*> *)inboundGroupSessions;
 
 
+#pragma mark - Outbound group sessions
+
+/**
+ Store the outbound group session currently used in a room.
+
+ It replaces the previous session of the room.
+
+ @param session the outbound group session.
+ */
+- (void)storeOutboundGroupSession:(MXOlmOutboundGroupSession*)session;
+
+/**
+ Retrieve the outbound group session currently used in a room.
+
+ @param roomId the room id.
+ @return the outbound group session. nil if none.
+ */
+- (MXOlmOutboundGroupSession*)outboundGroupSessionWithRoomId:(NSString*)roomId;
+
+
 #pragma mark - Key backup
 
 /**
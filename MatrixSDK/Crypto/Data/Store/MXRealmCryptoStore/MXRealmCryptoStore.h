@@ -24,6 +24,19 @@
 
 @interface MXRealmCryptoStore : NSObject <MXCryptoStore>
 
+#pragma mark - Inbound group sessions cache
+
+/**
+ The number of `inboundGroupSessionWithId:andSenderKey:` calls served by the in-memory
+ cache of unpickled inbound group sessions.
+ */
+@property (nonatomic, readonly) NSUInteger inboundGroupSessionsCacheHitCount;
+
+/**
+ The number of `inboundGroupSessionWithId:andSenderKey:` calls that hit the Realm db.
+ */
+@property (nonatomic, readonly) NSUInteger inboundGroupSessionsCacheMissCount;
+
 @end
 
 #endif
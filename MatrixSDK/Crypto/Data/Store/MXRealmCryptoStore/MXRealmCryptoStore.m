@@ -23,11 +23,15 @@
 #import "MXSession.h"
 #import "MXTools.h"
 #import "MXCryptoTools.h"
+#import "MXStripedLRUCache.h"
 
-NSUInteger const kMXRealmCryptoStoreVersion = 12;
+NSUInteger const kMXRealmCryptoStoreVersion = 14;
 
 static NSString *const kMXRealmCryptoStoreFolder = @"MXRealmCryptoStore";
 
+// The maximum number of unpickled inbound group sessions kept in memory
+static NSUInteger const kMXRealmCryptoStoreInboundGroupSessionsCacheCountLimit = 100;
+
 
 #pragma mark - Realm objects that encapsulate existing ones
 
@@ -65,6 +69,24 @@ RLM_ARRAY_TYPE(MXRealmCrossSigningInfo)
 RLM_ARRAY_TYPE(MXRealmUser)
 
 
+@interface MXRealmDeviceTrackingStatus : RLMObject
+@property (nonatomic) NSString *userId;
+
+/**
+ The MXDeviceTrackingStatus value.
+ */
+@property (nonatomic) NSInteger status;
+@end
+
+@implementation MXRealmDeviceTrackingStatus
++ (NSString *)primaryKey
+{
+    return @"userId";
+}
+@end
+RLM_ARRAY_TYPE(MXRealmDeviceTrackingStatus)
+
+
 @interface MXRealmRoomAlgorithm : RLMObject
 @property NSString *roomId;
 @property NSString *algorithm;
@@ -130,6 +152,24 @@ RLM_ARRAY_TYPE(MXRealmOlmSession)
 RLM_ARRAY_TYPE(MXRealmOlmInboundGroupSession)
 
 
+@interface MXRealmOlmOutboundGroupSession : RLMObject
+@property NSString *roomId;
+@property NSString *sessionId;
+@property NSData *olmOutboundGroupSessionData;
+@property NSTimeInterval creationTime;
+@property NSInteger useCount;
+@property NSData *sharedWithDevicesData;
+@end
+
+@implementation MXRealmOlmOutboundGroupSession
++ (NSString *)primaryKey
+{
+    return @"roomId";
+}
+@end
+RLM_ARRAY_TYPE(MXRealmOlmOutboundGroupSession)
+
+
 @interface MXRealmOlmAccount : RLMObject
 
 /**
@@ -152,12 +192,6 @@ RLM_ARRAY_TYPE(MXRealmOlmInboundGroupSession)
  */
 @property (nonatomic) NSString *deviceSyncToken;
 
-/**
- NSData serialisation of users we are tracking device status for.
- userId -> MXDeviceTrackingStatus*
- */
-@property (nonatomic)  NSData *deviceTrackingStatusData;
-
 /**
  Settings for blacklisting unverified devices.
  */
@@ -269,6 +303,14 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 {
     NSString *userId;
     NSString *deviceId;
+
+    // Unpickled inbound group sessions by their Realm primary key
+    MXStripedLRUCache<NSString*, MXOlmInboundGroupSession*> *inboundGroupSessionsCache;
+
+    // The device tracking status of all users, loaded from MXRealmDeviceTrackingStatus objects
+    // on first access. It is then kept up-to-date by writes.
+    // userId -> MXDeviceTrackingStatus
+    NSMutableDictionary<NSString*, NSNumber*> *deviceTrackingStatus;
 }
 
 /**
@@ -332,6 +374,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     {
         userId = credentials.userId;
         deviceId = credentials.deviceId;
+        inboundGroupSessionsCache = [[MXStripedLRUCache alloc] initWithCountLimit:kMXRealmCryptoStoreInboundGroupSessionsCacheCountLimit totalCostLimit:0];
 
         MXRealmOlmAccount *account = self.accountInCurrentThread;
         if (!account)
@@ -369,11 +412,28 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     onComplete();
 }
 
+- (void)performBatchWrites:(void (^)(void))writes
+{
+    RLMRealm *realm = self.realm;
+    if (realm.inWriteTransaction)
+    {
+        writes();
+        return;
+    }
+
+    // Realm instances are per thread. Store methods called by the block on this
+    // thread will find this transaction open and will write into it
+    NSDate *startDate = [NSDate date];
+    [realm transactionWithBlock:writes];
+
+    NSLog(@"[MXRealmCryptoStore] performBatchWrites: committed in %.0fms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+}
+
 - (void)storeDeviceId:(NSString*)deviceId
 {
     MXRealmOlmAccount *account = self.accountInCurrentThread;
 
-    [account.realm transactionWithBlock:^{
+    [self writeInRealm:account.realm block:^{
         account.deviceId = deviceId;
     }];
 }
@@ -391,7 +451,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 
     MXRealmOlmAccount *account = self.accountInCurrentThread;
 
-    [account.realm transactionWithBlock:^{
+    [self writeInRealm:account.realm block:^{
         account.olmAccountData = [NSKeyedArchiver archivedDataWithRootObject:olmAccount];
     }];
 
@@ -411,7 +471,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)storeDeviceSyncToken:(NSString*)deviceSyncToken
 {
     MXRealmOlmAccount *account = self.accountInCurrentThread;
-    [account.realm transactionWithBlock:^{
+    [self writeInRealm:account.realm block:^{
         account.deviceSyncToken = deviceSyncToken;
     }];
 }
@@ -428,7 +488,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 
     RLMRealm *realm = self.realm;
 
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmUser *realmUser = [MXRealmUser objectsInRealm:realm where:@"userId = %@", userID].firstObject;
         if (!realmUser)
@@ -490,7 +550,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 
     RLMRealm *realm = self.realm;
 
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmUser *realmUser = [MXRealmUser objectsInRealm:realm where:@"userId = %@", userID].firstObject;
         if (!realmUser)
@@ -521,6 +581,73 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     NSLog(@"[MXRealmCryptoStore] storeDevicesForUser (count: %tu) in %.0fms", devices.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
 }
 
+- (void)storeDevicesForUsers:(NSDictionary<NSString*, NSDictionary<NSString*, MXDeviceInfo*>*>*)usersDevices
+{
+    NSDate *startDate = [NSDate date];
+    __block NSUInteger writeCount = 0;
+    __block NSUInteger deleteCount = 0;
+
+    RLMRealm *realm = self.realm;
+    [self writeInRealm:realm block:^{
+
+        for (NSString *theUserId in usersDevices)
+        {
+            NSDictionary<NSString*, MXDeviceInfo*> *devices = usersDevices[theUserId];
+
+            MXRealmUser *realmUser = [MXRealmUser objectInRealm:realm forPrimaryKey:theUserId];
+            if (!realmUser)
+            {
+                realmUser = [[MXRealmUser alloc] initWithValue:@{
+                                                                 @"userId": theUserId,
+                                                                 }];
+                [realm addObject:realmUser];
+            }
+
+            // Update or delete stored devices. Iterate backwards as deletions remove items from the list
+            NSMutableSet<NSString*> *storedDeviceIds = [NSMutableSet setWithCapacity:realmUser.devices.count];
+            for (NSInteger index = realmUser.devices.count - 1; index >= 0; index--)
+            {
+                MXRealmDeviceInfo *realmDevice = realmUser.devices[index];
+                MXDeviceInfo *device = devices[realmDevice.deviceId];
+
+                if (!device || [storedDeviceIds containsObject:realmDevice.deviceId])
+                {
+                    [realm deleteObject:realmDevice];
+                    deleteCount++;
+                    continue;
+                }
+                [storedDeviceIds addObject:realmDevice.deviceId];
+
+                MXDeviceInfo *storedDevice = [NSKeyedUnarchiver unarchiveObjectWithData:realmDevice.deviceInfoData];
+                if (![storedDevice isEqual:device])
+                {
+                    realmDevice.deviceInfoData = [NSKeyedArchiver archivedDataWithRootObject:device];
+                    realmDevice.identityKey = device.identityKey;
+                    writeCount++;
+                }
+            }
+
+            // Add new devices
+            for (NSString *theDeviceId in devices)
+            {
+                if (![storedDeviceIds containsObject:theDeviceId])
+                {
+                    MXDeviceInfo *device = devices[theDeviceId];
+                    MXRealmDeviceInfo *realmDevice = [[MXRealmDeviceInfo alloc] initWithValue:@{
+                                                                                                @"deviceId": device.deviceId,
+                                                                                                @"deviceInfoData": [NSKeyedArchiver archivedDataWithRootObject:device]
+                                                                                                }];
+                    realmDevice.identityKey = device.identityKey;
+                    [realmUser.devices addObject:realmDevice];
+                    writeCount++;
+                }
+            }
+        }
+    }];
+
+    NSLog(@"[MXRealmCryptoStore] storeDevicesForUsers (users: %tu - written devices: %tu - deleted devices: %tu) in %.0fms", usersDevices.count, writeCount, deleteCount, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+}
+
 - (NSDictionary<NSString*, MXDeviceInfo*>*)devicesForUser:(NSString*)userID
 {
     NSMutableDictionary *devicesForUser;
@@ -541,17 +668,74 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 
 - (NSDictionary<NSString*, NSNumber*>*)deviceTrackingStatus
 {
-    MXRealmOlmAccount *account = self.accountInCurrentThread;
-    return [NSKeyedUnarchiver unarchiveObjectWithData:account.deviceTrackingStatusData];
+    @synchronized (self)
+    {
+        if (!deviceTrackingStatus)
+        {
+            RLMResults<MXRealmDeviceTrackingStatus *> *realmStatuses = [MXRealmDeviceTrackingStatus allObjectsInRealm:self.realm];
+
+            deviceTrackingStatus = [NSMutableDictionary dictionaryWithCapacity:realmStatuses.count];
+            for (MXRealmDeviceTrackingStatus *realmStatus in realmStatuses)
+            {
+                deviceTrackingStatus[realmStatus.userId] = @(realmStatus.status);
+            }
+        }
+
+        return [deviceTrackingStatus copy];
+    }
 }
 
 - (void)storeDeviceTrackingStatus:(NSDictionary<NSString*, NSNumber*>*)statusMap
 {
-    MXRealmOlmAccount *account = self.accountInCurrentThread;
-    [account.realm transactionWithBlock:^{
+    NSDate *startDate = [NSDate date];
+
+    RLMRealm *realm = self.realm;
+    [self writeInRealm:realm block:^{
+
+        [realm deleteObjects:[MXRealmDeviceTrackingStatus allObjectsInRealm:realm]];
+
+        for (NSString *theUserId in statusMap)
+        {
+            MXRealmDeviceTrackingStatus *realmStatus = [[MXRealmDeviceTrackingStatus alloc] initWithValue:@{
+                                                                                                            @"userId": theUserId,
+                                                                                                            @"status": statusMap[theUserId]
+                                                                                                            }];
+            [realm addObject:realmStatus];
+        }
+    }];
+
+    @synchronized (self)
+    {
+        deviceTrackingStatus = statusMap ? [statusMap mutableCopy] : [NSMutableDictionary dictionary];
+    }
+
+    NSLog(@"[MXRealmCryptoStore] storeDeviceTrackingStatus: Stored the status of %tu users in %.0fms", statusMap.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+}
+
+- (void)storeDeviceTrackingStatusOfUsers:(NSDictionary<NSString*, NSNumber*>*)statusMap
+{
+    if (!statusMap.count)
+    {
+        return;
+    }
+
+    RLMRealm *realm = self.realm;
+    [self writeInRealm:realm block:^{
 
-        account.deviceTrackingStatusData = [NSKeyedArchiver archivedDataWithRootObject:statusMap];
+        for (NSString *theUserId in statusMap)
+        {
+            MXRealmDeviceTrackingStatus *realmStatus = [[MXRealmDeviceTrackingStatus alloc] initWithValue:@{
+                                                                                                            @"userId": theUserId,
+                                                                                                            @"status": statusMap[theUserId]
+                                                                                                            }];
+            [realm addOrUpdateObject:realmStatus];
+        }
     }];
+
+    @synchronized (self)
+    {
+        [deviceTrackingStatus addEntriesFromDictionary:statusMap];
+    }
 }
 
 
@@ -561,7 +745,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 {
     RLMRealm *realm = self.realm;
 
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmUser *realmUser = [MXRealmUser objectsInRealm:realm where:@"userId = %@", crossSigningInfo.userId].firstObject;
         if (!realmUser)
@@ -620,7 +804,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     NSDate *startDate = [NSDate date];
 
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmRoomAlgorithm *roomAlgorithm = [self realmRoomAlgorithmForRoom:roomId inRealm:realm];
         if (roomAlgorithm)
@@ -653,7 +837,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     NSDate *startDate = [NSDate date];
 
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmRoomAlgorithm *roomAlgorithm = [self realmRoomAlgorithmForRoom:roomId inRealm:realm];
         if (roomAlgorithm)
@@ -691,25 +875,37 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     __block BOOL isNew = NO;
     NSDate *startDate = [NSDate date];
 
+    // The session may be used by a concurrent encryption or decryption. Pickle it in a consistent state
+    NSString *sessionId;
+    NSData *olmSessionData;
+    NSTimeInterval lastReceivedMessageTs;
+    @synchronized (session)
+    {
+        sessionId = session.session.sessionIdentifier;
+        olmSessionData = [NSKeyedArchiver archivedDataWithRootObject:session.session];
+        lastReceivedMessageTs = session.lastReceivedMessageTs;
+    }
+
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
-        MXRealmOlmSession *realmOlmSession = [MXRealmOlmSession objectsInRealm:realm where:@"sessionId = %@ AND deviceKey = %@", session.session.sessionIdentifier, deviceKey].firstObject;
+        MXRealmOlmSession *realmOlmSession = [MXRealmOlmSession objectsInRealm:realm where:@"sessionId = %@ AND deviceKey = %@", sessionId, deviceKey].firstObject;
         if (realmOlmSession)
         {
             // Update the existing one
-            realmOlmSession.olmSessionData = [NSKeyedArchiver archivedDataWithRootObject:session.session];
+            realmOlmSession.olmSessionData = olmSessionData;
+            realmOlmSession.lastReceivedMessageTs = lastReceivedMessageTs;
         }
         else
         {
             // Create it
             isNew = YES;
             realmOlmSession = [[MXRealmOlmSession alloc] initWithValue:@{
-                                                                         @"sessionId": session.session.sessionIdentifier,
+                                                                         @"sessionId": sessionId,
                                                                          @"deviceKey": deviceKey,
-                                                                         @"olmSessionData": [NSKeyedArchiver archivedDataWithRootObject:session.session]
+                                                                         @"olmSessionData": olmSessionData
                                                                          }];
-            realmOlmSession.lastReceivedMessageTs = session.lastReceivedMessageTs;
+            realmOlmSession.lastReceivedMessageTs = lastReceivedMessageTs;
 
             [realm addObject:realmOlmSession];
         }
@@ -769,29 +965,34 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     NSDate *startDate = [NSDate date];
 
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         for (MXOlmInboundGroupSession *session in sessions)
         {
             NSString *sessionIdSenderKey = [MXRealmOlmInboundGroupSession primaryKeyWithSessionId:session.session.sessionIdentifier
                                                                                         senderKey:session.senderKey];
+
+            NSData *olmInboundGroupSessionData;
+            @synchronized (session)
+            {
+                olmInboundGroupSessionData = [NSKeyedArchiver archivedDataWithRootObject:session];
+            }
+
             MXRealmOlmInboundGroupSession *realmSession = [MXRealmOlmInboundGroupSession objectsInRealm:realm where:@"sessionIdSenderKey = %@", sessionIdSenderKey].firstObject;
             if (realmSession)
             {
                 // Update the existing one
-                realmSession.olmInboundGroupSessionData = [NSKeyedArchiver archivedDataWithRootObject:session];
+                realmSession.olmInboundGroupSessionData = olmInboundGroupSessionData;
             }
             else
             {
                 // Create it
                 newCount++;
-                NSString *sessionIdSenderKey = [MXRealmOlmInboundGroupSession primaryKeyWithSessionId:session.session.sessionIdentifier
-                                                                                            senderKey:session.senderKey];
                 realmSession = [[MXRealmOlmInboundGroupSession alloc] initWithValue:@{
                                                                                       @"sessionId": session.session.sessionIdentifier,
                                                                                       @"senderKey": session.senderKey,
                                                                                       @"sessionIdSenderKey": sessionIdSenderKey,
-                                                                                      @"olmInboundGroupSessionData": [NSKeyedArchiver archivedDataWithRootObject:session]
+                                                                                      @"olmInboundGroupSessionData": olmInboundGroupSessionData
                                                                                       }];
 
                 [realm addObject:realmSession];
@@ -799,15 +1000,31 @@ RLM_ARRAY_TYPE(MXRealmSecret)
         }
     }];
 
+    // The stored objects are now clean and become the reference ones. This replaces
+    // any session updated by a key import or a key forward
+    for (MXOlmInboundGroupSession *session in sessions)
+    {
+        session.dirty = NO;
+
+        NSString *sessionIdSenderKey = [MXRealmOlmInboundGroupSession primaryKeyWithSessionId:session.session.sessionIdentifier
+                                                                                    senderKey:session.senderKey];
+        [inboundGroupSessionsCache setObject:session forKey:sessionIdSenderKey];
+    }
 
     NSLog(@"[MXRealmCryptoStore] storeInboundGroupSessions: store %@ keys (%@ new) in %.0fms", @(sessions.count), @(newCount), [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
 }
 
 - (MXOlmInboundGroupSession*)inboundGroupSessionWithId:(NSString*)sessionId andSenderKey:(NSString*)senderKey
 {
-    MXOlmInboundGroupSession *session;
     NSString *sessionIdSenderKey = [MXRealmOlmInboundGroupSession primaryKeyWithSessionId:sessionId
                                                                                 senderKey:senderKey];
+
+    MXOlmInboundGroupSession *session = [inboundGroupSessionsCache objectForKey:sessionIdSenderKey];
+    if (session)
+    {
+        return session;
+    }
+
     MXRealmOlmInboundGroupSession *realmSession = [MXRealmOlmInboundGroupSession objectsInRealm:self.realm where:@"sessionIdSenderKey = %@", sessionIdSenderKey].firstObject;
 
     NSLog(@"[MXRealmCryptoStore] inboundGroupSessionWithId: %@ -> %@", sessionId, realmSession ? @"found" : @"not found");
@@ -816,7 +1033,11 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     {
         session = [NSKeyedUnarchiver unarchiveObjectWithData:realmSession.olmInboundGroupSessionData];
 
-        if (!session)
+        if (session)
+        {
+            [inboundGroupSessionsCache setObject:session forKey:sessionIdSenderKey];
+        }
+        else
         {
             NSLog(@"[MXRealmCryptoStore] inboundGroupSessionWithId: ERROR: Failed to create MXOlmInboundGroupSession object");
         }
@@ -840,12 +1061,79 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)removeInboundGroupSessionWithId:(NSString*)sessionId andSenderKey:(NSString*)senderKey
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         RLMResults<MXRealmOlmInboundGroupSession *> *realmSessions = [MXRealmOlmInboundGroupSession objectsInRealm:realm where:@"sessionId = %@ AND senderKey = %@", sessionId, senderKey];
 
         [realm deleteObjects:realmSessions];
     }];
+
+    [inboundGroupSessionsCache removeObjectForKey:[MXRealmOlmInboundGroupSession primaryKeyWithSessionId:sessionId senderKey:senderKey]];
+}
+
+- (NSUInteger)inboundGroupSessionsCacheHitCount
+{
+    return inboundGroupSessionsCache.hitCount;
+}
+
+- (NSUInteger)inboundGroupSessionsCacheMissCount
+{
+    return inboundGroupSessionsCache.missCount;
+}
+
+
+#pragma mark - Outbound group sessions
+
+- (void)storeOutboundGroupSession:(MXOlmOutboundGroupSession *)session
+{
+    NSDate *startDate = [NSDate date];
+
+    RLMRealm *realm = self.realm;
+    [self writeInRealm:realm block:^{
+
+        MXRealmOlmOutboundGroupSession *realmSession = [[MXRealmOlmOutboundGroupSession alloc] initWithValue:@{
+                                                                                                            @"roomId": session.roomId,
+                                                                                                            @"sessionId": session.sessionId,
+                                                                                                            @"olmOutboundGroupSessionData": [NSKeyedArchiver archivedDataWithRootObject:session.session],
+                                                                                                            @"creationTime": @(session.creationTime),
+                                                                                                            @"useCount": @(session.useCount),
+                                                                                                            @"sharedWithDevicesData": [NSKeyedArchiver archivedDataWithRootObject:session.sharedWithDevices]
+                                                                                                            }];
+
+        // Replace the previous session of the room
+        [realm addOrUpdateObject:realmSession];
+    }];
+
+    NSLog(@"[MXRealmCryptoStore] storeOutboundGroupSession: store session %@ in room %@ in %.0fms", session.sessionId, session.roomId, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+}
+
+- (MXOlmOutboundGroupSession *)outboundGroupSessionWithRoomId:(NSString *)roomId
+{
+    MXOlmOutboundGroupSession *session;
+
+    MXRealmOlmOutboundGroupSession *realmSession = [MXRealmOlmOutboundGroupSession objectsInRealm:self.realm where:@"roomId = %@", roomId].firstObject;
+    if (realmSession)
+    {
+        OLMOutboundGroupSession *olmSession = [NSKeyedUnarchiver unarchiveObjectWithData:realmSession.olmOutboundGroupSessionData];
+        if (olmSession)
+        {
+            session = [[MXOlmOutboundGroupSession alloc] initWithSession:olmSession roomId:roomId];
+            session.creationTime = realmSession.creationTime;
+            session.useCount = realmSession.useCount;
+
+            MXUsersDevicesMap<NSNumber*> *sharedWithDevices = [NSKeyedUnarchiver unarchiveObjectWithData:realmSession.sharedWithDevicesData];
+            if (sharedWithDevices)
+            {
+                session.sharedWithDevices = sharedWithDevices;
+            }
+        }
+        else
+        {
+            NSLog(@"[MXRealmCryptoStore] outboundGroupSessionWithRoomId: ERROR: Failed to create OLMOutboundGroupSession object");
+        }
+    }
+
+    return session;
 }
 
 
@@ -854,7 +1142,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)setBackupVersion:(NSString *)backupVersion
 {
     MXRealmOlmAccount *account = self.accountInCurrentThread;
-    [account.realm transactionWithBlock:^{
+    [self writeInRealm:account.realm block:^{
         account.backupVersion = backupVersion;
     }];
 }
@@ -868,7 +1156,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)resetBackupMarkers
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         RLMResults<MXRealmOlmInboundGroupSession *> *realmSessions = [MXRealmOlmInboundGroupSession allObjectsInRealm:realm];
 
@@ -884,7 +1172,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)markBackupDoneForInboundGroupSessions:(NSArray<MXOlmInboundGroupSession *>*)sessions
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         for (MXOlmInboundGroupSession *session in sessions)
         {
@@ -986,7 +1274,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)storeOutgoingRoomKeyRequest:(MXOutgoingRoomKeyRequest*)request
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         NSString *requestBodyString = [MXTools serialiseJSONObject:request.requestBody];
         NSString *requestBodyHash = [MXCryptoTools canonicalJSONStringForJSON:request.requestBody];
@@ -1009,7 +1297,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)updateOutgoingRoomKeyRequest:(MXOutgoingRoomKeyRequest*)request
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmOutgoingRoomKeyRequest *realmOutgoingRoomKeyRequest = [MXRealmOutgoingRoomKeyRequest objectsInRealm:realm where:@"requestId = %@", request.requestId].firstObject;
 
@@ -1026,7 +1314,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)deleteOutgoingRoomKeyRequestWithRequestId:(NSString*)requestId
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         RLMResults<MXRealmOutgoingRoomKeyRequest *> *realmOutgoingRoomKeyRequests = [MXRealmOutgoingRoomKeyRequest objectsInRealm:realm where:@"requestId = %@", requestId];
 
@@ -1040,7 +1328,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)storeIncomingRoomKeyRequest:(MXIncomingRoomKeyRequest*)request
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         MXRealmIncomingRoomKeyRequest *realmIncomingRoomKeyRequest =
         [[MXRealmIncomingRoomKeyRequest alloc] initWithValue:@{
@@ -1056,7 +1344,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)deleteIncomingRoomKeyRequest:(NSString*)requestId fromUser:(NSString*)userId andDevice:(NSString*)deviceId
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
 
         RLMResults<MXRealmIncomingRoomKeyRequest *> *realmIncomingRoomKeyRequests = [MXRealmIncomingRoomKeyRequest objectsInRealm:realm where:@"requestId = %@ AND userId = %@ AND deviceId = %@", requestId, userId, deviceId];
         
@@ -1103,7 +1391,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)storeSecret:(NSString*)secret withSecretId:(NSString*)secretId
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
         
         MXRealmSecret *realmSecret =
         [[MXRealmSecret alloc] initWithValue:@{
@@ -1123,7 +1411,7 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)deleteSecretWithSecretId:(NSString*)secretId
 {
     RLMRealm *realm = self.realm;
-    [realm transactionWithBlock:^{
+    [self writeInRealm:realm block:^{
         [realm deleteObjects:[MXRealmSecret objectsInRealm:self.realm where:@"secretId = %@", secretId]];
     }];
 }
@@ -1140,12 +1428,33 @@ RLM_ARRAY_TYPE(MXRealmSecret)
 - (void)setGlobalBlacklistUnverifiedDevices:(BOOL)globalBlacklistUnverifiedDevices
 {
     MXRealmOlmAccount *account = self.accountInCurrentThread;
-    [account.realm transactionWithBlock:^{
+    [self writeInRealm:account.realm block:^{
         account.globalBlacklistUnverifiedDevices = globalBlacklistUnverifiedDevices;
     }];
 }
 
 #pragma mark - Private methods
+
+/**
+ Run a write block in a transaction.
+
+ If a batch is in progress on the current thread, the block is run in its transaction.
+
+ @param realm the realm to write into.
+ @param block the write block.
+ */
+- (void)writeInRealm:(RLMRealm*)realm block:(void (^)(void))block
+{
+    if (realm.inWriteTransaction)
+    {
+        block();
+    }
+    else
+    {
+        [realm transactionWithBlock:block];
+    }
+}
+
 + (RLMRealm*)realmForUser:(NSString*)userId andDevice:(NSString*)deviceId
 {
     // Each user has its own db file.
@@ -1245,9 +1554,11 @@ RLM_ARRAY_TYPE(MXRealmSecret)
                              MXRealmDeviceInfo.class,
                              MXRealmCrossSigningInfo.class,
                              MXRealmUser.class,
+                             MXRealmDeviceTrackingStatus.class,
                              MXRealmRoomAlgorithm.class,
                              MXRealmOlmSession.class,
                              MXRealmOlmInboundGroupSession.class,   
+                             MXRealmOlmOutboundGroupSession.class,
                              MXRealmOlmAccount.class,
                              MXRealmOutgoingRoomKeyRequest.class,
                              MXRealmIncomingRoomKeyRequest.class,
@@ -1446,6 +1757,34 @@ RLM_ARRAY_TYPE(MXRealmSecret)
                         newObject[@"deviceInfoData"] = [NSKeyedArchiver archivedDataWithRootObject:device];
                     }];
                 }
+
+                case 12:
+                    NSLog(@"[MXRealmCryptoStore] Migration from schema #12 -> #13: Nothing to do (added MXRealmOlmOutboundGroupSession)");
+
+                case 13:
+                {
+                    NSLog(@"[MXRealmCryptoStore] Migration from schema #13 -> #14");
+
+                    // MXRealmOlmAccount.deviceTrackingStatusData has been replaced by one
+                    // MXRealmDeviceTrackingStatus object per user
+                    NSLog(@"[MXRealmCryptoStore]    Move device tracking status to MXRealmDeviceTrackingStatus objects");
+
+                    __block NSUInteger count = 0;
+                    [migration enumerateObjects:MXRealmOlmAccount.className block:^(RLMObject *oldObject, RLMObject *newObject) {
+
+                        NSDictionary<NSString*, NSNumber*> *statusMap = [MXRealmCryptoStore deviceTrackingStatusFromLegacyData:oldObject[@"deviceTrackingStatusData"]];
+                        for (NSString *theUserId in statusMap)
+                        {
+                            [migration createObject:MXRealmDeviceTrackingStatus.className withValue:@{
+                                                                                                      @"userId": theUserId,
+                                                                                                      @"status": statusMap[theUserId]
+                                                                                                      }];
+                            count++;
+                        }
+                    }];
+
+                    NSLog(@"[MXRealmCryptoStore]    -> Moved the status of %tu users", count);
+                }
             }
         }
     };
@@ -1525,6 +1864,34 @@ RLM_ARRAY_TYPE(MXRealmSecret)
     }];
 }
 
+/**
+ Decode the device tracking status that schemas #5 to #13 stored as an archived
+ dictionary in MXRealmOlmAccount.deviceTrackingStatusData.
+
+ @param deviceTrackingStatusData the archived data.
+ @return the map userId -> MXDeviceTrackingStatus. nil if there is no data or if it cannot be decoded.
+ */
++ (NSDictionary<NSString*, NSNumber*>*)deviceTrackingStatusFromLegacyData:(NSData*)deviceTrackingStatusData
+{
+    if (!deviceTrackingStatusData)
+    {
+        return nil;
+    }
+
+    NSDictionary<NSString*, NSNumber*> *statusMap;
+    @try
+    {
+        statusMap = [NSKeyedUnarchiver unarchiveObjectWithData:deviceTrackingStatusData];
+    }
+    @catch (NSException *exception)
+    {
+        // Users without status are considered as not tracked. They will be tracked again when needed
+        NSLog(@"[MXRealmCryptoStore] deviceTrackingStatusFromLegacyData: Cannot decode data. Exception: %@", exception);
+    }
+
+    return [statusMap isKindOfClass:NSDictionary.class] ? statusMap : nil;
+}
+
 @end
 
 #endif
@@ -172,6 +172,24 @@ extern NSString *const MXDeviceListDidUpdateUsersDevicesNotification;
  */
 - (MXEventDecryptionResult *)decryptEvent:(MXEvent*)event inTimeline:(NSString*)timeline error:(NSError** )error;
 
+/**
+ Decrypt received events asynchronously.
+
+ Events are decrypted in order, on the decryption queue. The main thread is not blocked.
+ Events are not modified: the caller applies the results.
+
+ @param events the raw events.
+ @param timeline the id of the timeline where the events are decrypted. It is used
+                 to prevent replay attack. It is not used for replace events.
+ @param queue the queue to call `onComplete` on.
+ @param onComplete the block called with a decryption result for each event, in the order of `events`.
+                   The result of an event that could not be decrypted has an `error`.
+ */
+- (void)decryptEvents:(NSArray<MXEvent*> *)events
+           inTimeline:(NSString*)timeline
+                queue:(dispatch_queue_t)queue
+           onComplete:(void (^)(NSArray<MXEventDecryptionResult *>*results))onComplete;
+
 /**
  Ensure that the outbound session is ready to encrypt events.
  
@@ -460,56 +460,64 @@ NSTimeInterval kMXCryptoMinForceSessionPeriod = 3600.0; // one hour
 
     __block MXEventDecryptionResult *result;
 
-    // TODO: dispatch_async (https://github.com/matrix-org/matrix-ios-sdk/issues/205)
-    // At the moment, we lock the main thread while decrypting events.
-    // Fortunately, decrypting is far quicker that encrypting.
+    // At the moment, we lock the calling thread while decrypting events.
+    // Use decryptEvents:inTimeline:queue:onComplete: to decrypt without blocking it.
     dispatch_sync(_decryptionQueue, ^{
+        result = [self decryptEventOnDecryptionQueue:event inTimeline:timeline error:error];
+    });
 
-        if (!event.content.count)
-        {
-            NSLog(@"[MXCrypto] decryptEvent: No content to decrypt in event %@ (isRedacted: %@). Event: %@", event.eventId, @(event.isRedactedEvent), event.JSONDictionary);
-            result = [[MXEventDecryptionResult alloc] init];
-            result.clearEvent = event.content;
-            return;
-        }
+    return result;
 
-        id<MXDecrypting> alg = [self getRoomDecryptor:event.roomId algorithm:event.content[@"algorithm"]];
-        if (!alg)
-        {
-            NSLog(@"[MXCrypto] decryptEvent: Unable to decrypt %@ with algorithm %@. Event: %@", event.eventId, event.content[@"algorithm"], event.JSONDictionary);
+#else
+    return nil;
+#endif
+}
 
-            if (error)
-            {
-                *error = [NSError errorWithDomain:MXDecryptingErrorDomain
-                                             code:MXDecryptingErrorUnableToDecryptCode
-                                         userInfo:@{
-                                                    NSLocalizedDescriptionKey: MXDecryptingErrorUnableToDecrypt,
-                                                    NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:MXDecryptingErrorUnableToDecryptReason, event, event.content[@"algorithm"]]
-                                                    }];
-            }
-        }
-        else
-        {
-            result = [alg decryptEvent:event inTimeline:timeline error:error];
-            if (error && *error)
+- (void)decryptEvents:(NSArray<MXEvent *> *)events
+           inTimeline:(NSString *)timeline
+                queue:(dispatch_queue_t)queue
+           onComplete:(void (^)(NSArray<MXEventDecryptionResult *> *))onComplete
+{
+#ifdef MX_CRYPTO
+
+    MXWeakify(self);
+    dispatch_async(_decryptionQueue, ^{
+        MXStrongifyAndReturnIfNil(self);
+
+        NSMutableArray<MXEventDecryptionResult *> *results = [NSMutableArray arrayWithCapacity:events.count];
+
+        // Sessions updated by the decryptions are saved in one go, once they are done
+        [self.olmDevice performGroupDecryptions:^{
+            for (MXEvent *event in events)
             {
-                NSLog(@"[MXCrypto] decryptEvent: Error for %@: %@\nEvent: %@", event.eventId, *error, event.JSONDictionary);
-                
-                if ([(*error).domain isEqualToString:MXDecryptingErrorDomain]
-                    && (*error).code == MXDecryptingErrorBadEncryptedMessageCode)
+                @autoreleasepool
                 {
-                    dispatch_async(self.decryptionQueue, ^{
-                        [self markOlmSessionForUnwedgingInEvent:event];
-                    });
+                    // Like [MXEventTimeline addEvent:direction:fromStore:isRoomInitialSync:], do not track duplicate
+                    // decryption for content of replace events because it is decrypted later with the edited event.
+                    // TODO: Remove this with the coming update of MSC1849.
+                    NSString *eventTimeline = event.unsignedData.relations.replace ? nil : timeline;
+
+                    NSError *error;
+                    MXEventDecryptionResult *result = [self decryptEventOnDecryptionQueue:event inTimeline:eventTimeline error:&error];
+                    if (!result)
+                    {
+                        result = [MXEventDecryptionResult new];
+                        result.error = error ?: [NSError errorWithDomain:MXDecryptingErrorDomain code:MXDecryptingErrorUnableToDecryptCode userInfo:nil];
+                    }
+                    [results addObject:result];
                 }
             }
-        }
-    });
+        }];
 
-    return result;
+        dispatch_async(queue, ^{
+            onComplete(results);
+        });
+    });
 
 #else
-    return nil;
+    dispatch_async(queue, ^{
+        onComplete(@[]);
+    });
 #endif
 }
 
@@ -1930,44 +1938,14 @@ NSTimeInterval kMXCryptoMinForceSessionPeriod = 3600.0; // one hour
 
 - (NSDictionary*)encryptMessage:(NSDictionary*)payloadFields forDevices:(NSArray<MXDeviceInfo*>*)devices
 {
-    NSMutableDictionary *ciphertext = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, NSString*> *payloadStrings = [NSMutableDictionary dictionaryWithCapacity:devices.count];
     for (MXDeviceInfo *recipientDevice in devices)
     {
-        NSString *sessionId = [_olmDevice sessionIdForDevice:recipientDevice.identityKey];
-        if (sessionId)
-        {
-            NSMutableDictionary *payloadJson = [NSMutableDictionary dictionaryWithDictionary:payloadFields];
-            payloadJson[@"sender"] = _matrixRestClient.credentials.userId;
-            payloadJson[@"sender_device"] = _store.deviceId;
-
-            // Include the Ed25519 key so that the recipient knows what
-            // device this message came from.
-            // We don't need to include the curve25519 key since the
-            // recipient will already know this from the olm headers.
-            // When combined with the device keys retrieved from the
-            // homeserver signed by the ed25519 key this proves that
-            // the curve25519 key and the ed25519 key are owned by
-            // the same device.
-            payloadJson[@"keys"] = @{
-                                     @"ed25519": _olmDevice.deviceEd25519Key
-                                     };
-
-            // Include the recipient device details in the payload,
-            // to avoid unknown key attacks, per
-            // https://github.com/vector-im/vector-web/issues/2483
-            payloadJson[@"recipient"] = recipientDevice.userId;
-            payloadJson[@"recipient_keys"] = @{
-                                               @"ed25519": recipientDevice.fingerprint
-                                               };
-
-            NSData *payloadData = [NSJSONSerialization  dataWithJSONObject:payloadJson options:0 error:nil];
-            NSString *payloadString = [[NSString alloc] initWithData:payloadData encoding:NSUTF8StringEncoding];
-
-            //NSLog(@"[MXCrypto] encryptMessage: %@\nUsing sessionid %@ for device %@", payloadJson, sessionId, recipientDevice.identityKey);
-            ciphertext[recipientDevice.identityKey] = [_olmDevice encryptMessage:recipientDevice.identityKey sessionId:sessionId payloadString:payloadString];
-        }
+        payloadStrings[recipientDevice.identityKey] = [self olmPayloadStringWithFields:payloadFields forDevice:recipientDevice];
     }
 
+    NSDictionary *ciphertext = [_olmDevice encryptMessages:payloadStrings];
+
     return @{
              @"algorithm": kMXCryptoOlmAlgorithm,
              @"sender_key": _olmDevice.deviceCurve25519Key,
@@ -1975,6 +1953,73 @@ NSTimeInterval kMXCryptoMinForceSessionPeriod = 3600.0; // one hour
              };
 }
 
+- (MXUsersDevicesMap<NSDictionary*>*)encryptMessage:(NSDictionary*)payloadFields forEachDevice:(NSArray<MXDeviceInfo*>*)devices
+{
+    NSMutableDictionary<NSString*, NSString*> *payloadStrings = [NSMutableDictionary dictionaryWithCapacity:devices.count];
+    for (MXDeviceInfo *recipientDevice in devices)
+    {
+        payloadStrings[recipientDevice.identityKey] = [self olmPayloadStringWithFields:payloadFields forDevice:recipientDevice];
+    }
+
+    NSDictionary<NSString*, NSDictionary*> *messages = [_olmDevice encryptMessages:payloadStrings];
+
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [[MXUsersDevicesMap alloc] init];
+    for (MXDeviceInfo *recipientDevice in devices)
+    {
+        NSDictionary *message = messages[recipientDevice.identityKey];
+        if (message)
+        {
+            [contentMap setObject:@{
+                                    @"algorithm": kMXCryptoOlmAlgorithm,
+                                    @"sender_key": _olmDevice.deviceCurve25519Key,
+                                    @"ciphertext": @{
+                                            recipientDevice.identityKey: message
+                                            }
+                                    }
+                          forUser:recipientDevice.userId andDevice:recipientDevice.deviceId];
+        }
+    }
+
+    return contentMap;
+}
+
+/**
+ Build the olm payload to send to a device.
+
+ @param payloadFields fields to include in the payload.
+ @param recipientDevice the recipient device.
+ @return the JSON string to encrypt.
+ */
+- (NSString*)olmPayloadStringWithFields:(NSDictionary*)payloadFields forDevice:(MXDeviceInfo*)recipientDevice
+{
+    NSMutableDictionary *payloadJson = [NSMutableDictionary dictionaryWithDictionary:payloadFields];
+    payloadJson[@"sender"] = _matrixRestClient.credentials.userId;
+    payloadJson[@"sender_device"] = _store.deviceId;
+
+    // Include the Ed25519 key so that the recipient knows what
+    // device this message came from.
+    // We don't need to include the curve25519 key since the
+    // recipient will already know this from the olm headers.
+    // When combined with the device keys retrieved from the
+    // homeserver signed by the ed25519 key this proves that
+    // the curve25519 key and the ed25519 key are owned by
+    // the same device.
+    payloadJson[@"keys"] = @{
+                             @"ed25519": _olmDevice.deviceEd25519Key
+                             };
+
+    // Include the recipient device details in the payload,
+    // to avoid unknown key attacks, per
+    // https://github.com/vector-im/vector-web/issues/2483
+    payloadJson[@"recipient"] = recipientDevice.userId;
+    payloadJson[@"recipient_keys"] = @{
+                                       @"ed25519": recipientDevice.fingerprint
+                                       };
+
+    NSData *payloadData = [NSJSONSerialization  dataWithJSONObject:payloadJson options:0 error:nil];
+    return [[NSString alloc] initWithData:payloadData encoding:NSUTF8StringEncoding];
+}
+
 - (id<MXDecrypting>)getRoomDecryptor:(NSString*)roomId algorithm:(NSString*)algorithm
 {
     id<MXDecrypting> alg;
@@ -2061,6 +2106,64 @@ NSTimeInterval kMXCryptoMinForceSessionPeriod = 3600.0; // one hour
 }
 
 #pragma mark - Private methods
+
+/**
+ Decrypt a received event.
+
+ Must be called on the decryption queue.
+
+ @param event the raw event.
+ @param timeline the id of the timeline where the event is decrypted.
+ @param error the result error if there is a problem decrypting the event.
+ @return The decryption result. Nil if it failed.
+ */
+- (MXEventDecryptionResult *)decryptEventOnDecryptionQueue:(MXEvent *)event inTimeline:(NSString*)timeline error:(NSError* __autoreleasing * )error
+{
+    if (!event.content.count)
+    {
+        NSLog(@"[MXCrypto] decryptEvent: No content to decrypt in event %@ (isRedacted: %@). Event: %@", event.eventId, @(event.isRedactedEvent), event.JSONDictionary);
+        MXEventDecryptionResult *result = [[MXEventDecryptionResult alloc] init];
+        result.clearEvent = event.content;
+        return result;
+    }
+
+    MXEventDecryptionResult *result;
+
+    id<MXDecrypting> alg = [self getRoomDecryptor:event.roomId algorithm:event.content[@"algorithm"]];
+    if (!alg)
+    {
+        NSLog(@"[MXCrypto] decryptEvent: Unable to decrypt %@ with algorithm %@. Event: %@", event.eventId, event.content[@"algorithm"], event.JSONDictionary);
+
+        if (error)
+        {
+            *error = [NSError errorWithDomain:MXDecryptingErrorDomain
+                                         code:MXDecryptingErrorUnableToDecryptCode
+                                     userInfo:@{
+                                                NSLocalizedDescriptionKey: MXDecryptingErrorUnableToDecrypt,
+                                                NSLocalizedFailureReasonErrorKey: [NSString stringWithFormat:MXDecryptingErrorUnableToDecryptReason, event, event.content[@"algorithm"]]
+                                                }];
+        }
+    }
+    else
+    {
+        result = [alg decryptEvent:event inTimeline:timeline error:error];
+        if (error && *error)
+        {
+            NSLog(@"[MXCrypto] decryptEvent: Error for %@: %@\nEvent: %@", event.eventId, *error, event.JSONDictionary);
+
+            if ([(*error).domain isEqualToString:MXDecryptingErrorDomain]
+                && (*error).code == MXDecryptingErrorBadEncryptedMessageCode)
+            {
+                dispatch_async(self.decryptionQueue, ^{
+                    [self markOlmSessionForUnwedgingInEvent:event];
+                });
+            }
+        }
+    }
+
+    return result;
+}
+
 /**
  Get or create the GCD queue for a given user.
 
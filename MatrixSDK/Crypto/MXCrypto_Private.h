@@ -145,6 +145,19 @@
  */
 - (NSDictionary*)encryptMessage:(NSDictionary*)payloadFields forDevices:(NSArray<MXDeviceInfo*>*)devices;
 
+/**
+ Encrypt an event payload for each device separately.
+
+ Messages for the different devices are encrypted concurrently.
+
+ @param payloadFields fields to include in the encrypted payload.
+ @param devices the list of the recipient devices.
+
+ @return the content of an m.room.encrypted event for each device. Devices with no
+         established olm session are missing.
+ */
+- (MXUsersDevicesMap<NSDictionary*>*)encryptMessage:(NSDictionary*)payloadFields forEachDevice:(NSArray<MXDeviceInfo*>*)devices;
+
 /**
  Get a decryptor for a given room and algorithm.
 
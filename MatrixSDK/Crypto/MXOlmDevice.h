@@ -149,6 +149,18 @@
  */
 - (NSDictionary*)encryptMessage:(NSString*)theirDeviceIdentityKey sessionId:(NSString*)sessionId payloadString:(NSString*)payloadString;
 
+/**
+ Encrypt outgoing messages for several devices using their existing sessions.
+
+ Olm sessions of different devices are independent so that messages are encrypted
+ concurrently. Updated sessions are then saved in one store transaction.
+
+ @param payloadStrings the payload to encrypt for each device, by Curve25519 identity key.
+ @return dictionaries containing a "body" and a "type", by identity key. Devices with
+         no established session are missing.
+ */
+- (NSDictionary<NSString*, NSDictionary*>*)encryptMessages:(NSDictionary<NSString*, NSString*>*)payloadStrings;
+
 /**
  Decrypt an incoming message using an existing session.
 
@@ -198,6 +210,21 @@ Determine if an incoming messages is a prekey message matching an existing sessi
  */
 - (NSUInteger)messageIndexForOutboundGroupSession:(NSString*)sessionId;
 
+/**
+ Get an outbound group session.
+
+ @param sessionId the id of the outbound group session.
+ @return the olm outbound group session. nil if not found.
+ */
+- (OLMOutboundGroupSession*)outboundGroupSessionWithId:(NSString*)sessionId;
+
+/**
+ Add an existing outbound group session, restored from the store for example.
+
+ @param session the olm outbound group session.
+ */
+- (void)addOutboundGroupSession:(OLMOutboundGroupSession*)session;
+
 /**
  Encrypt an outgoing message with an outbound group session.
 
@@ -255,6 +282,16 @@ Determine if an incoming messages is a prekey message matching an existing sessi
                                  sessionId:(NSString*)sessionId senderKey:(NSString*)senderKey
                                      error:(NSError** )error;
 
+/**
+ Run group message decryptions made on the current thread by a block and store the
+ inbound group sessions they modified once the block returns, in one store write.
+
+ The decryptions themselves do not hold any store transaction.
+
+ @param decryptions the block decrypting group messages.
+ */
+- (void)performGroupDecryptions:(void (^)(void))decryptions;
+
 /**
  Reset replay attack data for the given timeline.
 
@@ -309,6 +346,8 @@ Determine if an incoming messages is a prekey message matching an existing sessi
 /**
  Verify an ed25519 signature on a JSON object.
 
+ This method can be called from any thread.
+
  @param key the ed25519 key.
  @param JSONDictinary the JSON object which was signed.
  @param signature the base64-encoded signature to be checked.
@@ -23,6 +23,11 @@
 #import <OLMKit/OLMKit.h>
 
 #import "MXCryptoTools.h"
+#import "MXStripedLRUCache.h"
+#import "MXReplayAttackIndex.h"
+
+// Maximum number of unpickled olm sessions kept in memory
+static NSUInteger const kMXOlmDeviceOlmSessionsCacheCountLimit = 100;
 
 @interface MXOlmDevice ()
 {
@@ -32,9 +37,30 @@
     // The OLMKit utility instance.
     OLMUtility *olmUtility;
 
+    // The ids of the olm sessions of each device, the session that has most recently
+    // received a message first.
+    // The list of a device is loaded from the store the first time it is needed. It is
+    // then maintained by `storeSession:forDevice:` so that choosing a session does not
+    // need to read and unpickle all sessions of the device.
+    // The key is the device curve25519 key.
+    NSMutableDictionary<NSString*, NSMutableArray<NSString*>*> *olmSessionIdsByDevice;
+
+    // The `lastReceivedMessageTs` of the sessions in `olmSessionIdsByDevice`, used to keep them sorted.
+    // The key is "<deviceKey>|<sessionId>".
+    NSMutableDictionary<NSString*, NSNumber*> *olmSessionsLastReceivedMessageTs;
+
+    // Sessions stored for devices whose list is being loaded from the store, to be merged into
+    // the loaded list in case the store was read before they were written.
+    // The key is the device curve25519 key, the value the `lastReceivedMessageTs` by session id.
+    NSMutableDictionary<NSString*, NSMutableDictionary<NSString*, NSNumber*>*> *olmSessionsStoredDuringIndexLoad;
+
+    // The most recently used unpickled olm sessions.
+    // The key is "<deviceKey>|<sessionId>".
+    MXStripedLRUCache<NSString*, MXOlmSession*> *olmSessionsCache;
+
     // The outbound group session.
-    // They are not stored in 'store' to avoid to remember to which devices we sent the session key.
-    // Plus, in cryptography, it is good to refresh sessions from time to time.
+    // They are stored in 'store' by their MXMegolmEncryption, with the devices we sent
+    // the session key to, so that they can be resumed after a restart.
     // The key is the session id, the value the outbound group session.
     NSMutableDictionary<NSString*, OLMOutboundGroupSession*> *outboundGroupSessionStore;
 
@@ -46,12 +72,11 @@
     // timelines from a same room so that a message can be decrypted several times but from
     // a different timeline.
     // So, store these message indexes per timeline id.
-    //
-    // The first level keys are timeline ids.
-    // The second level keys are strings of form "<senderKey>|<session_id>|<message_index>"
-    // Values are @(YES).
-    NSMutableDictionary<NSString*,
-        NSMutableDictionary<NSString*, NSNumber*> *> *inboundGroupSessionMessageIndexes;
+    MXReplayAttackIndex *inboundGroupSessionMessageIndexes;
+
+    // Key in the thread dictionary of the inbound group sessions modified by the
+    // `performGroupDecryptions:` call running on that thread
+    NSString *dirtyInboundGroupSessionsThreadKey;
 }
 
 // The store where crypto data is saved.
@@ -88,8 +113,14 @@
 
         olmUtility = [[OLMUtility alloc] init];
 
+        olmSessionIdsByDevice = [NSMutableDictionary dictionary];
+        olmSessionsLastReceivedMessageTs = [NSMutableDictionary dictionary];
+        olmSessionsStoredDuringIndexLoad = [NSMutableDictionary dictionary];
+        olmSessionsCache = [[MXStripedLRUCache alloc] initWithCountLimit:kMXOlmDeviceOlmSessionsCacheCountLimit totalCostLimit:0];
+
         outboundGroupSessionStore = [NSMutableDictionary dictionary];
-        inboundGroupSessionMessageIndexes = [NSMutableDictionary dictionary];
+        inboundGroupSessionMessageIndexes = [[MXReplayAttackIndex alloc] init];
+        dirtyInboundGroupSessionsThreadKey = [NSString stringWithFormat:@"MXOlmDevice.dirtyInboundGroupSessions.%p", self];
 
         _deviceCurve25519Key = olmAccount.identityKeys[@"curve25519"];
         _deviceEd25519Key = olmAccount.identityKeys[@"ed25519"];
@@ -155,7 +186,7 @@
         // this session
         [mxOlmSession didReceiveMessage];
 
-        [store storeSession:mxOlmSession forDevice:theirIdentityKey];
+        [self storeSession:mxOlmSession forDevice:theirIdentityKey];
         return olmSession.sessionIdentifier;
     }
     else if (error)
@@ -197,7 +228,7 @@
         // to now
         [mxOlmSession didReceiveMessage];
 
-        [store storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
+        [self storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
 
         return olmSession.sessionIdentifier;
     }
@@ -211,22 +242,13 @@
 
 - (NSArray<NSString *> *)sessionIdsForDevice:(NSString *)theirDeviceIdentityKey
 {
-    NSArray<MXOlmSession*> *sessions = [store sessionsWithDevice:theirDeviceIdentityKey];
-
-    NSMutableArray *sessionIds = [NSMutableArray arrayWithCapacity:sessions.count];
-    for (MXOlmSession *session in sessions)
-    {
-        [sessionIds addObject:session.session.sessionIdentifier];
-    }
-
-    return sessionIds;
+    return [self sortedSessionIdsForDevice:theirDeviceIdentityKey];
 }
 
 - (NSString *)sessionIdForDevice:(NSString *)theirDeviceIdentityKey
 {
     // Use the session that has most recently received a message
-    // This is the first item in the sorted array returned by the store
-    return [store sessionsWithDevice:theirDeviceIdentityKey].firstObject.session.sessionIdentifier;
+    return [self sortedSessionIdsForDevice:theirDeviceIdentityKey].firstObject;
 }
 
 - (NSDictionary *)encryptMessage:(NSString *)theirDeviceIdentityKey sessionId:(NSString *)sessionId payloadString:(NSString *)payloadString
@@ -241,14 +263,17 @@
 
     if (mxOlmSession.session)
     {
-        olmMessage = [mxOlmSession.session encryptMessage:payloadString error:&error];
+        @synchronized (mxOlmSession)
+        {
+            olmMessage = [mxOlmSession.session encryptMessage:payloadString error:&error];
+        }
 
         if (error)
         {
             NSLog(@"[MXOlmDevice] encryptMessage failed: %@", error);
         }
 
-        [store storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
+        [self storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
     }
 
     //NSLog(@">>>> ciphertext: %@", olmMessage.ciphertext);
@@ -260,6 +285,62 @@
              };
 }
 
+- (NSDictionary<NSString*, NSDictionary*> *)encryptMessages:(NSDictionary<NSString*, NSString*> *)payloadStrings
+{
+    NSDate *startDate = [NSDate date];
+
+    NSArray<NSString*> *identityKeys = payloadStrings.allKeys;
+    NSMutableDictionary<NSString*, NSDictionary*> *messages = [NSMutableDictionary dictionaryWithCapacity:identityKeys.count];
+    NSMutableDictionary<NSString*, MXOlmSession*> *updatedSessions = [NSMutableDictionary dictionaryWithCapacity:identityKeys.count];
+
+    dispatch_apply(identityKeys.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+        @autoreleasepool
+        {
+            NSString *identityKey = identityKeys[index];
+
+            // Use the session that has most recently received a message
+            NSString *sessionId = [self sessionIdForDevice:identityKey];
+            MXOlmSession *mxOlmSession = sessionId ? [self sessionForDevice:identityKey andSessionId:sessionId] : nil;
+            if (!mxOlmSession.session)
+            {
+                return;
+            }
+
+            NSError *error;
+            OLMMessage *olmMessage;
+            @synchronized (mxOlmSession)
+            {
+                olmMessage = [mxOlmSession.session encryptMessage:payloadStrings[identityKey] error:&error];
+            }
+            if (!olmMessage.ciphertext)
+            {
+                NSLog(@"[MXOlmDevice] encryptMessages failed for %@: %@", identityKey, error);
+                return;
+            }
+
+            @synchronized (messages)
+            {
+                messages[identityKey] = @{
+                                          @"body": olmMessage.ciphertext,
+                                          @"type": @(olmMessage.type)
+                                          };
+                updatedSessions[identityKey] = mxOlmSession;
+            }
+        }
+    });
+
+    [store performBatchWrites:^{
+        for (NSString *identityKey in updatedSessions)
+        {
+            [self storeSession:updatedSessions[identityKey] forDevice:identityKey];
+        }
+    }];
+
+    NSLog(@"[MXOlmDevice] encryptMessages: Encrypted %tu messages out of %tu in %.0fms", messages.count, identityKeys.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+
+    return messages;
+}
+
 - (NSString*)decryptMessage:(NSString*)ciphertext withType:(NSUInteger)messageType sessionId:(NSString*)sessionId theirDeviceIdentityKey:(NSString*)theirDeviceIdentityKey
 {
     NSError *error;
@@ -268,7 +349,10 @@
     MXOlmSession *mxOlmSession = [self sessionForDevice:theirDeviceIdentityKey andSessionId:sessionId];
     if (mxOlmSession)
     {
-        payloadString = [mxOlmSession.session decryptMessage:[[OLMMessage alloc] initWithCiphertext:ciphertext type:messageType] error:&error];
+        @synchronized (mxOlmSession)
+        {
+            payloadString = [mxOlmSession.session decryptMessage:[[OLMMessage alloc] initWithCiphertext:ciphertext type:messageType] error:&error];
+        }
 
         if (error)
         {
@@ -276,7 +360,7 @@
         }
 
         [mxOlmSession didReceiveMessage];
-        [store storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
+        [self storeSession:mxOlmSession forDevice:theirDeviceIdentityKey];
     }
 
     return payloadString;
@@ -290,7 +374,10 @@
     }
 
     MXOlmSession *mxOlmSession = [self sessionForDevice:theirDeviceIdentityKey andSessionId:sessionId];
-    return [mxOlmSession.session matchesInboundSession:ciphertext];
+    @synchronized (mxOlmSession)
+    {
+        return [mxOlmSession.session matchesInboundSession:ciphertext];
+    }
 }
 
 
@@ -318,6 +405,16 @@
     return [outboundGroupSessionStore[sessionId] encryptMessage:payloadString error:nil];
 }
 
+- (OLMOutboundGroupSession *)outboundGroupSessionWithId:(NSString *)sessionId
+{
+    return outboundGroupSessionStore[sessionId];
+}
+
+- (void)addOutboundGroupSession:(OLMOutboundGroupSession *)session
+{
+    outboundGroupSessionStore[session.sessionIdentifier] = session;
+}
+
 
 #pragma mark - Inbound group session
 - (BOOL)addInboundGroupSession:(NSString*)sessionId sessionKey:(NSString*)sessionKey
@@ -419,23 +516,37 @@
     if (session)
     {
         NSUInteger messageIndex;
-        NSString *payloadString = [session.session decryptMessage:body messageIndex:&messageIndex error:error];
+        NSString *payloadString;
+
+        // The store may share this object between threads
+        @synchronized (session)
+        {
+            payloadString = [session decryptMessage:body messageIndex:&messageIndex error:error];
+        }
 
-        [store storeInboundGroupSessions:@[session]];
+        // Decryption rarely modifies the session. Do not rewrite it for nothing
+        if (session.isDirty)
+        {
+            NSMutableSet<MXOlmInboundGroupSession*> *dirtySessions = NSThread.currentThread.threadDictionary[dirtyInboundGroupSessionsThreadKey];
+            if (dirtySessions)
+            {
+                // Stored at the end of performGroupDecryptions:
+                [dirtySessions addObject:session];
+            }
+            else
+            {
+                [store storeInboundGroupSessions:@[session]];
+            }
+        }
 
         if (payloadString)
         {
             // Check if we have seen this message index before to detect replay attacks.
             if (timeline)
             {
-                if (!inboundGroupSessionMessageIndexes[timeline])
-                {
-                    inboundGroupSessionMessageIndexes[timeline] = [NSMutableDictionary dictionary];
-                }
-
-                NSString *messageIndexKey = [NSString stringWithFormat:@"%@|%@|%tu", senderKey, sessionId, messageIndex];
-                if (inboundGroupSessionMessageIndexes[timeline][messageIndexKey])
+                if (![inboundGroupSessionMessageIndexes addMessageIndex:messageIndex ofSession:sessionId senderKey:senderKey inTimeline:timeline])
                 {
+                    NSString *messageIndexKey = [NSString stringWithFormat:@"%@|%@|%tu", senderKey, sessionId, messageIndex];
                     NSLog(@"[MXOlmDevice] decryptGroupMessage: Warning: Possible replay attack %@", messageIndexKey);
 
                     if (error)
@@ -449,8 +560,6 @@
 
                     return nil;
                 }
-
-                inboundGroupSessionMessageIndexes[timeline][messageIndexKey] = @(YES);
             }
 
             result = [[MXDecryptionResult alloc] init];
@@ -469,9 +578,44 @@
     return result;
 }
 
+- (void)performGroupDecryptions:(void (^)(void))decryptions
+{
+    NSMutableDictionary *threadDictionary = NSThread.currentThread.threadDictionary;
+    if (threadDictionary[dirtyInboundGroupSessionsThreadKey])
+    {
+        // Join the outer call
+        decryptions();
+        return;
+    }
+
+    NSMutableSet<MXOlmInboundGroupSession*> *dirtySessions = [NSMutableSet set];
+    threadDictionary[dirtyInboundGroupSessionsThreadKey] = dirtySessions;
+
+    decryptions();
+
+    [threadDictionary removeObjectForKey:dirtyInboundGroupSessionsThreadKey];
+
+    NSMutableArray<MXOlmInboundGroupSession*> *sessionsToStore = [NSMutableArray arrayWithCapacity:dirtySessions.count];
+    for (MXOlmInboundGroupSession *session in dirtySessions)
+    {
+        // Skip sessions already stored from another thread or replaced meanwhile by a key
+        // import or a key forward. The changes made by decryptions are only a cache
+        if (session.isDirty
+            && [store inboundGroupSessionWithId:session.session.sessionIdentifier andSenderKey:session.senderKey] == session)
+        {
+            [sessionsToStore addObject:session];
+        }
+    }
+
+    if (sessionsToStore.count)
+    {
+        [store storeInboundGroupSessions:sessionsToStore];
+    }
+}
+
 - (void)resetReplayAttackCheckInTimeline:(NSString*)timeline
 {
-    [inboundGroupSessionMessageIndexes removeObjectForKey:timeline];
+    [inboundGroupSessionMessageIndexes removeTimeline:timeline];
 }
 
 /**
@@ -559,7 +703,11 @@
         NSDictionary *claimedKeys = session.keysClaimed;
         NSString *senderEd25519Key = claimedKeys[@"ed25519"];
 
-        MXMegolmSessionData *sessionData = [session exportSessionDataAtMessageIndex:[messageIndex unsignedIntegerValue]];
+        MXMegolmSessionData *sessionData;
+        @synchronized (session)
+        {
+            sessionData = [session exportSessionDataAtMessageIndex:[messageIndex unsignedIntegerValue]];
+        }
         NSArray<NSString*> *forwardingCurve25519KeyChain = sessionData.forwardingCurve25519KeyChain;
 
         inboundGroupSessionKey = @{
@@ -587,7 +735,10 @@
 
 - (BOOL)verifySignature:(NSString *)key JSON:(NSDictionary *)JSONDictinary signature:(NSString *)signature error:(NSError *__autoreleasing *)error
 {
-    return [olmUtility verifyEd25519Signature:signature key:key message:[MXCryptoTools canonicalJSONDataForJSON:JSONDictinary] error:error];
+    // OLMUtility stores the last error. Use a dedicated instance so that signatures
+    // can be verified from several threads at the same time
+    OLMUtility *utility = [[OLMUtility alloc] init];
+    return [utility verifyEd25519Signature:signature key:key message:[MXCryptoTools canonicalJSONDataForJSON:JSONDictinary] error:error];
 }
 
 - (NSString *)sha256:(NSString *)message
@@ -599,7 +750,139 @@
 #pragma mark - Private methods
 - (MXOlmSession*)sessionForDevice:(NSString *)theirDeviceIdentityKey andSessionId:(NSString*)sessionId
 {
-    return [store sessionWithDevice:theirDeviceIdentityKey andSessionId:sessionId];
+    NSString *cacheKey = [self olmSessionKeyWithDevice:theirDeviceIdentityKey andSessionId:sessionId];
+
+    MXOlmSession *mxOlmSession = [olmSessionsCache objectForKey:cacheKey];
+    if (!mxOlmSession)
+    {
+        mxOlmSession = [store sessionWithDevice:theirDeviceIdentityKey andSessionId:sessionId];
+        if (mxOlmSession)
+        {
+            [olmSessionsCache setObject:mxOlmSession forKey:cacheKey];
+        }
+    }
+
+    return mxOlmSession;
+}
+
+/**
+ Store an olm session and update the in-memory index of olm sessions.
+
+ @param session the session to store.
+ @param deviceKey the Curve25519 identity key of the remote device.
+ */
+- (void)storeSession:(MXOlmSession*)session forDevice:(NSString*)deviceKey
+{
+    [store storeSession:session forDevice:deviceKey];
+
+    NSString *sessionId = session.session.sessionIdentifier;
+    NSString *sessionKey = [self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId];
+
+    [olmSessionsCache setObject:session forKey:sessionKey];
+
+    @synchronized (olmSessionIdsByDevice)
+    {
+        // If the index of this device is not loaded yet, it will be read from the store
+        // that is now up-to-date. If it is being loaded, the store may have been read before
+        // this session was written: let the loading merge it
+        NSMutableArray<NSString*> *sessionIds = olmSessionIdsByDevice[deviceKey];
+        if (!sessionIds)
+        {
+            olmSessionsStoredDuringIndexLoad[deviceKey][sessionId] = @(session.lastReceivedMessageTs);
+        }
+        else
+        {
+            [sessionIds removeObject:sessionId];
+            olmSessionsLastReceivedMessageTs[sessionKey] = @(session.lastReceivedMessageTs);
+
+            // Keep the list sorted, the most recent first. This is an insertion at the head
+            // in the common case of a session that has just received a message
+            NSUInteger index = [sessionIds indexOfObject:sessionId
+                                           inSortedRange:NSMakeRange(0, sessionIds.count)
+                                                 options:NSBinarySearchingInsertionIndex | NSBinarySearchingFirstEqual
+                                         usingComparator:^NSComparisonResult(NSString *sessionId1, NSString *sessionId2) {
+                                             NSNumber *ts1 = self->olmSessionsLastReceivedMessageTs[[self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId1]];
+                                             NSNumber *ts2 = self->olmSessionsLastReceivedMessageTs[[self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId2]];
+                                             return [ts2 compare:ts1];
+                                         }];
+            [sessionIds insertObject:sessionId atIndex:index];
+        }
+    }
+}
+
+/**
+ Get the ids of the olm sessions of a device, the session that has most recently
+ received a message first.
+
+ @param deviceKey the Curve25519 identity key of the remote device.
+ @return the session ids.
+ */
+- (NSArray<NSString*>*)sortedSessionIdsForDevice:(NSString*)deviceKey
+{
+    @synchronized (olmSessionIdsByDevice)
+    {
+        NSMutableArray<NSString*> *sessionIds = olmSessionIdsByDevice[deviceKey];
+        if (sessionIds)
+        {
+            return [sessionIds copy];
+        }
+
+        if (!olmSessionsStoredDuringIndexLoad[deviceKey])
+        {
+            olmSessionsStoredDuringIndexLoad[deviceKey] = [NSMutableDictionary dictionary];
+        }
+    }
+
+    // Build the index of this device from the store, out of the lock because it unpickles all sessions
+    NSArray<MXOlmSession*> *sessions = [store sessionsWithDevice:deviceKey];
+
+    NSMutableArray<NSString*> *sessionIds = [NSMutableArray arrayWithCapacity:sessions.count];
+    NSMutableDictionary<NSString*, NSNumber*> *lastReceivedMessageTs = [NSMutableDictionary dictionaryWithCapacity:sessions.count];
+    for (MXOlmSession *session in sessions)
+    {
+        NSString *sessionId = session.session.sessionIdentifier;
+        [sessionIds addObject:sessionId];
+        lastReceivedMessageTs[[self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId]] = @(session.lastReceivedMessageTs);
+    }
+
+    @synchronized (olmSessionIdsByDevice)
+    {
+        // Another thread may have built it in the meantime
+        if (!olmSessionIdsByDevice[deviceKey])
+        {
+            // Merge sessions stored while the store was read
+            NSDictionary<NSString*, NSNumber*> *storedSessions = olmSessionsStoredDuringIndexLoad[deviceKey];
+            if (storedSessions.count)
+            {
+                for (NSString *sessionId in storedSessions)
+                {
+                    NSString *sessionKey = [self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId];
+                    if (!lastReceivedMessageTs[sessionKey])
+                    {
+                        [sessionIds addObject:sessionId];
+                    }
+                    lastReceivedMessageTs[sessionKey] = storedSessions[sessionId];
+                }
+
+                [sessionIds sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSString *sessionId1, NSString *sessionId2) {
+                    NSNumber *ts1 = lastReceivedMessageTs[[self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId1]];
+                    NSNumber *ts2 = lastReceivedMessageTs[[self olmSessionKeyWithDevice:deviceKey andSessionId:sessionId2]];
+                    return [ts2 compare:ts1];
+                }];
+            }
+            [olmSessionsStoredDuringIndexLoad removeObjectForKey:deviceKey];
+
+            olmSessionIdsByDevice[deviceKey] = sessionIds;
+            [olmSessionsLastReceivedMessageTs addEntriesFromDictionary:lastReceivedMessageTs];
+        }
+
+        return [olmSessionIdsByDevice[deviceKey] copy];
+    }
+}
+
+- (NSString*)olmSessionKeyWithDevice:(NSString*)deviceKey andSessionId:(NSString*)sessionId
+{
+    return [NSString stringWithFormat:@"%@|%@", deviceKey, sessionId];
 }
 
 @end
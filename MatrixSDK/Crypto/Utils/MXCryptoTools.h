@@ -24,6 +24,7 @@ NS_ASSUME_NONNULL_BEGIN
  Get the canonical serialisation of a JSON dictionary.
 
  This ensures that a JSON has the same string representation cross platforms.
+ See https://matrix.org/docs/spec/appendices#canonical-json.
 
  @param JSONDictinary the JSON to convert.
  @return the canonical serialisation of the JSON.
@@ -34,6 +35,8 @@ NS_ASSUME_NONNULL_BEGIN
 /**
  Get the canonical serialisation of a JSON dictionary.
 
+ The UTF-8 data is written directly, without an intermediate string.
+
  @param JSONDictinary the JSON to convert.
  @return the canonical serialisation of the JSON in NSData format.
  */
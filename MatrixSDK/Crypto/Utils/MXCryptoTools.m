@@ -16,32 +16,250 @@
 
 #import "MXCryptoTools.h"
 
-#import "NSObject+sortedKeys.h"
 
-@implementation MXCryptoTools
+#pragma mark - Canonical JSON writer
 
-+ (nullable NSString *)canonicalJSONStringForJSON:(NSDictionary *)JSONDictinary
+/**
+ Append the canonical JSON serialisation of a JSON object to a buffer.
+
+ Keys of dictionaries are sorted by Unicode code point, which is the order of their
+ UTF-8 bytes. There is no whitespace. Only '"', '\' and control characters are escaped
+ in strings.
+
+ @return NO if the object cannot be serialised in JSON.
+ */
+static BOOL MXCryptoToolsAppendCanonicalJSON(NSMutableData *buffer, id object);
+
+static void MXCryptoToolsAppendBytes(NSMutableData *buffer, const char *bytes)
+{
+    [buffer appendBytes:bytes length:strlen(bytes)];
+}
+
+static BOOL MXCryptoToolsAppendCanonicalJSONString(NSMutableData *buffer, NSString *string)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    const char *bytes = string.UTF8String;
+    if (!bytes)
+    {
+        // Not valid Unicode
+        return NO;
+    }
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+
+    [buffer appendBytes:"\"" length:1];
+
+    // Append runs of characters that do not need escaping in one go
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)bytes[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        [buffer appendBytes:bytes + runStart length:i - runStart];
+        runStart = i + 1;
+
+        switch (c)
+        {
+            case '"':  [buffer appendBytes:"\\\"" length:2]; break;
+            case '\\': [buffer appendBytes:"\\\\" length:2]; break;
+            case '\b': [buffer appendBytes:"\\b" length:2]; break;
+            case '\f': [buffer appendBytes:"\\f" length:2]; break;
+            case '\n': [buffer appendBytes:"\\n" length:2]; break;
+            case '\r': [buffer appendBytes:"\\r" length:2]; break;
+            case '\t': [buffer appendBytes:"\\t" length:2]; break;
+            default:
+            {
+                char escaped[] = {'\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF]};
+                [buffer appendBytes:escaped length:sizeof(escaped)];
+                break;
+            }
+        }
+    }
+    [buffer appendBytes:bytes + runStart length:length - runStart];
+
+    [buffer appendBytes:"\"" length:1];
+    return YES;
+}
+
+static BOOL MXCryptoToolsAppendCanonicalJSONNumber(NSMutableData *buffer, NSNumber *number)
+{
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID())
+    {
+        MXCryptoToolsAppendBytes(buffer, number.boolValue ? "true" : "false");
+        return YES;
+    }
+
+    char digits[32];
+    switch (number.objCType[0])
+    {
+        case 'c':
+        case 'i':
+        case 's':
+        case 'l':
+        case 'q':
+            snprintf(digits, sizeof(digits), "%lld", number.longLongValue);
+            MXCryptoToolsAppendBytes(buffer, digits);
+            return YES;
+
+        case 'C':
+        case 'I':
+        case 'S':
+        case 'L':
+        case 'Q':
+            snprintf(digits, sizeof(digits), "%llu", number.unsignedLongLongValue);
+            MXCryptoToolsAppendBytes(buffer, digits);
+            return YES;
+
+        default:
+        {
+            // Canonical JSON has no floating point numbers. Keep the NSJSONSerialization formatting for them
+            NSData *arrayData = [NSJSONSerialization dataWithJSONObject:@[number] options:0 error:nil];
+            if (arrayData.length < 2)
+            {
+                return NO;
+            }
+
+            // Strip "[" and "]"
+            [buffer appendBytes:(const char*)arrayData.bytes + 1 length:arrayData.length - 2];
+            return YES;
+        }
+    }
+}
+
+static BOOL MXCryptoToolsAppendCanonicalJSONDictionary(NSMutableData *buffer, NSDictionary *dictionary)
+{
+    for (id key in dictionary)
+    {
+        if (![key isKindOfClass:NSString.class] || !((NSString*)key).UTF8String)
+        {
+            return NO;
+        }
+    }
+
+    NSArray<NSString*> *keys = [dictionary.allKeys sortedArrayUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+
+        const char *bytes1 = key1.UTF8String;
+        const char *bytes2 = key2.UTF8String;
+        NSUInteger length1 = [key1 lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        NSUInteger length2 = [key2 lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+
+        int result = memcmp(bytes1, bytes2, MIN(length1, length2));
+        if (result == 0)
+        {
+            return length1 == length2 ? NSOrderedSame : (length1 < length2 ? NSOrderedAscending : NSOrderedDescending);
+        }
+        return result < 0 ? NSOrderedAscending : NSOrderedDescending;
+    }];
+
+    [buffer appendBytes:"{" length:1];
+
+    BOOL first = YES;
+    for (NSString *key in keys)
+    {
+        if (!first)
+        {
+            [buffer appendBytes:"," length:1];
+        }
+        first = NO;
+
+        MXCryptoToolsAppendCanonicalJSONString(buffer, key);
+        [buffer appendBytes:":" length:1];
+
+        if (!MXCryptoToolsAppendCanonicalJSON(buffer, dictionary[key]))
+        {
+            return NO;
+        }
+    }
+
+    [buffer appendBytes:"}" length:1];
+    return YES;
+}
+
+static BOOL MXCryptoToolsAppendCanonicalJSONArray(NSMutableData *buffer, NSArray *array)
 {
-    NSString *unescapedCanonicalJSON;
+    [buffer appendBytes:"[" length:1];
+
+    BOOL first = YES;
+    for (id object in array)
+    {
+        if (!first)
+        {
+            [buffer appendBytes:"," length:1];
+        }
+        first = NO;
 
-    NSData *canonicalJSONData = [NSJSONSerialization dataWithJSONObject:[JSONDictinary objectWithSortedKeys] options:0 error:nil];
+        if (!MXCryptoToolsAppendCanonicalJSON(buffer, object))
+        {
+            return NO;
+        }
+    }
 
-    // NSJSONSerialization escapes the '/' character in base64 strings which is useless in our case
-    // and does not match with other platforms.
-    // Remove this escaping
+    [buffer appendBytes:"]" length:1];
+    return YES;
+}
 
-    if (canonicalJSONData)
+static BOOL MXCryptoToolsAppendCanonicalJSON(NSMutableData *buffer, id object)
+{
+    if ([object isKindOfClass:NSString.class])
+    {
+        return MXCryptoToolsAppendCanonicalJSONString(buffer, object);
+    }
+    else if ([object isKindOfClass:NSDictionary.class])
+    {
+        return MXCryptoToolsAppendCanonicalJSONDictionary(buffer, object);
+    }
+    else if ([object isKindOfClass:NSArray.class])
+    {
+        return MXCryptoToolsAppendCanonicalJSONArray(buffer, object);
+    }
+    else if ([object isKindOfClass:NSNumber.class])
     {
-        unescapedCanonicalJSON = [[NSString alloc] initWithData:canonicalJSONData encoding:NSUTF8StringEncoding];
-        unescapedCanonicalJSON = [unescapedCanonicalJSON stringByReplacingOccurrencesOfString:@"\\/" withString:@"/"];
+        return MXCryptoToolsAppendCanonicalJSONNumber(buffer, object);
+    }
+    else if ([object isKindOfClass:NSNull.class])
+    {
+        MXCryptoToolsAppendBytes(buffer, "null");
+        return YES;
     }
 
-    return unescapedCanonicalJSON;
+    return NO;
+}
+
+
+#pragma mark - MXCryptoTools
+
+@implementation MXCryptoTools
+
++ (nullable NSString *)canonicalJSONStringForJSON:(NSDictionary *)JSONDictinary
+{
+    NSData *canonicalJSONData = [self canonicalJSONDataForJSON:JSONDictinary];
+    if (!canonicalJSONData)
+    {
+        return nil;
+    }
+
+    return [[NSString alloc] initWithData:canonicalJSONData encoding:NSUTF8StringEncoding];
 }
 
 + (nullable NSData *)canonicalJSONDataForJSON:(NSDictionary *)JSONDictinary
 {
-    return [[self canonicalJSONStringForJSON:JSONDictinary] dataUsingEncoding:NSUTF8StringEncoding];
+    if (![JSONDictinary isKindOfClass:NSDictionary.class])
+    {
+        return nil;
+    }
+
+    NSMutableData *buffer = [NSMutableData dataWithCapacity:256];
+    if (!MXCryptoToolsAppendCanonicalJSONDictionary(buffer, JSONDictinary))
+    {
+        NSLog(@"[MXCryptoTools] canonicalJSONDataForJSON: Invalid JSON object");
+        return nil;
+    }
+
+    return buffer;
 }
 
 @end
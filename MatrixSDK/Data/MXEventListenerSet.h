@@ -0,0 +1,71 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "MXEventListener.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXEventListenerSet` is a set of `MXEventListener` objects indexed by event type.
+
+ Listeners are stored in an immutable snapshot that is replaced on every add or remove.
+ Notifying an event does not copy the listeners: it only reads the current snapshot and
+ calls the listeners registered for the event type and the ones listening to all events,
+ in their registration order.
+
+ Like before, a listener removed while an event is notified is not called anymore and a
+ listener added while an event is notified is called from the next event.
+ */
+@interface MXEventListenerSet : NSObject
+
+/**
+ Register a listener.
+
+ @param listener the listener to add.
+ */
+- (void)addListener:(MXEventListener*)listener;
+
+/**
+ Unregister a listener.
+
+ @param listener the listener to remove.
+ */
+- (void)removeListener:(MXEventListener*)listener;
+
+/**
+ Unregister all listeners.
+ */
+- (void)removeAllListeners;
+
+/**
+ The registered listeners, in registration order.
+ */
+@property (nonatomic, readonly) NSArray<MXEventListener*> *listeners;
+
+/**
+ Call the listeners that listen to the type of an event.
+
+ @param event the event.
+ @param direction the origin of the event.
+ @param customObject the object to pass to listeners.
+ */
+- (void)notifyListeners:(MXEvent*)event direction:(MXTimelineDirection)direction customObject:(nullable id)customObject;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,230 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXEventListenerSet.h"
+
+#pragma mark - MXEventListenerSetEntry
+
+@interface MXEventListenerSetEntry : NSObject
+{
+    @public
+    MXEventListener *listener;
+
+    // The registration order of the listener
+    NSUInteger order;
+}
+@end
+
+@implementation MXEventListenerSetEntry
+@end
+
+
+#pragma mark - MXEventListenerSetSnapshot
+
+/**
+ An immutable state of the set.
+ */
+@interface MXEventListenerSetSnapshot : NSObject
+{
+    @public
+    // All entries, by registration order
+    NSArray<MXEventListenerSetEntry*> *entries;
+
+    // Entries of listeners with event types, by event type and registration order
+    NSDictionary<NSString*, NSArray<MXEventListenerSetEntry*>*> *entriesByEventType;
+
+    // Entries of listeners to all events, by registration order
+    NSArray<MXEventListenerSetEntry*> *wildcardEntries;
+
+    NSSet<MXEventListener*> *listeners;
+
+    NSUInteger nextOrder;
+}
+
+- (instancetype)initWithEntries:(NSArray<MXEventListenerSetEntry*>*)entries nextOrder:(NSUInteger)nextOrder;
+
+@end
+
+@implementation MXEventListenerSetSnapshot
+
+- (instancetype)initWithEntries:(NSArray<MXEventListenerSetEntry *> *)theEntries nextOrder:(NSUInteger)theNextOrder
+{
+    self = [super init];
+    if (self)
+    {
+        entries = theEntries;
+        nextOrder = theNextOrder;
+
+        NSMutableDictionary<NSString*, NSMutableArray<MXEventListenerSetEntry*>*> *theEntriesByEventType = [NSMutableDictionary dictionary];
+        NSMutableArray<MXEventListenerSetEntry*> *theWildcardEntries = [NSMutableArray array];
+        NSMutableSet<MXEventListener*> *theListeners = [NSMutableSet setWithCapacity:entries.count];
+
+        for (MXEventListenerSetEntry *entry in entries)
+        {
+            [theListeners addObject:entry->listener];
+
+            NSArray<MXEventTypeString> *eventTypes = entry->listener.eventTypes;
+            if (!eventTypes)
+            {
+                [theWildcardEntries addObject:entry];
+                continue;
+            }
+
+            // A listener is called once even if an event type is repeated
+            for (MXEventTypeString eventType in [NSSet setWithArray:eventTypes])
+            {
+                NSMutableArray<MXEventListenerSetEntry*> *eventTypeEntries = theEntriesByEventType[eventType];
+                if (!eventTypeEntries)
+                {
+                    eventTypeEntries = [NSMutableArray array];
+                    theEntriesByEventType[eventType] = eventTypeEntries;
+                }
+                [eventTypeEntries addObject:entry];
+            }
+        }
+
+        entriesByEventType = theEntriesByEventType;
+        wildcardEntries = theWildcardEntries;
+        listeners = theListeners;
+    }
+    return self;
+}
+
+@end
+
+
+#pragma mark - MXEventListenerSet
+
+@interface MXEventListenerSet ()
+
+// The current state. Readers get it without locking. Writers replace it under @synchronized
+@property (atomic) MXEventListenerSetSnapshot *snapshot;
+
+@end
+
+@implementation MXEventListenerSet
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _snapshot = [[MXEventListenerSetSnapshot alloc] initWithEntries:@[] nextOrder:0];
+    }
+    return self;
+}
+
+- (void)addListener:(MXEventListener *)listener
+{
+    if (!listener)
+    {
+        return;
+    }
+
+    @synchronized (self)
+    {
+        MXEventListenerSetSnapshot *snapshot = self.snapshot;
+
+        MXEventListenerSetEntry *entry = [[MXEventListenerSetEntry alloc] init];
+        entry->listener = listener;
+        entry->order = snapshot->nextOrder;
+
+        self.snapshot = [[MXEventListenerSetSnapshot alloc] initWithEntries:[snapshot->entries arrayByAddingObject:entry]
+                                                                  nextOrder:snapshot->nextOrder + 1];
+    }
+}
+
+- (void)removeListener:(MXEventListener *)listener
+{
+    @synchronized (self)
+    {
+        MXEventListenerSetSnapshot *snapshot = self.snapshot;
+        if (!listener || ![snapshot->listeners containsObject:listener])
+        {
+            return;
+        }
+
+        NSMutableArray<MXEventListenerSetEntry*> *entries = [NSMutableArray arrayWithCapacity:snapshot->entries.count];
+        for (MXEventListenerSetEntry *entry in snapshot->entries)
+        {
+            if (entry->listener != listener)
+            {
+                [entries addObject:entry];
+            }
+        }
+
+        self.snapshot = [[MXEventListenerSetSnapshot alloc] initWithEntries:entries nextOrder:snapshot->nextOrder];
+    }
+}
+
+- (void)removeAllListeners
+{
+    @synchronized (self)
+    {
+        self.snapshot = [[MXEventListenerSetSnapshot alloc] initWithEntries:@[] nextOrder:self.snapshot->nextOrder];
+    }
+}
+
+- (NSArray<MXEventListener *> *)listeners
+{
+    NSArray<MXEventListenerSetEntry*> *entries = self.snapshot->entries;
+
+    NSMutableArray<MXEventListener*> *listeners = [NSMutableArray arrayWithCapacity:entries.count];
+    for (MXEventListenerSetEntry *entry in entries)
+    {
+        [listeners addObject:entry->listener];
+    }
+    return listeners;
+}
+
+- (void)notifyListeners:(MXEvent *)event direction:(MXTimelineDirection)direction customObject:(id)customObject
+{
+    MXEventListenerSetSnapshot *snapshot = self.snapshot;
+
+    NSArray<MXEventListenerSetEntry*> *eventTypeEntries = event.type ? snapshot->entriesByEventType[event.type] : nil;
+    NSArray<MXEventListenerSetEntry*> *wildcardEntries = snapshot->wildcardEntries;
+
+    NSUInteger eventTypeEntriesCount = eventTypeEntries.count;
+    NSUInteger wildcardEntriesCount = wildcardEntries.count;
+
+    // Merge both lists to call listeners in their registration order
+    NSUInteger i = 0, j = 0;
+    while (i < eventTypeEntriesCount || j < wildcardEntriesCount)
+    {
+        MXEventListenerSetEntry *entry;
+        if (j == wildcardEntriesCount
+            || (i < eventTypeEntriesCount && eventTypeEntries[i]->order < wildcardEntries[j]->order))
+        {
+            entry = eventTypeEntries[i++];
+        }
+        else
+        {
+            entry = wildcardEntries[j++];
+        }
+
+        // A previous listener may have removed this one
+        MXEventListenerSetSnapshot *currentSnapshot = self.snapshot;
+        if (currentSnapshot != snapshot && ![currentSnapshot->listeners containsObject:entry->listener])
+        {
+            continue;
+        }
+
+        // The event type has already been checked
+        entry->listener.listenerBlock(event, direction, customObject);
+    }
+}
+
+@end
@@ -209,6 +209,16 @@ typedef void (^MXOnRoomEvent)(MXEvent *event, MXTimelineDirection direction, MXR
  */
 - (void)handleJoinedRoomSync:(MXRoomSync*)roomSync;
 
+/**
+ Same as `handleJoinedRoomSync:`.
+
+ @param roomSync information to sync the room with the home server data
+ @param decryptionAttempted YES if the timeline events of `roomSync` have already gone through
+                            [MXSession decryptEvents:inTimeline:onComplete:] with this timeline.
+                            Events that are still encrypted are then not decrypted again.
+ */
+- (void)handleJoinedRoomSync:(MXRoomSync*)roomSync decryptionAttempted:(BOOL)decryptionAttempted;
+
 /**
  For live timeline, update invited room state according to the received /sync response.
 
@@ -28,13 +28,14 @@
 #import "MXTools.h"
 
 #import "MXEventsEnumeratorOnArray.h"
+#import "MXEventListenerSet.h"
 
 NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
 
 @interface MXEventTimeline ()
 {
     // The list of event listeners (`MXEventListener`) of this timeline.
-    NSMutableArray<MXEventListener *> *eventListeners;
+    MXEventListenerSet *eventListeners;
 
     // The historical state of the room when paginating back.
     MXRoomState *backState;
@@ -45,6 +46,13 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
     // room members state events).
     MXRoomState *previousState;
 
+    // The forward state events handled while a chunk of events (the room part of a /sync
+    // response or a pagination response) is being processed.
+    // The room summary is updated once with all of them at the end of the chunk.
+    // nil when no chunk is being processed.
+    NSMutableArray<MXEvent *> *stateEventsBatch;
+    NSUInteger stateEventsBatchDepth;
+
     // The associated room.
     __weak MXRoom *room;
 
@@ -97,7 +105,7 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         _initialEventId = initialEventId;
         room = theRoom;
         store = theStore;
-        eventListeners = [NSMutableArray array];
+        eventListeners = [[MXEventListenerSet alloc] init];
 
         if (!initialEventId)
         {
@@ -199,33 +207,59 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
     hasReachedHomeServerForwardsPaginationEnd = NO;
 
     // Get the context around the initial event
+    // The operation is checked after decryption because it may have been cancelled meanwhile
+    MXHTTPOperation *operation;
+    __block __weak MXHTTPOperation *weakOperation;
+
     MXWeakify(self);
-    return [room.mxSession.matrixRestClient contextOfEvent:_initialEventId inRoom:room.roomId limit:limit filter:_roomEventFilter success:^(MXEventContext *eventContext) {
+    operation = [room.mxSession.matrixRestClient contextOfEvent:_initialEventId inRoom:room.roomId limit:limit filter:_roomEventFilter success:^(MXEventContext *eventContext) {
         MXStrongifyAndReturnIfNil(self);
 
-        // And fill the timelime with received data
-        [self initialiseState:eventContext.state];
+        // Decrypt events before adding them to the timeline, without blocking the main thread
+        NSMutableArray<MXEvent*> *events = [NSMutableArray arrayWithArray:eventContext.eventsBefore];
+        [events addObjectsFromArray:eventContext.eventsAfter];
+        if (eventContext.event)
+        {
+            [events addObject:eventContext.event];
+        }
 
-        // Reset pagination state from here
-        [self resetPagination];
+        MXWeakify(self);
+        [self->room.mxSession decryptEvents:events inTimeline:self->_timelineId onComplete:^(NSArray<MXEvent *> *failedEvents) {
+            MXStrongifyAndReturnIfNil(self);
 
-        [self addEvent:eventContext.event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:NO];
+            if (weakOperation.isCancelled)
+            {
+                NSLog(@"[MXEventTimeline] resetPaginationAroundInitialEventWithLimit: cancelled");
+                return;
+            }
 
-        for (MXEvent *event in eventContext.eventsBefore)
-        {
-            [self addEvent:event direction:MXTimelineDirectionBackwards fromStore:NO isRoomInitialSync:NO];
-        }
+            // And fill the timelime with received data
+            [self initialiseState:eventContext.state];
 
-        for (MXEvent *event in eventContext.eventsAfter)
-        {
-            [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:NO];
-        }
+            // Reset pagination state from here
+            [self resetPagination];
+
+            [self addEvent:eventContext.event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:NO decryptionAttempted:YES];
+
+            for (MXEvent *event in eventContext.eventsBefore)
+            {
+                [self addEvent:event direction:MXTimelineDirectionBackwards fromStore:NO isRoomInitialSync:NO decryptionAttempted:YES];
+            }
 
-        [self->store storePaginationTokenOfRoom:self->room.roomId andToken:eventContext.start];
-        self->forwardsPaginationToken = eventContext.end;
+            for (MXEvent *event in eventContext.eventsAfter)
+            {
+                [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:NO decryptionAttempted:YES];
+            }
+
+            [self->store storePaginationTokenOfRoom:self->room.roomId andToken:eventContext.start];
+            self->forwardsPaginationToken = eventContext.end;
 
-        success();
+            success();
+        }];
     } failure:failure];
+
+    weakOperation = operation;
+    return operation;
 }
 
 
@@ -314,23 +348,38 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
 
     NSLog(@"[MXEventTimeline] paginate : request %tu messages from the server", numItems);
 
+    // The operation is checked after decryption because it may have been cancelled meanwhile
+    __block __weak MXHTTPOperation *weakOperation;
+
     MXWeakify(self);
     operation = [room.mxSession.matrixRestClient messagesForRoom:_state.roomId from:paginationToken direction:direction limit:numItems filter:_roomEventFilter success:^(MXPaginationResponse *paginatedResponse) {
         MXStrongifyAndReturnIfNil(self);
 
         NSLog(@"[MXEventTimeline] paginate : got %tu messages from the server", paginatedResponse.chunk.count);
 
-        // Check if the room has not been left while waiting for the response
-        if ([self->room.mxSession hasRoomWithRoomId:self->room.roomId]
-            || [self->room.mxSession isPeekingInRoomWithRoomId:self->room.roomId])
-        {
-            [self handlePaginationResponse:paginatedResponse direction:direction];
-        }
+        // Decrypt events before adding them to the timeline, without blocking the main thread
+        MXWeakify(self);
+        [self->room.mxSession decryptEvents:paginatedResponse.chunk inTimeline:self->_timelineId onComplete:^(NSArray<MXEvent *> *failedEvents) {
+            MXStrongifyAndReturnIfNil(self);
 
-        // Inform the method caller
-        complete();
+            if (weakOperation.isCancelled)
+            {
+                NSLog(@"[MXEventTimeline] paginate: cancelled");
+                return;
+            }
 
-        NSLog(@"[MXEventTimeline] paginate: is done");
+            // Check if the room has not been left while waiting for the response
+            if ([self->room.mxSession hasRoomWithRoomId:self->room.roomId]
+                || [self->room.mxSession isPeekingInRoomWithRoomId:self->room.roomId])
+            {
+                [self handlePaginationResponse:paginatedResponse direction:direction];
+            }
+
+            // Inform the method caller
+            complete();
+
+            NSLog(@"[MXEventTimeline] paginate: is done");
+        }];
 
     } failure:^(NSError *error) {
         MXStrongifyAndReturnIfNil(self);
@@ -360,6 +409,8 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         failure(error);
     }];
 
+    weakOperation = operation;
+
     if (messagesFromStoreCount)
     {
         // Disable retry to let the caller handle messages from store without delay.
@@ -378,6 +429,11 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
 
 #pragma mark - Homeserver responses handling
 - (void)handleJoinedRoomSync:(MXRoomSync *)roomSync
+{
+    [self handleJoinedRoomSync:roomSync decryptionAttempted:NO];
+}
+
+- (void)handleJoinedRoomSync:(MXRoomSync *)roomSync decryptionAttempted:(BOOL)decryptionAttempted
 {
     // Is it an initial sync for this room?
     BOOL isRoomInitialSync = (room.summary.membership == MXMembershipUnknown || room.summary.membership == MXMembershipInvite);
@@ -397,6 +453,8 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         room.summary.membership = MXMembershipJoin;
     }
 
+    [self beginStateEventsBatch];
+
     // Build/Update first the room state corresponding to the 'start' of the timeline.
     // Note: We consider it is not required to clone the existing room state here, because no notification is posted for these events.
     for (MXEvent *event in roomSync.state.events)
@@ -416,7 +474,7 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
             event.roomId = _state.roomId;
 
             // Add the event to the end of the timeline
-            [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:isRoomInitialSync];
+            [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:isRoomInitialSync decryptionAttempted:decryptionAttempted];
         }
 
         // Check whether we got all history from the home server
@@ -440,10 +498,12 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
             event.roomId = _state.roomId;
 
             // Add the event to the end of the timeline
-            [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:isRoomInitialSync];
+            [self addEvent:event direction:MXTimelineDirectionForwards fromStore:NO isRoomInitialSync:isRoomInitialSync decryptionAttempted:decryptionAttempted];
         }
     }
 
+    [self endStateEventsBatch];
+
     // In case of limited timeline, update token where to start back pagination
     if (roomSync.timeline.limited)
     {
@@ -517,6 +577,8 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         }
     }
 
+    [self beginStateEventsBatch];
+
     // Process additional state events (this happens in case of lazy loading)
     if (paginatedResponse.state.count)
     {
@@ -548,9 +610,11 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
     for (MXEvent *event in paginatedResponse.chunk)
     {
         // Make sure we have not processed this event yet
-		[self addEvent:event direction:direction fromStore:NO isRoomInitialSync:NO];
+		[self addEvent:event direction:direction fromStore:NO isRoomInitialSync:NO decryptionAttempted:YES];
     }
 
+    [self endStateEventsBatch];
+
     // And update pagination tokens
     if (direction == MXTimelineDirectionBackwards)
     {
@@ -580,6 +644,21 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
  @param isRoomInitialSync YES we are managing the first sync of this room.
  */
 - (void)addEvent:(MXEvent*)event direction:(MXTimelineDirection)direction fromStore:(BOOL)fromStore isRoomInitialSync:(BOOL)isRoomInitialSync
+{
+    [self addEvent:event direction:direction fromStore:fromStore isRoomInitialSync:isRoomInitialSync decryptionAttempted:NO];
+}
+
+/**
+ Add an event to the timeline.
+
+ @param event the event to add.
+ @param direction the direction indicates if the event must added to the start or to the end of the timeline.
+ @param fromStore YES if the messages have been loaded from the store.
+ @param isRoomInitialSync YES we are managing the first sync of this room.
+ @param decryptionAttempted YES if the event has already gone through [MXSession decryptEvents:inTimeline:onComplete:]
+                            with this timeline. An event that is still encrypted is then not decrypted again.
+ */
+- (void)addEvent:(MXEvent*)event direction:(MXTimelineDirection)direction fromStore:(BOOL)fromStore isRoomInitialSync:(BOOL)isRoomInitialSync decryptionAttempted:(BOOL)decryptionAttempted
 {
     // Make sure we have not processed this event yet
     if (fromStore == NO && [store eventExistsWithEventId:event.eventId inRoom:room.roomId])
@@ -596,7 +675,7 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
     }
 
     // Decrypt event if necessary
-    if (event.eventType == MXEventTypeRoomEncrypted)
+    if (event.eventType == MXEventTypeRoomEncrypted && !decryptionAttempted)
     {
 
         NSString *timelineId = _timelineId;
@@ -787,18 +866,64 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         // Forwards events update the current state of the room
         [_state handleStateEvents:stateEvents];
 
-        // Update summary with this state events update
-        [room.summary handleStateEvents:stateEvents];
-
-        if (!room.mxSession.syncWithLazyLoadOfRoomMembers && ![store hasLoadedAllRoomMembersForRoom:room.roomId])
+        if (stateEventsBatch)
+        {
+            // The summary will be updated at the end of the chunk
+            [stateEventsBatch addObjectsFromArray:stateEvents];
+        }
+        else
         {
-            // If there is no lazy loading of room members, consider we have fetched
-            // all of them
-            [store storeHasLoadedAllRoomMembersForRoom:room.roomId andValue:YES];
+            [self updateSummaryWithStateEvents:stateEvents];
         }
     }
 }
 
+- (void)updateSummaryWithStateEvents:(NSArray<MXEvent *> *)stateEvents
+{
+    // Update summary with this state events update
+    [room.summary handleStateEvents:stateEvents];
+
+    if (!room.mxSession.syncWithLazyLoadOfRoomMembers && ![store hasLoadedAllRoomMembersForRoom:room.roomId])
+    {
+        // If there is no lazy loading of room members, consider we have fetched
+        // all of them
+        [store storeHasLoadedAllRoomMembersForRoom:room.roomId andValue:YES];
+    }
+}
+
+/**
+ Start to batch the room summary update of the forward state events of a chunk of events.
+
+ Calls can be nested: only the outermost `endStateEventsBatch` updates the summary.
+ */
+- (void)beginStateEventsBatch
+{
+    if (!stateEventsBatch)
+    {
+        stateEventsBatch = [NSMutableArray array];
+    }
+    stateEventsBatchDepth++;
+}
+
+/**
+ Update the room summary once with all the state events handled since `beginStateEventsBatch`.
+ */
+- (void)endStateEventsBatch
+{
+    if (--stateEventsBatchDepth)
+    {
+        return;
+    }
+
+    NSArray<MXEvent *> *stateEvents = stateEventsBatch;
+    stateEventsBatch = nil;
+
+    if (stateEvents.count)
+    {
+        [self updateSummaryWithStateEvents:stateEvents];
+    }
+}
+
 
 #pragma mark - Events listeners
 - (id)listenToEvents:(MXOnRoomEvent)onEvent
@@ -810,19 +935,19 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
 {
     MXEventListener *listener = [[MXEventListener alloc] initWithSender:self andEventTypes:types andListenerBlock:onEvent];
 
-    [eventListeners addObject:listener];
+    [eventListeners addListener:listener];
 
     return listener;
 }
 
 - (void)removeListener:(id)listener
 {
-    [eventListeners removeObject:listener];
+    [eventListeners removeListener:listener];
 }
 
 - (void)removeAllListeners
 {
-    [eventListeners removeAllObjects];
+    [eventListeners removeAllListeners];
 }
 
 - (void)notifyListeners:(MXEvent*)event direction:(MXTimelineDirection)direction
@@ -846,19 +971,8 @@ NSString *const kMXRoomInviteStateEventIdPrefix = @"invite-";
         }
     }
 
-    // Notify all listeners
-    // The SDK client may remove a listener while calling them by enumeration
-    // So, use a copy of them
-    NSArray<MXEventListener *> *listeners = [eventListeners copy];
-
-    for (MXEventListener *listener in listeners)
-    {
-        // And check the listener still exists before calling it
-        if (NSNotFound != [eventListeners indexOfObject:listener])
-        {
-            [listener notify:event direction:direction andCustomObject:roomState];
-        }
-    }
+    // Notify the listeners of this event type
+    [eventListeners notifyListeners:event direction:direction customObject:roomState];
     
     if (_isLiveTimeline && (direction == MXTimelineDirectionForwards))
     {
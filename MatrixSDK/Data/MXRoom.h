@@ -205,6 +205,12 @@ FOUNDATION_EXPORT NSString *const kMXRoomDidFlushDataNotification;
 
 #pragma mark - Server sync
 
+/**
+ The id of the live timeline.
+ It is available before the live timeline data is loaded.
+ */
+@property (nonatomic, readonly) NSString *liveTimelineId;
+
 /**
  Update room data according to the provided sync response.
  
@@ -212,6 +218,15 @@ FOUNDATION_EXPORT NSString *const kMXRoomDidFlushDataNotification;
  */
 - (void)handleJoinedRoomSync:(MXRoomSync*)roomSync;
 
+/**
+ Update room data according to the provided sync response.
+
+ @param roomSync information to sync the room with the home server data
+ @param decryptionAttempted YES if the timeline events of `roomSync` have already gone through
+                            [MXSession decryptEvents:inTimeline:onComplete:] with the live timeline.
+ */
+- (void)handleJoinedRoomSync:(MXRoomSync*)roomSync decryptionAttempted:(BOOL)decryptionAttempted;
+
 /**
  Update the invited room state according to the provided data.
  
@@ -1036,11 +1051,22 @@ FOUNDATION_EXPORT NSString *const kMXRoomDidFlushDataNotification;
  Returns the read receipts list for an event, excluding the read receipt from the current user.
 
  @param eventId The event Id.
- @param sort YES to sort them from the latest to the oldest.
+ @param sort ignored. Receipts are always sorted from the latest to the oldest.
  @return the receipts for an event in a dedicated room.
  */
 - (NSArray<MXReceiptData*> *)getEventReceipts:(NSString*)eventId sorted:(BOOL)sort;
 
+/**
+ Returns the read receipts lists for several events, excluding the read receipts from the current user.
+
+ This is more efficient than calling `getEventReceipts:sorted:` for each event.
+
+ @param eventIds The event Ids.
+ @param sort ignored. Receipts are always sorted from the latest to the oldest.
+ @return the receipts by event id. Events without receipts are not in the dictionary.
+ */
+- (NSDictionary<NSString*, NSArray<MXReceiptData*>*> *)getEventsReceipts:(NSArray<NSString*>*)eventIds sorted:(BOOL)sort;
+
 /**
  Store a receipt.
 
@@ -197,6 +197,11 @@ NSString *const kMXRoomInitialSyncNotification = @"kMXRoomInitialSyncNotificatio
     }
 }
 
+- (NSString *)liveTimelineId
+{
+    return liveTimeline.timelineId;
+}
+
 - (void)state:(void (^)(MXRoomState *))onComplete
 {
     [self liveTimeline:^(MXEventTimeline *theLiveTimeline) {
@@ -349,13 +354,18 @@ NSString *const kMXRoomInitialSyncNotification = @"kMXRoomInitialSyncNotificatio
 
 #pragma mark - Sync
 - (void)handleJoinedRoomSync:(MXRoomSync *)roomSync
+{
+    [self handleJoinedRoomSync:roomSync decryptionAttempted:NO];
+}
+
+- (void)handleJoinedRoomSync:(MXRoomSync *)roomSync decryptionAttempted:(BOOL)decryptionAttempted
 {
     MXWeakify(self);
     [self liveTimeline:^(MXEventTimeline *theLiveTimeline) {
         MXStrongifyAndReturnIfNil(self);
 
         // Let the live timeline handle live events
-        [theLiveTimeline handleJoinedRoomSync:roomSync];
+        [theLiveTimeline handleJoinedRoomSync:roomSync decryptionAttempted:decryptionAttempted];
 
         // Handle here ephemeral events (if any)
         for (MXEvent *event in roomSync.ephemeral.events)
@@ -2846,6 +2856,44 @@ NSString *const kMXRoomInitialSyncNotification = @"kMXRoomInitialSyncNotificatio
     return receipts;
 }
 
+- (NSDictionary<NSString*, NSArray<MXReceiptData*>*> *)getEventsReceipts:(NSArray<NSString*>*)eventIds sorted:(BOOL)sort
+{
+    NSMutableDictionary<NSString*, NSArray<MXReceiptData*>*> *receiptsByEventId = [NSMutableDictionary dictionary];
+
+    if ([mxSession.store respondsToSelector:@selector(getEventsReceipts:eventIds:sorted:)])
+    {
+        NSString* myUserId = mxSession.myUserId;
+        NSDictionary<NSString*, NSArray<MXReceiptData*>*> *storedReceiptsByEventId = [mxSession.store getEventsReceipts:self.roomId eventIds:eventIds sorted:sort];
+
+        [storedReceiptsByEventId enumerateKeysAndObjectsUsingBlock:^(NSString *eventId, NSArray<MXReceiptData*> *receipts, BOOL *stop) {
+
+            // Remove the oneself receipts
+            NSMutableArray* res = [[NSMutableArray alloc] init];
+            for (MXReceiptData* data in receipts)
+            {
+                if (![data.userId isEqualToString:myUserId])
+                {
+                    [res addObject:data];
+                }
+            }
+
+            if (res.count > 0)
+            {
+                receiptsByEventId[eventId] = res;
+            }
+        }];
+    }
+    else
+    {
+        for (NSString *eventId in eventIds)
+        {
+            receiptsByEventId[eventId] = [self getEventReceipts:eventId sorted:sort];
+        }
+    }
+
+    return receiptsByEventId;
+}
+
 - (BOOL)storeLocalReceipt:(NSString *)receiptType eventId:(NSString *)eventId userId:(NSString *)userId ts:(uint64_t)ts
 {
     // Sanity check
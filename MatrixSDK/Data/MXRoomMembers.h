@@ -49,6 +49,26 @@
  */
 @property (nonatomic, readonly) NSArray<MXRoomMember*> *joinedMembers;
 
+/**
+ The number of room members.
+ */
+@property (nonatomic, readonly) NSUInteger membersCount;
+
+/**
+ Return the number of members with a given membership.
+
+ @param membership the membership to look for.
+ @return the number of members.
+ */
+- (NSUInteger)membersCountWithMembership:(MXMembership)membership;
+
+/**
+ The joined and invited members sorted by the date of their membership event, oldest first.
+
+ The list is sorted once per `MXRoomMembers` instance.
+ */
+@property (nonatomic, readonly) NSArray<MXRoomMember*> *joinedOrInvitedMembersSortedByDate;
+
 /**
  A copy of the list of members we should be encrypting for in this room.
  
@@ -19,6 +19,7 @@
 #import "MXRoomState.h"
 #import "MXSession.h"
 #import "MXSDKOptions.h"
+#import "MXPersistentDictionary.h"
 
 @interface MXRoomMembers ()
 {
@@ -27,15 +28,30 @@
 
     /**
      Members ordered by userId.
+
+     Persistent dictionaries are shared with copies of this instance: a copy costs nothing
+     and an update only copies the path to the updated member.
+     */
+    MXPersistentDictionary<NSString*, MXRoomMember*> *members;
+
+    /**
+     The same members partitioned by membership so that queries on a membership do not
+     go through all members.
+     membership (as NSNumber) -> userId -> member
+     */
+    MXPersistentDictionary<NSNumber*, MXPersistentDictionary<NSString*, MXRoomMember*>*> *membersByMembership;
+
+    /**
+     Cache for `joinedOrInvitedMembersSortedByDate`. Reset on any change of members.
      */
-    NSMutableDictionary<NSString*, MXRoomMember*> *members;
+    NSArray<MXRoomMember*> *joinedOrInvitedMembersSortedByDate;
 
     /**
      Track the usage of members displaynames in order to disambiguate them if necessary,
      ie if the same displayname is used by several users, we have to update their displaynames.
      displayname -> count (= how many members of the room uses this displayname)
      */
-    NSMutableDictionary<NSString*, NSNumber*> *membersNamesInUse;
+    MXPersistentDictionary<NSString*, NSNumber*> *membersNamesInUse;
 }
 @end
 
@@ -49,8 +65,9 @@
         mxSession = matrixSession;
         state = roomState;
 
-        members = [NSMutableDictionary dictionary];
-        membersNamesInUse = [NSMutableDictionary dictionary];
+        members = [MXPersistentDictionary dictionary];
+        membersByMembership = [MXPersistentDictionary dictionary];
+        membersNamesInUse = [MXPersistentDictionary dictionary];
     }
     return self;
 }
@@ -65,6 +82,45 @@
     return [self membersWithMembership:MXMembershipJoin];
 }
 
+- (NSUInteger)membersCount
+{
+    return members.count;
+}
+
+- (NSUInteger)membersCountWithMembership:(MXMembership)membership
+{
+    return membersByMembership[@(membership)].count;
+}
+
+- (NSArray<MXRoomMember *> *)joinedOrInvitedMembersSortedByDate
+{
+    if (!joinedOrInvitedMembersSortedByDate)
+    {
+        NSMutableArray<MXRoomMember*> *sortedMembers = [NSMutableArray arrayWithArray:[self membersWithMembership:MXMembershipJoin]];
+        [sortedMembers addObjectsFromArray:[self membersWithMembership:MXMembershipInvite]];
+
+        // Sort members by their creation (oldest first)
+        [sortedMembers sortUsingComparator:^NSComparisonResult(MXRoomMember *member1, MXRoomMember *member2) {
+
+            uint64_t originServerTs1 = member1.originalEvent.originServerTs;
+            uint64_t originServerTs2 = member2.originalEvent.originServerTs;
+
+            if (originServerTs1 == originServerTs2)
+            {
+                return NSOrderedSame;
+            }
+            else
+            {
+                return originServerTs1 > originServerTs2 ? NSOrderedDescending : NSOrderedAscending;
+            }
+        }];
+
+        joinedOrInvitedMembersSortedByDate = sortedMembers;
+    }
+
+    return joinedOrInvitedMembersSortedByDate;
+}
+
 - (NSArray<MXRoomMember *> *)encryptionTargetMembers:(MXRoomHistoryVisibility)historyVisibility
 {
     // Retrieve first the joined members
@@ -138,15 +194,8 @@
 
 - (NSArray<MXRoomMember*>*)membersWithMembership:(MXMembership)theMembership
 {
-    NSMutableArray *membersWithMembership = [NSMutableArray array];
-    for (MXRoomMember *roomMember in members.allValues)
-    {
-        if (roomMember.membership == theMembership)
-        {
-            [membersWithMembership addObject:roomMember];
-        }
-    }
-    return membersWithMembership;
+    NSArray<MXRoomMember*> *membersWithMembership = membersByMembership[@(theMembership)].allValues;
+    return membersWithMembership ? membersWithMembership : @[];
 }
 
 - (NSArray<MXRoomMember *> *)membersWithoutConferenceUser
@@ -166,9 +215,7 @@
     else
     {
         // Filter the conference user from the list
-        NSMutableDictionary<NSString*, MXRoomMember*> *membersWithoutConferenceUserDict = [NSMutableDictionary dictionaryWithDictionary:members];
-        [membersWithoutConferenceUserDict removeObjectForKey:state.conferenceUserId];
-        membersWithoutConferenceUser = membersWithoutConferenceUserDict.allValues;
+        membersWithoutConferenceUser = [members dictionaryByRemovingObjectForKey:state.conferenceUserId].allValues;
     }
 
     return membersWithoutConferenceUser;
@@ -193,17 +240,7 @@
         }
         else
         {
-            NSMutableDictionary *membersWithMembershipDict = [NSMutableDictionary dictionaryWithCapacity:members.count];
-            for (MXRoomMember *roomMember in members.allValues)
-            {
-                if (roomMember.membership == theMembership)
-                {
-                    membersWithMembershipDict[roomMember.userId] = roomMember;
-                }
-            }
-
-            [membersWithMembershipDict removeObjectForKey:state.conferenceUserId];
-            membersWithMembership = membersWithMembershipDict.allValues;
+            membersWithMembership = [membersByMembership[@(theMembership)] dictionaryByRemovingObjectForKey:state.conferenceUserId].allValues;
         }
     }
 
@@ -228,6 +265,12 @@
                     // Remove the previous MXRoomMember of this user from membersNamesInUse
                     NSString *userId = event.stateKey;
                     MXRoomMember *oldRoomMember = members[userId];
+                    if (oldRoomMember)
+                    {
+                        [self removeMemberFromMembershipIndex:oldRoomMember];
+                    }
+                    joinedOrInvitedMembersSortedByDate = nil;
+
                     if (oldRoomMember && oldRoomMember.displayname)
                     {
                         NSNumber *memberNameCount = membersNamesInUse[oldRoomMember.displayname];
@@ -241,11 +284,11 @@
 
                             if (count)
                             {
-                                membersNamesInUse[oldRoomMember.displayname] = @(count);
+                                membersNamesInUse = [membersNamesInUse dictionaryBySettingObject:@(count) forKey:oldRoomMember.displayname];
                             }
                             else
                             {
-                                [membersNamesInUse removeObjectForKey:oldRoomMember.displayname];
+                                membersNamesInUse = [membersNamesInUse dictionaryByRemovingObjectForKey:oldRoomMember.displayname];
                             }
                         }
                     }
@@ -266,10 +309,11 @@
                                 count++;
                             }
 
-                            membersNamesInUse[roomMember.displayname] = @(count);
+                            membersNamesInUse = [membersNamesInUse dictionaryBySettingObject:@(count) forKey:roomMember.displayname];
                         }
 
-                        members[roomMember.userId] = roomMember;
+                        members = [members dictionaryBySettingObject:roomMember forKey:roomMember.userId];
+                        [self addMemberToMembershipIndex:roomMember];
 
                         // Handle here the case where the member has no defined avatar.
                         if (nil == roomMember.avatarUrl && ![MXSDKOptions sharedInstance].disableIdenticonUseForUserAvatar)
@@ -282,7 +326,7 @@
                     {
                         // The user is no more part of the room. Remove him.
                         // This case happens during back pagination: we remove here users when they are not in the room yet.
-                        [members removeObjectForKey:event.stateKey];
+                        members = [members dictionaryByRemovingObjectForKey:event.stateKey];
                     }
 
                     // Special handling for presence: update MXUser data in case of membership event.
@@ -307,6 +351,28 @@
     return hasRoomMemberEvent;
 }
 
+- (void)addMemberToMembershipIndex:(MXRoomMember*)roomMember
+{
+    NSNumber *membership = @(roomMember.membership);
+
+    MXPersistentDictionary<NSString*, MXRoomMember*> *membersWithMembership = membersByMembership[membership];
+    if (!membersWithMembership)
+    {
+        membersWithMembership = [MXPersistentDictionary dictionary];
+    }
+
+    membersWithMembership = [membersWithMembership dictionaryBySettingObject:roomMember forKey:roomMember.userId];
+    membersByMembership = [membersByMembership dictionaryBySettingObject:membersWithMembership forKey:membership];
+}
+
+- (void)removeMemberFromMembershipIndex:(MXRoomMember*)roomMember
+{
+    NSNumber *membership = @(roomMember.membership);
+
+    MXPersistentDictionary<NSString*, MXRoomMember*> *membersWithMembership = [membersByMembership[membership] dictionaryByRemovingObjectForKey:roomMember.userId];
+    membersByMembership = [membersByMembership dictionaryBySettingObject:membersWithMembership forKey:membership];
+}
+
 #pragma mark - NSCopying
 - (id)copyWithZone:(NSZone *)zone
 {
@@ -318,9 +384,12 @@
     // MXRoomMember objects in members are immutable. A new instance of it is created each time
     // the sdk receives room member event, even if it is an update of an existing member like a
     // membership change (ex: "invited" -> "joined")
-    membersCopy->members = [members mutableCopyWithZone:zone];
+    // Persistent dictionaries are immutable too: the copy shares them
+    membersCopy->members = members;
+    membersCopy->membersByMembership = membersByMembership;
+    membersCopy->joinedOrInvitedMembersSortedByDate = joinedOrInvitedMembersSortedByDate;
 
-    membersCopy->membersNamesInUse = [membersNamesInUse mutableCopyWithZone:zone];
+    membersCopy->membersNamesInUse = membersNamesInUse;
 
     return membersCopy;
 }
@@ -22,6 +22,7 @@
 #import "MXSession.h"
 #import "MXTools.h"
 #import "MXCallManager.h"
+#import "MXPersistentDictionary.h"
 
 @interface MXRoomState ()
 {
@@ -29,18 +30,21 @@
 
     /**
      State events ordered by type.
+
+     Like the other persistent dictionaries below, it is shared with copies of this instance
+     so that copying a room state does not copy its content. The arrays are immutable.
      */
-    NSMutableDictionary<NSString*, NSMutableArray<MXEvent*>*> *stateEvents;
+    MXPersistentDictionary<NSString*, NSArray<MXEvent*>*> *stateEvents;
 
     /**
      The room aliases. The key is the domain.
      */
-    NSMutableDictionary<NSString*, MXEvent*> *roomAliases;
+    MXPersistentDictionary<NSString*, MXEvent*> *roomAliases;
 
     /**
      The third party invites. The key is the token provided by the homeserver.
      */
-    NSMutableDictionary<NSString*, MXRoomThirdPartyInvite*> *thirdPartyInvites;
+    MXPersistentDictionary<NSString*, MXRoomThirdPartyInvite*> *thirdPartyInvites;
     
     /**
      Maximum power level observed in power level list
@@ -51,7 +55,7 @@
      Cache for [self memberWithThirdPartyInviteToken].
      The key is the 3pid invite token.
      */
-    NSMutableDictionary<NSString*, MXRoomMember*> *membersWithThirdPartyInviteTokenCache;
+    MXPersistentDictionary<NSString*, MXRoomMember*> *membersWithThirdPartyInviteTokenCache;
 
     /**
      The cache for the conference user id.
@@ -75,12 +79,12 @@
         
         _isLive = isLive;
         
-        stateEvents = [NSMutableDictionary dictionary];
+        stateEvents = [MXPersistentDictionary dictionary];
         _members = [[MXRoomMembers alloc] initWithRoomState:self andMatrixSession:mxSession];
         _membersCount = [MXRoomMembersCount new];
-        roomAliases = [NSMutableDictionary dictionary];
-        thirdPartyInvites = [NSMutableDictionary dictionary];
-        membersWithThirdPartyInviteTokenCache = [NSMutableDictionary dictionary];
+        roomAliases = [MXPersistentDictionary dictionary];
+        thirdPartyInvites = [MXPersistentDictionary dictionary];
+        membersWithThirdPartyInviteTokenCache = [MXPersistentDictionary dictionary];
     }
     return self;
 }
@@ -132,13 +136,12 @@
         // as the current current room state.
         // So, use the same state events content.
         // @TODO: Find another way than modifying the event content.
-        for (NSArray<MXEvent*> *events in stateEvents.allValues)
-        {
+        [stateEvents enumerateKeysAndObjectsUsingBlock:^(NSString *type, NSArray<MXEvent*> *events, BOOL *stop) {
             for (MXEvent *event in events)
             {
                 event.prevContent = event.content;
             }
-        }
+        }];
     }
     return self;
 }
@@ -165,10 +168,9 @@
 - (NSArray<MXEvent *> *)stateEvents
 {
     NSMutableArray<MXEvent *> *state = [NSMutableArray array];
-    for (NSArray<MXEvent*> *events in stateEvents.allValues)
-    {
+    [stateEvents enumerateKeysAndObjectsUsingBlock:^(NSString *type, NSArray<MXEvent*> *events, BOOL *stop) {
         [state addObjectsFromArray:events];
-    }
+    }];
 
     // Members are also state events
     for (MXRoomMember *roomMember in self.members.members)
@@ -380,9 +382,9 @@
     if ([_members handleStateEvents:events])
     {
         // Update counters for currently known room members
-        _membersCount.members = _members.members.count;
-        _membersCount.joined = _members.joinedMembers.count;
-        _membersCount.invited =  [_members membersWithMembership:MXMembershipInvite].count;
+        _membersCount.members = _members.membersCount;
+        _membersCount.joined = [_members membersCountWithMembership:MXMembershipJoin];
+        _membersCount.invited = [_members membersCountWithMembership:MXMembershipInvite];
     }
 
     @autoreleasepool
@@ -409,7 +411,7 @@
                     {
                         // Cache room member event that is successor of a third party invite event
                         MXRoomMember *roomMember = [[MXRoomMember alloc] initWithMXEvent:event andEventContent:content];
-                        membersWithThirdPartyInviteTokenCache[roomMember.thirdPartyInviteToken] = roomMember;
+                        membersWithThirdPartyInviteTokenCache = [membersWithThirdPartyInviteTokenCache dictionaryBySettingObject:roomMember forKey:roomMember.thirdPartyInviteToken];
                     }
 
                     // In case of invite, process the provided but incomplete room state
@@ -438,13 +440,13 @@
                         MXRoomThirdPartyInvite *thirdPartyInvite = [[MXRoomThirdPartyInvite alloc] initWithMXEvent:event];
                         if (thirdPartyInvite)
                         {
-                            thirdPartyInvites[thirdPartyInvite.token] = thirdPartyInvite;
+                            thirdPartyInvites = [thirdPartyInvites dictionaryBySettingObject:thirdPartyInvite forKey:thirdPartyInvite.token];
                         }
                     }
                     else
                     {
                         // Note: the 3pid invite token is stored in the event state key
-                        [thirdPartyInvites removeObjectForKey:event.stateKey];
+                        thirdPartyInvites = [thirdPartyInvites dictionaryByRemovingObjectForKey:event.stateKey];
                     }
                     break;
                 }
@@ -454,7 +456,7 @@
                     if (event.stateKey.length)
                     {
                         // Store the bunch of aliases for the domain (which is the state_key)
-                        roomAliases[event.stateKey] = event;
+                        roomAliases = [roomAliases dictionaryBySettingObject:event forKey:event.stateKey];
                     }
                     break;
                 }
@@ -477,13 +479,13 @@
                     // Do not break here to store the event into the stateEvents dictionary.
                 }
                 default:
+                {
                     // Store other states into the stateEvents dictionary.
-                    if (!stateEvents[event.type])
-                    {
-                        stateEvents[event.type] = [NSMutableArray array];
-                    }
-                    [stateEvents[event.type] addObject:event];
+                    NSArray<MXEvent*> *events = stateEvents[event.type];
+                    events = events ? [events arrayByAddingObject:event] : @[event];
+                    stateEvents = [stateEvents dictionaryBySettingObject:events forKey:event.type];
                     break;
+                }
             }
         }
     }
@@ -575,23 +577,19 @@
 
     stateCopy->_isLive = _isLive;
 
-    // Copy the state events. A deep copy of each events array is necessary.
-    stateCopy->stateEvents = [[NSMutableDictionary allocWithZone:zone] initWithCapacity:stateEvents.count];
-    for (NSString *key in stateEvents)
-    {
-        // Copy the list of state events pointers. A deep copy is not necessary as MXEvent objects are immutable
-        stateCopy->stateEvents[key] = [[NSMutableArray allocWithZone:zone] initWithArray:stateEvents[key]];
-    }
+    // Share the state events. Persistent dictionaries and their events arrays are never modified:
+    // each state event handled by either state replaces them with updated ones.
+    stateCopy->stateEvents = stateEvents;
 
     stateCopy->_members = [_members copyWithZone:zone];
 
     stateCopy->_membersCount = _membersCount;
     
-    stateCopy->roomAliases = [[NSMutableDictionary allocWithZone:zone] initWithDictionary:roomAliases];
+    stateCopy->roomAliases = roomAliases;
 
-    stateCopy->thirdPartyInvites = [[NSMutableDictionary allocWithZone:zone] initWithDictionary:thirdPartyInvites];
+    stateCopy->thirdPartyInvites = thirdPartyInvites;
 
-    stateCopy->membersWithThirdPartyInviteTokenCache= [[NSMutableDictionary allocWithZone:zone] initWithDictionary:membersWithThirdPartyInviteTokenCache];
+    stateCopy->membersWithThirdPartyInviteTokenCache = membersWithThirdPartyInviteTokenCache;
     
     stateCopy->_membership = _membership;
 
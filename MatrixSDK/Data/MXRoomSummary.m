@@ -47,6 +47,11 @@ NSString *const kMXRoomSummaryDidChangeNotification = @"kMXRoomSummaryDidChangeN
  */
 static NSUInteger const kMXRoomSummaryTrustComputationDelayMs = 1000;
 
+/**
+ Number of stored events decrypted together when looking for the last message.
+ */
+static NSUInteger const kMXRoomSummaryLastMessageCandidatesBatchSize = 10;
+
 
 @interface MXRoomSummary ()
 {
@@ -313,96 +318,144 @@ static NSUInteger const kMXRoomSummaryTrustComputationDelayMs = 1000;
         }
 
         // 1.2 Check events one by one until finding the right last message for the room
-        BOOL lastMessageUpdated = NO;
-        while (event)
-        {
-            // Decrypt the event if necessary
-            if (event.eventType == MXEventTypeRoomEncrypted)
-            {
-                if (![self.mxSession decryptEvent:event inTimeline:nil])
+        MXWeakify(self);
+        [self checkLastMessageCandidatesFromEvent:event enumerator:messagesEnumerator state:state roomState:roomState lastEventIdChecked:lastEventIdCheckedInBlock onComplete:^(NSString *lastCheckedEventId) {
+            MXStrongifyAndReturnIfNil(self);
+
+            // 2.1 If lastMessageEventId is still nil, fetch events from the homeserver
+            MXWeakify(self);
+            [room liveTimeline:^(MXEventTimeline *liveTimeline) {
+                MXStrongifyAndReturnIfNil(self);
+
+                if (!self->_lastMessageEventId && [liveTimeline canPaginate:MXTimelineDirectionBackwards])
                 {
-                    NSLog(@"[MXRoomSummary] fetchLastMessage: Warning: Unable to decrypt event: %@\nError: %@", event.content[@"body"], event.decryptionError);
+                    NSUInteger messagesToPaginate = 30;
+
+                    // Reset pagination the first time
+                    if (firstIteration)
+                    {
+                        [liveTimeline resetPagination];
+
+                        // Make sure we paginate more than the events we have already in the store
+                        messagesToPaginate += messagesInStore;
+                    }
+
+                    // Paginate events from the homeserver
+                    // XXX: Pagination on the timeline may conflict with request from the app
+                    __block MXHTTPOperation *newOperation;
+                    newOperation = [liveTimeline paginate:messagesToPaginate direction:MXTimelineDirectionBackwards onlyFromStore:NO complete:^{
+
+                        // Received messages have been stored in the store. We can make a new loop
+                        // XXX: This is only true for a permanent storage. Only MXNoStore is not permanent.
+                        // MXNoStore is only used for tests. We can skip it here.
+                        if (self.mxSession.store.isPermanent)
+                        {
+                            [self fetchLastMessage:complete failure:failure
+                                lastEventIdChecked:lastCheckedEventId
+                                         operation:(operation ? operation : newOperation)
+                                            commit:commit];
+                        }
+
+                    } failure:failure];
+
+                    // Update the current HTTP operation
+                    [operation mutateTo:newOperation];
                 }
-            }
+                else
+                {
+                    if (complete)
+                    {
+                        complete();
+                    }
 
+                    [self save:commit];
+                }
+            }];
+        }];
+    }];
+
+    return operation;
+}
+
+/**
+ Check stored events until finding the right last message for the room.
+
+ Events are checked by batches. The encrypted events of a batch are decrypted
+ asynchronously before being checked in order.
+
+ @param firstEvent the first event to check. Nil to start with the next event of the enumerator.
+ @param messagesEnumerator the enumerator on stored events, from the most recent.
+ @param state the room state at the first event.
+ @param roomState the current room state.
+ @param lastEventIdChecked the id of the last event checked so far.
+ @param onComplete the block called with the id of the last checked event once the last
+        message has been found or when there are no more events.
+ */
+- (void)checkLastMessageCandidatesFromEvent:(MXEvent*)firstEvent
+                                 enumerator:(id<MXEventsEnumerator>)messagesEnumerator
+                                      state:(MXRoomState*)state
+                                  roomState:(MXRoomState*)roomState
+                         lastEventIdChecked:(NSString*)lastEventIdChecked
+                                 onComplete:(void (^)(NSString *lastEventIdChecked))onComplete
+{
+    NSMutableArray<MXEvent*> *events = [NSMutableArray arrayWithCapacity:kMXRoomSummaryLastMessageCandidatesBatchSize];
+    MXEvent *event = firstEvent ? firstEvent : messagesEnumerator.nextEvent;
+    while (event)
+    {
+        [events addObject:event];
+        if (events.count == kMXRoomSummaryLastMessageCandidatesBatchSize)
+        {
+            break;
+        }
+        event = messagesEnumerator.nextEvent;
+    }
+
+    if (!events.count)
+    {
+        onComplete(lastEventIdChecked);
+        return;
+    }
+
+    MXWeakify(self);
+    [self.mxSession decryptEvents:events inTimeline:nil onComplete:^(NSArray<MXEvent *> *failedEvents) {
+        MXStrongifyAndReturnIfNil(self);
+
+        for (MXEvent *failedEvent in failedEvents)
+        {
+            NSLog(@"[MXRoomSummary] fetchLastMessage: Warning: Unable to decrypt event: %@\nError: %@", failedEvent.content[@"body"], failedEvent.decryptionError);
+        }
+
+        MXRoomState *eventState = state;
+        NSString *lastEventIdCheckedInBlock = lastEventIdChecked;
+        for (MXEvent *event in events)
+        {
             if (event.isState)
             {
                 // Need to go backward in the state to provide it as it was when the event occured
-                if (state.isLive)
+                if (eventState.isLive)
                 {
-                    state = [state copy];
-                    state.isLive = NO;
+                    eventState = [eventState copy];
+                    eventState.isLive = NO;
                 }
 
-                [state handleStateEvents:@[event]];
+                [eventState handleStateEvents:@[event]];
             }
 
             lastEventIdCheckedInBlock = event.eventId;
 
             // Propose the event as last message
-            lastMessageUpdated = [self.mxSession.roomSummaryUpdateDelegate session:self.mxSession updateRoomSummary:self withLastEvent:event eventState:state roomState:roomState];
-            if (lastMessageUpdated)
+            if ([self.mxSession.roomSummaryUpdateDelegate session:self.mxSession updateRoomSummary:self withLastEvent:event eventState:eventState roomState:roomState])
             {
                 // The event is accepted. We have our last message
                 // The roomSummaryUpdateDelegate has stored the _lastMessageEventId
-                break;
+                onComplete(lastEventIdCheckedInBlock);
+                return;
             }
-
-            event = messagesEnumerator.nextEvent;
         }
 
-        // 2.1 If lastMessageEventId is still nil, fetch events from the homeserver
-        MXWeakify(self);
-        [room liveTimeline:^(MXEventTimeline *liveTimeline) {
-            MXStrongifyAndReturnIfNil(self);
-
-            if (!self->_lastMessageEventId && [liveTimeline canPaginate:MXTimelineDirectionBackwards])
-            {
-                NSUInteger messagesToPaginate = 30;
-
-                // Reset pagination the first time
-                if (firstIteration)
-                {
-                    [liveTimeline resetPagination];
-
-                    // Make sure we paginate more than the events we have already in the store
-                    messagesToPaginate += messagesInStore;
-                }
-
-                // Paginate events from the homeserver
-                // XXX: Pagination on the timeline may conflict with request from the app
-                __block MXHTTPOperation *newOperation;
-                newOperation = [liveTimeline paginate:messagesToPaginate direction:MXTimelineDirectionBackwards onlyFromStore:NO complete:^{
-
-                    // Received messages have been stored in the store. We can make a new loop
-                    // XXX: This is only true for a permanent storage. Only MXNoStore is not permanent.
-                    // MXNoStore is only used for tests. We can skip it here.
-                    if (self.mxSession.store.isPermanent)
-                    {
-                        [self fetchLastMessage:complete failure:failure
-                            lastEventIdChecked:lastEventIdCheckedInBlock
-                                     operation:(operation ? operation : newOperation)
-                                        commit:commit];
-                    }
-
-                } failure:failure];
-
-                // Update the current HTTP operation
-                [operation mutateTo:newOperation];
-            }
-            else
-            {
-                if (complete)
-                {
-                    complete();
-                }
-
-                [self save:commit];
-            }
-        }];
+        // Check the next batch
+        [self checkLastMessageCandidatesFromEvent:nil enumerator:messagesEnumerator state:eventState roomState:roomState lastEventIdChecked:lastEventIdCheckedInBlock onComplete:onComplete];
     }];
-
-    return operation;
 }
 
 - (void)eventDidChangeSentState:(NSNotification *)notif
@@ -509,33 +509,15 @@
 
 - (NSArray<MXRoomMember*> *)sortedOtherMembersInRoomState:(MXRoomState*)roomState withMatrixSession:(MXSession *)session
 {
-    // Get all joined and invited members other than my user
-    NSMutableArray<MXRoomMember*> *otherMembers = [NSMutableArray array];
-    for (MXRoomMember *member in roomState.members.members)
+    // Get all joined and invited members other than my user, sorted by their creation (oldest first)
+    NSMutableArray<MXRoomMember*> *otherMembers = [NSMutableArray arrayWithArray:roomState.members.joinedOrInvitedMembersSortedByDate];
+
+    MXRoomMember *myMember = [roomState.members memberWithUserId:session.myUserId];
+    if (myMember)
     {
-        if ((member.membership == MXMembershipJoin || member.membership == MXMembershipInvite)
-            && ![member.userId isEqualToString:session.myUserId])
-        {
-            [otherMembers addObject:member];
-        }
+        [otherMembers removeObjectIdenticalTo:myMember];
     }
 
-    // Sort members by their creation (oldest first)
-    [otherMembers sortUsingComparator:^NSComparisonResult(MXRoomMember *member1, MXRoomMember *member2) {
-
-        uint64_t originServerTs1 = member1.originalEvent.originServerTs;
-        uint64_t originServerTs2 = member2.originalEvent.originServerTs;
-
-        if (originServerTs1 == originServerTs2)
-        {
-            return NSOrderedSame;
-        }
-        else
-        {
-            return originServerTs1 > originServerTs2 ? NSOrderedDescending : NSOrderedAscending;
-        }
-    }];
-
     return otherMembers;
 }
 
@@ -0,0 +1,106 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXBinaryArchiver` is a keyed coder that serialises `NSCoding` objects into a compact
+ binary format. It is used by `MXFileStore` as a faster and smaller replacement of
+ `NSKeyedArchiver`.
+
+ The format is:
+    - a header: a magic number and the format version
+    - a table of interned strings: coder keys, class names, dictionary keys and short strings
+    - the root value
+
+ Values are tagged and length-prefixed. Integers are stored as varints. Objects are
+ stored as their class name index followed by their fields, ie (key index, value) pairs.
+
+ Unlike `NSKeyedArchiver`, the format does not keep objects identity: an object referenced
+ twice is stored twice. Objects of Foundation or UIKit classes that are not property list
+ types are embedded as `NSKeyedArchiver` data.
+ */
+@interface MXBinaryArchiver : NSCoder
+
+/**
+ Serialise an object graph.
+
+ @param rootObject the root object.
+ @return the binary data.
+ */
++ (NSData*)archivedDataWithRootObject:(id)rootObject;
+
+/**
+ Serialise an object graph into a file.
+
+ The file is written atomically.
+
+ @param rootObject the root object.
+ @param path the file path.
+ @return YES if the operation succeeds.
+ */
++ (BOOL)archiveRootObject:(id)rootObject toFile:(NSString*)path;
+
+@end
+
+
+/**
+ `MXBinaryUnarchiver` decodes data created by `MXBinaryArchiver`.
+
+ It raises an `NSInvalidUnarchiveOperationException` if the data is corrupted.
+ */
+@interface MXBinaryUnarchiver : NSCoder
+
+/**
+ Check if data has been created by `MXBinaryArchiver`.
+
+ @param data the data to check.
+ @return YES if the data starts with the `MXBinaryArchiver` header.
+ */
++ (BOOL)isBinaryArchive:(NSData*)data;
+
+/**
+ Decode an object graph.
+
+ @param data data created by `MXBinaryArchiver`.
+ @return the root object. nil if data is not a binary archive.
+ */
++ (nullable id)unarchiveObjectWithData:(NSData*)data;
+
+/**
+ Decode an object graph, falling back to `NSKeyedUnarchiver` for data that is not
+ a binary archive.
+
+ This allows to read archives created before the binary format was introduced.
+
+ @param data data created by `MXBinaryArchiver` or `NSKeyedArchiver`.
+ @return the root object.
+ */
++ (nullable id)unarchiveObjectWithBinaryOrKeyedData:(NSData*)data;
+
+/**
+ Same as `unarchiveObjectWithBinaryOrKeyedData:` for a file.
+
+ @param path the file path.
+ @return the root object. nil if the file does not exist.
+ */
++ (nullable id)unarchiveObjectWithFile:(NSString*)path;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,743 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXBinaryArchiver.h"
+
+static uint32_t const kMXBinaryArchiverMagic = 0x4D584241;   // "MXBA"
+static uint64_t const kMXBinaryArchiverVersion = 1;
+
+// Strings up to this size are interned in the strings table
+static NSUInteger const kMXBinaryArchiverMaxInternedStringLength = 32;
+
+typedef NS_ENUM(uint8_t, MXBinaryArchiverTag)
+{
+    MXBinaryArchiverTagEnd = 0,             // End of object fields
+    MXBinaryArchiverTagFalse,
+    MXBinaryArchiverTagTrue,
+    MXBinaryArchiverTagInteger,             // zigzag varint
+    MXBinaryArchiverTagUnsignedInteger,     // varint, for values above INT64_MAX
+    MXBinaryArchiverTagDouble,              // 8 bytes, little endian
+    MXBinaryArchiverTagString,              // varint length + UTF-8 bytes
+    MXBinaryArchiverTagMutableString,
+    MXBinaryArchiverTagInternedString,      // varint index in the strings table
+    MXBinaryArchiverTagData,                // varint length + bytes
+    MXBinaryArchiverTagMutableData,
+    MXBinaryArchiverTagArray,               // varint count + values
+    MXBinaryArchiverTagMutableArray,
+    MXBinaryArchiverTagDictionary,          // varint count + (key, value) values
+    MXBinaryArchiverTagMutableDictionary,
+    MXBinaryArchiverTagSet,                 // varint count + values
+    MXBinaryArchiverTagMutableSet,
+    MXBinaryArchiverTagDate,                // double
+    MXBinaryArchiverTagNull,
+    MXBinaryArchiverTagObject,              // varint class name index + (varint key index + 1, value)* + end tag
+    MXBinaryArchiverTagKeyedArchive         // varint length + NSKeyedArchiver data
+};
+
+/**
+ Check whether objects of a class must be serialised with NSKeyedArchiver.
+
+ System classes may rely on NSKeyedArchiver specifics.
+ */
+static BOOL MXBinaryArchiverUsesKeyedArchiverForClass(Class class)
+{
+    NSString *className = NSStringFromClass(class);
+    return [className hasPrefix:@"NS"] || [className hasPrefix:@"UI"] || [className hasPrefix:@"_"];
+}
+
+
+#pragma mark - MXBinaryArchiver
+
+@interface MXBinaryArchiver ()
+{
+    NSMutableData *body;
+
+    // The strings table
+    NSMutableArray<NSString*> *strings;
+    NSMutableDictionary<NSString*, NSNumber*> *stringsIndexes;
+}
+@end
+
+@implementation MXBinaryArchiver
+
++ (NSData *)archivedDataWithRootObject:(id)rootObject
+{
+    MXBinaryArchiver *archiver = [[MXBinaryArchiver alloc] init];
+    [archiver writeValue:rootObject];
+    return [archiver encodedData];
+}
+
++ (BOOL)archiveRootObject:(id)rootObject toFile:(NSString *)path
+{
+    return [[self archivedDataWithRootObject:rootObject] writeToFile:path atomically:YES];
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        body = [NSMutableData data];
+        strings = [NSMutableArray array];
+        stringsIndexes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSData*)encodedData
+{
+    NSMutableData *data = [NSMutableData dataWithCapacity:body.length + 16 * strings.count];
+
+    uint32_t magic = CFSwapInt32HostToLittle(kMXBinaryArchiverMagic);
+    [data appendBytes:&magic length:sizeof(magic)];
+    [self appendVarint:kMXBinaryArchiverVersion toData:data];
+
+    [self appendVarint:strings.count toData:data];
+    for (NSString *string in strings)
+    {
+        [self appendString:string toData:data];
+    }
+
+    [data appendData:body];
+
+    return data;
+}
+
+#pragma mark - NSCoder
+- (BOOL)allowsKeyedCoding
+{
+    return YES;
+}
+
+- (void)encodeObject:(id)object forKey:(NSString *)key
+{
+    // nil values are not stored. They will be decoded as nil
+    if (object)
+    {
+        [self writeKey:key];
+        [self writeValue:object];
+    }
+}
+
+- (void)encodeConditionalObject:(id)object forKey:(NSString *)key
+{
+    [self encodeObject:object forKey:key];
+}
+
+- (void)encodeBool:(BOOL)value forKey:(NSString *)key
+{
+    [self writeKey:key];
+    [self writeTag:value ? MXBinaryArchiverTagTrue : MXBinaryArchiverTagFalse];
+}
+
+- (void)encodeInt:(int)value forKey:(NSString *)key
+{
+    [self encodeInt64:value forKey:key];
+}
+
+- (void)encodeInt32:(int32_t)value forKey:(NSString *)key
+{
+    [self encodeInt64:value forKey:key];
+}
+
+- (void)encodeInteger:(NSInteger)value forKey:(NSString *)key
+{
+    [self encodeInt64:value forKey:key];
+}
+
+- (void)encodeInt64:(int64_t)value forKey:(NSString *)key
+{
+    [self writeKey:key];
+    [self writeInteger:value];
+}
+
+- (void)encodeFloat:(float)value forKey:(NSString *)key
+{
+    [self encodeDouble:value forKey:key];
+}
+
+- (void)encodeDouble:(double)value forKey:(NSString *)key
+{
+    [self writeKey:key];
+    [self writeDouble:value withTag:MXBinaryArchiverTagDouble];
+}
+
+- (void)encodeBytes:(const uint8_t *)bytes length:(NSUInteger)length forKey:(NSString *)key
+{
+    [self writeKey:key];
+    [self writeTag:MXBinaryArchiverTagData];
+    [self appendVarint:length toData:body];
+    [body appendBytes:bytes length:length];
+}
+
+#pragma mark - Private methods
+- (void)writeTag:(MXBinaryArchiverTag)tag
+{
+    [body appendBytes:&tag length:1];
+}
+
+- (void)writeKey:(NSString*)key
+{
+    [self appendVarint:[self indexOfString:key] + 1 toData:body];
+}
+
+- (void)writeInteger:(int64_t)value
+{
+    [self writeTag:MXBinaryArchiverTagInteger];
+
+    // zigzag encoding so that small negative values stay small
+    [self appendVarint:((uint64_t)value << 1) ^ (uint64_t)(value >> 63) toData:body];
+}
+
+- (void)writeDouble:(double)value withTag:(MXBinaryArchiverTag)tag
+{
+    [self writeTag:tag];
+
+    CFSwappedFloat64 swapped = CFConvertDoubleHostToSwapped(value);
+    [body appendBytes:&swapped length:sizeof(swapped)];
+}
+
+- (void)writeValue:(id)value
+{
+    if (!value)
+    {
+        [self writeTag:MXBinaryArchiverTagNull];
+    }
+    else if ([value isKindOfClass:NSString.class])
+    {
+        NSString *string = value;
+        if ([string classForCoder] == NSMutableString.class)
+        {
+            [self writeTag:MXBinaryArchiverTagMutableString];
+            [self appendString:string toData:body];
+        }
+        else if (string.length <= kMXBinaryArchiverMaxInternedStringLength)
+        {
+            [self writeTag:MXBinaryArchiverTagInternedString];
+            [self appendVarint:[self indexOfString:string] toData:body];
+        }
+        else
+        {
+            [self writeTag:MXBinaryArchiverTagString];
+            [self appendString:string toData:body];
+        }
+    }
+    else if ([value isKindOfClass:NSNumber.class])
+    {
+        NSNumber *number = value;
+        const char *objCType = number.objCType;
+
+        if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID())
+        {
+            [self writeTag:number.boolValue ? MXBinaryArchiverTagTrue : MXBinaryArchiverTagFalse];
+        }
+        else if (strcmp(objCType, @encode(float)) == 0 || strcmp(objCType, @encode(double)) == 0)
+        {
+            [self writeDouble:number.doubleValue withTag:MXBinaryArchiverTagDouble];
+        }
+        else if (strcmp(objCType, @encode(unsigned long long)) == 0 && number.unsignedLongLongValue > INT64_MAX)
+        {
+            [self writeTag:MXBinaryArchiverTagUnsignedInteger];
+            [self appendVarint:number.unsignedLongLongValue toData:body];
+        }
+        else
+        {
+            [self writeInteger:number.longLongValue];
+        }
+    }
+    else if ([value isKindOfClass:NSData.class])
+    {
+        NSData *data = value;
+        [self writeTag:([data classForCoder] == NSMutableData.class) ? MXBinaryArchiverTagMutableData : MXBinaryArchiverTagData];
+        [self appendVarint:data.length toData:body];
+        [body appendData:data];
+    }
+    else if ([value isKindOfClass:NSArray.class])
+    {
+        NSArray *array = value;
+        [self writeTag:([array classForCoder] == NSMutableArray.class) ? MXBinaryArchiverTagMutableArray : MXBinaryArchiverTagArray];
+        [self appendVarint:array.count toData:body];
+        for (id item in array)
+        {
+            [self writeValue:item];
+        }
+    }
+    else if ([value isKindOfClass:NSDictionary.class])
+    {
+        NSDictionary *dictionary = value;
+        [self writeTag:([dictionary classForCoder] == NSMutableDictionary.class) ? MXBinaryArchiverTagMutableDictionary : MXBinaryArchiverTagDictionary];
+        [self appendVarint:dictionary.count toData:body];
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id object, BOOL *stop) {
+            [self writeValue:key];
+            [self writeValue:object];
+        }];
+    }
+    else if ([value isKindOfClass:NSSet.class])
+    {
+        NSSet *set = value;
+        [self writeTag:([set classForCoder] == NSMutableSet.class) ? MXBinaryArchiverTagMutableSet : MXBinaryArchiverTagSet];
+        [self appendVarint:set.count toData:body];
+        for (id item in set)
+        {
+            [self writeValue:item];
+        }
+    }
+    else if ([value isKindOfClass:NSDate.class])
+    {
+        [self writeDouble:((NSDate*)value).timeIntervalSinceReferenceDate withTag:MXBinaryArchiverTagDate];
+    }
+    else if ([value isKindOfClass:NSNull.class])
+    {
+        [self writeTag:MXBinaryArchiverTagNull];
+    }
+    else if (MXBinaryArchiverUsesKeyedArchiverForClass([value classForCoder]))
+    {
+        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:value];
+        [self writeTag:MXBinaryArchiverTagKeyedArchive];
+        [self appendVarint:data.length toData:body];
+        [body appendData:data];
+    }
+    else if ([value conformsToProtocol:@protocol(NSCoding)])
+    {
+        [self writeTag:MXBinaryArchiverTagObject];
+        [self appendVarint:[self indexOfString:NSStringFromClass([value classForCoder])] toData:body];
+
+        [(id<NSCoding>)value encodeWithCoder:self];
+
+        [self writeTag:MXBinaryArchiverTagEnd];
+    }
+    else
+    {
+        [NSException raise:NSInvalidArchiveOperationException format:@"[MXBinaryArchiver] %@ does not conform to NSCoding", [value class]];
+    }
+}
+
+- (NSUInteger)indexOfString:(NSString*)string
+{
+    NSNumber *index = stringsIndexes[string];
+    if (!index)
+    {
+        index = @(strings.count);
+        string = [string copy];
+        [strings addObject:string];
+        stringsIndexes[string] = index;
+    }
+    return index.unsignedIntegerValue;
+}
+
+- (void)appendString:(NSString*)string toData:(NSMutableData*)data
+{
+    // Take the length of the UTF-8 data, not strlen(), so that strings containing U+0000 are not truncated.
+    // Unpaired surrogates have no UTF-8 representation: they are replaced as by any lossy conversion
+    NSData *utf8Data = [string dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+    if (!utf8Data)
+    {
+        [NSException raise:NSInvalidArchiveOperationException format:@"[MXBinaryArchiver] Cannot encode string: %@", string];
+    }
+
+    [self appendVarint:utf8Data.length toData:data];
+    [data appendData:utf8Data];
+}
+
+- (void)appendVarint:(uint64_t)value toData:(NSMutableData*)data
+{
+    uint8_t buffer[10];
+    NSUInteger length = 0;
+    do
+    {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer[length++] = value ? (byte | 0x80) : byte;
+    } while (value);
+
+    [data appendBytes:buffer length:length];
+}
+
+@end
+
+
+#pragma mark - MXBinaryUnarchiver
+
+@interface MXBinaryUnarchiver ()
+{
+    NSData *data;
+    const uint8_t *bytes;
+    NSUInteger offset;
+
+    // The strings table
+    NSMutableArray<NSString*> *strings;
+
+    // Fields of objects being decoded. The last one is the current object
+    NSMutableArray<NSDictionary<NSString*, id>*> *frames;
+}
+@end
+
+@implementation MXBinaryUnarchiver
+
++ (BOOL)isBinaryArchive:(NSData *)data
+{
+    uint32_t magic = 0;
+    if (data.length >= sizeof(magic))
+    {
+        memcpy(&magic, data.bytes, sizeof(magic));
+    }
+    return CFSwapInt32LittleToHost(magic) == kMXBinaryArchiverMagic;
+}
+
++ (id)unarchiveObjectWithData:(NSData *)data
+{
+    if (![self isBinaryArchive:data])
+    {
+        return nil;
+    }
+
+    MXBinaryUnarchiver *unarchiver = [[MXBinaryUnarchiver alloc] initWithData:data];
+    return [unarchiver readValue];
+}
+
++ (id)unarchiveObjectWithBinaryOrKeyedData:(NSData *)data
+{
+    if ([self isBinaryArchive:data])
+    {
+        return [self unarchiveObjectWithData:data];
+    }
+    return data ? [NSKeyedUnarchiver unarchiveObjectWithData:data] : nil;
+}
+
++ (id)unarchiveObjectWithFile:(NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+    return [self unarchiveObjectWithBinaryOrKeyedData:data];
+}
+
+- (instancetype)initWithData:(NSData*)theData
+{
+    self = [super init];
+    if (self)
+    {
+        data = theData;
+        bytes = data.bytes;
+        offset = sizeof(uint32_t);
+        frames = [NSMutableArray array];
+
+        uint64_t version = [self readVarint];
+        if (version > kMXBinaryArchiverVersion)
+        {
+            [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Unsupported version: %@", @(version)];
+        }
+
+        uint64_t stringsCount = [self readVarint];
+        strings = [NSMutableArray arrayWithCapacity:(NSUInteger)MIN(stringsCount, data.length)];
+        for (uint64_t i = 0; i < stringsCount; i++)
+        {
+            [strings addObject:[self readString]];
+        }
+    }
+    return self;
+}
+
+#pragma mark - NSCoder
+- (BOOL)allowsKeyedCoding
+{
+    return YES;
+}
+
+- (BOOL)containsValueForKey:(NSString *)key
+{
+    return frames.lastObject[key] != nil;
+}
+
+- (id)decodeObjectForKey:(NSString *)key
+{
+    return frames.lastObject[key];
+}
+
+- (id)decodeObjectOfClass:(Class)aClass forKey:(NSString *)key
+{
+    id value = [self decodeObjectForKey:key];
+    return [value isKindOfClass:aClass] ? value : nil;
+}
+
+- (id)decodeObjectOfClasses:(NSSet<Class> *)classes forKey:(NSString *)key
+{
+    return [self decodeObjectForKey:key];
+}
+
+- (BOOL)decodeBoolForKey:(NSString *)key
+{
+    return [frames.lastObject[key] boolValue];
+}
+
+- (int)decodeIntForKey:(NSString *)key
+{
+    return [frames.lastObject[key] intValue];
+}
+
+- (int32_t)decodeInt32ForKey:(NSString *)key
+{
+    return [frames.lastObject[key] intValue];
+}
+
+- (NSInteger)decodeIntegerForKey:(NSString *)key
+{
+    return [frames.lastObject[key] integerValue];
+}
+
+- (int64_t)decodeInt64ForKey:(NSString *)key
+{
+    return [frames.lastObject[key] longLongValue];
+}
+
+- (float)decodeFloatForKey:(NSString *)key
+{
+    return [frames.lastObject[key] floatValue];
+}
+
+- (double)decodeDoubleForKey:(NSString *)key
+{
+    return [frames.lastObject[key] doubleValue];
+}
+
+- (const uint8_t *)decodeBytesForKey:(NSString *)key returnedLength:(NSUInteger *)lengthp
+{
+    NSData *value = frames.lastObject[key];
+    if (lengthp)
+    {
+        *lengthp = value.length;
+    }
+    return value.bytes;
+}
+
+#pragma mark - Private methods
+- (void)checkAvailableBytes:(uint64_t)length
+{
+    if (length > data.length - offset)
+    {
+        [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Truncated data at offset %tu", offset];
+    }
+}
+
+- (uint8_t)readByte
+{
+    [self checkAvailableBytes:1];
+    return bytes[offset++];
+}
+
+- (uint64_t)readVarint
+{
+    uint64_t value = 0;
+    for (NSUInteger shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = [self readByte];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+
+    [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Invalid varint at offset %tu", offset];
+    return 0;
+}
+
+- (NSUInteger)readLength
+{
+    uint64_t length = [self readVarint];
+    [self checkAvailableBytes:length];
+    return (NSUInteger)length;
+}
+
+- (NSString*)readString
+{
+    NSUInteger length = [self readLength];
+    NSString *string = [[NSString alloc] initWithBytes:bytes + offset length:length encoding:NSUTF8StringEncoding];
+    offset += length;
+
+    if (!string)
+    {
+        [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Invalid UTF-8 string at offset %tu", offset];
+    }
+    return string;
+}
+
+- (NSString*)readInternedString
+{
+    uint64_t index = [self readVarint];
+    if (index >= strings.count)
+    {
+        [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Invalid string index at offset %tu", offset];
+    }
+    return strings[(NSUInteger)index];
+}
+
+- (NSData*)readData
+{
+    NSUInteger length = [self readLength];
+    NSData *value = [NSData dataWithBytes:bytes + offset length:length];
+    offset += length;
+    return value;
+}
+
+- (double)readDouble
+{
+    CFSwappedFloat64 swapped;
+    [self checkAvailableBytes:sizeof(swapped)];
+    memcpy(&swapped, bytes + offset, sizeof(swapped));
+    offset += sizeof(swapped);
+    return CFConvertDoubleSwappedToHost(swapped);
+}
+
+/**
+ Read a value.
+
+ @return the value. nil if it is an object that cannot be decoded.
+ */
+- (nullable id)readValue
+{
+    MXBinaryArchiverTag tag = [self readByte];
+    switch (tag)
+    {
+        case MXBinaryArchiverTagFalse:
+            return @NO;
+
+        case MXBinaryArchiverTagTrue:
+            return @YES;
+
+        case MXBinaryArchiverTagInteger:
+        {
+            uint64_t zigzag = [self readVarint];
+            return @((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+        }
+
+        case MXBinaryArchiverTagUnsignedInteger:
+            return @([self readVarint]);
+
+        case MXBinaryArchiverTagDouble:
+            return @([self readDouble]);
+
+        case MXBinaryArchiverTagString:
+            return [self readString];
+
+        case MXBinaryArchiverTagMutableString:
+            return [[self readString] mutableCopy];
+
+        case MXBinaryArchiverTagInternedString:
+            return [self readInternedString];
+
+        case MXBinaryArchiverTagData:
+            return [self readData];
+
+        case MXBinaryArchiverTagMutableData:
+            return [[self readData] mutableCopy];
+
+        case MXBinaryArchiverTagArray:
+        case MXBinaryArchiverTagMutableArray:
+        {
+            NSUInteger count = [self readLength];
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+            for (NSUInteger i = 0; i < count; i++)
+            {
+                id item = [self readValue];
+                if (item)
+                {
+                    [array addObject:item];
+                }
+            }
+            return (tag == MXBinaryArchiverTagMutableArray) ? array : [array copy];
+        }
+
+        case MXBinaryArchiverTagDictionary:
+        case MXBinaryArchiverTagMutableDictionary:
+        {
+            NSUInteger count = [self readLength];
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:count];
+            for (NSUInteger i = 0; i < count; i++)
+            {
+                id key = [self readValue];
+                id object = [self readValue];
+                if (key && object)
+                {
+                    dictionary[key] = object;
+                }
+            }
+            return (tag == MXBinaryArchiverTagMutableDictionary) ? dictionary : [dictionary copy];
+        }
+
+        case MXBinaryArchiverTagSet:
+        case MXBinaryArchiverTagMutableSet:
+        {
+            NSUInteger count = [self readLength];
+            NSMutableSet *set = [NSMutableSet setWithCapacity:count];
+            for (NSUInteger i = 0; i < count; i++)
+            {
+                id item = [self readValue];
+                if (item)
+                {
+                    [set addObject:item];
+                }
+            }
+            return (tag == MXBinaryArchiverTagMutableSet) ? set : [set copy];
+        }
+
+        case MXBinaryArchiverTagDate:
+            return [NSDate dateWithTimeIntervalSinceReferenceDate:[self readDouble]];
+
+        case MXBinaryArchiverTagNull:
+            return NSNull.null;
+
+        case MXBinaryArchiverTagKeyedArchive:
+            return [NSKeyedUnarchiver unarchiveObjectWithData:[self readData]];
+
+        case MXBinaryArchiverTagObject:
+            return [self readObject];
+
+        default:
+            [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Unknown tag %@ at offset %tu", @(tag), offset];
+            return nil;
+    }
+}
+
+- (nullable id)readObject
+{
+    NSString *className = [self readInternedString];
+
+    // Read all fields so that they can be decoded in any order
+    NSMutableDictionary<NSString*, id> *fields = [NSMutableDictionary dictionary];
+    uint64_t keyIndex;
+    while ((keyIndex = [self readVarint]))
+    {
+        if (keyIndex > strings.count)
+        {
+            [NSException raise:NSInvalidUnarchiveOperationException format:@"[MXBinaryUnarchiver] Invalid key index at offset %tu", offset];
+        }
+        fields[strings[(NSUInteger)keyIndex - 1]] = [self readValue];
+    }
+
+    Class class = NSClassFromString(className);
+    if (!class)
+    {
+        NSLog(@"[MXBinaryUnarchiver] readObject: Unknown class %@. Ignore the object", className);
+        return nil;
+    }
+
+    [frames addObject:fields];
+    id object = [(id<NSCoding>)[class alloc] initWithCoder:self];
+    [frames removeLastObject];
+
+    return [object awakeAfterUsingCoder:self];
+}
+
+@end
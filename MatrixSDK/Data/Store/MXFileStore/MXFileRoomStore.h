@@ -22,7 +22,34 @@
  
  This serialisation is done in the context of the multi-threading managed by [MXFileStore commit].
  @see [MXFileRoomStore encodeWithCoder] for more details.
+
+ Between two full serialisations (snapshots), `MXFileRoomStore` records the changes made to
+ the room so that [MXFileStore commit] only needs to append them to the room log.
  */
 @interface MXFileRoomStore : MXMemoryRoomStore <NSCoding>
 
+/**
+ YES if changes made since the last snapshot cannot be expressed as log records
+ (ex: all messages have been removed). A new snapshot must be written.
+ */
+@property (nonatomic, readonly) BOOL needsSnapshot;
+
+/**
+ Take the changes made to the room since the last call.
+
+ This resets `needsSnapshot`.
+
+ @return the changes to append to the room log. Each change is a dictionary that can be archived.
+ */
+- (NSArray<NSDictionary*>*)takePendingChanges;
+
+/**
+ Apply a change read from the room log.
+
+ Changes are idempotent: an event that is already in the store is not added twice.
+
+ @param change a change previously returned by `takePendingChanges`.
+ */
+- (void)replayChange:(NSDictionary*)change;
+
 @end
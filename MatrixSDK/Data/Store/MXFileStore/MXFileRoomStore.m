@@ -17,15 +17,198 @@
 
 #import "MXFileRoomStore.h"
 
+// Keys of changes recorded in the room log
+static NSString *const kMXFileRoomStoreChangeType = @"type";
+static NSString *const kMXFileRoomStoreChangeEvent = @"event";
+static NSString *const kMXFileRoomStoreChangeDirection = @"direction";
+
+typedef NS_ENUM(NSUInteger, MXFileRoomStoreChangeType)
+{
+    // A new event. The event is stored with its timeline direction
+    MXFileRoomStoreChangeTypeStoreEvent,
+
+    // An event has been replaced
+    MXFileRoomStoreChangeTypeReplaceEvent,
+
+    // Pagination and composer properties. The change contains the values of all of them
+    MXFileRoomStoreChangeTypeProperties,
+
+    // The list of outgoing messages. The change contains all of them
+    MXFileRoomStoreChangeTypeOutgoingMessages
+};
+
+@interface MXFileRoomStore ()
+{
+    // Changes made since the last call of takePendingChanges
+    NSMutableArray<NSDictionary*> *pendingChanges;
+    BOOL propertiesHaveChanged;
+    BOOL outgoingMessagesHaveChanged;
+}
+@end
+
 @implementation MXFileRoomStore
 
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        pendingChanges = [NSMutableArray array];
+    }
+    return self;
+}
+
+#pragma mark - Changes tracking
+- (void)storeEvent:(MXEvent *)event direction:(MXTimelineDirection)direction
+{
+    [super storeEvent:event direction:direction];
+
+    if (!_needsSnapshot)
+    {
+        [pendingChanges addObject:@{
+                                    kMXFileRoomStoreChangeType: @(MXFileRoomStoreChangeTypeStoreEvent),
+                                    kMXFileRoomStoreChangeEvent: event,
+                                    kMXFileRoomStoreChangeDirection: @(direction)
+                                    }];
+    }
+}
+
+- (void)replaceEvent:(MXEvent *)event
+{
+    [super replaceEvent:event];
+
+    if (!_needsSnapshot)
+    {
+        [pendingChanges addObject:@{
+                                    kMXFileRoomStoreChangeType: @(MXFileRoomStoreChangeTypeReplaceEvent),
+                                    kMXFileRoomStoreChangeEvent: event
+                                    }];
+    }
+}
+
+- (void)removeAllMessages
+{
+    [super removeAllMessages];
+
+    // There is no point to log changes that will be part of the next snapshot
+    _needsSnapshot = YES;
+    [pendingChanges removeAllObjects];
+}
+
+- (void)setPaginationToken:(NSString *)paginationToken
+{
+    [super setPaginationToken:paginationToken];
+    propertiesHaveChanged = YES;
+}
+
+- (void)setHasReachedHomeServerPaginationEnd:(BOOL)hasReachedHomeServerPaginationEnd
+{
+    [super setHasReachedHomeServerPaginationEnd:hasReachedHomeServerPaginationEnd];
+    propertiesHaveChanged = YES;
+}
+
+- (void)setHasLoadedAllRoomMembersForRoom:(BOOL)hasLoadedAllRoomMembersForRoom
+{
+    [super setHasLoadedAllRoomMembersForRoom:hasLoadedAllRoomMembersForRoom];
+    propertiesHaveChanged = YES;
+}
+
+- (void)setPartialTextMessage:(NSString *)partialTextMessage
+{
+    [super setPartialTextMessage:partialTextMessage];
+    propertiesHaveChanged = YES;
+}
+
+- (void)storeOutgoingMessage:(MXEvent *)outgoingMessage
+{
+    [super storeOutgoingMessage:outgoingMessage];
+    outgoingMessagesHaveChanged = YES;
+}
+
+- (void)removeAllOutgoingMessages
+{
+    [super removeAllOutgoingMessages];
+    outgoingMessagesHaveChanged = YES;
+}
+
+- (void)removeOutgoingMessage:(NSString *)outgoingMessageEventId
+{
+    [super removeOutgoingMessage:outgoingMessageEventId];
+    outgoingMessagesHaveChanged = YES;
+}
+
+- (NSArray<NSDictionary *> *)takePendingChanges
+{
+    NSMutableArray<NSDictionary*> *changes = pendingChanges;
+    pendingChanges = [NSMutableArray array];
+
+    if (propertiesHaveChanged)
+    {
+        NSMutableDictionary *change = [NSMutableDictionary dictionary];
+        change[kMXFileRoomStoreChangeType] = @(MXFileRoomStoreChangeTypeProperties);
+        change[@"paginationToken"] = self.paginationToken;
+        change[@"hasReachedHomeServerPaginationEnd"] = @(self.hasReachedHomeServerPaginationEnd);
+        change[@"hasLoadedAllRoomMembersForRoom"] = @(self.hasLoadedAllRoomMembersForRoom);
+        change[@"partialTextMessage"] = self.partialTextMessage;
+        [changes addObject:change];
+    }
+
+    if (outgoingMessagesHaveChanged)
+    {
+        [changes addObject:@{
+                             kMXFileRoomStoreChangeType: @(MXFileRoomStoreChangeTypeOutgoingMessages),
+                             @"outgoingMessages": [outgoingMessages copy]
+                             }];
+    }
+
+    propertiesHaveChanged = NO;
+    outgoingMessagesHaveChanged = NO;
+    _needsSnapshot = NO;
+
+    return changes;
+}
+
+- (void)replayChange:(NSDictionary *)change
+{
+    MXEvent *event = change[kMXFileRoomStoreChangeEvent];
+
+    switch ([change[kMXFileRoomStoreChangeType] unsignedIntegerValue])
+    {
+        case MXFileRoomStoreChangeTypeStoreEvent:
+            // The change may be already part of the snapshot
+            if (!event.eventId || ![messages eventWithEventId:event.eventId])
+            {
+                [super storeEvent:event direction:[change[kMXFileRoomStoreChangeDirection] integerValue]];
+            }
+            break;
+
+        case MXFileRoomStoreChangeTypeReplaceEvent:
+            [super replaceEvent:event];
+            break;
+
+        case MXFileRoomStoreChangeTypeProperties:
+            [super setPaginationToken:change[@"paginationToken"]];
+            [super setHasReachedHomeServerPaginationEnd:[change[@"hasReachedHomeServerPaginationEnd"] boolValue]];
+            [super setHasLoadedAllRoomMembersForRoom:[change[@"hasLoadedAllRoomMembersForRoom"] boolValue]];
+            [super setPartialTextMessage:change[@"partialTextMessage"]];
+            break;
+
+        case MXFileRoomStoreChangeTypeOutgoingMessages:
+            outgoingMessages = [change[@"outgoingMessages"] mutableCopy];
+            break;
+
+        default:
+            NSLog(@"[MXFileRoomStore] replayChange: Unknown change: %@", change[kMXFileRoomStoreChangeType]);
+            break;
+    }
+}
+
 #pragma mark - NSCoding
 - (id)initWithCoder:(NSCoder *)aDecoder
 {
     self = [self init];
     if (self)
     {
-        messages = [aDecoder decodeObjectForKey:@"messages"];
 
         self.paginationToken = [aDecoder decodeObjectForKey:@"paginationToken"];
 
@@ -36,14 +219,19 @@
 
         outgoingMessages = [aDecoder decodeObjectForKey:@"outgoingMessages"];
 
-        // Rebuild the messagesByEventIds cache
-        for (MXEvent *event in messages)
+        // Rebuild the messages container and its indexes
+        for (MXEvent *event in [aDecoder decodeObjectForKey:@"messages"])
         {
-            if (event.eventId)
+            // Snapshots taken while messages were removed could contain empty slots
+            if ([event isKindOfClass:MXEvent.class])
             {
-                messagesByEventIds[event.eventId] = event;
+                [messages appendEvent:event];
             }
         }
+
+        // The decoded data is the snapshot. Nothing is pending
+        propertiesHaveChanged = NO;
+        outgoingMessagesHaveChanged = NO;
     }
     return self;
 }
@@ -52,12 +240,10 @@
 {
     // The goal of the NSCoding implementation here is to store room data to the file system during a [MXFileStore commit].
 
-    // Note this operation is  called from another thread.
-    // As the messages array continously grows, if some messages come while looping, they will not
-    // be serialised this time but they will be on the next [MXFileStore commit] that will be called for them.
-    // If messages come between [MXFileStore commit] and this method, more messages will be serialised. This is
-    // not a problem.
-    [aCoder encodeObject:[messages mutableCopy] forKey:@"messages"];
+    // Note this operation is called from another thread while messages can be added or removed.
+    // `allEvents` takes a consistent snapshot of them. If messages come between [MXFileStore commit]
+    // and this method, more messages will be serialised. This is not a problem.
+    [aCoder encodeObject:messages.allEvents forKey:@"messages"];
 
     if (self.paginationToken)
     {
@@ -0,0 +1,93 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXFileRoomStoreLog` manages the append-only log of changes made to a room messages
+ since the last snapshot of its `MXFileRoomStore`.
+
+ The log is split into segment files (`messagesLog.0`, `messagesLog.1`, ...) stored in the
+ room folder. Each record is prefixed by its length and a checksum so that a record
+ partially written before a crash is detected and dropped when the log is read.
+
+ This class is not thread safe. `MXFileStore` uses it from its dispatch queue, except
+ for the first read of a room loaded on demand.
+ */
+@interface MXFileRoomStoreLog : NSObject
+
+/**
+ Create an instance for the log stored in a room folder.
+
+ @param folder the room folder.
+ */
+- (instancetype)initWithFolder:(NSString*)folder;
+
+/**
+ The total size in bytes of all segments.
+ */
+@property (nonatomic, readonly) unsigned long long size;
+
+/**
+ The size in bytes of the snapshot the log applies to.
+ */
+@property (nonatomic) unsigned long long snapshotSize;
+
+/**
+ Read all records in their append order.
+
+ If a torn or corrupted record is found, it and everything after it is removed from
+ the log so that next appends start from a valid position.
+
+ @param block the block called for each record.
+ */
+- (void)enumerateRecordsUsingBlock:(void (^)(NSData *record))block;
+
+/**
+ Append records at the end of the log.
+
+ A new segment is started when the current one is full.
+
+ @param records the serialised records.
+ */
+- (void)appendRecords:(NSArray<NSData*> *)records;
+
+/**
+ Remove all segments once their content has been folded into a new snapshot.
+
+ @param folder the folder to move segments to. Segments are deleted if nil.
+ */
+- (void)moveSegmentsToFolder:(nullable NSString*)folder;
+
+/**
+ The current end of the log.
+
+ This position can be passed to `truncateToPosition:` to discard appends done after it.
+ */
+@property (nonatomic, readonly) NSDictionary *position;
+
+/**
+ Discard everything written after a position.
+
+ @param position a value previously returned by `position`.
+ */
+- (void)truncateToPosition:(NSDictionary*)position;
+
+@end
+
+NS_ASSUME_NONNULL_END
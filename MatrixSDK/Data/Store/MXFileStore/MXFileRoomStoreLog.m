@@ -0,0 +1,274 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXFileRoomStoreLog.h"
+
+static NSString *const kMXFileRoomStoreLogSegmentFilePrefix = @"messagesLog.";
+
+// Segment header: magic + format version
+static uint32_t const kMXFileRoomStoreLogMagic = 0x4D58524C;   // "MXRL"
+static uint32_t const kMXFileRoomStoreLogVersion = 1;
+static NSUInteger const kMXFileRoomStoreLogHeaderSize = 2 * sizeof(uint32_t);
+
+// Record header: payload length + payload checksum
+static NSUInteger const kMXFileRoomStoreLogRecordHeaderSize = 2 * sizeof(uint32_t);
+
+// A new segment is started when the current one reaches this size
+static unsigned long long const kMXFileRoomStoreLogSegmentMaxSize = 512 * 1024;
+
+static NSString *const kMXFileRoomStoreLogPositionSegmentsCount = @"segmentsCount";
+static NSString *const kMXFileRoomStoreLogPositionLastSegmentSize = @"lastSegmentSize";
+
+// FNV-1a hash used as record checksum
+static uint32_t MXFileRoomStoreLogChecksum(const uint8_t *bytes, NSUInteger length)
+{
+    uint32_t hash = 2166136261u;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+@interface MXFileRoomStoreLog ()
+{
+    NSString *folder;
+
+    // Sizes of the segments files, in segment order
+    NSMutableArray<NSNumber*> *segmentsSizes;
+}
+@end
+
+@implementation MXFileRoomStoreLog
+
+- (instancetype)initWithFolder:(NSString *)theFolder
+{
+    self = [super init];
+    if (self)
+    {
+        folder = theFolder;
+        segmentsSizes = [NSMutableArray array];
+
+        // Segments are numbered contiguously from 0
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        NSString *segmentFile = [self segmentFile:0];
+        while ([fileManager fileExistsAtPath:segmentFile])
+        {
+            NSDictionary *attributes = [fileManager attributesOfItemAtPath:segmentFile error:nil];
+            [segmentsSizes addObject:@(attributes.fileSize)];
+
+            segmentFile = [self segmentFile:segmentsSizes.count];
+        }
+    }
+    return self;
+}
+
+- (unsigned long long)size
+{
+    unsigned long long size = 0;
+    for (NSNumber *segmentSize in segmentsSizes)
+    {
+        size += segmentSize.unsignedLongLongValue;
+    }
+    return size;
+}
+
+- (void)enumerateRecordsUsingBlock:(void (^)(NSData *record))block
+{
+    for (NSUInteger segment = 0; segment < segmentsSizes.count; segment++)
+    {
+        NSData *data = [NSData dataWithContentsOfFile:[self segmentFile:segment] options:NSDataReadingMappedIfSafe error:nil];
+        const uint8_t *bytes = data.bytes;
+
+        // Check the segment header
+        uint32_t header[2] = {0, 0};
+        if (data.length >= kMXFileRoomStoreLogHeaderSize)
+        {
+            memcpy(header, bytes, kMXFileRoomStoreLogHeaderSize);
+        }
+        if (CFSwapInt32LittleToHost(header[0]) != kMXFileRoomStoreLogMagic
+            || CFSwapInt32LittleToHost(header[1]) != kMXFileRoomStoreLogVersion)
+        {
+            NSLog(@"[MXFileRoomStoreLog] enumerateRecords: Invalid header in segment %tu. Drop the log from it", segment);
+            [self truncateSegment:segment atOffset:0];
+            return;
+        }
+
+        NSUInteger offset = kMXFileRoomStoreLogHeaderSize;
+        while (offset < data.length)
+        {
+            uint32_t recordHeader[2];
+            if (data.length - offset < kMXFileRoomStoreLogRecordHeaderSize)
+            {
+                break;
+            }
+            memcpy(recordHeader, bytes + offset, kMXFileRoomStoreLogRecordHeaderSize);
+
+            NSUInteger length = CFSwapInt32LittleToHost(recordHeader[0]);
+            uint32_t checksum = CFSwapInt32LittleToHost(recordHeader[1]);
+            NSUInteger payloadOffset = offset + kMXFileRoomStoreLogRecordHeaderSize;
+
+            if (data.length - payloadOffset < length
+                || MXFileRoomStoreLogChecksum(bytes + payloadOffset, length) != checksum)
+            {
+                break;
+            }
+
+            @autoreleasepool
+            {
+                block([data subdataWithRange:NSMakeRange(payloadOffset, length)]);
+            }
+
+            offset = payloadOffset + length;
+        }
+
+        if (offset != data.length)
+        {
+            // The tail of the log has not been fully written
+            NSLog(@"[MXFileRoomStoreLog] enumerateRecords: Torn record at offset %tu in segment %tu. Truncate the log", offset, segment);
+            [self truncateSegment:segment atOffset:offset];
+            return;
+        }
+    }
+}
+
+- (void)appendRecords:(NSArray<NSData *> *)records
+{
+    if (!records.count)
+    {
+        return;
+    }
+
+    NSMutableData *data = [NSMutableData data];
+
+    if (!segmentsSizes.count || segmentsSizes.lastObject.unsignedLongLongValue >= kMXFileRoomStoreLogSegmentMaxSize)
+    {
+        // Start a new segment
+        NSString *segmentFile = [self segmentFile:segmentsSizes.count];
+        [[NSFileManager defaultManager] createFileAtPath:segmentFile contents:nil attributes:nil];
+        [segmentsSizes addObject:@(0)];
+
+        uint32_t header[2] = {CFSwapInt32HostToLittle(kMXFileRoomStoreLogMagic), CFSwapInt32HostToLittle(kMXFileRoomStoreLogVersion)};
+        [data appendBytes:header length:kMXFileRoomStoreLogHeaderSize];
+    }
+
+    for (NSData *record in records)
+    {
+        uint32_t recordHeader[2] = {
+            CFSwapInt32HostToLittle((uint32_t)record.length),
+            CFSwapInt32HostToLittle(MXFileRoomStoreLogChecksum(record.bytes, record.length))
+        };
+        [data appendBytes:recordHeader length:kMXFileRoomStoreLogRecordHeaderSize];
+        [data appendData:record];
+    }
+
+    NSUInteger segment = segmentsSizes.count - 1;
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:[self segmentFile:segment]];
+    [fileHandle seekToFileOffset:segmentsSizes[segment].unsignedLongLongValue];
+    [fileHandle writeData:data];
+    [fileHandle closeFile];
+
+    segmentsSizes[segment] = @(segmentsSizes[segment].unsignedLongLongValue + data.length);
+}
+
+- (void)moveSegmentsToFolder:(NSString *)backupFolder
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    for (NSUInteger segment = 0; segment < segmentsSizes.count; segment++)
+    {
+        NSString *segmentFile = [self segmentFile:segment];
+        if (backupFolder)
+        {
+            NSString *backupFile = [backupFolder stringByAppendingPathComponent:segmentFile.lastPathComponent];
+            if ([fileManager moveItemAtPath:segmentFile toPath:backupFile error:nil])
+            {
+                continue;
+            }
+        }
+
+        [fileManager removeItemAtPath:segmentFile error:nil];
+    }
+
+    [segmentsSizes removeAllObjects];
+}
+
+- (NSDictionary *)position
+{
+    return @{
+             kMXFileRoomStoreLogPositionSegmentsCount: @(segmentsSizes.count),
+             kMXFileRoomStoreLogPositionLastSegmentSize: segmentsSizes.lastObject ?: @(0)
+             };
+}
+
+- (void)truncateToPosition:(NSDictionary *)position
+{
+    NSUInteger segmentsCount = [position[kMXFileRoomStoreLogPositionSegmentsCount] unsignedIntegerValue];
+    unsigned long long lastSegmentSize = [position[kMXFileRoomStoreLogPositionLastSegmentSize] unsignedLongLongValue];
+
+    if (segmentsCount == 0)
+    {
+        [self truncateSegment:0 atOffset:0];
+    }
+    else if (segmentsCount <= segmentsSizes.count)
+    {
+        [self truncateSegment:segmentsCount - 1 atOffset:lastSegmentSize];
+    }
+}
+
+
+#pragma mark - Private methods
+
+- (NSString*)segmentFile:(NSUInteger)segment
+{
+    return [folder stringByAppendingPathComponent:[NSString stringWithFormat:@"%@%tu", kMXFileRoomStoreLogSegmentFilePrefix, segment]];
+}
+
+/**
+ Truncate a segment and delete all segments after it.
+
+ A segment truncated to its start is deleted too.
+ */
+- (void)truncateSegment:(NSUInteger)segment atOffset:(unsigned long long)offset
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    while (segmentsSizes.count > segment + 1)
+    {
+        [fileManager removeItemAtPath:[self segmentFile:segmentsSizes.count - 1] error:nil];
+        [segmentsSizes removeLastObject];
+    }
+
+    if (segmentsSizes.count == segment + 1)
+    {
+        if (offset <= kMXFileRoomStoreLogHeaderSize)
+        {
+            [fileManager removeItemAtPath:[self segmentFile:segment] error:nil];
+            [segmentsSizes removeLastObject];
+        }
+        else if (offset < segmentsSizes[segment].unsignedLongLongValue)
+        {
+            NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:[self segmentFile:segment]];
+            [fileHandle truncateFileAtOffset:offset];
+            [fileHandle closeFile];
+
+            segmentsSizes[segment] = @(offset);
+        }
+    }
+}
+
+@end
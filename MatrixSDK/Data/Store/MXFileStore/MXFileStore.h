@@ -32,7 +32,12 @@ typedef NS_OPTIONS(NSInteger, MXFileStorePreloadOptions)
     MXFileStorePreloadOptionRoomState = 0x2,
 
     // Preload rooms account data
-    MXFileStorePreloadOptionRoomAccountData = 0x4
+    MXFileStorePreloadOptionRoomAccountData = 0x4,
+
+    // Preload rooms messages.
+    // If not set, the messages of a room are loaded on their first access and
+    // can be unloaded later (see `[MXFileStore setLazyLoadedRoomsLimit:]`).
+    MXFileStorePreloadOptionRoomMessages = 0x8
 };
 
 /**
@@ -47,13 +52,16 @@ typedef NS_OPTIONS(NSInteger, MXFileStorePreloadOptions)
         + Matrix user id (one folder per account)
             + rooms
                 + {roomId1}
-                    L messages: The room messages
+                    L messages: The snapshot of the room messages
+                    L messagesLog.0, messagesLog.1, ...: The segments of the append-only log
+                            of changes made to the room messages since the snapshot
                     L state: The room state events
                     L summary: The room summary
                     L accountData: The account data for this room
                     L receipts: The read receipts for this room
                 + {roomId2}
                     L messages
+                    L messagesLog.0
                     L state
                     L summary
                     L accountData
@@ -75,7 +83,8 @@ typedef NS_OPTIONS(NSInteger, MXFileStorePreloadOptions)
                   interrupted.
                 + {syncToken} : the token that corresponds to the backup data
                     + rooms
-                        + {roomIdA}
+                        + {roomIdA}: Backup of room files and the `messagesLogRollback` file that
+                                     indicates where to truncate back the room messages log
                         + {roomIdB}
                         + ...
                     + users
@@ -112,6 +121,19 @@ typedef NS_OPTIONS(NSInteger, MXFileStorePreloadOptions)
  */
 + (void)setPreloadOptions:(MXFileStorePreloadOptions)preloadOptions;
 
+/**
+ Set the maximum number of rooms whose messages are kept in memory when they are loaded
+ on demand, ie when `MXFileStorePreloadOptionRoomMessages` is not set.
+
+ Beyond this limit, the least recently used rooms with no pending changes are unloaded.
+ They will be loaded again from the file system on their next access. Their unread
+ counts already done are stored with them so that `localUnreadEventCount:withTypeIn:`
+ does not need to load them again.
+
+ @param limit the number of rooms. 0 means no limit. Default is 100.
+ */
++ (void)setLazyLoadedRoomsLimit:(NSUInteger)limit;
+
 #pragma mark - Async API
 
 /**
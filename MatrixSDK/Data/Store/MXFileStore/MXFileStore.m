@@ -19,13 +19,18 @@
 #import "MXFileStore.h"
 
 #import "MXBackgroundModeHandler.h"
+#import "MXBinaryArchiver.h"
 #import "MXEnumConstants.h"
 #import "MXFileRoomStore.h"
+#import "MXFileRoomStoreLog.h"
 #import "MXFileStoreMetaData.h"
 #import "MXSDKOptions.h"
 #import "MXTools.h"
 
-static NSUInteger const kMXFileVersion = 66;
+static NSUInteger const kMXFileVersion = 68;
+
+// The oldest store version whose data can be kept on upgrade
+static NSUInteger const kMXFileMigratableVersion = 66;
 
 static NSString *const kMXFileStoreFolder = @"MXFileStore";
 static NSString *const kMXFileStoreMedaDataFile = @"MXFileStore";
@@ -38,12 +43,22 @@ static NSString *const kMXFileStoreSavingMarker = @"savingMarker";
 
 static NSString *const kMXFileStoreRoomsFolder = @"rooms";
 static NSString *const kMXFileStoreRoomMessagesFile = @"messages";
+static NSString *const kMXFileStoreRoomMessagesLogRollbackFile = @"messagesLogRollback";
 static NSString *const kMXFileStoreRoomStateFile = @"state";
 static NSString *const kMXFileStoreRoomSummaryFile = @"summary";
 static NSString *const kMXFileStoreRoomAccountDataFile = @"accountData";
 static NSString *const kMXFileStoreRoomReadReceiptsFile = @"readReceipts";
+static NSString *const kMXFileStoreRoomUnreadCountersFile = @"unreadCounters";
+
+// The room messages log is folded into a new snapshot when it becomes bigger than
+// the snapshot itself and than this size
+static unsigned long long const kMXFileStoreRoomMessagesLogMinCompactionSize = 1024 * 1024;
 
 static NSUInteger preloadOptions;
+static NSUInteger lazyLoadedRoomsLimit;
+
+// Key to detect that code runs on the MXFileStore dispatch queue
+static void *kMXFileStoreDispatchQueueKey = &kMXFileStoreDispatchQueueKey;
 
 @interface MXFileStore ()
 {
@@ -54,6 +69,30 @@ static NSUInteger preloadOptions;
     // List of rooms to save on [MXStore commit]
     NSMutableArray *roomsToCommitForMessages;
 
+    // Commit operations queued by the save methods. They are run concurrently by `runCommitTasks`.
+    NSMutableArray<dispatch_block_t> *commitTasks;
+
+    // The messages logs of rooms. Accessed only from `dispatchQueue`.
+    NSMutableDictionary<NSString*, MXFileRoomStoreLog*> *roomsMessagesLogs;
+
+    // Rooms stored in the file system whose messages are not loaded in `roomStores` yet.
+    // There is no pending write of their messages on `dispatchQueue`, which allows to read
+    // them from the main thread.
+    // Used only when messages are not preloaded.
+    NSMutableSet<NSString*> *roomsToLoad;
+
+    // Rooms in `roomStores` ordered from the least recently used.
+    // Used only when messages are not preloaded.
+    NSMutableOrderedSet<NSString*> *roomsLoadedOnDemand;
+
+    // Unread counters snapshots of rooms in `roomsToLoad` (see [MXMemoryRoomStore unreadCountersSnapshot]).
+    // They allow to get unread counts without loading rooms messages.
+    // Used only when messages are not preloaded.
+    NSMutableDictionary<NSString*, NSDictionary*> *roomsUnreadCounters;
+
+    // Unread counters snapshots to store. NSNull means there is none.
+    NSMutableDictionary<NSString*, id> *roomsToCommitForUnreadCounters;
+
     NSMutableDictionary *roomsToCommitForState;
 
     NSMutableDictionary<NSString*, MXRoomSummary*> *roomsToCommitForSummary;
@@ -103,6 +142,8 @@ static NSUInteger preloadOptions;
     // The queue invokes blocks serially in FIFO order.
     // This ensures that data is stored in the expected order: MXFileStore metadata
     // must be stored after messages and state events because of the event stream token it stores.
+    // Within a commit, the writes of the different data kinds and rooms are run concurrently
+    // from a single block of this queue (see `runCommitTasks`).
     dispatch_queue_t dispatchQueue;
 
     // The number of commits being done
@@ -127,7 +168,9 @@ static NSUInteger preloadOptions;
     dispatch_once(&onceToken, ^{
 
         // By default, we do not need to preload rooms states now
-        preloadOptions = MXFileStorePreloadOptionRoomSummary | MXFileStorePreloadOptionRoomAccountData;
+        preloadOptions = MXFileStorePreloadOptionRoomSummary | MXFileStorePreloadOptionRoomAccountData | MXFileStorePreloadOptionRoomMessages;
+
+        lazyLoadedRoomsLimit = 100;
     });
 }
 
@@ -137,6 +180,12 @@ static NSUInteger preloadOptions;
     if (self)
     {
         roomsToCommitForMessages = [NSMutableArray array];
+        roomsMessagesLogs = [NSMutableDictionary dictionary];
+        commitTasks = [NSMutableArray array];
+        roomsToLoad = [NSMutableSet set];
+        roomsLoadedOnDemand = [NSMutableOrderedSet orderedSet];
+        roomsUnreadCounters = [NSMutableDictionary dictionary];
+        roomsToCommitForUnreadCounters = [NSMutableDictionary dictionary];
         roomsToCommitForState = [NSMutableDictionary dictionary];
         roomsToCommitForSummary = [NSMutableDictionary dictionary];
         roomsToCommitForAccountData = [NSMutableDictionary dictionary];
@@ -152,8 +201,11 @@ static NSUInteger preloadOptions;
         metaDataHasChanged = NO;
 
         dispatchQueue = dispatch_queue_create("MXFileStoreDispatchQueue", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(dispatchQueue, kMXFileStoreDispatchQueueKey, kMXFileStoreDispatchQueueKey, NULL);
 
         pendingCommits = 0;
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(onDidDecryptEventOfUnloadedRoom:) name:kMXEventDidDecryptNotification object:nil];
     }
     return self;
 }
@@ -214,7 +266,21 @@ static NSUInteger preloadOptions;
                     [[NSURLCache sharedURLCache] removeAllCachedResponses];
                 }
 
-                [self deleteAllData];
+                if (self->metaData.version >= kMXFileMigratableVersion && self->metaData.version < kMXFileVersion)
+                {
+                    // Version 67 appends room messages changes to a log: a version 66 messages file
+                    // is read as a snapshot with an empty log.
+                    // Version 68 only changed the files encoding. MXBinaryUnarchiver still reads
+                    // NSKeyedArchiver files: keep data and let next commits rewrite them
+                    NSLog(@"[MXFileStore] Migrate store from version %tu to version %tu", self->metaData.version, kMXFileVersion);
+                    self->metaData.version = kMXFileVersion;
+                    self->metaDataHasChanged = YES;
+                    [self saveMetaData];
+                }
+                else
+                {
+                    [self deleteAllData];
+                }
             }
 
             // If metaData is still defined, we can load rooms data
@@ -298,6 +364,11 @@ static NSUInteger preloadOptions;
     preloadOptions = thePreloadOptions;
 }
 
++ (void)setLazyLoadedRoomsLimit:(NSUInteger)limit
+{
+    lazyLoadedRoomsLimit = limit;
+}
+
 #pragma mark - MXStore
 - (void)storeEventForRoom:(NSString*)roomId event:(MXEvent*)event direction:(MXTimelineDirection)direction
 {
@@ -339,7 +410,11 @@ static NSUInteger preloadOptions;
     }
     
     // Remove this room identifier from the other arrays.
+    [roomsToLoad removeObject:roomId];
+    [roomsLoadedOnDemand removeObject:roomId];
+    [roomsUnreadCounters removeObjectForKey:roomId];
     [roomsToCommitForMessages removeObject:roomId];
+    [roomsToCommitForUnreadCounters removeObjectForKey:roomId];
     [roomsToCommitForState removeObjectForKey:roomId];
     [roomsToCommitForSummary removeObjectForKey:roomId];
     [roomsToCommitForAccountData removeObjectForKey:roomId];
@@ -365,6 +440,10 @@ static NSUInteger preloadOptions;
     // Reset data
     metaData = nil;
     [roomStores removeAllObjects];
+    [roomsMessagesLogs removeAllObjects];
+    [roomsToLoad removeAllObjects];
+    [roomsLoadedOnDemand removeAllObjects];
+    [roomsUnreadCounters removeAllObjects];
     self.eventStreamToken = nil;
 }
 
@@ -439,9 +518,52 @@ static NSUInteger preloadOptions;
 
 - (NSArray *)rooms
 {
+    if (roomsToLoad.count)
+    {
+        return [roomStores.allKeys arrayByAddingObjectsFromArray:roomsToLoad.allObjects];
+    }
     return roomStores.allKeys;
 }
 
+- (NSUInteger)localUnreadEventCount:(NSString *)roomId withTypeIn:(NSArray *)types
+{
+    if ([roomsToLoad containsObject:roomId])
+    {
+        MXReceiptData *data = [self getReceiptInRoom:roomId forUserId:credentials.userId];
+        if (!data)
+        {
+            return 0;
+        }
+
+        // Use the counts stored with the room to avoid loading its messages
+        NSNumber *count = [MXMemoryRoomStore unreadEventCountInCounters:roomsUnreadCounters[roomId]
+                                                                  after:data.eventId
+                                                                 except:credentials.userId
+                                                             withTypeIn:[NSSet setWithArray:types]];
+        if (count)
+        {
+            return count.unsignedIntegerValue;
+        }
+
+        // Else, the room messages must be loaded to count them
+        [self getOrCreateRoomStore:roomId];
+    }
+
+    return [super localUnreadEventCount:roomId withTypeIn:types];
+}
+
+- (void)onDidDecryptEventOfUnloadedRoom:(NSNotification *)notification
+{
+    MXEvent *event = notification.object;
+
+    // Like [MXMemoryStore onDidDecryptEvent:], count unread events of the room again
+    if (event.roomId && roomsUnreadCounters[event.roomId])
+    {
+        [roomsUnreadCounters removeObjectForKey:event.roomId];
+        roomsToCommitForUnreadCounters[event.roomId] = [NSNull null];
+    }
+}
+
 - (void)storeStateForRoom:(NSString*)roomId stateEvents:(NSArray*)stateEvents
 {
     roomsToCommitForState[roomId] = stateEvents;
@@ -466,7 +588,7 @@ static NSUInteger preloadOptions;
 
     if (!stateEvents)
     {
-        stateEvents =[NSKeyedUnarchiver unarchiveObjectWithFile:[self stateFileForRoom:roomId forBackup:NO]];
+        stateEvents =[MXBinaryUnarchiver unarchiveObjectWithFile:[self stateFileForRoom:roomId forBackup:NO]];
 
         if (NO == [NSThread isMainThread])
         {
@@ -496,7 +618,7 @@ static NSUInteger preloadOptions;
 
     if (!summary)
     {
-        summary =[NSKeyedUnarchiver unarchiveObjectWithFile:[self summaryFileForRoom:roomId forBackup:NO]];
+        summary =[MXBinaryUnarchiver unarchiveObjectWithFile:[self summaryFileForRoom:roomId forBackup:NO]];
 
         if (NO == [NSThread isMainThread])
         {
@@ -526,7 +648,7 @@ static NSUInteger preloadOptions;
 
     if (!roomUserdData)
     {
-        roomUserdData =[NSKeyedUnarchiver unarchiveObjectWithFile:[self accountDataFileForRoom:roomId forBackup:NO]];
+        roomUserdData =[MXBinaryUnarchiver unarchiveObjectWithFile:[self accountDataFileForRoom:roomId forBackup:NO]];
 
         if (NO == [NSThread isMainThread])
         {
@@ -725,20 +847,82 @@ static NSUInteger preloadOptions;
 
 - (void)saveDataToFiles
 {
-    // Save each component one by one
+    // Deletions must be done before new data for the same rooms or groups is stored
     [self saveRoomsDeletion];
+    [self saveGroupsDeletion];
+
+    // Then, save other components concurrently
     [self saveRoomsMessages];
+    [self saveRoomsUnreadCounters];
     [self saveRoomsState];
     [self saveRoomsSummaries];
     [self saveRoomsAccountData];
     [self saveReceipts];
     [self saveUsers];
-    [self saveGroupsDeletion];
     [self saveGroups];
     [self saveFilters];
+    [self runCommitTasks];
+
+    // Metadata must be stored after all other data because of the event stream token it stores
     [self saveMetaData];
 }
 
+/**
+ Add a task to run by the next `runCommitTasks` call.
+
+ The task can run concurrently with other commit tasks. It must not write files written
+ by them.
+
+ @param task the block to run.
+ */
+- (void)addCommitTask:(dispatch_block_t)task
+{
+    [commitTasks addObject:task];
+}
+
+/**
+ Run pending commit tasks concurrently.
+
+ They are dispatched as a single block on `dispatchQueue` that completes once all of them
+ are done. Then, all operations queued after on `dispatchQueue` see their writes.
+ */
+- (void)runCommitTasks
+{
+    if (commitTasks.count)
+    {
+        NSArray<dispatch_block_t> *tasks = commitTasks;
+        commitTasks = [NSMutableArray array];
+
+        dispatch_async(dispatchQueue, ^(void){
+            dispatch_apply(tasks.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+                @autoreleasepool
+                {
+                    tasks[index]();
+                }
+            });
+        });
+    }
+}
+
+/**
+ Process items stored in separate files (rooms, users groups, ...) concurrently.
+
+ Concurrency is bounded by GCD to the number of available cores. The method returns
+ once all items have been processed.
+
+ @param items the items.
+ @param block the block called for each item.
+ */
+- (void)concurrentlyEnumerateItems:(NSArray<NSString*>*)items usingBlock:(void (^)(NSString *item))block
+{
+    dispatch_apply(items.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+        @autoreleasepool
+        {
+            block(items[index]);
+        }
+    });
+}
+
 - (void)close
 {
     NSLog(@"[MXFileStore] close: %tu pendingCommits", pendingCommits);
@@ -768,13 +952,138 @@ static NSUInteger preloadOptions;
     MXFileRoomStore *roomStore = roomStores[roomId];
     if (nil == roomStore)
     {
-        // MXFileStore requires MXFileRoomStore objets
+        if ([roomsToLoad containsObject:roomId])
+        {
+            roomStore = [self loadRoomStoreOnDemand:roomId];
+        }
+        else
+        {
+            // MXFileStore requires MXFileRoomStore objets
+            roomStore = [[MXFileRoomStore alloc] init];
+            roomStores[roomId] = roomStore;
+        }
+    }
+
+    if (!(preloadOptions & MXFileStorePreloadOptionRoomMessages))
+    {
+        // Mark the room as the most recently used
+        [roomsLoadedOnDemand removeObject:roomId];
+        [roomsLoadedOnDemand addObject:roomId];
+    }
+
+    return roomStore;
+}
+
+/**
+ Load the messages of a room from the file system on its first access.
+
+ @param roomId the room id.
+ @return the loaded room store.
+ */
+- (MXFileRoomStore*)loadRoomStoreOnDemand:(NSString*)roomId
+{
+    // Files of rooms in `roomsToLoad` have no pending writes. Read them directly rather than
+    // waiting for the commits queued on `dispatchQueue` for other rooms.
+    // The log used to read them is then handed over to `dispatchQueue` for next commits
+    MXFileRoomStoreLog *log = [[MXFileRoomStoreLog alloc] initWithFolder:[self folderForRoom:roomId forBackup:NO]];
+    MXFileRoomStore *roomStore = [self loadRoomStore:roomId withMessagesLog:log];
+
+    MXWeakify(self);
+    dispatch_block_t handOverBlock = ^{
+        MXStrongifyAndReturnIfNil(self);
+        self->roomsMessagesLogs[roomId] = log;
+    };
+    if (dispatch_get_specific(kMXFileStoreDispatchQueueKey))
+    {
+        handOverBlock();
+    }
+    else
+    {
+        dispatch_async(dispatchQueue, handOverBlock);
+    }
+
+    if (!roomStore)
+    {
+        NSLog(@"[MXFileStore] loadRoomStoreOnDemand: Warning: Cannot load messages of room %@. Start from empty data", roomId);
         roomStore = [[MXFileRoomStore alloc] init];
-        roomStores[roomId] = roomStore;
     }
+
+    [roomsToLoad removeObject:roomId];
+    [roomsUnreadCounters removeObjectForKey:roomId];
+    roomStores[roomId] = roomStore;
+
+    [self unloadLeastRecentlyUsedRooms];
+
     return roomStore;
 }
 
+/**
+ Unload rooms messages beyond `lazyLoadedRoomsLimit`.
+
+ Only rooms without changes to commit are unloaded. They are actually unloaded once
+ their writes already queued on `dispatchQueue` are done.
+ */
+- (void)unloadLeastRecentlyUsedRooms
+{
+    if (!lazyLoadedRoomsLimit || roomsLoadedOnDemand.count < lazyLoadedRoomsLimit)
+    {
+        return;
+    }
+
+    NSMutableArray<NSString*> *roomsToUnload = [NSMutableArray array];
+    NSUInteger roomsCount = roomsLoadedOnDemand.count;
+
+    for (NSString *roomId in roomsLoadedOnDemand)
+    {
+        if (roomsCount < lazyLoadedRoomsLimit)
+        {
+            break;
+        }
+
+        if (NSNotFound == [roomsToCommitForMessages indexOfObject:roomId])
+        {
+            [roomsToUnload addObject:roomId];
+            roomsCount--;
+        }
+    }
+
+    NSMutableDictionary<NSString*, MXFileRoomStore*> *roomStoresToUnload = [NSMutableDictionary dictionary];
+    for (NSString *roomId in roomsToUnload)
+    {
+        roomStoresToUnload[roomId] = roomStores[roomId];
+        [roomsLoadedOnDemand removeObject:roomId];
+    }
+
+    // Keep serving rooms from memory until their queued writes are done so that
+    // `loadRoomStoreOnDemand` never reads files being written
+    MXWeakify(self);
+    dispatch_async(dispatchQueue, ^{
+        dispatch_async(dispatch_get_main_queue(), ^{
+            MXStrongifyAndReturnIfNil(self);
+
+            for (NSString *roomId in roomStoresToUnload)
+            {
+                // Skip rooms accessed, changed or deleted in the meantime
+                if (self->roomStores[roomId] == roomStoresToUnload[roomId]
+                    && ![self->roomsLoadedOnDemand containsObject:roomId]
+                    && NSNotFound == [self->roomsToCommitForMessages indexOfObject:roomId])
+                {
+                    [self->roomStores removeObjectForKey:roomId];
+                    [self->roomsToLoad addObject:roomId];
+
+                    // Keep unread counts done while the room was loaded
+                    NSDictionary *countersSnapshot = [roomStoresToUnload[roomId] unreadCountersSnapshot];
+                    if (countersSnapshot)
+                    {
+                        self->roomsUnreadCounters[roomId] = countersSnapshot;
+                        self->roomsToCommitForUnreadCounters[roomId] = countersSnapshot;
+                    }
+                }
+            }
+        });
+    });
+}
+
 
 #pragma mark - File paths
 - (void)setUpStoragePaths
@@ -843,6 +1152,11 @@ static NSUInteger preloadOptions;
     return [[self folderForRoom:roomId forBackup:backup] stringByAppendingPathComponent:kMXFileStoreRoomMessagesFile];
 }
 
+- (NSString*)messagesLogRollbackFileForRoom:(NSString*)roomId forBackup:(BOOL)backup
+{
+    return [[self folderForRoom:roomId forBackup:backup] stringByAppendingPathComponent:kMXFileStoreRoomMessagesLogRollbackFile];
+}
+
 - (NSString*)stateFileForRoom:(NSString*)roomId forBackup:(BOOL)backup
 {
     return [[self folderForRoom:roomId forBackup:backup] stringByAppendingPathComponent:kMXFileStoreRoomStateFile];
@@ -863,6 +1177,11 @@ static NSUInteger preloadOptions;
     return [[self folderForRoom:roomId forBackup:backup] stringByAppendingPathComponent:kMXFileStoreRoomReadReceiptsFile];
 }
 
+- (NSString*)unreadCountersFileForRoom:(NSString*)roomId forBackup:(BOOL)backup
+{
+    return [[self folderForRoom:roomId forBackup:backup] stringByAppendingPathComponent:kMXFileStoreRoomUnreadCountersFile];
+}
+
 - (NSString*)metaDataFileForBackup:(BOOL)backup
 {
     if (!backup)
@@ -1036,22 +1355,21 @@ static NSUInteger preloadOptions;
 {
     NSArray<NSString *> *roomIDs = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:storeRoomsPath error:nil];
 
-    NSDate *startDate = [NSDate date];
+    if (!(preloadOptions & MXFileStorePreloadOptionRoomMessages))
+    {
+        // Only index rooms. Their messages will be loaded on demand
+        [roomsToLoad addObjectsFromArray:roomIDs];
+        [self loadRoomsUnreadCounters];
 
-    for (NSString *roomId in roomIDs)  {
+        NSLog(@"[MXFileStore] Indexed %tu rooms. Their messages will be loaded on demand", roomsToLoad.count);
+        return;
+    }
 
-        NSString *roomFile = [self messagesFileForRoom:roomId forBackup:NO];
+    NSDate *startDate = [NSDate date];
 
-        MXFileRoomStore *roomStore;
-        @try
-        {
-            roomStore =[NSKeyedUnarchiver unarchiveObjectWithFile:roomFile];
-        }
-        @catch (NSException *exception)
-        {
-            NSLog(@"[MXFileStore] Warning: MXFileRoomStore file for room %@ has been corrupted", roomId);
-        }
+    for (NSString *roomId in roomIDs)  {
 
+        MXFileRoomStore *roomStore = [self loadRoomStore:roomId];
         if (roomStore)
         {
             //NSLog(@"   - %@: %@", roomId, roomStore);
@@ -1068,11 +1386,135 @@ static NSUInteger preloadOptions;
     NSLog(@"[MXFileStore] Loaded room messages of %tu rooms in %.0fms", roomStores.allKeys.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
 }
 
+/**
+ Load the messages of a room from its snapshot and its log.
+
+ This operation must be called on the `dispatchQueue` thread.
+
+ @param roomId the room id.
+ @return the room store. nil if the room messages file is corrupted.
+ */
+- (MXFileRoomStore*)loadRoomStore:(NSString*)roomId
+{
+    return [self loadRoomStore:roomId withMessagesLog:[self messagesLogForRoom:roomId]];
+}
+
+/**
+ Load the messages of a room from its snapshot and a log.
+
+ This operation can be called from any thread if there is no pending write of the
+ room messages on `dispatchQueue`.
+
+ @param roomId the room id.
+ @param log the messages log of the room.
+ @return the room store. nil if the room messages file is corrupted.
+ */
+- (MXFileRoomStore*)loadRoomStore:(NSString*)roomId withMessagesLog:(MXFileRoomStoreLog*)log
+{
+    NSString *roomFile = [self messagesFileForRoom:roomId forBackup:NO];
+
+    MXFileRoomStore *roomStore;
+    @try
+    {
+        roomStore =[MXBinaryUnarchiver unarchiveObjectWithFile:roomFile];
+    }
+    @catch (NSException *exception)
+    {
+        NSLog(@"[MXFileStore] Warning: MXFileRoomStore file for room %@ has been corrupted", roomId);
+    }
+
+    if (roomStore)
+    {
+        // Apply changes logged since the snapshot
+        [self loadMessagesLog:log ofRoom:roomId intoRoomStore:roomStore];
+    }
+
+    return roomStore;
+}
+
+/**
+ Get the messages log of a room.
+
+ This operation must be called on the `dispatchQueue` thread.
+ */
+- (MXFileRoomStoreLog*)messagesLogForRoom:(NSString*)roomId
+{
+    MXFileRoomStoreLog *log = roomsMessagesLogs[roomId];
+    if (!log)
+    {
+        log = [[MXFileRoomStoreLog alloc] initWithFolder:[self folderForRoom:roomId forBackup:NO]];
+        roomsMessagesLogs[roomId] = log;
+    }
+    return log;
+}
+
+/**
+ Replay the messages log of a room on its snapshot.
+
+ Like `loadRoomStore:withMessagesLog:`, there must be no pending write of the room messages.
+ */
+- (void)loadMessagesLog:(MXFileRoomStoreLog*)log ofRoom:(NSString*)roomId intoRoomStore:(MXFileRoomStore*)roomStore
+{
+    // If the store has been restored from a backup, drop log records appended by the interrupted commit
+    NSString *rollbackFile = [self messagesLogRollbackFileForRoom:roomId forBackup:NO];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:rollbackFile])
+    {
+        NSDictionary *position = [MXBinaryUnarchiver unarchiveObjectWithFile:rollbackFile];
+        if (position)
+        {
+            [log truncateToPosition:position];
+        }
+        [[NSFileManager defaultManager] removeItemAtPath:rollbackFile error:nil];
+    }
+
+    [log enumerateRecordsUsingBlock:^(NSData *record) {
+
+        NSDictionary *change;
+        @try
+        {
+            change = [MXBinaryUnarchiver unarchiveObjectWithBinaryOrKeyedData:record];
+        }
+        @catch (NSException *exception)
+        {
+            NSLog(@"[MXFileStore] Warning: Messages log record for room %@ has been corrupted", roomId);
+        }
+
+        if (change)
+        {
+            [roomStore replayChange:change];
+        }
+    }];
+
+    NSDictionary *fileAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[self messagesFileForRoom:roomId forBackup:NO] error:nil];
+    log.snapshotSize = fileAttributes.fileSize;
+}
+
 - (void)saveRoomsMessages
 {
     if (roomsToCommitForMessages.count)
     {
-        NSArray *roomsToCommit = [[NSArray alloc] initWithArray:roomsToCommitForMessages copyItems:YES];
+        // Take a snapshot of the changes to store to process them on the other thread
+        NSMutableDictionary<NSString*, NSArray<NSDictionary*>*> *roomsToCommit = [NSMutableDictionary dictionary];
+        NSMutableDictionary<NSString*, MXFileRoomStore*> *roomStoresToCommit = [NSMutableDictionary dictionary];
+        NSMutableSet<NSString*> *roomsToSnapshot = [NSMutableSet set];
+        for (NSString *roomId in roomsToCommitForMessages)
+        {
+            MXFileRoomStore *roomStore = roomStores[roomId];
+            if (roomStore)
+            {
+                if (roomStore.needsSnapshot)
+                {
+                    [roomsToSnapshot addObject:roomId];
+                }
+                roomsToCommit[roomId] = [roomStore takePendingChanges];
+
+                // Stored unread counts must match stored messages
+                roomsToCommitForUnreadCounters[roomId] = [roomStore unreadCountersSnapshot] ?: [NSNull null];
+
+                // Keep a reference on the room store as it may be unloaded before the commit happens
+                roomStoresToCommit[roomId] = roomStore;
+            }
+        }
         [roomsToCommitForMessages removeAllObjects];
 
 #if DEBUG
@@ -1080,38 +1522,167 @@ static NSUInteger preloadOptions;
 #endif
 
         MXWeakify(self);
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
             MXStrongifyAndReturnIfNil(self);
 
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
-            // Save rooms where there was changes
+            // Get rooms logs before going concurrent
+            NSMutableDictionary<NSString*, MXFileRoomStoreLog*> *logs = [NSMutableDictionary dictionary];
             for (NSString *roomId in roomsToCommit)
             {
-                MXFileRoomStore *roomStore = self->roomStores[roomId];
+                logs[roomId] = [self messagesLogForRoom:roomId];
+            }
+
+            // Save rooms where there was changes
+            [self concurrentlyEnumerateItems:roomsToCommit.allKeys usingBlock:^(NSString *roomId) {
+                MXFileRoomStore *roomStore = roomStoresToCommit[roomId];
                 if (roomStore)
                 {
                     NSString *file = [self messagesFileForRoom:roomId forBackup:NO];
                     NSString *backupFile = [self messagesFileForRoom:roomId forBackup:YES];
 
-                    // Backup the file
-                    if (backupFile && [[NSFileManager defaultManager] fileExistsAtPath:file])
+                    MXFileRoomStoreLog *log = logs[roomId];
+
+                    [self checkFolderExistenceForRoom:roomId forBackup:NO];
+
+                    // Backup the end of the log so that it can be truncated back
+                    [self backupMessagesLogPosition:log ofRoom:roomId];
+
+                    if ([roomsToSnapshot containsObject:roomId]
+                        || ![[NSFileManager defaultManager] fileExistsAtPath:file]
+                        || log.size > MAX(kMXFileStoreRoomMessagesLogMinCompactionSize, log.snapshotSize))
                     {
-                        [self checkFolderExistenceForRoom:roomId forBackup:YES];
-                        [[NSFileManager defaultManager] moveItemAtPath:file toPath:backupFile error:nil];
+                        // Compact the log into a new snapshot
+                        // Backup the files
+                        if (backupFile)
+                        {
+                            [self checkFolderExistenceForRoom:roomId forBackup:YES];
+                            [[NSFileManager defaultManager] moveItemAtPath:file toPath:backupFile error:nil];
+                        }
+                        [log moveSegmentsToFolder:[self folderForRoom:roomId forBackup:YES]];
+
+                        // Store new data
+                        [MXBinaryArchiver archiveRootObject:roomStore toFile:file];
+
+                        NSDictionary *fileAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:file error:nil];
+                        log.snapshotSize = fileAttributes.fileSize;
                     }
+                    else
+                    {
+                        // Append only the changes
+                        NSMutableArray<NSData*> *records = [NSMutableArray array];
+                        for (NSDictionary *change in roomsToCommit[roomId])
+                        {
+                            [records addObject:[MXBinaryArchiver archivedDataWithRootObject:change]];
+                        }
 
-                    // Store new data
-                    [self checkFolderExistenceForRoom:roomId forBackup:NO];
-                    [NSKeyedArchiver archiveRootObject:roomStore toFile:file];
+                        [log appendRecords:records];
+                    }
                 }
-            }
+            }];
 
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for %tu rooms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
 #endif
-        });
+        }];
+    }
+}
+
+/**
+ Store in the backup folder the current end of the messages log of a room.
+
+ Only the first position stored for a given backup is kept so that a restore discards
+ all records appended since the backup started.
+ */
+- (void)backupMessagesLogPosition:(MXFileRoomStoreLog*)log ofRoom:(NSString*)roomId
+{
+    NSString *rollbackFile = [self messagesLogRollbackFileForRoom:roomId forBackup:YES];
+    if (rollbackFile && ![[NSFileManager defaultManager] fileExistsAtPath:rollbackFile])
+    {
+        [self checkFolderExistenceForRoom:roomId forBackup:YES];
+        [MXBinaryArchiver archiveRootObject:log.position toFile:rollbackFile];
+    }
+}
+
+
+#pragma mark - Rooms unread counters
+/**
+ Load unread counters snapshots of rooms whose messages are loaded on demand.
+
+ This operation must be called on the `dispatchQueue` thread to avoid blocking the main thread.
+ */
+- (void)loadRoomsUnreadCounters
+{
+    NSDate *startDate = [NSDate date];
+
+    for (NSString *roomId in roomsToLoad)
+    {
+        NSString *file = [self unreadCountersFileForRoom:roomId forBackup:NO];
+
+        NSDictionary *countersSnapshot;
+        @try
+        {
+            countersSnapshot = [MXBinaryUnarchiver unarchiveObjectWithFile:file];
+        }
+        @catch (NSException *exception)
+        {
+            NSLog(@"[MXFileStore] Warning: Unread counters file for room %@ has been corrupted", roomId);
+        }
+
+        // Without them, unread counts will be done by loading the room messages
+        if ([countersSnapshot isKindOfClass:NSDictionary.class])
+        {
+            roomsUnreadCounters[roomId] = countersSnapshot;
+        }
+    }
+
+    NSLog(@"[MXFileStore] Loaded unread counters of %tu rooms in %.0fms", roomsUnreadCounters.count, [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+}
+
+- (void)saveRoomsUnreadCounters
+{
+    if (roomsToCommitForUnreadCounters.count)
+    {
+        // Take a snapshot of room ids to store to process them on the other thread
+        NSDictionary *roomsToCommit = [NSDictionary dictionaryWithDictionary:roomsToCommitForUnreadCounters];
+        [roomsToCommitForUnreadCounters removeAllObjects];
+#if DEBUG
+        NSLog(@"[MXFileStore commit] queuing saveRoomsUnreadCounters for %tu rooms", roomsToCommit.count);
+#endif
+        [self addCommitTask:^{
+#if DEBUG
+            NSDate *startDate = [NSDate date];
+#endif
+            [self concurrentlyEnumerateItems:roomsToCommit.allKeys usingBlock:^(NSString *roomId) {
+                id countersSnapshot = roomsToCommit[roomId];
+
+                NSString *file = [self unreadCountersFileForRoom:roomId forBackup:NO];
+                NSString *backupFile = [self unreadCountersFileForRoom:roomId forBackup:YES];
+
+                // Backup the file. This also removes it if there is no counters anymore
+                if (backupFile && [[NSFileManager defaultManager] fileExistsAtPath:file])
+                {
+                    [self checkFolderExistenceForRoom:roomId forBackup:YES];
+                    [[NSFileManager defaultManager] moveItemAtPath:file toPath:backupFile error:nil];
+                }
+                else if (countersSnapshot == [NSNull null])
+                {
+                    [[NSFileManager defaultManager] removeItemAtPath:file error:nil];
+                }
+
+                // Store new data
+                if (countersSnapshot != [NSNull null])
+                {
+                    [self checkFolderExistenceForRoom:roomId forBackup:NO];
+                    [MXBinaryArchiver archiveRootObject:countersSnapshot toFile:file];
+                }
+            }];
+#if DEBUG
+            NSLog(@"[MXFileStore commit] lasted %.0fms for unread counters for %tu rooms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
+#endif
+        }];
     }
 }
 
@@ -1146,12 +1717,11 @@ static NSUInteger preloadOptions;
 #if DEBUG
         NSLog(@"[MXFileStore commit] queuing saveRoomsState for %tu rooms", roomsToCommit.count);
 #endif
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
-            for (NSString *roomId in roomsToCommit)
-            {
+            [self concurrentlyEnumerateItems:roomsToCommit.allKeys usingBlock:^(NSString *roomId) {
                 NSArray *stateEvents = roomsToCommit[roomId];
 
                 NSString *file = [self stateFileForRoom:roomId forBackup:NO];
@@ -1166,12 +1736,12 @@ static NSUInteger preloadOptions;
 
                 // Store new data
                 [self checkFolderExistenceForRoom:roomId forBackup:NO];
-                [NSKeyedArchiver archiveRootObject:stateEvents toFile:file];
-            }
+                [MXBinaryArchiver archiveRootObject:stateEvents toFile:file];
+            }];
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for %tu rooms state", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
 #endif
-        });
+        }];
     }
 }
 
@@ -1206,12 +1776,11 @@ static NSUInteger preloadOptions;
 #if DEBUG
         NSLog(@"[MXFileStore commit] queuing saveRoomsSummaries for %tu rooms", roomsToCommit.count);
 #endif
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
-            for (NSString *roomId in roomsToCommit)
-            {
+            [self concurrentlyEnumerateItems:roomsToCommit.allKeys usingBlock:^(NSString *roomId) {
                 MXRoomSummary *summary = roomsToCommit[roomId];
 
                 NSString *file = [self summaryFileForRoom:roomId forBackup:NO];
@@ -1226,12 +1795,12 @@ static NSUInteger preloadOptions;
 
                 // Store new data
                 [self checkFolderExistenceForRoom:roomId forBackup:NO];
-                [NSKeyedArchiver archiveRootObject:summary toFile:file];
-            }
+                [MXBinaryArchiver archiveRootObject:summary toFile:file];
+            }];
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for summaries for %tu rooms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
 #endif
-        });
+        }];
     }
 }
 
@@ -1266,12 +1835,11 @@ static NSUInteger preloadOptions;
 #if DEBUG
         NSLog(@"[MXFileStore commit] queuing saveRoomsAccountData for %tu rooms", roomsToCommit.count);
 #endif
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
-            for (NSString *roomId in roomsToCommit)
-            {
+            [self concurrentlyEnumerateItems:roomsToCommit.allKeys usingBlock:^(NSString *roomId) {
                 MXRoomAccountData *roomAccountData = roomsToCommit[roomId];
 
                 NSString *file = [self accountDataFileForRoom:roomId forBackup:NO];
@@ -1286,12 +1854,12 @@ static NSUInteger preloadOptions;
 
                 // Store new data
                 [self checkFolderExistenceForRoom:roomId forBackup:NO];
-                [NSKeyedArchiver archiveRootObject:roomAccountData toFile:file];
-            }
+                [MXBinaryArchiver archiveRootObject:roomAccountData toFile:file];
+            }];
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for account data for %tu rooms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
 #endif
-        });
+        }];
     }
 }
 
@@ -1314,6 +1882,8 @@ static NSUInteger preloadOptions;
             // Delete rooms folders from the file system
             for (NSString *roomId in roomsToCommit)
             {
+                [self->roomsMessagesLogs removeObjectForKey:roomId];
+
                 NSString *folder = [self folderForRoom:roomId forBackup:NO];
                 NSString *backupFolder = [self folderForRoom:roomId forBackup:YES];
 
@@ -1377,7 +1947,7 @@ static NSUInteger preloadOptions;
 
     @try
     {
-        metaData = [NSKeyedUnarchiver unarchiveObjectWithFile:metaDataFile];
+        metaData = [MXBinaryUnarchiver unarchiveObjectWithFile:metaDataFile];
     }
     @catch (NSException *exception)
     {
@@ -1434,7 +2004,7 @@ static NSUInteger preloadOptions;
             self->backupEventStreamToken = self->metaData.eventStreamToken;
 
             // Store new data
-            [NSKeyedArchiver archiveRootObject:self->metaData toFile:file];
+            [MXBinaryArchiver archiveRootObject:self->metaData toFile:file];
 
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for metadata", [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
@@ -1447,7 +2017,7 @@ static NSUInteger preloadOptions;
 - (void)loadFilters
 {
     NSString *file = [storePath stringByAppendingPathComponent:kMXFileStoreFiltersFile];
-    filters = [NSKeyedUnarchiver unarchiveObjectWithFile:file];
+    filters = [MXBinaryUnarchiver unarchiveObjectWithFile:file];
 
     if (!filters)
     {
@@ -1464,7 +2034,7 @@ static NSUInteger preloadOptions;
         filtersHasChanged = NO;
 
         MXWeakify(self);
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
             MXStrongifyAndReturnIfNil(self);
 
             NSString *file = [self filtersFileForBackup:NO];
@@ -1484,8 +2054,8 @@ static NSUInteger preloadOptions;
             }
 
             // Store new data
-            [NSKeyedArchiver archiveRootObject:self->filters toFile:file];
-        });
+            [MXBinaryArchiver archiveRootObject:self->filters toFile:file];
+        }];
     }
 }
 
@@ -1509,7 +2079,7 @@ static NSUInteger preloadOptions;
         // Load stored users in this group
         @try
         {
-            NSMutableDictionary <NSString*, MXUser*> *groupUsers = [NSKeyedUnarchiver unarchiveObjectWithFile:groupFile];
+            NSMutableDictionary <NSString*, MXUser*> *groupUsers = [MXBinaryUnarchiver unarchiveObjectWithFile:groupFile];
             if (groupUsers)
             {
                 // Append them
@@ -1552,7 +2122,7 @@ static NSUInteger preloadOptions;
             // Load stored users in this group
             @try
             {
-                NSMutableDictionary <NSString *, MXUser *> *groupUsers = [NSKeyedUnarchiver unarchiveObjectWithFile:groupFile];
+                NSMutableDictionary <NSString *, MXUser *> *groupUsers = [MXBinaryUnarchiver unarchiveObjectWithFile:groupFile];
                 if (groupUsers)
                 {
                     NSSet *usersToLoad = [NSSet setWithArray:groups[group]];
@@ -1584,7 +2154,7 @@ static NSUInteger preloadOptions;
 #if DEBUG
         NSLog(@"[MXFileStore commit] queuing saveUsers");
 #endif
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
 
 #if DEBUG
             NSDate *startDate = [NSDate date];
@@ -1619,8 +2189,7 @@ static NSUInteger preloadOptions;
             }
 
             // Process users group one by one
-            for (NSString *file in usersByFiles)
-            {
+            [self concurrentlyEnumerateItems:usersByFiles.allKeys usingBlock:^(NSString *file) {
                 // Backup the file for this group of users
                 NSString *backupFile = usersByFilesBackupFiles[file];
                 if (backupFile && [[NSFileManager defaultManager] fileExistsAtPath:file])
@@ -1629,7 +2198,7 @@ static NSUInteger preloadOptions;
                 }
 
                 // Load stored users in this group
-                NSMutableDictionary <NSString*, MXUser*> *group = [NSKeyedUnarchiver unarchiveObjectWithFile:file];
+                NSMutableDictionary <NSString*, MXUser*> *group = [MXBinaryUnarchiver unarchiveObjectWithFile:file];
                 if (!group)
                 {
                     group = [NSMutableDictionary dictionary];
@@ -1642,13 +2211,13 @@ static NSUInteger preloadOptions;
                 }
 
                 // And store the users group
-                [NSKeyedArchiver archiveRootObject:group toFile:file];
-            }
+                [MXBinaryArchiver archiveRootObject:group toFile:file];
+            }];
 
 #if DEBUG
             NSLog(@"[MXFileStore] saveUsers in %.0fms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
 #endif
-        });
+        }];
     }
 }
 
@@ -1672,7 +2241,7 @@ static NSUInteger preloadOptions;
         // Load stored group
         @try
         {
-            MXGroup *group = [NSKeyedUnarchiver unarchiveObjectWithFile:groupFile];
+            MXGroup *group = [MXBinaryUnarchiver unarchiveObjectWithFile:groupFile];
             if (group)
             {
                 [groups setObject:group forKey:groupId];
@@ -1730,13 +2299,12 @@ static NSUInteger preloadOptions;
 #if DEBUG
         NSLog(@"[MXFileStore commit] queuing saveGroups");
 #endif
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
             
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
-            for (NSString *groupId in theGroupsToCommit)
-            {
+            [self concurrentlyEnumerateItems:theGroupsToCommit.allKeys usingBlock:^(NSString *groupId) {
                 MXGroup *group = theGroupsToCommit[groupId];
                 
                 NSString *file = [self groupFileForGroup:groupId forBackup:NO];
@@ -1749,12 +2317,12 @@ static NSUInteger preloadOptions;
                 }
                 
                 // And store the users group
-                [NSKeyedArchiver archiveRootObject:group toFile:file];
-            }
+                [MXBinaryArchiver archiveRootObject:group toFile:file];
+            }];
 #if DEBUG
             NSLog(@"[MXFileStore] saveGroups in %.0fms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
 #endif
-        });
+        }];
     }
 }
 
@@ -1794,7 +2362,7 @@ static NSUInteger preloadOptions;
         NSMutableDictionary *receiptsDict;
         @try
         {
-            receiptsDict =[NSKeyedUnarchiver unarchiveObjectWithFile:roomFile];
+            receiptsDict =[MXBinaryUnarchiver unarchiveObjectWithFile:roomFile];
         }
         @catch (NSException *exception)
         {
@@ -1835,15 +2403,14 @@ static NSUInteger preloadOptions;
         NSLog(@"[MXFileStore commit] queuing saveReceipts for %tu rooms", roomsToCommit.count);
 #endif
         MXWeakify(self);
-        dispatch_async(dispatchQueue, ^(void){
+        [self addCommitTask:^{
             MXStrongifyAndReturnIfNil(self);
 
 #if DEBUG
             NSDate *startDate = [NSDate date];
 #endif
             // Save rooms where there was changes
-            for (NSString *roomId in roomsToCommit)
-            {
+            [self concurrentlyEnumerateItems:roomsToCommit usingBlock:^(NSString *roomId) {
                 NSMutableDictionary* receiptsByUserId = self->receiptsByRoomId[roomId];
                 if (receiptsByUserId)
                 {
@@ -1861,15 +2428,15 @@ static NSUInteger preloadOptions;
 
                         // Store new data
                         [self checkFolderExistenceForRoom:roomId forBackup:NO];
-                        [NSKeyedArchiver archiveRootObject:receiptsByUserId toFile:file];
+                        [MXBinaryArchiver archiveRootObject:receiptsByUserId toFile:file];
                     }
                 }
-            }
+            }];
             
 #if DEBUG
             NSLog(@"[MXFileStore commit] lasted %.0fms for receipts in %tu rooms", [[NSDate date] timeIntervalSinceDate:startDate] * 1000, roomsToCommit.count);
 #endif
-        });
+        }];
     }
 }
 
@@ -0,0 +1,110 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "MXEvent.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXEventsDeque` stores the events of a room timeline in chronological order.
+
+ Events are stored in fixed size chunks so that adding an event at either end is O(1).
+ Every event has a position that does not change while it is stored. Positions are
+ indexed by event id and by the id of the event they relate to so that lookup,
+ replacement and relations queries do not need to scan the timeline.
+
+ Events must be added, replaced and removed from a single thread. `allEvents` can be
+ called from any thread.
+ */
+@interface MXEventsDeque : NSObject
+
+/**
+ The number of events.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Add an event after the most recent one.
+
+ @param event the event to add.
+ */
+- (void)appendEvent:(MXEvent*)event;
+
+/**
+ Add an event before the oldest one.
+
+ @param event the event to add.
+ */
+- (void)prependEvent:(MXEvent*)event;
+
+/**
+ Replace the event that has the same event id.
+
+ @param event the new version of the event.
+ @return NO if there is no event with this event id.
+ */
+- (BOOL)replaceEvent:(MXEvent*)event;
+
+/**
+ Remove all events.
+ */
+- (void)removeAllEvents;
+
+/**
+ Get an event by its id.
+
+ @param eventId the event id.
+ @return the event. nil if not found.
+ */
+- (nullable MXEvent*)eventWithEventId:(NSString*)eventId;
+
+/**
+ Get the position of an event.
+
+ Positions increase from the oldest event to the most recent one. They do not change
+ while events are added or replaced.
+
+ @param eventId the event id.
+ @return the event position. NSNotFound if not found.
+ */
+- (NSInteger)positionOfEvent:(NSString*)eventId;
+
+/**
+ All events, from the oldest to the most recent.
+ */
+@property (nonatomic, readonly) NSArray<MXEvent*> *allEvents;
+
+/**
+ Enumerate events more recent than an event, from the oldest to the most recent.
+
+ @param eventId the id of the event to start after. All events are enumerated if it is unknown.
+ @param block the block called for each event.
+ */
+- (void)enumerateEventsAfter:(NSString*)eventId usingBlock:(void (^)(MXEvent *event))block;
+
+/**
+ Get events that relate to an event.
+
+ @param eventId the id of the related event.
+ @return events with a `relatesTo.eventId` equal to `eventId`, from the oldest to the most recent.
+ */
+- (NSArray<MXEvent*>*)eventsRelatedToEvent:(NSString*)eventId;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,246 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXEventsDeque.h"
+
+// Number of events in a chunk
+static NSInteger const kMXEventsDequeChunkSize = 256;
+
+@interface MXEventsDeque ()
+{
+    // Chunks of kMXEventsDequeChunkSize slots. Empty slots contain NSNull
+    NSMutableArray<NSMutableArray*> *chunks;
+
+    // The position of the first slot of the first chunk
+    NSInteger chunksOrigin;
+
+    // The positions of the oldest event and after the most recent event.
+    // Events prepended get decreasing positions, events appended increasing ones.
+    NSInteger startPosition;
+    NSInteger endPosition;
+
+    // Event id -> event position
+    NSMutableDictionary<NSString*, NSNumber*> *positionsByEventId;
+
+    // Related event id -> positions of events that relate to it
+    NSMutableDictionary<NSString*, NSMutableArray<NSNumber*>*> *relationsPositionsByEventId;
+}
+@end
+
+@implementation MXEventsDeque
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        chunks = [NSMutableArray array];
+        positionsByEventId = [NSMutableDictionary dictionary];
+        relationsPositionsByEventId = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return endPosition - startPosition;
+}
+
+- (void)appendEvent:(MXEvent *)event
+{
+    @synchronized (self)
+    {
+        if (endPosition == chunksOrigin + (NSInteger)chunks.count * kMXEventsDequeChunkSize)
+        {
+            [chunks addObject:[self newChunk]];
+        }
+
+        [self setEvent:event atPosition:endPosition];
+        [self indexEvent:event atPosition:endPosition];
+        endPosition++;
+    }
+}
+
+- (void)prependEvent:(MXEvent *)event
+{
+    @synchronized (self)
+    {
+        if (startPosition == chunksOrigin)
+        {
+            // The number of chunks is small. Inserting one at the front is cheap
+            [chunks insertObject:[self newChunk] atIndex:0];
+            chunksOrigin -= kMXEventsDequeChunkSize;
+        }
+
+        startPosition--;
+        [self setEvent:event atPosition:startPosition];
+        [self indexEvent:event atPosition:startPosition];
+    }
+}
+
+- (BOOL)replaceEvent:(MXEvent *)event
+{
+    NSNumber *position = event.eventId ? positionsByEventId[event.eventId] : nil;
+    if (!position)
+    {
+        return NO;
+    }
+
+    NSInteger eventPosition = position.integerValue;
+    MXEvent *oldEvent = [self eventAtPosition:eventPosition];
+
+    // Update the relations index if the relation has changed, e.g. after a redaction
+    NSString *oldRelatedEventId = oldEvent.relatesTo.eventId;
+    NSString *relatedEventId = event.relatesTo.eventId;
+    if (oldRelatedEventId != relatedEventId && ![oldRelatedEventId isEqualToString:relatedEventId])
+    {
+        [self removeRelationOfEventAtPosition:position toEvent:oldRelatedEventId];
+        [self addRelationOfEventAtPosition:position toEvent:relatedEventId];
+    }
+
+    @synchronized (self)
+    {
+        [self setEvent:event atPosition:eventPosition];
+    }
+    return YES;
+}
+
+- (void)removeAllEvents
+{
+    @synchronized (self)
+    {
+        [chunks removeAllObjects];
+        chunksOrigin = startPosition = endPosition = 0;
+
+        [positionsByEventId removeAllObjects];
+        [relationsPositionsByEventId removeAllObjects];
+    }
+}
+
+- (MXEvent *)eventWithEventId:(NSString *)eventId
+{
+    NSNumber *position = positionsByEventId[eventId];
+    return position ? [self eventAtPosition:position.integerValue] : nil;
+}
+
+- (NSInteger)positionOfEvent:(NSString *)eventId
+{
+    NSNumber *position = positionsByEventId[eventId];
+    return position ? position.integerValue : NSNotFound;
+}
+
+- (NSArray<MXEvent *> *)allEvents
+{
+    // This method may be called from another thread while events are added.
+    // See [MXFileRoomStore encodeWithCoder:]
+    @synchronized (self)
+    {
+        NSMutableArray<MXEvent*> *events = [NSMutableArray arrayWithCapacity:self.count];
+        for (NSInteger position = startPosition; position < endPosition; position++)
+        {
+            [events addObject:[self eventAtPosition:position]];
+        }
+        return events;
+    }
+}
+
+- (void)enumerateEventsAfter:(NSString *)eventId usingBlock:(void (^)(MXEvent * _Nonnull))block
+{
+    NSNumber *position = positionsByEventId[eventId];
+    NSInteger firstPosition = position ? position.integerValue + 1 : startPosition;
+
+    for (NSInteger p = firstPosition; p < endPosition; p++)
+    {
+        block([self eventAtPosition:p]);
+    }
+}
+
+- (NSArray<MXEvent *> *)eventsRelatedToEvent:(NSString *)eventId
+{
+    NSArray<NSNumber*> *positions = [relationsPositionsByEventId[eventId] sortedArrayUsingSelector:@selector(compare:)];
+
+    NSMutableArray<MXEvent*> *events = [NSMutableArray arrayWithCapacity:positions.count];
+    for (NSNumber *position in positions)
+    {
+        [events addObject:[self eventAtPosition:position.integerValue]];
+    }
+    return events;
+}
+
+
+#pragma mark - Private methods
+
+- (NSMutableArray*)newChunk
+{
+    NSMutableArray *chunk = [NSMutableArray arrayWithCapacity:kMXEventsDequeChunkSize];
+    for (NSInteger i = 0; i < kMXEventsDequeChunkSize; i++)
+    {
+        [chunk addObject:[NSNull null]];
+    }
+    return chunk;
+}
+
+- (MXEvent*)eventAtPosition:(NSInteger)position
+{
+    NSInteger slot = position - chunksOrigin;
+    return chunks[slot / kMXEventsDequeChunkSize][slot % kMXEventsDequeChunkSize];
+}
+
+- (void)setEvent:(MXEvent*)event atPosition:(NSInteger)position
+{
+    NSInteger slot = position - chunksOrigin;
+    chunks[slot / kMXEventsDequeChunkSize][slot % kMXEventsDequeChunkSize] = event;
+}
+
+- (void)indexEvent:(MXEvent*)event atPosition:(NSInteger)position
+{
+    NSNumber *positionNumber = @(position);
+
+    if (event.eventId)
+    {
+        positionsByEventId[event.eventId] = positionNumber;
+    }
+    [self addRelationOfEventAtPosition:positionNumber toEvent:event.relatesTo.eventId];
+}
+
+- (void)addRelationOfEventAtPosition:(NSNumber*)position toEvent:(NSString*)relatedEventId
+{
+    if (relatedEventId)
+    {
+        NSMutableArray<NSNumber*> *positions = relationsPositionsByEventId[relatedEventId];
+        if (!positions)
+        {
+            positions = [NSMutableArray array];
+            relationsPositionsByEventId[relatedEventId] = positions;
+        }
+        [positions addObject:position];
+    }
+}
+
+- (void)removeRelationOfEventAtPosition:(NSNumber*)position toEvent:(NSString*)relatedEventId
+{
+    if (relatedEventId)
+    {
+        NSMutableArray<NSNumber*> *positions = relationsPositionsByEventId[relatedEventId];
+        [positions removeObject:position];
+        if (positions && !positions.count)
+        {
+            [relationsPositionsByEventId removeObjectForKey:relatedEventId];
+        }
+    }
+}
+
+@end
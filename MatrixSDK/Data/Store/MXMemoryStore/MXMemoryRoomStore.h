@@ -18,18 +18,17 @@
 #import <Foundation/Foundation.h>
 
 #import "MXStore.h"
+#import "MXEventsDeque.h"
 
 @interface MXMemoryRoomStore : NSObject
 {
     @protected
     // The events downloaded so far.
     // The order is chronological: the first item is the oldest message.
-    NSMutableArray<MXEvent*> *messages;
-
-    // A cache to quickly retrieve an event by its event id.
-    // This significanly improves [MXMemoryStore eventWithEventId:] and [MXMemoryStore eventExistsWithEventId:]
-    // speed. The last one is critical since it is called on each received event to check event duplication.
-    NSMutableDictionary<NSString*, MXEvent*> *messagesByEventIds;
+    // Events are indexed by event id. This significanly improves [MXMemoryStore eventWithEventId:] and
+    // [MXMemoryStore eventExistsWithEventId:] speed. The last one is critical since it is called on each
+    // received event to check event duplication.
+    MXEventsDeque *messages;
 
     // The events that are being sent.
     NSMutableArray<MXEvent*> *outgoingMessages;
@@ -104,6 +103,48 @@
  */
 - (NSArray*)eventsAfter:(NSString *)eventId except:(NSString*)userId withTypeIn:(NSSet*)types;
 
+/**
+ Count events newer than the event with the passed id, except redacted ones.
+
+ Counts are cached per types set. They are updated when events are stored or replaced
+ so that the cost of a call does not depend on the number of unread events.
+
+ @param eventId the id of the last read event.
+ @param userId the user whose events are not counted.
+ @param types a set of event types strings (MXEventTypeString).
+ @return the number of unread events.
+ */
+- (NSUInteger)unreadEventCountAfter:(NSString*)eventId except:(NSString*)userId withTypeIn:(NSSet*)types;
+
+/**
+ A copy of the cached unread counts, with the read event and the user they have been
+ done for.
+
+ The returned dictionary can be archived. It allows to get unread counts of the room
+ without loading its messages (see `unreadEventCountInCounters:after:except:withTypeIn:`).
+
+ @return the unread counts. nil if there is none.
+ */
+- (NSDictionary*)unreadCountersSnapshot;
+
+/**
+ Get an unread count from a snapshot returned by `unreadCountersSnapshot`.
+
+ @param countersSnapshot the unread counts snapshot.
+ @param eventId the id of the last read event.
+ @param userId the user whose events are not counted.
+ @param types a set of event types strings (MXEventTypeString).
+ @return the number of unread events. nil if the snapshot has no count for these parameters.
+ */
++ (NSNumber*)unreadEventCountInCounters:(NSDictionary*)countersSnapshot after:(NSString*)eventId except:(NSString*)userId withTypeIn:(NSSet*)types;
+
+/**
+ Reset the cached unread counts.
+
+ They will be computed again on next `unreadEventCountAfter:except:withTypeIn:` calls.
+ */
+- (void)resetUnreadCounters;
+
 /**
  Get events related to a specific event.
 
@@ -20,8 +20,18 @@
 #import "MXEventsEnumeratorOnArray.h"
 #import "MXEventsByTypesEnumeratorOnArray.h"
 
+// Keys of unread counters snapshots
+static NSString *const kMXMemoryRoomStoreUnreadCountersEventId = @"eventId";
+static NSString *const kMXMemoryRoomStoreUnreadCountersUserId = @"userId";
+static NSString *const kMXMemoryRoomStoreUnreadCountersCounts = @"counts";
+
 @interface MXMemoryRoomStore ()
 {
+    // Unread counts of events after `unreadCountersEventId` not sent by `unreadCountersUserId`.
+    // Types set -> count
+    NSString *unreadCountersEventId;
+    NSString *unreadCountersUserId;
+    NSMutableDictionary<id<NSCopying>, NSNumber*> *unreadCounters;
 }
 
 @end
@@ -34,9 +44,9 @@
     self = [super init];
     if (self)
     {
-        messages = [NSMutableArray array];
-        messagesByEventIds = [NSMutableDictionary dictionary];
+        messages = [[MXEventsDeque alloc] init];
         outgoingMessages = [NSMutableArray array];
+        unreadCounters = [NSMutableDictionary dictionary];
         _hasReachedHomeServerPaginationEnd = NO;
         _hasLoadedAllRoomMembersForRoom = NO;
     }
@@ -47,54 +57,45 @@
 {
     if (MXTimelineDirectionForwards == direction)
     {
-        [messages addObject:event];
+        [messages appendEvent:event];
     }
     else
     {
-        [messages insertObject:event atIndex:0];
+        [messages prependEvent:event];
     }
 
-    if (event.eventId)
-    {
-        messagesByEventIds[event.eventId] = event;
-    }
+    [self updateUnreadCountersWithStoredEvent:event direction:direction];
 }
 
 - (void)replaceEvent:(MXEvent*)event
 {
-    NSUInteger index = messages.count;
-    while (index--)
-    {
-        MXEvent *anEvent = [messages objectAtIndex:index];
-        if ([anEvent.eventId isEqualToString:event.eventId])
-        {
-            [messages replaceObjectAtIndex:index withObject:event];
+    MXEvent *oldEvent = unreadCounters.count ? [messages eventWithEventId:event.eventId] : nil;
 
-            messagesByEventIds[event.eventId] = event;
-            break;
-        }
+    if ([messages replaceEvent:event] && oldEvent)
+    {
+        [self updateUnreadCountersWithReplacedEvent:oldEvent byEvent:event];
     }
 }
 
 - (MXEvent *)eventWithEventId:(NSString *)eventId
 {
-    return messagesByEventIds[eventId];
+    return [messages eventWithEventId:eventId];
 }
 
 - (void)removeAllMessages
 {
-    [messages removeAllObjects];
-    [messagesByEventIds removeAllObjects];
+    [messages removeAllEvents];
+    [self resetUnreadCounters];
 }
 
 - (id<MXEventsEnumerator>)messagesEnumerator
 {
-    return [[MXEventsEnumeratorOnArray alloc] initWithMessages:messages];
+    return [[MXEventsEnumeratorOnArray alloc] initWithMessages:messages.allEvents];
 }
 
 - (id<MXEventsEnumerator>)enumeratorForMessagesWithTypeIn:(NSArray*)types
 {
-    return [[MXEventsByTypesEnumeratorOnArray alloc] initWithMessages:messages andTypesIn:types];
+    return [[MXEventsByTypesEnumeratorOnArray alloc] initWithMessages:messages.allEvents andTypesIn:types];
 }
 
 - (NSArray*)eventsAfter:(NSString *)eventId except:(NSString*)userId withTypeIn:(NSSet*)types
@@ -103,39 +104,100 @@
 
     if (eventId)
     {
-        // Check messages from the most recent
-        for (NSInteger i = messages.count - 1; i >= 0 ; i--)
-        {
-            MXEvent *event = messages[i];
+        [messages enumerateEventsAfter:eventId usingBlock:^(MXEvent *event) {
 
-            if (NO == [event.eventId isEqualToString:eventId])
+            // Keep events matching filters
+            if ((!types || [types containsObject:event.type]) && ![event.sender isEqualToString:userId])
             {
-                // Keep events matching filters
-                if ((!types || [types containsObject:event.type]) && ![event.sender isEqualToString:userId])
-                {
-                    [list insertObject:event atIndex:0];
-                }
+                [list addObject:event];
             }
-            else
+        }];
+    }
+
+    return list;
+}
+
+- (NSUInteger)unreadEventCountAfter:(NSString *)eventId except:(NSString *)userId withTypeIn:(NSSet *)types
+{
+    if (!eventId)
+    {
+        return 0;
+    }
+
+    if (![eventId isEqualToString:unreadCountersEventId]
+        || (userId != unreadCountersUserId && ![userId isEqualToString:unreadCountersUserId]))
+    {
+        [self resetUnreadCounters];
+        unreadCountersEventId = eventId;
+        unreadCountersUserId = userId;
+    }
+
+    id<NSCopying> key = types ? [types copy] : [NSNull null];
+    NSNumber *count = unreadCounters[key];
+    if (!count)
+    {
+        __block NSUInteger unreadCount = 0;
+        [messages enumerateEventsAfter:eventId usingBlock:^(MXEvent *event) {
+            if ([self isUnreadEvent:event withTypeIn:types])
             {
-                // We are done
-                break;
+                unreadCount++;
             }
-        }
+        }];
+
+        count = @(unreadCount);
+        unreadCounters[key] = count;
     }
 
-    return list;
+    return count.unsignedIntegerValue;
+}
+
+- (NSDictionary *)unreadCountersSnapshot
+{
+    if (!unreadCounters.count)
+    {
+        return nil;
+    }
+
+    NSMutableDictionary *countersSnapshot = [NSMutableDictionary dictionary];
+    countersSnapshot[kMXMemoryRoomStoreUnreadCountersEventId] = unreadCountersEventId;
+    countersSnapshot[kMXMemoryRoomStoreUnreadCountersUserId] = unreadCountersUserId;
+    countersSnapshot[kMXMemoryRoomStoreUnreadCountersCounts] = [unreadCounters copy];
+
+    return countersSnapshot;
+}
+
++ (NSNumber *)unreadEventCountInCounters:(NSDictionary *)countersSnapshot after:(NSString *)eventId except:(NSString *)userId withTypeIn:(NSSet *)types
+{
+    if (!eventId)
+    {
+        return @(0);
+    }
+
+    NSString *countersUserId = countersSnapshot[kMXMemoryRoomStoreUnreadCountersUserId];
+    if (![eventId isEqualToString:countersSnapshot[kMXMemoryRoomStoreUnreadCountersEventId]]
+        || (userId != countersUserId && ![userId isEqualToString:countersUserId]))
+    {
+        return nil;
+    }
+
+    NSDictionary<id<NSCopying>, NSNumber*> *counts = countersSnapshot[kMXMemoryRoomStoreUnreadCountersCounts];
+    return counts[types ? types : [NSNull null]];
+}
+
+- (void)resetUnreadCounters
+{
+    [unreadCounters removeAllObjects];
+    unreadCountersEventId = nil;
+    unreadCountersUserId = nil;
 }
 
 - (NSArray<MXEvent*>*)relationsForEvent:(NSString*)eventId relationType:(NSString*)relationType
 {
     NSMutableArray<MXEvent*>* referenceEvents = [NSMutableArray new];
     
-    for (MXEvent* event in messages)
+    for (MXEvent* event in [messages eventsRelatedToEvent:eventId])
     {
-        MXEventContentRelatesTo *relatesTo = event.relatesTo;
-        
-        if (relatesTo && [relatesTo.eventId isEqualToString:eventId] && [relatesTo.relationType isEqualToString:relationType])
+        if ([event.relatesTo.relationType isEqualToString:relationType])
         {
             [referenceEvents addObject:event];
         }
@@ -171,6 +233,64 @@
     }
 }
 
+#pragma mark - Unread counters
+
+- (BOOL)isUnreadEvent:(MXEvent*)event withTypeIn:(NSSet*)types
+{
+    return (!types || [types containsObject:event.type])
+    && ![event.sender isEqualToString:unreadCountersUserId]
+    && !event.redactedBecause;
+}
+
+- (void)updateUnreadCountersWithStoredEvent:(MXEvent*)event direction:(MXTimelineDirection)direction
+{
+    if (!unreadCounters.count)
+    {
+        return;
+    }
+
+    if ([event.eventId isEqualToString:unreadCountersEventId])
+    {
+        // Counts were done from the oldest event because the read event was unknown
+        [self resetUnreadCounters];
+        return;
+    }
+
+    if (MXTimelineDirectionBackwards == direction && [messages positionOfEvent:unreadCountersEventId] != NSNotFound)
+    {
+        // The event is older than the read event
+        return;
+    }
+
+    [self addToUnreadCounters:1 forEvent:event];
+}
+
+- (void)updateUnreadCountersWithReplacedEvent:(MXEvent*)oldEvent byEvent:(MXEvent*)event
+{
+    NSInteger readEventPosition = [messages positionOfEvent:unreadCountersEventId];
+    if (readEventPosition != NSNotFound && [messages positionOfEvent:event.eventId] <= readEventPosition)
+    {
+        // The event has been read
+        return;
+    }
+
+    // A redaction removes the event from counts
+    [self addToUnreadCounters:-1 forEvent:oldEvent];
+    [self addToUnreadCounters:1 forEvent:event];
+}
+
+- (void)addToUnreadCounters:(NSInteger)delta forEvent:(MXEvent*)event
+{
+    for (id<NSCopying> key in unreadCounters.allKeys)
+    {
+        NSSet *types = (key == [NSNull null]) ? nil : (NSSet*)key;
+        if ([self isUnreadEvent:event withTypeIn:types])
+        {
+            unreadCounters[key] = @(unreadCounters[key].integerValue + delta);
+        }
+    }
+}
+
 - (NSString *)description
 {
     return [NSString stringWithFormat:@"%tu messages - paginationToken: %@ - hasReachedHomeServerPaginationEnd: %@ - hasLoadedAllRoomMembersForRoom: %@", messages.count, _paginationToken, @(_hasReachedHomeServerPaginationEnd), @(_hasLoadedAllRoomMembersForRoom)];
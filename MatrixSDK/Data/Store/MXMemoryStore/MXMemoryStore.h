@@ -37,6 +37,12 @@
     // Dict of dict of MXReceiptData indexed by userId
     NSMutableDictionary *receiptsByRoomId;
 
+    // Reverse index of receiptsByRoomId, built on demand:
+    // roomId -> eventId -> receipts sorted from the latest to the oldest
+    // The dictionary itself is guarded by its own lock. The index of a room is guarded
+    // by the receipts lock of the room, ie its dictionary in receiptsByRoomId.
+    NSMutableDictionary<NSString*, NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*>*> *receiptsByEventIdByRoomId;
+
     // Matrix filters
     // FilterId -> Filter JSON string
     NSMutableDictionary<NSString*, NSString*> *filters;
@@ -45,6 +51,19 @@
     MXCredentials *credentials;
 }
 
+/**
+ Cross-check unread counts against a scan of stored events.
+
+ Unread counts are maintained incrementally by room stores. When this mode is enabled,
+ `localUnreadEventCount:withTypeIn:` also counts unread events by scanning the timeline
+ and logs and asserts on any mismatch. It is meant for tests.
+
+ Default is NO.
+
+ @param enabled YES to check unread counts.
+ */
++ (void)setUnreadCountsConsistencyCheckEnabled:(BOOL)enabled;
+
 #pragma mark - protected operations
 
 /**
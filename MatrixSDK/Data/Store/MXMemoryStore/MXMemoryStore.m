@@ -21,6 +21,8 @@
 
 #import "MXTools.h"
 
+static BOOL unreadCountsConsistencyCheckEnabled = NO;
+
 @interface MXMemoryStore()
 {
     NSString *eventStreamToken;
@@ -40,12 +42,25 @@
     {
         roomStores = [NSMutableDictionary dictionary];
         receiptsByRoomId = [NSMutableDictionary dictionary];
+        receiptsByEventIdByRoomId = [NSMutableDictionary dictionary];
         users = [NSMutableDictionary dictionary];
         groups = [NSMutableDictionary dictionary];
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(onDidDecryptEvent:) name:kMXEventDidDecryptNotification object:nil];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
++ (void)setUnreadCountsConsistencyCheckEnabled:(BOOL)enabled
+{
+    unreadCountsConsistencyCheckEnabled = enabled;
+}
+
 - (void)openWithCredentials:(MXCredentials *)someCredentials onComplete:(void (^)(void))onComplete failure:(void (^)(NSError *))failure
 {
     credentials = someCredentials;
@@ -98,11 +113,19 @@
     {
         [receiptsByRoomId removeObjectForKey:roomId];
     }
+    @synchronized (receiptsByEventIdByRoomId)
+    {
+        [receiptsByEventIdByRoomId removeObjectForKey:roomId];
+    }
 }
 
 - (void)deleteAllData
 {
     [roomStores removeAllObjects];
+    @synchronized (receiptsByEventIdByRoomId)
+    {
+        [receiptsByEventIdByRoomId removeAllObjects];
+    }
 }
 
 - (void)storePaginationTokenOfRoom:(NSString*)roomId andToken:(NSString*)token
@@ -168,38 +191,43 @@
 
 - (NSArray<MXReceiptData*> *)getEventReceipts:(NSString*)roomId eventId:(NSString*)eventId sorted:(BOOL)sort
 {
-    NSMutableArray* receipts = [[NSMutableArray alloc] init];
-    
+    NSArray<MXReceiptData*> *receipts;
+
     NSMutableDictionary* receiptsByUserId = receiptsByRoomId[roomId];
-    
     if (receiptsByUserId)
     {
         @synchronized (receiptsByUserId)
         {
-            for (NSString* userId in receiptsByUserId)
-            {
-                MXReceiptData* receipt = receiptsByUserId[userId];
+            // Receipts are already sorted in the index
+            receipts = [[self receiptsByEventIdInRoom:roomId][eventId] copy];
+        }
+    }
+
+    return receipts ?: @[];
+}
+
+- (NSDictionary<NSString*, NSArray<MXReceiptData*>*> *)getEventsReceipts:(NSString *)roomId eventIds:(NSArray<NSString *> *)eventIds sorted:(BOOL)sort
+{
+    NSMutableDictionary<NSString*, NSArray<MXReceiptData*>*> *receiptsByEventId = [NSMutableDictionary dictionary];
 
-                if (receipt && [receipt.eventId isEqualToString:eventId])
+    NSMutableDictionary* receiptsByUserId = receiptsByRoomId[roomId];
+    if (receiptsByUserId)
+    {
+        @synchronized (receiptsByUserId)
+        {
+            NSDictionary<NSString*, NSMutableArray<MXReceiptData*>*> *index = [self receiptsByEventIdInRoom:roomId];
+            for (NSString *eventId in eventIds)
+            {
+                NSArray<MXReceiptData*> *receipts = index[eventId];
+                if (receipts.count)
                 {
-                    [receipts addObject:receipt];
+                    receiptsByEventId[eventId] = [receipts copy];
                 }
             }
         }
     }
 
-    if (sort)
-    {
-        return [receipts sortedArrayUsingComparator:^NSComparisonResult(id a, id b)
-                                {
-                                    MXReceiptData *first =  (MXReceiptData*)a;
-                                    MXReceiptData *second = (MXReceiptData*)b;
-                                    
-                                    return (first.ts < second.ts) ? NSOrderedDescending : NSOrderedAscending;
-                                }];
-    }
-    
-    return receipts;
+    return receiptsByEventId;
 }
 
 - (BOOL)storeReceipt:(MXReceiptData*)receipt inRoom:(NSString*)roomId
@@ -220,6 +248,28 @@
         @synchronized (receiptsByUserId)
         {
             receiptsByUserId[receipt.userId] = receipt;
+
+            // Keep the reverse index in sync if it has been built
+            NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*> *receiptsByEventId;
+            @synchronized (receiptsByEventIdByRoomId)
+            {
+                receiptsByEventId = receiptsByEventIdByRoomId[roomId];
+            }
+            if (receiptsByEventId)
+            {
+                if (curReceipt)
+                {
+                    [self removeReceipt:curReceipt fromReceiptsByEventId:receiptsByEventId];
+                }
+                [self addReceipt:receipt toReceiptsByEventId:receiptsByEventId];
+            }
+        }
+
+        if ([receipt.userId isEqualToString:credentials.userId])
+        {
+            // Unread counts must now start from the new read event
+            MXMemoryRoomStore *roomStore = roomStores[roomId];
+            [roomStore resetUnreadCounters];
         }
         return true;
     }
@@ -256,15 +306,32 @@
         
         if (data)
         {
-            // Check the current stored events (by ignoring oneself events)
-            NSArray *array = [store eventsAfter:data.eventId except:credentials.userId withTypeIn:[NSSet setWithArray:types]];
-            
-            // Check whether these unread events have not been redacted.
-            for (MXEvent *event in array)
+            // Use the counters maintained by the room store (by ignoring oneself events)
+            NSSet *typesSet = [NSSet setWithArray:types];
+            count = [store unreadEventCountAfter:data.eventId except:credentials.userId withTypeIn:typesSet];
+
+            if (unreadCountsConsistencyCheckEnabled)
             {
-                if (event.redactedBecause == nil)
+                // Check the current stored events
+                NSArray *array = [store eventsAfter:data.eventId except:credentials.userId withTypeIn:typesSet];
+
+                // Check whether these unread events have not been redacted.
+                NSUInteger scannedCount = 0;
+                for (MXEvent *event in array)
                 {
-                    count ++;
+                    if (event.redactedBecause == nil)
+                    {
+                        scannedCount++;
+                    }
+                }
+
+                if (count != scannedCount)
+                {
+                    NSLog(@"[MXMemoryStore] localUnreadEventCount: Error: Unread count mismatch in room %@: %@ instead of %@", roomId, @(count), @(scannedCount));
+                    NSAssert(NO, @"[MXMemoryStore] localUnreadEventCount: Unread count mismatch");
+
+                    [store resetUnreadCounters];
+                    count = scannedCount;
                 }
             }
         }
@@ -273,6 +340,18 @@
     return count;
 }
 
+- (void)onDidDecryptEvent:(NSNotification *)notification
+{
+    MXEvent *event = notification.object;
+
+    // The type of a lately decrypted event has changed. Unread counts of its room must be done again
+    MXMemoryRoomStore *roomStore = roomStores[event.roomId];
+    if ([roomStore eventWithEventId:event.eventId])
+    {
+        [roomStore resetUnreadCounters];
+    }
+}
+
 - (void)storeHomeserverWellknown:(nonnull MXWellKnown *)wellknown
 {
     homeserverWellknown = wellknown;
@@ -295,6 +374,84 @@
 }
 
 
+#pragma mark - Receipts index
+/**
+ Get the reverse index of receipts of a room.
+
+ It is built on first access. Must be called under the room receipts lock.
+
+ @param roomId the room id.
+ @return receipts by event id.
+ */
+- (NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*>*)receiptsByEventIdInRoom:(NSString*)roomId
+{
+    NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*> *receiptsByEventId;
+    @synchronized (receiptsByEventIdByRoomId)
+    {
+        receiptsByEventId = receiptsByEventIdByRoomId[roomId];
+    }
+
+    if (!receiptsByEventId)
+    {
+        // The room receipts lock prevents from building the index of the same room twice
+        receiptsByEventId = [NSMutableDictionary dictionary];
+        for (MXReceiptData *receipt in [receiptsByRoomId[roomId] allValues])
+        {
+            [self addReceipt:receipt toReceiptsByEventId:receiptsByEventId];
+        }
+
+        @synchronized (receiptsByEventIdByRoomId)
+        {
+            receiptsByEventIdByRoomId[roomId] = receiptsByEventId;
+        }
+    }
+    return receiptsByEventId;
+}
+
+- (void)addReceipt:(MXReceiptData*)receipt toReceiptsByEventId:(NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*>*)receiptsByEventId
+{
+    if (!receipt.eventId)
+    {
+        return;
+    }
+
+    NSMutableArray<MXReceiptData*> *receipts = receiptsByEventId[receipt.eventId];
+    if (!receipts)
+    {
+        receipts = [NSMutableArray array];
+        receiptsByEventId[receipt.eventId] = receipts;
+    }
+
+    // Keep receipts sorted from the latest to the oldest
+    NSUInteger index = [receipts indexOfObject:receipt
+                                 inSortedRange:NSMakeRange(0, receipts.count)
+                                       options:NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual
+                               usingComparator:^NSComparisonResult(MXReceiptData *first, MXReceiptData *second) {
+                                   if (first.ts == second.ts)
+                                   {
+                                       return NSOrderedSame;
+                                   }
+                                   return (first.ts < second.ts) ? NSOrderedDescending : NSOrderedAscending;
+                               }];
+    [receipts insertObject:receipt atIndex:index];
+}
+
+- (void)removeReceipt:(MXReceiptData*)receipt fromReceiptsByEventId:(NSMutableDictionary<NSString*, NSMutableArray<MXReceiptData*>*>*)receiptsByEventId
+{
+    if (!receipt.eventId)
+    {
+        return;
+    }
+
+    NSMutableArray<MXReceiptData*> *receipts = receiptsByEventId[receipt.eventId];
+    [receipts removeObjectIdenticalTo:receipt];
+    if (receipts && !receipts.count)
+    {
+        [receiptsByEventId removeObjectForKey:receipt.eventId];
+    }
+}
+
+
 #pragma mark - Matrix users
 - (void)storeUser:(MXUser *)user
 {
@@ -230,11 +230,13 @@
 
 /**
  Returns the receipts list for an event in a dedicated room.
- if sort is set to YES, they are sorted from the latest to the oldest ones.
- 
+
+ Receipts are always sorted from the latest to the oldest ones, whatever the value
+ of `sort`. The stores keep them sorted so that there is nothing to sort on reading.
+
  @param roomId The room Id.
  @param eventId The event Id.
- @param sort to sort them from the latest to the oldest
+ @param sort ignored. Receipts are always sorted.
  @return the receipts for an event in a dedicated room.
  */
 - (NSArray<MXReceiptData*> * _Nullable)getEventReceipts:(nonnull NSString*)roomId eventId:(nonnull NSString*)eventId sorted:(BOOL)sort;
@@ -314,6 +316,20 @@
  */
 - (void)close;
 
+/**
+ Returns the receipts lists for several events in a dedicated room.
+
+ This allows a timeline to get receipts of all its displayed events in one call.
+ Like `getEventReceipts:eventId:sorted:`, receipts are always sorted from the latest
+ to the oldest ones.
+
+ @param roomId The room Id.
+ @param eventIds The event Ids.
+ @param sort ignored. Receipts are always sorted.
+ @return the receipts by event id. Events without receipts are not in the dictionary.
+ */
+- (NSDictionary<NSString*, NSArray<MXReceiptData*>*> * _Nonnull)getEventsReceipts:(nonnull NSString*)roomId eventIds:(nonnull NSArray<NSString*>*)eventIds sorted:(BOOL)sort;
+
 
 #pragma mark - Permanent storage -
 
@@ -0,0 +1,76 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "MXJSONModels.h"
+#import "MXEnumConstants.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The error domain of `MXSyncResponseDecoder`.
+ */
+FOUNDATION_EXPORT NSString *const kMXSyncResponseDecoderErrorDomain;
+
+/**
+ `MXSyncResponseDecoder` builds a `MXSyncResponse` from the raw JSON data of a /sync response.
+
+ Unlike `NSJSONSerialization` followed by `[MXSyncResponse modelFromJSON:]`, it does not
+ build a JSON object tree of the whole response. The data is read sequentially and only
+ the JSON object of one room is alive at a time: it is converted to a `MXRoomSync` or a
+ `MXInvitedRoomSync` and released before the next room is read.
+
+ Null values in JSON objects are removed while reading, like `[MXJSONModel removeNullValuesInJSON:]` does.
+ */
+@interface MXSyncResponseDecoder : NSObject
+
+/**
+ Create a decoder.
+
+ @param data the JSON data of a /sync response.
+ */
+- (instancetype)initWithData:(NSData*)data NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ A block called as soon as a room has been decoded, before the next one is read.
+
+ `roomSync` is a `MXRoomSync` for joined and left rooms and a `MXInvitedRoomSync` for invited rooms.
+ */
+@property (nonatomic, copy, nullable) void (^onRoomSync)(NSString *roomId, MXMembership membership, MXJSONModel *roomSync);
+
+/**
+ Decode the data.
+
+ @param error the parsing error, if any.
+ @return the sync response. nil if the data is not a valid JSON object.
+ */
+- (nullable MXSyncResponse*)decode:(NSError**)error;
+
+/**
+ Decode the raw JSON data of a /sync response.
+
+ @param data the JSON data.
+ @param error the parsing error, if any.
+ @return the sync response. nil if the data is not a valid JSON object.
+ */
++ (nullable MXSyncResponse*)syncResponseFromData:(NSData*)data error:(NSError**)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
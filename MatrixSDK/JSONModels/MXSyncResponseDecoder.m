@@ -0,0 +1,746 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXSyncResponseDecoder.h"
+
+NSString *const kMXSyncResponseDecoderErrorDomain = @"org.matrix.sdk.MXSyncResponseDecoder";
+
+// Maximum nesting of JSON objects and arrays
+static NSUInteger const kMXJSONReaderMaxDepth = 512;
+
+// Maximum length of a JSON number that is parsed without allocation
+static NSUInteger const kMXJSONReaderMaxNumberLength = 63;
+
+
+#pragma mark - MXJSONReader
+
+/**
+ A sequential reader of JSON data.
+
+ Functions return nil on error and set `errorReason`. The first error is kept.
+ */
+typedef struct
+{
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger position;
+    NSUInteger depth;
+    const char *errorReason;
+} MXJSONReader;
+
+static id MXJSONReaderReadValue(MXJSONReader *reader);
+
+static void MXJSONReaderFail(MXJSONReader *reader, const char *reason)
+{
+    if (!reader->errorReason)
+    {
+        reader->errorReason = reason;
+    }
+}
+
+/**
+ Skip whitespaces and return the next character. 0 at the end of the data.
+ */
+static uint8_t MXJSONReaderPeek(MXJSONReader *reader)
+{
+    while (reader->position < reader->length)
+    {
+        uint8_t c = reader->bytes[reader->position];
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+        {
+            return c;
+        }
+        reader->position++;
+    }
+    return 0;
+}
+
+/**
+ Consume the next character if it is `c`.
+ */
+static BOOL MXJSONReaderConsume(MXJSONReader *reader, uint8_t c)
+{
+    if (MXJSONReaderPeek(reader) == c)
+    {
+        reader->position++;
+        return YES;
+    }
+    return NO;
+}
+
+static void MXJSONReaderAppendCodePoint(NSMutableData *buffer, uint32_t codePoint)
+{
+    uint8_t utf8[4];
+    NSUInteger length;
+
+    if (codePoint < 0x80)
+    {
+        utf8[0] = codePoint;
+        length = 1;
+    }
+    else if (codePoint < 0x800)
+    {
+        utf8[0] = 0xC0 | (codePoint >> 6);
+        utf8[1] = 0x80 | (codePoint & 0x3F);
+        length = 2;
+    }
+    else if (codePoint < 0x10000)
+    {
+        utf8[0] = 0xE0 | (codePoint >> 12);
+        utf8[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        utf8[2] = 0x80 | (codePoint & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = 0xF0 | (codePoint >> 18);
+        utf8[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+        utf8[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+        utf8[3] = 0x80 | (codePoint & 0x3F);
+        length = 4;
+    }
+
+    [buffer appendBytes:utf8 length:length];
+}
+
+/**
+ Read the 4 hexadecimal digits of a \u escape sequence. -1 on error.
+ */
+static int32_t MXJSONReaderReadHex4(MXJSONReader *reader)
+{
+    if (reader->position + 4 > reader->length)
+    {
+        return -1;
+    }
+
+    int32_t value = 0;
+    for (NSUInteger i = 0; i < 4; i++)
+    {
+        uint8_t c = reader->bytes[reader->position++];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            value |= c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            value |= c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            value |= c - 'A' + 10;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return value;
+}
+
+/**
+ Read the end of a string that contains escape sequences.
+
+ @param reader the reader, positioned on the first backslash.
+ @param buffer the UTF-8 bytes read so far.
+ */
+static NSString* MXJSONReaderReadEscapedString(MXJSONReader *reader, NSMutableData *buffer)
+{
+    const uint8_t *bytes = reader->bytes;
+
+    while (reader->position < reader->length)
+    {
+        uint8_t c = bytes[reader->position];
+
+        if (c == '"')
+        {
+            reader->position++;
+
+            NSString *string = [[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding];
+            if (!string)
+            {
+                MXJSONReaderFail(reader, "Invalid UTF-8 string");
+            }
+            return string;
+        }
+        else if (c == '\\')
+        {
+            reader->position++;
+            if (reader->position >= reader->length)
+            {
+                break;
+            }
+
+            uint8_t escaped = bytes[reader->position++];
+            uint8_t unescaped;
+            switch (escaped)
+            {
+                case '"':
+                case '\\':
+                case '/':
+                    unescaped = escaped;
+                    break;
+                case 'b':
+                    unescaped = '\b';
+                    break;
+                case 'f':
+                    unescaped = '\f';
+                    break;
+                case 'n':
+                    unescaped = '\n';
+                    break;
+                case 'r':
+                    unescaped = '\r';
+                    break;
+                case 't':
+                    unescaped = '\t';
+                    break;
+                case 'u':
+                {
+                    int32_t codeUnit = MXJSONReaderReadHex4(reader);
+                    if (codeUnit < 0)
+                    {
+                        MXJSONReaderFail(reader, "Invalid unicode escape sequence");
+                        return nil;
+                    }
+
+                    uint32_t codePoint = codeUnit;
+                    if (codeUnit >= 0xD800 && codeUnit <= 0xDBFF)
+                    {
+                        // A high surrogate must be followed by a low one
+                        codePoint = 0xFFFD;
+                        if (reader->position + 6 <= reader->length
+                            && bytes[reader->position] == '\\' && bytes[reader->position + 1] == 'u')
+                        {
+                            NSUInteger position = reader->position;
+                            reader->position += 2;
+                            int32_t lowSurrogate = MXJSONReaderReadHex4(reader);
+                            if (lowSurrogate >= 0xDC00 && lowSurrogate <= 0xDFFF)
+                            {
+                                codePoint = 0x10000 + ((codeUnit - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+                            }
+                            else
+                            {
+                                // Read it as a separate code unit
+                                reader->position = position;
+                            }
+                        }
+                    }
+                    else if (codeUnit >= 0xDC00 && codeUnit <= 0xDFFF)
+                    {
+                        codePoint = 0xFFFD;
+                    }
+
+                    MXJSONReaderAppendCodePoint(buffer, codePoint);
+                    continue;
+                }
+                default:
+                    MXJSONReaderFail(reader, "Invalid escape sequence");
+                    return nil;
+            }
+
+            [buffer appendBytes:&unescaped length:1];
+        }
+        else if (c < 0x20)
+        {
+            MXJSONReaderFail(reader, "Control character in string");
+            return nil;
+        }
+        else
+        {
+            // Copy the run of characters until the next special one
+            NSUInteger start = reader->position;
+            while (reader->position < reader->length)
+            {
+                c = bytes[reader->position];
+                if (c == '"' || c == '\\' || c < 0x20)
+                {
+                    break;
+                }
+                reader->position++;
+            }
+            [buffer appendBytes:bytes + start length:reader->position - start];
+        }
+    }
+
+    MXJSONReaderFail(reader, "Unterminated string");
+    return nil;
+}
+
+static NSString* MXJSONReaderReadString(MXJSONReader *reader)
+{
+    if (!MXJSONReaderConsume(reader, '"'))
+    {
+        MXJSONReaderFail(reader, "Expected a string");
+        return nil;
+    }
+
+    const uint8_t *bytes = reader->bytes;
+    NSUInteger start = reader->position;
+    NSUInteger position = start;
+
+    while (position < reader->length)
+    {
+        uint8_t c = bytes[position];
+        if (c == '"')
+        {
+            // Most strings have no escape sequence. Create them directly from the data
+            reader->position = position + 1;
+
+            NSString *string = [[NSString alloc] initWithBytes:bytes + start length:position - start encoding:NSUTF8StringEncoding];
+            if (!string)
+            {
+                MXJSONReaderFail(reader, "Invalid UTF-8 string");
+            }
+            return string;
+        }
+        else if (c == '\\')
+        {
+            reader->position = position;
+
+            NSMutableData *buffer = [NSMutableData dataWithCapacity:position - start + 32];
+            [buffer appendBytes:bytes + start length:position - start];
+            return MXJSONReaderReadEscapedString(reader, buffer);
+        }
+        else if (c < 0x20)
+        {
+            reader->position = position;
+            MXJSONReaderFail(reader, "Control character in string");
+            return nil;
+        }
+        position++;
+    }
+
+    reader->position = position;
+    MXJSONReaderFail(reader, "Unterminated string");
+    return nil;
+}
+
+static NSNumber* MXJSONReaderReadNumber(MXJSONReader *reader)
+{
+    const uint8_t *bytes = reader->bytes;
+    NSUInteger start = reader->position;
+    NSUInteger position = start;
+    BOOL isInteger = YES;
+
+    if (position < reader->length && bytes[position] == '-')
+    {
+        position++;
+    }
+
+    NSUInteger digitsStart = position;
+    while (position < reader->length && bytes[position] >= '0' && bytes[position] <= '9')
+    {
+        position++;
+    }
+    if (position == digitsStart)
+    {
+        MXJSONReaderFail(reader, "Invalid number");
+        return nil;
+    }
+
+    if (position < reader->length && bytes[position] == '.')
+    {
+        isInteger = NO;
+        position++;
+        while (position < reader->length && bytes[position] >= '0' && bytes[position] <= '9')
+        {
+            position++;
+        }
+    }
+
+    if (position < reader->length && (bytes[position] == 'e' || bytes[position] == 'E'))
+    {
+        isInteger = NO;
+        position++;
+        if (position < reader->length && (bytes[position] == '+' || bytes[position] == '-'))
+        {
+            position++;
+        }
+        while (position < reader->length && bytes[position] >= '0' && bytes[position] <= '9')
+        {
+            position++;
+        }
+    }
+
+    reader->position = position;
+
+    // strtoll and strtod need a null-terminated string
+    NSUInteger length = position - start;
+    if (length > kMXJSONReaderMaxNumberLength)
+    {
+        NSString *string = [[NSString alloc] initWithBytes:bytes + start length:length encoding:NSASCIIStringEncoding];
+        return [NSDecimalNumber decimalNumberWithString:string locale:@{NSLocaleDecimalSeparator: @"."}];
+    }
+
+    char buffer[kMXJSONReaderMaxNumberLength + 1];
+    memcpy(buffer, bytes + start, length);
+    buffer[length] = 0;
+
+    if (isInteger)
+    {
+        errno = 0;
+        long long value = strtoll(buffer, NULL, 10);
+        if (errno != ERANGE)
+        {
+            return @(value);
+        }
+    }
+
+    return @(strtod(buffer, NULL));
+}
+
+static BOOL MXJSONReaderConsumeLiteral(MXJSONReader *reader, const char *literal, NSUInteger length)
+{
+    if (reader->position + length <= reader->length
+        && memcmp(reader->bytes + reader->position, literal, length) == 0)
+    {
+        reader->position += length;
+        return YES;
+    }
+
+    MXJSONReaderFail(reader, "Invalid literal");
+    return NO;
+}
+
+/**
+ Start reading an object.
+ */
+static BOOL MXJSONReaderBeginObject(MXJSONReader *reader)
+{
+    if (!MXJSONReaderConsume(reader, '{'))
+    {
+        MXJSONReaderFail(reader, "Expected an object");
+        return NO;
+    }
+
+    if (++reader->depth > kMXJSONReaderMaxDepth)
+    {
+        MXJSONReaderFail(reader, "Too many nested containers");
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ Read the next key of the object being read.
+
+ @param reader the reader.
+ @param first YES before reading the first key. Set to NO.
+ @return the key. nil at the end of the object or on error.
+ */
+static NSString* MXJSONReaderNextKey(MXJSONReader *reader, BOOL *first)
+{
+    if (MXJSONReaderConsume(reader, '}'))
+    {
+        reader->depth--;
+        return nil;
+    }
+
+    if (!*first && !MXJSONReaderConsume(reader, ','))
+    {
+        MXJSONReaderFail(reader, "Invalid object");
+        return nil;
+    }
+    *first = NO;
+
+    NSString *key = MXJSONReaderReadString(reader);
+    if (key && !MXJSONReaderConsume(reader, ':'))
+    {
+        MXJSONReaderFail(reader, "Invalid object");
+        return nil;
+    }
+    return key;
+}
+
+static NSDictionary* MXJSONReaderReadObject(MXJSONReader *reader)
+{
+    if (!MXJSONReaderBeginObject(reader))
+    {
+        return nil;
+    }
+
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionary];
+
+    BOOL first = YES;
+    NSString *key;
+    while ((key = MXJSONReaderNextKey(reader, &first)))
+    {
+        id value = MXJSONReaderReadValue(reader);
+        if (!value)
+        {
+            return nil;
+        }
+
+        if (value != [NSNull null])
+        {
+            dictionary[key] = value;
+        }
+        else if ([key isEqualToString:kMXRoomTagServerNotice])
+        {
+            // Same as [MXJSONModel removeNullValuesInJSON:]
+            dictionary[key] = @{};
+        }
+    }
+
+    return reader->errorReason ? nil : dictionary;
+}
+
+static NSArray* MXJSONReaderReadArray(MXJSONReader *reader)
+{
+    reader->position++;
+    if (++reader->depth > kMXJSONReaderMaxDepth)
+    {
+        MXJSONReaderFail(reader, "Too many nested containers");
+        return nil;
+    }
+
+    NSMutableArray *array = [NSMutableArray array];
+
+    if (!MXJSONReaderConsume(reader, ']'))
+    {
+        do
+        {
+            // Like NSJSONSerialization, keep null values in arrays
+            id value = MXJSONReaderReadValue(reader);
+            if (!value)
+            {
+                return nil;
+            }
+            [array addObject:value];
+        }
+        while (MXJSONReaderConsume(reader, ','));
+
+        if (!MXJSONReaderConsume(reader, ']'))
+        {
+            MXJSONReaderFail(reader, "Invalid array");
+            return nil;
+        }
+    }
+
+    reader->depth--;
+    return array;
+}
+
+static id MXJSONReaderReadValue(MXJSONReader *reader)
+{
+    switch (MXJSONReaderPeek(reader))
+    {
+        case '{':
+            return MXJSONReaderReadObject(reader);
+        case '[':
+            return MXJSONReaderReadArray(reader);
+        case '"':
+            return MXJSONReaderReadString(reader);
+        case 't':
+            return MXJSONReaderConsumeLiteral(reader, "true", 4) ? @YES : nil;
+        case 'f':
+            return MXJSONReaderConsumeLiteral(reader, "false", 5) ? @NO : nil;
+        case 'n':
+            return MXJSONReaderConsumeLiteral(reader, "null", 4) ? [NSNull null] : nil;
+        case '-':
+        case '0' ... '9':
+            return MXJSONReaderReadNumber(reader);
+        default:
+            MXJSONReaderFail(reader, "Unexpected character");
+            return nil;
+    }
+}
+
+
+#pragma mark - MXSyncResponseDecoder
+
+@interface MXSyncResponseDecoder ()
+{
+    NSData *data;
+    MXJSONReader reader;
+}
+@end
+
+@implementation MXSyncResponseDecoder
+
+- (instancetype)initWithData:(NSData *)theData
+{
+    self = [super init];
+    if (self)
+    {
+        data = theData;
+    }
+    return self;
+}
+
++ (MXSyncResponse *)syncResponseFromData:(NSData *)data error:(NSError **)error
+{
+    return [[[MXSyncResponseDecoder alloc] initWithData:data] decode:error];
+}
+
+- (MXSyncResponse *)decode:(NSError **)error
+{
+    reader = (MXJSONReader){
+        .bytes = data.bytes,
+        .length = data.length
+    };
+
+    // All top-level members but rooms are small. Parse them as usual
+    NSMutableDictionary *JSONResponse = [NSMutableDictionary dictionary];
+    MXRoomsSyncResponse *roomsSync;
+
+    if (MXJSONReaderBeginObject(&reader))
+    {
+        BOOL first = YES;
+        NSString *key;
+        while ((key = MXJSONReaderNextKey(&reader, &first)))
+        {
+            if ([key isEqualToString:@"rooms"] && MXJSONReaderPeek(&reader) == '{')
+            {
+                roomsSync = [self decodeRooms];
+            }
+            else
+            {
+                id value = MXJSONReaderReadValue(&reader);
+                if (value && value != [NSNull null])
+                {
+                    JSONResponse[key] = value;
+                }
+            }
+
+            if (reader.errorReason)
+            {
+                break;
+            }
+        }
+    }
+
+    if (!reader.errorReason && MXJSONReaderPeek(&reader))
+    {
+        MXJSONReaderFail(&reader, "Unexpected data after the response");
+    }
+
+    if (reader.errorReason)
+    {
+        NSLog(@"[MXSyncResponseDecoder] decode: Error: %s at offset %tu", reader.errorReason, reader.position);
+
+        if (error)
+        {
+            *error = [NSError errorWithDomain:kMXSyncResponseDecoderErrorDomain
+                                         code:0
+                                     userInfo:@{
+                                                NSLocalizedDescriptionKey: [NSString stringWithFormat:@"%s at offset %tu", reader.errorReason, reader.position]
+                                                }];
+        }
+        return nil;
+    }
+
+    MXSyncResponse *syncResponse = [MXSyncResponse modelFromJSON:JSONResponse];
+    syncResponse.rooms = roomsSync;
+
+    return syncResponse;
+}
+
+
+#pragma mark - Private methods
+
+- (MXRoomsSyncResponse*)decodeRooms
+{
+    NSMutableDictionary<NSString*, MXRoomSync*> *join = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, MXInvitedRoomSync*> *invite = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, MXRoomSync*> *leave = [NSMutableDictionary dictionary];
+
+    MXJSONReaderBeginObject(&reader);
+
+    BOOL first = YES;
+    NSString *section;
+    while ((section = MXJSONReaderNextKey(&reader, &first)))
+    {
+        MXMembership membership = MXMembershipUnknown;
+        NSMutableDictionary *rooms;
+        if ([section isEqualToString:@"join"])
+        {
+            membership = MXMembershipJoin;
+            rooms = join;
+        }
+        else if ([section isEqualToString:@"invite"])
+        {
+            membership = MXMembershipInvite;
+            rooms = invite;
+        }
+        else if ([section isEqualToString:@"leave"])
+        {
+            membership = MXMembershipLeave;
+            rooms = leave;
+        }
+
+        if (!rooms || MXJSONReaderPeek(&reader) != '{')
+        {
+            if (!MXJSONReaderReadValue(&reader))
+            {
+                break;
+            }
+            continue;
+        }
+
+        MXJSONReaderBeginObject(&reader);
+
+        BOOL firstRoom = YES;
+        NSString *roomId;
+        while ((roomId = MXJSONReaderNextKey(&reader, &firstRoom)))
+        {
+            // Release the JSON of a room before reading the next one
+            @autoreleasepool
+            {
+                id roomJSON = MXJSONReaderReadValue(&reader);
+                if (!roomJSON)
+                {
+                    break;
+                }
+
+                MXJSONModel *roomSync;
+                if (membership == MXMembershipInvite)
+                {
+                    MXJSONModelSetMXJSONModel(roomSync, MXInvitedRoomSync, roomJSON);
+                }
+                else
+                {
+                    MXJSONModelSetMXJSONModel(roomSync, MXRoomSync, roomJSON);
+                }
+
+                if (roomSync)
+                {
+                    rooms[roomId] = roomSync;
+
+                    if (_onRoomSync)
+                    {
+                        _onRoomSync(roomId, membership, roomSync);
+                    }
+                }
+            }
+        }
+
+        if (reader.errorReason)
+        {
+            break;
+        }
+    }
+
+    MXRoomsSyncResponse *roomsSync = [[MXRoomsSyncResponse alloc] init];
+    roomsSync.join = join;
+    roomsSync.invite = invite;
+    roomsSync.leave = leave;
+
+    return roomsSync;
+}
+
+@end
@@ -20,6 +20,7 @@
 #import "MXRestClient.h"
 
 #import "MXJSONModel.h"
+#import "MXSyncResponseDecoder.h"
 #import "MXTools.h"
 #import "MXError.h"
 
@@ -3259,16 +3260,25 @@ MXAuthAction;
     MXHTTPOperation *operation = [httpClient requestWithMethod:@"GET"
                                                           path:[NSString stringWithFormat:@"%@/sync", apiPathPrefix]
                                                     parameters:parameters timeout:clientTimeoutInSeconds
-                                                       success:^(NSDictionary *JSONResponse) {
+                                                   successData:^(NSData *responseData) {
                                                            MXStrongifyAndReturnIfNil(self);
 
                                                            if (success)
                                                            {
+                                                               // Decode the response without building the JSON tree of the whole response
                                                                __block MXSyncResponse *syncResponse;
+                                                               __block NSError *error;
                                                                [self dispatchProcessing:^{
-                                                                   MXJSONModelSetMXJSONModel(syncResponse, MXSyncResponse, JSONResponse);
+                                                                   syncResponse = [MXSyncResponseDecoder syncResponseFromData:responseData error:&error];
                                                                } andCompletion:^{
-                                                                   success(syncResponse);
+                                                                   if (syncResponse)
+                                                                   {
+                                                                       success(syncResponse);
+                                                                   }
+                                                                   else if (failure)
+                                                                   {
+                                                                       failure(error);
+                                                                   }
                                                                }];
                                                            }
                                                        }
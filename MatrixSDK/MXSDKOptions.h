@@ -63,6 +63,15 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic) BOOL computeE2ERoomSummaryTrust;
 
+/**
+ Decrypt the timeline events of known rooms in a /sync response off the main thread
+ before handling the response.
+ Only decryption moves off the main thread: rooms, timelines and summaries are still
+ updated one by one on the main thread.
+ NO by default.
+ */
+@property (nonatomic) BOOL decryptSyncResponsesInBackground;
+
 /**
  The delegate object to receive analytics events
  
@@ -37,6 +37,7 @@ static MXSDKOptions *sharedOnceInstance = nil;
     {
         _disableIdenticonUseForUserAvatar = NO;
         _enableCryptoWhenStartingMXSession = NO;
+        _decryptSyncResponsesInBackground = NO;
         _mediaCacheAppVersion = 0;
         _applicationGroupIdentifier = nil;
     }
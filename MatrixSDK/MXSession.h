@@ -1422,6 +1422,22 @@ typedef void (^MXOnBackgroundSyncFail)(NSError *error);
  */
 - (BOOL)decryptEvent:(MXEvent*)event inTimeline:(NSString*)timeline;
 
+/**
+ Decrypt events asynchronously and update their data.
+
+ Encrypted events are decrypted in order, off the main thread. Their data is updated
+ on the main thread, before `onComplete` is called.
+
+ @param events the events to decrypt. Events that are not encrypted are ignored.
+ @param timeline the id of the timeline where the events are decrypted. It is used
+        to prevent replay attack.
+ @param onComplete the block called on the main thread with the events that could not be decrypted.
+        It is called synchronously if there is no encrypted event.
+ */
+- (void)decryptEvents:(NSArray<MXEvent*> *)events
+           inTimeline:(NSString*)timeline
+           onComplete:(void (^)(NSArray<MXEvent*> *failedEvents))onComplete;
+
 /**
  Reset replay attack data for the given timeline.
 
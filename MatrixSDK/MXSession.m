@@ -23,6 +23,7 @@
 #import <AFNetworking/AFNetworking.h>
 
 #import "MXSessionEventListener.h"
+#import "MXEventListenerSet.h"
 
 #import "MXTools.h"
 #import "MXHTTPClient.h"
@@ -113,10 +114,22 @@ typedef void (^MXOnResumeDone)(void);
      */
     MXHTTPOperation *eventStreamRequest;
 
+    /**
+     YES while a /sync response is being handled, from its to-device events to the storage
+     of its token.
+     */
+    BOOL handlingSyncResponse;
+
+    /**
+     The event stream request to launch once the current /sync response is handled.
+     A request launched before would use the previous token and get the same response again.
+     */
+    dispatch_block_t pendingEventStreamLaunch;
+
     /**
      The list of global events listeners (`MXSessionEventListener`).
      */
-    NSMutableArray *globalEventListeners;
+    MXEventListenerSet *globalEventListeners;
 
     /** 
      The block to call when MSSession resume is complete.
@@ -200,7 +213,7 @@ typedef void (^MXOnResumeDone)(void);
         rooms = [NSMutableDictionary dictionary];
         roomsSummaries = [NSMutableDictionary dictionary];
         _roomSummaryUpdateDelegate = [MXRoomSummaryUpdater roomSummaryUpdaterForSession:self];
-        globalEventListeners = [NSMutableArray array];
+        globalEventListeners = [[MXEventListenerSet alloc] init];
         _notificationCenter = [[MXNotificationCenter alloc] initWithMatrixSession:self];
         _accountData = [[MXAccountData alloc] init];
         peekingRooms = [NSMutableArray array];
@@ -646,6 +659,7 @@ typedef void (^MXOnResumeDone)(void);
         // Cancel the current request managing the event stream
         [eventStreamRequest cancel];
         eventStreamRequest = nil;
+        pendingEventStreamLaunch = nil;
 
         for (MXPeekingRoom *peekingRoom in peekingRooms)
         {
@@ -682,7 +696,9 @@ typedef void (^MXOnResumeDone)(void);
         if (!eventStreamRequest)
         {
             // Relaunch live events stream (long polling)
-            [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
+            [self launchEventStream:^{
+                [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
+            }];
         }
     }
 
@@ -713,7 +729,9 @@ typedef void (^MXOnResumeDone)(void);
             onBackgroundSyncDone = backgroundSyncDone;
             onBackgroundSyncFail = backgroundSyncfails;
 
-            [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:timeout setPresence:@"offline"];
+            [self launchEventStream:^{
+                [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:timeout setPresence:@"offline"];
+            }];
         }
     }
 }
@@ -728,7 +746,9 @@ typedef void (^MXOnResumeDone)(void);
         
         // retrieve the available data asap
         // disable the long poll to get the available data asap
-        [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:10 setPresence:nil];
+        [self launchEventStream:^{
+            [self serverSyncWithServerTimeout:0 success:nil failure:nil clientTimeout:10 setPresence:nil];
+        }];
         
         return YES;
     }
@@ -745,6 +765,8 @@ typedef void (^MXOnResumeDone)(void);
     // Cancel the current server request (if any)
     [eventStreamRequest cancel];
     eventStreamRequest = nil;
+    pendingEventStreamLaunch = nil;
+    handlingSyncResponse = NO;
 
     // Flush pending direct room operations
     [directRoomsOperationsQueue removeAllObjects];
@@ -961,6 +983,9 @@ typedef void (^MXOnResumeDone)(void);
             return;
         }
 
+        MXHTTPOperation *syncRequest = self->eventStreamRequest;
+        self->handlingSyncResponse = YES;
+
         // By default, the next sync will be a long polling (with the default server timeout value)
         NSUInteger nextServerTimeout = SERVER_TIMEOUT_MS;
 
@@ -999,253 +1024,283 @@ typedef void (^MXOnResumeDone)(void);
             [self handleAccountData:syncResponse.accountData];
         }
 
-        // Handle first joined rooms
-        for (NSString *roomId in syncResponse.rooms.join)
-        {
-            MXRoomSync *roomSync = syncResponse.rooms.join[roomId];
+        // Decrypt rooms events before handling them. This may be done off the main thread
+        [self decryptRoomsEventsInSyncResponse:syncResponse onComplete:^(NSSet<NSString*> *decryptedRoomIds) {
 
-            @autoreleasepool {
-
-                // Retrieve existing room or create a new one
-                MXRoom *room = [self getOrCreateRoom:roomId notify:!isInitialSync];
-
-                // Sync room
-                [room liveTimeline:^(MXEventTimeline *liveTimeline) {
-                    [room handleJoinedRoomSync:roomSync];
-                    [room.summary handleJoinedRoomSync:roomSync];
-                }];
+            // Make sure [MXSession close] has not been called meanwhile.
+            // If [MXSession pause] has been called, the response must still be handled up to
+            // the storage of its token: its to-device events have already been handled and
+            // must not be handled again on resume
+            if (self.state == MXSessionStateClosed)
+            {
+                return;
             }
-        }
 
-        // Handle invited rooms
-        for (NSString *roomId in syncResponse.rooms.invite)
-        {
-            MXInvitedRoomSync *invitedRoomSync = syncResponse.rooms.invite[roomId];
+            // Handle first joined rooms
+            for (NSString *roomId in syncResponse.rooms.join)
+            {
+                MXRoomSync *roomSync = syncResponse.rooms.join[roomId];
 
-            @autoreleasepool {
+                @autoreleasepool {
 
-                // Retrieve existing room or create a new one
-                MXRoom *room = [self getOrCreateRoom:roomId notify:!isInitialSync];
+                    // Retrieve existing room or create a new one
+                    MXRoom *room = [self getOrCreateRoom:roomId notify:!isInitialSync];
 
-                // Prepare invited room
-                [room liveTimeline:^(MXEventTimeline *liveTimeline) {
-                    [room handleInvitedRoomSync:invitedRoomSync];
-                    [room.summary handleInvitedRoomSync:invitedRoomSync];
-                }];
+                    // Sync room
+                    [room liveTimeline:^(MXEventTimeline *liveTimeline) {
+                        [room handleJoinedRoomSync:roomSync decryptionAttempted:[decryptedRoomIds containsObject:roomId]];
+                        [room.summary handleJoinedRoomSync:roomSync];
+                    }];
+                }
             }
-        }
 
-        // Handle archived rooms
-        for (NSString *roomId in syncResponse.rooms.leave)
-        {
-            MXRoomSync *leftRoomSync = syncResponse.rooms.leave[roomId];
+            // Handle invited rooms
+            for (NSString *roomId in syncResponse.rooms.invite)
+            {
+                MXInvitedRoomSync *invitedRoomSync = syncResponse.rooms.invite[roomId];
 
-            @autoreleasepool {
+                @autoreleasepool {
 
-                // Presently we remove the existing room from the rooms list.
-                // FIXME SYNCV2 Archive/Display the left rooms!
-                // For that create 'handleArchivedRoomSync' method
+                    // Retrieve existing room or create a new one
+                    MXRoom *room = [self getOrCreateRoom:roomId notify:!isInitialSync];
 
-                // Retrieve existing room
-                MXRoom *room = [self roomWithRoomId:roomId];
-                if (room)
-                {
-                    // FIXME SYNCV2: While 'handleArchivedRoomSync' is not available,
-                    // use 'handleJoinedRoomSync' to pass the last events to the room before leaving it.
-                    // The room will then able to notify its listeners.
+                    // Prepare invited room
                     [room liveTimeline:^(MXEventTimeline *liveTimeline) {
-                        [room handleJoinedRoomSync:leftRoomSync];
-                        [room.summary handleJoinedRoomSync:leftRoomSync];
+                        [room handleInvitedRoomSync:invitedRoomSync];
+                        [room.summary handleInvitedRoomSync:invitedRoomSync];
+                    }];
+                }
+            }
 
-                        // Look for the last room member event
-                        MXEvent *roomMemberEvent;
-                        NSInteger index = leftRoomSync.timeline.events.count;
-                        while (index--)
-                        {
-                            MXEvent *event = leftRoomSync.timeline.events[index];
+            // Handle archived rooms
+            for (NSString *roomId in syncResponse.rooms.leave)
+            {
+                MXRoomSync *leftRoomSync = syncResponse.rooms.leave[roomId];
+
+                @autoreleasepool {
+
+                    // Presently we remove the existing room from the rooms list.
+                    // FIXME SYNCV2 Archive/Display the left rooms!
+                    // For that create 'handleArchivedRoomSync' method
 
-                            if ([event.type isEqualToString:kMXEventTypeStringRoomMember])
+                    // Retrieve existing room
+                    MXRoom *room = [self roomWithRoomId:roomId];
+                    if (room)
+                    {
+                        // FIXME SYNCV2: While 'handleArchivedRoomSync' is not available,
+                        // use 'handleJoinedRoomSync' to pass the last events to the room before leaving it.
+                        // The room will then able to notify its listeners.
+                        [room liveTimeline:^(MXEventTimeline *liveTimeline) {
+                            [room handleJoinedRoomSync:leftRoomSync decryptionAttempted:[decryptedRoomIds containsObject:roomId]];
+                            [room.summary handleJoinedRoomSync:leftRoomSync];
+
+                            // Look for the last room member event
+                            MXEvent *roomMemberEvent;
+                            NSInteger index = leftRoomSync.timeline.events.count;
+                            while (index--)
                             {
-                                roomMemberEvent = event;
-                                break;
+                                MXEvent *event = leftRoomSync.timeline.events[index];
+
+                                if ([event.type isEqualToString:kMXEventTypeStringRoomMember])
+                                {
+                                    roomMemberEvent = event;
+                                    break;
+                                }
                             }
-                        }
 
-                        // Notify the room is going to disappear
-                        NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:room.roomId forKey:kMXSessionNotificationRoomIdKey];
-                        if (roomMemberEvent)
-                        {
-                            userInfo[kMXSessionNotificationEventKey] = roomMemberEvent;
-                        }
-                        [[NSNotificationCenter defaultCenter] postNotificationName:kMXSessionWillLeaveRoomNotification
-                                                                            object:self
-                                                                          userInfo:userInfo];
-                        // Remove the room from the rooms list
-                        [self removeRoom:room.roomId];
-                    }];
+                            // Notify the room is going to disappear
+                            NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:room.roomId forKey:kMXSessionNotificationRoomIdKey];
+                            if (roomMemberEvent)
+                            {
+                                userInfo[kMXSessionNotificationEventKey] = roomMemberEvent;
+                            }
+                            [[NSNotificationCenter defaultCenter] postNotificationName:kMXSessionWillLeaveRoomNotification
+                                                                                object:self
+                                                                              userInfo:userInfo];
+                            // Remove the room from the rooms list
+                            [self removeRoom:room.roomId];
+                        }];
+                    }
                 }
             }
-        }
 
-        // Check the conditions to update summaries direct user ids for retrieved rooms (We have to do it
-        // when we receive some invites to handle correctly a new invite to a direct chat that the user has left).
-        if (isInitialSync || syncResponse.rooms.invite.count)
-        {
-            [self updateSummaryDirectUserIdForRooms:[self directRoomIds]];
-        }
+            // Check the conditions to update summaries direct user ids for retrieved rooms (We have to do it
+            // when we receive some invites to handle correctly a new invite to a direct chat that the user has left).
+            if (isInitialSync || syncResponse.rooms.invite.count)
+            {
+                [self updateSummaryDirectUserIdForRooms:[self directRoomIds]];
+            }
 
-        // Handle invited groups
-        for (NSString *groupId in syncResponse.groups.invite)
-        {
-            // Create a new group for each invite
-            MXInvitedGroupSync *invitedGroupSync = syncResponse.groups.invite[groupId];
-            [self createGroupInviteWithId:groupId profile:invitedGroupSync.profile andInviter:invitedGroupSync.inviter notify:!isInitialSync];
-        }
+            // Handle invited groups
+            for (NSString *groupId in syncResponse.groups.invite)
+            {
+                // Create a new group for each invite
+                MXInvitedGroupSync *invitedGroupSync = syncResponse.groups.invite[groupId];
+                [self createGroupInviteWithId:groupId profile:invitedGroupSync.profile andInviter:invitedGroupSync.inviter notify:!isInitialSync];
+            }
 
-        // Handle joined groups
-        for (NSString *groupId in syncResponse.groups.join)
-        {
-            // Join an existing group or create a new one
-            [self didJoinGroupWithId:groupId notify:!isInitialSync];
-        }
+            // Handle joined groups
+            for (NSString *groupId in syncResponse.groups.join)
+            {
+                // Join an existing group or create a new one
+                [self didJoinGroupWithId:groupId notify:!isInitialSync];
+            }
 
-        // Handle left groups
-        for (NSString *groupId in syncResponse.groups.leave)
-        {
-            // Remove the group from the group list
-            [self removeGroup:groupId];
-        }
+            // Handle left groups
+            for (NSString *groupId in syncResponse.groups.leave)
+            {
+                // Remove the group from the group list
+                [self removeGroup:groupId];
+            }
 
-        // Handle presence of other users
-        for (MXEvent *presenceEvent in syncResponse.presence.events)
-        {
-            [self handlePresenceEvent:presenceEvent direction:MXTimelineDirectionForwards];
-        }
+            // Handle presence of other users
+            for (MXEvent *presenceEvent in syncResponse.presence.events)
+            {
+                [self handlePresenceEvent:presenceEvent direction:MXTimelineDirectionForwards];
+            }
 
-        // Sync point: wait that all rooms in the /sync response have been loaded
-        // and their /sync response has been processed
-        [self preloadRoomsData:[self roomsInSyncResponse:syncResponse] onComplete:^{
+            // Sync point: wait that all rooms in the /sync response have been loaded
+            // and their /sync response has been processed
+            [self preloadRoomsData:[self roomsInSyncResponse:syncResponse] onComplete:^{
 
-            if (self.crypto)
-            {
-                // Handle device list updates
-                if (syncResponse.deviceLists)
+                if (self.crypto)
                 {
-                    [self.crypto handleDeviceListsChanges:syncResponse.deviceLists];
-                }
+                    // Handle device list updates
+                    if (syncResponse.deviceLists)
+                    {
+                        [self.crypto handleDeviceListsChanges:syncResponse.deviceLists];
+                    }
 
-                // Handle one_time_keys_count
-                if (syncResponse.deviceOneTimeKeysCount)
-                {
-                    [self.crypto handleDeviceOneTimeKeysCount:syncResponse.deviceOneTimeKeysCount];
+                    // Handle one_time_keys_count
+                    if (syncResponse.deviceOneTimeKeysCount)
+                    {
+                        [self.crypto handleDeviceOneTimeKeysCount:syncResponse.deviceOneTimeKeysCount];
+                    }
+
+                    // Tell the crypto module to do its processing
+                    [self.crypto onSyncCompleted:self.store.eventStreamToken
+                                   nextSyncToken:syncResponse.nextBatch
+                                      catchingUp:self.catchingUp];
                 }
 
-                // Tell the crypto module to do its processing
-                [self.crypto onSyncCompleted:self.store.eventStreamToken
-                               nextSyncToken:syncResponse.nextBatch
-                                  catchingUp:self.catchingUp];
-            }
 
+                // Update live event stream token
+                self.store.eventStreamToken = syncResponse.nextBatch;
 
-            // Update live event stream token
-            self.store.eventStreamToken = syncResponse.nextBatch;
+                // Commit store changes done in [room handleMessages]
+                if ([self.store respondsToSelector:@selector(commit)])
+                {
+                    [self.store commit];
+                }
 
-            // Commit store changes done in [room handleMessages]
-            if ([self.store respondsToSelector:@selector(commit)])
-            {
-                [self.store commit];
-            }
+                self->handlingSyncResponse = NO;
 
-            // Do a loop of /syncs until catching up is done
-            if (nextServerTimeout == 0)
-            {
-                [self serverSyncWithServerTimeout:nextServerTimeout success:success failure:failure clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
-                return;
-            }
+                // Stop here if [MXSession pause] has been called while rooms events were decrypted.
+                // Launch the event stream requested meanwhile by a resume, if any
+                if (self->eventStreamRequest != syncRequest)
+                {
+                    NSLog(@"[MXSession] The session has been paused while handling the /sync response");
 
-            // there is a pending backgroundSync
-            if (self->onBackgroundSyncDone)
-            {
-                NSLog(@"[MXSession] Events stream background Sync succeeded");
+                    dispatch_block_t launchBlock = self->pendingEventStreamLaunch;
+                    self->pendingEventStreamLaunch = nil;
+                    if (launchBlock)
+                    {
+                        launchBlock();
+                    }
+                    return;
+                }
 
-                // Operations on session may occur during this block. For example, [MXSession close] may be triggered.
-                // We run a copy of the block to prevent app from crashing if the block is released by one of these operations.
-                MXOnBackgroundSyncDone onBackgroundSyncDoneCpy = [self->onBackgroundSyncDone copy];
-                onBackgroundSyncDoneCpy();
-                self->onBackgroundSyncDone = nil;
+                // Do a loop of /syncs until catching up is done
+                if (nextServerTimeout == 0)
+                {
+                    [self serverSyncWithServerTimeout:nextServerTimeout success:success failure:failure clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
+                    return;
+                }
 
-                // check that the application was not resumed while catching up in background
-                if (self.state == MXSessionStateBackgroundSyncInProgress)
+                // there is a pending backgroundSync
+                if (self->onBackgroundSyncDone)
                 {
-                    // Check that none required the session to keep running
-                    if (self.preventPauseCount)
+                    NSLog(@"[MXSession] Events stream background Sync succeeded");
+
+                    // Operations on session may occur during this block. For example, [MXSession close] may be triggered.
+                    // We run a copy of the block to prevent app from crashing if the block is released by one of these operations.
+                    MXOnBackgroundSyncDone onBackgroundSyncDoneCpy = [self->onBackgroundSyncDone copy];
+                    onBackgroundSyncDoneCpy();
+                    self->onBackgroundSyncDone = nil;
+
+                    // check that the application was not resumed while catching up in background
+                    if (self.state == MXSessionStateBackgroundSyncInProgress)
                     {
-                        // Delay the pause by calling the reliable `pause` method.
-                        [self pause];
+                        // Check that none required the session to keep running
+                        if (self.preventPauseCount)
+                        {
+                            // Delay the pause by calling the reliable `pause` method.
+                            [self pause];
+                        }
+                        else
+                        {
+                            NSLog(@"[MXSession] go to paused ");
+                            self->eventStreamRequest = nil;
+                            [self setState:MXSessionStatePaused];
+                            return;
+                        }
                     }
                     else
                     {
-                        NSLog(@"[MXSession] go to paused ");
-                        self->eventStreamRequest = nil;
-                        [self setState:MXSessionStatePaused];
-                        return;
+                        NSLog(@"[MXSession] resume after a background Sync");
                     }
                 }
-                else
+
+                // If we are resuming inform the app that it received the last uptodate data
+                if (self->onResumeDone)
                 {
-                    NSLog(@"[MXSession] resume after a background Sync");
-                }
-            }
+                    NSLog(@"[MXSession] Events stream resumed");
 
-            // If we are resuming inform the app that it received the last uptodate data
-            if (self->onResumeDone)
-            {
-                NSLog(@"[MXSession] Events stream resumed");
+                    // Operations on session may occur during this block. For example, [MXSession close] or [MXSession pause] may be triggered.
+                    // We run a copy of the block to prevent app from crashing if the block is released by one of these operations.
+                    MXOnResumeDone onResumeDoneCpy = [self->onResumeDone copy];
+                    onResumeDoneCpy();
+                    self->onResumeDone = nil;
+
+                    // Stop here if [MXSession close] or [MXSession pause] has been triggered during onResumeDone block.
+                    if (nil == self.myUser || self.state == MXSessionStatePaused)
+                    {
+                        return;
+                    }
+                }
 
-                // Operations on session may occur during this block. For example, [MXSession close] or [MXSession pause] may be triggered.
-                // We run a copy of the block to prevent app from crashing if the block is released by one of these operations.
-                MXOnResumeDone onResumeDoneCpy = [self->onResumeDone copy];
-                onResumeDoneCpy();
-                self->onResumeDone = nil;
+                if (self.state != MXSessionStatePauseRequested)
+                {
+                    // The event stream is running by now
+                    [self setState:MXSessionStateRunning];
+                }
 
-                // Stop here if [MXSession close] or [MXSession pause] has been triggered during onResumeDone block.
+                // Check SDK user did not called [MXSession close] or [MXSession pause] during the session state change notification handling.
                 if (nil == self.myUser || self.state == MXSessionStatePaused)
                 {
                     return;
                 }
-            }
-
-            if (self.state != MXSessionStatePauseRequested)
-            {
-                // The event stream is running by now
-                [self setState:MXSessionStateRunning];
-            }
 
-            // Check SDK user did not called [MXSession close] or [MXSession pause] during the session state change notification handling.
-            if (nil == self.myUser || self.state == MXSessionStatePaused)
-            {
-                return;
-            }
+                // Pursue live events listening
+                [self serverSyncWithServerTimeout:nextServerTimeout success:nil failure:nil clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
 
-            // Pursue live events listening
-            [self serverSyncWithServerTimeout:nextServerTimeout success:nil failure:nil clientTimeout:CLIENT_TIMEOUT_MS setPresence:nil];
-
-            if (wasfirstSync)
-            {
-                [[MXSDKOptions sharedInstance].analyticsDelegate trackRoomCount:self->rooms.count];
-            }
+                if (wasfirstSync)
+                {
+                    [[MXSDKOptions sharedInstance].analyticsDelegate trackRoomCount:self->rooms.count];
+                }
 
-            // Broadcast that a server sync has been processed.
-            [[NSNotificationCenter defaultCenter] postNotificationName:kMXSessionDidSyncNotification
-                                                                object:self
-                                                              userInfo:@{
-                                                                         kMXSessionNotificationSyncResponseKey: syncResponse
-                                                                         }];
+                // Broadcast that a server sync has been processed.
+                [[NSNotificationCenter defaultCenter] postNotificationName:kMXSessionDidSyncNotification
+                                                                    object:self
+                                                                  userInfo:@{
+                                                                             kMXSessionNotificationSyncResponseKey: syncResponse
+                                                                             }];
 
-            if (success)
-            {
-                success();
-            }
+                if (success)
+                {
+                    success();
+                }
+            }];
         }];
 
     } failure:^(NSError *error) {
@@ -2253,7 +2308,7 @@ typedef void (^MXOnResumeDone)(void);
 - (void)addRoom:(MXRoom*)room notify:(BOOL)notify
 {
     // Register global listeners for this room
-    for (MXSessionEventListener *listener in globalEventListeners)
+    for (MXSessionEventListener *listener in globalEventListeners.listeners)
     {
         [listener addRoomToSpy:room];
     }
@@ -2286,7 +2341,7 @@ typedef void (^MXOnResumeDone)(void);
     if (room)
     {
         // Unregister global listeners for this room
-        for (MXSessionEventListener *listener in globalEventListeners)
+        for (MXSessionEventListener *listener in globalEventListeners.listeners)
         {
             [listener removeSpiedRoom:room];
         }
@@ -2327,6 +2382,77 @@ typedef void (^MXOnResumeDone)(void);
     return room;
 }
 
+/**
+ Launch a request of the event stream.
+
+ If a /sync response is being handled, the launch is delayed until its token is stored.
+
+ @param launchBlock the block that launches the request.
+ */
+- (void)launchEventStream:(dispatch_block_t)launchBlock
+{
+    if (handlingSyncResponse)
+    {
+        NSLog(@"[MXSession] launchEventStream: Delay the request until the current /sync response is handled");
+        pendingEventStreamLaunch = launchBlock;
+    }
+    else
+    {
+        launchBlock();
+    }
+}
+
+/**
+ Decrypt the timeline events of rooms in a /sync response before handling them.
+
+ If `MXSDKOptions.decryptSyncResponsesInBackground` is enabled, encrypted timeline events
+ of known joined and left rooms are decrypted asynchronously, off the main thread.
+ They are decrypted with the id of the room live timeline so that replay attacks are still
+ detected. Events of new rooms are decrypted when the live timeline handles them.
+
+ Rooms data (timelines, states, summaries) are not modified here. They are updated
+ one by one on the main thread once decryption is done.
+
+ @param syncResponse the /sync response.
+ @param onComplete called on the main thread when rooms are ready to be handled. It provides
+                   the ids of rooms whose timeline events have been decrypted. Their events
+                   that are still encrypted must not be decrypted again.
+ */
+- (void)decryptRoomsEventsInSyncResponse:(MXSyncResponse*)syncResponse onComplete:(void (^)(NSSet<NSString*> *decryptedRoomIds))onComplete
+{
+    if (!_crypto || ![MXSDKOptions sharedInstance].decryptSyncResponsesInBackground)
+    {
+        onComplete([NSSet set]);
+        return;
+    }
+
+    NSMutableDictionary<NSString*, MXRoomSync*> *roomsSyncs = [NSMutableDictionary dictionaryWithDictionary:syncResponse.rooms.join];
+    [roomsSyncs addEntriesFromDictionary:syncResponse.rooms.leave];
+
+    NSMutableSet<NSString*> *decryptedRoomIds = [NSMutableSet set];
+    NSDate *startDate = [NSDate date];
+    dispatch_group_t group = dispatch_group_create();
+
+    for (NSString *roomId in roomsSyncs)
+    {
+        // The live timeline id of a new room is not known yet
+        MXRoom *room = [self roomWithRoomId:roomId];
+        if (room)
+        {
+            [decryptedRoomIds addObject:roomId];
+            dispatch_group_enter(group);
+            [self decryptEvents:roomsSyncs[roomId].timeline.events inTimeline:room.liveTimelineId onComplete:^(NSArray<MXEvent *> *failedEvents) {
+                dispatch_group_leave(group);
+            }];
+        }
+    }
+
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        NSLog(@"[MXSession] decryptRoomsEventsInSyncResponse: Decrypted events of %@ rooms in %.0fms", @(decryptedRoomIds.count), [[NSDate date] timeIntervalSinceDate:startDate] * 1000);
+        onComplete(decryptedRoomIds);
+    });
+}
+
 - (void)preloadRoomsData:(NSArray<NSString*> *)roomIds onComplete:(dispatch_block_t)onComplete
 {
     NSLog(@"[MXSession] preloadRooms: %@ rooms", @(roomIds.count));
@@ -3709,6 +3835,64 @@ typedef void (^MXOnResumeDone)(void);
     return (result != nil);
 }
 
+- (void)decryptEvents:(NSArray<MXEvent*> *)events
+           inTimeline:(NSString*)timeline
+           onComplete:(void (^)(NSArray<MXEvent*> *failedEvents))onComplete
+{
+    NSMutableArray<MXEvent*> *encryptedEvents = [NSMutableArray array];
+    for (MXEvent *event in events)
+    {
+        if (event.eventType == MXEventTypeRoomEncrypted)
+        {
+            [encryptedEvents addObject:event];
+        }
+    }
+
+    if (!encryptedEvents.count)
+    {
+        onComplete(@[]);
+        return;
+    }
+
+    if (!_crypto)
+    {
+        // Encryption not enabled. Set the error synchronously
+        for (MXEvent *event in encryptedEvents)
+        {
+            [self decryptEvent:event inTimeline:timeline];
+        }
+        onComplete(encryptedEvents);
+        return;
+    }
+
+    [_crypto decryptEvents:encryptedEvents inTimeline:timeline queue:dispatch_get_main_queue() onComplete:^(NSArray<MXEventDecryptionResult *> *results) {
+
+        NSMutableArray<MXEvent*> *failedEvents = [NSMutableArray array];
+        [results enumerateObjectsUsingBlock:^(MXEventDecryptionResult *result, NSUInteger index, BOOL *stop) {
+
+            MXEvent *event = encryptedEvents[index];
+
+            // The event may have been decrypted meanwhile
+            if (event.eventType != MXEventTypeRoomEncrypted)
+            {
+                return;
+            }
+
+            if (result.error)
+            {
+                event.decryptionError = result.error;
+                [failedEvents addObject:event];
+            }
+            else
+            {
+                [event setClearData:result];
+            }
+        }];
+
+        onComplete(failedEvents);
+    }];
+}
+
 - (void)resetReplayAttackCheckInTimeline:(NSString*)timeline
 {
     if (_crypto)
@@ -3747,7 +3931,7 @@ typedef void (^MXOnResumeDone)(void);
         [listener addRoomToSpy:room];
     }
     
-    [globalEventListeners addObject:listener];
+    [globalEventListeners addListener:listener];
     
     return listener;
 }
@@ -3759,16 +3943,12 @@ typedef void (^MXOnResumeDone)(void);
     [listener removeAllSpiedRooms];
     
     // Before removing it
-    [globalEventListeners removeObject:listener];
+    [globalEventListeners removeListener:listener];
 }
 
 - (void)removeAllListeners
 {
-    // must be done before deleted the listeners to avoid
-    // ollection <__NSArrayM: ....> was mutated while being enumerated.'
-    NSArray* eventListeners = [globalEventListeners copy];
-    
-    for (MXSessionEventListener *listener in eventListeners)
+    for (MXSessionEventListener *listener in globalEventListeners.listeners)
     {
         [self removeListener:listener];
     }
@@ -3776,19 +3956,8 @@ typedef void (^MXOnResumeDone)(void);
 
 - (void)notifyListeners:(MXEvent*)event direction:(MXTimelineDirection)direction
 {
-    // Notify all listeners
-    // The SDK client may remove a listener while calling them by enumeration
-    // So, use a copy of them
-    NSArray *listeners = [globalEventListeners copy];
-
-    for (MXEventListener *listener in listeners)
-    {
-        // And check the listener still exists before calling it
-        if (NSNotFound != [globalEventListeners indexOfObject:listener])
-        {
-            [listener notify:event direction:direction andCustomObject:nil];
-        }
-    }
+    // Notify the listeners of this event type
+    [globalEventListeners notifyListeners:event direction:direction customObject:nil];
 }
 
 #pragma mark - Publicised groups
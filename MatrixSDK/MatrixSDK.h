@@ -49,6 +49,8 @@ FOUNDATION_EXPORT NSString *MatrixSDKVersion;
 #import "MXMediaManager.h"
 
 #import "MXLRUCache.h"
+#import "MXStripedLRUCache.h"
+#import "MXPersistentDictionary.h"
 
 #import "MXCallStack.h"
 
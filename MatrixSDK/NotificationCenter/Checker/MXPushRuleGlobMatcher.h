@@ -0,0 +1,81 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Check whether the range [start, end[ of a string is delimited by non-word characters or by
+ the string bounds, like `(^|\W)` and `($|\W)` do in a regular expression.
+
+ @param characters the UTF-16 characters of the string.
+ @param length the number of characters.
+ @param start the start of the range.
+ @param end the end of the range.
+ @return YES if the range is word delimited.
+ */
+FOUNDATION_EXPORT BOOL MXPushRuleIsWordDelimited(const unichar *characters, NSUInteger length, NSUInteger start, NSUInteger end);
+
+/**
+ `MXPushRuleGlobMatcher` is a compiled push rule pattern.
+
+ It matches like the regular expression built by `MXPushRuleEventMatchConditionChecker`:
+ the pattern must be found in the string, case insensitively, between word delimiters.
+ '*' matches any sequence of characters, '?' and '.' any character, line terminators excepted.
+ */
+@interface MXPushRuleGlobMatcher : NSObject
+
+/**
+ Compile a pattern.
+
+ @param pattern the push rule pattern.
+ @return the matcher. nil if the pattern is empty or uses other regular expression syntax.
+ */
++ (nullable instancetype)matcherWithPattern:(NSString*)pattern;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ YES if the pattern has no wildcard.
+ */
+@property (nonatomic, readonly) BOOL isLiteral;
+
+/**
+ The lowercased pattern.
+ */
+@property (nonatomic, readonly) NSString *lowercasePattern;
+
+/**
+ Check whether the pattern matches a string.
+
+ @param string the string.
+ @return YES if it matches.
+ */
+- (BOOL)matchesString:(NSString*)string;
+
+/**
+ Check whether the pattern matches a lowercased string.
+
+ @param characters the UTF-16 characters of the lowercased string.
+ @param length the number of characters.
+ @return YES if it matches.
+ */
+- (BOOL)matchesLowercaseCharacters:(const unichar*)characters length:(NSUInteger)length;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,238 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXPushRuleGlobMatcher.h"
+
+// Characters of the pattern that are not supported by the matcher
+static NSString *const kMXPushRuleGlobMatcherUnsupportedCharacters = @"\\^$|+()[]{}";
+
+// Tokens of a compiled pattern. Other values are lowercased characters
+static uint32_t const kMXPushRuleGlobMatcherTokenAnyCharacter = 0x10000;
+static uint32_t const kMXPushRuleGlobMatcherTokenAnySequence = 0x10001;
+
+static BOOL MXPushRuleIsWordCharacterAt(const unichar *characters, NSUInteger length, NSUInteger position)
+{
+    static NSCharacterSet *wordCharacterSet;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // \w of ICU regular expressions
+        NSMutableCharacterSet *characterSet = [NSMutableCharacterSet alphanumericCharacterSet];
+        [characterSet addCharactersInString:@"_\u200c\u200d"];
+        wordCharacterSet = [characterSet copy];
+    });
+
+    unichar character = characters[position];
+    if (CFStringIsSurrogateHighCharacter(character) && position + 1 < length && CFStringIsSurrogateLowCharacter(characters[position + 1]))
+    {
+        return [wordCharacterSet longCharacterIsMember:CFStringGetLongCharacterForSurrogatePair(character, characters[position + 1])];
+    }
+    if (CFStringIsSurrogateLowCharacter(character) && position > 0 && CFStringIsSurrogateHighCharacter(characters[position - 1]))
+    {
+        return [wordCharacterSet longCharacterIsMember:CFStringGetLongCharacterForSurrogatePair(characters[position - 1], character)];
+    }
+
+    return [wordCharacterSet characterIsMember:character];
+}
+
+BOOL MXPushRuleIsWordDelimited(const unichar *characters, NSUInteger length, NSUInteger start, NSUInteger end)
+{
+    return (start == 0 || !MXPushRuleIsWordCharacterAt(characters, length, start - 1))
+        && (end == length || !MXPushRuleIsWordCharacterAt(characters, length, end));
+}
+
+// Line terminators are not matched by '.' in regular expressions
+static BOOL MXPushRuleIsLineTerminator(unichar character)
+{
+    return character == '\n' || character == '\r' || character == 0x85 || character == 0x2028 || character == 0x2029;
+}
+
+// The number of UTF-16 characters of the code point at position
+static NSUInteger MXPushRuleCodePointLength(const unichar *characters, NSUInteger length, NSUInteger position)
+{
+    if (CFStringIsSurrogateHighCharacter(characters[position]) && position + 1 < length && CFStringIsSurrogateLowCharacter(characters[position + 1]))
+    {
+        return 2;
+    }
+    return 1;
+}
+
+
+@interface MXPushRuleGlobMatcher ()
+{
+    uint32_t *tokens;
+    NSUInteger tokensCount;
+}
+@end
+
+@implementation MXPushRuleGlobMatcher
+
++ (instancetype)matcherWithPattern:(NSString *)pattern
+{
+    if (!pattern.length
+        || [pattern rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:kMXPushRuleGlobMatcherUnsupportedCharacters]].location != NSNotFound)
+    {
+        return nil;
+    }
+
+    return [[self alloc] initWithPattern:pattern];
+}
+
+- (instancetype)initWithPattern:(NSString *)pattern
+{
+    self = [super init];
+    if (self)
+    {
+        _lowercasePattern = pattern.lowercaseString;
+        _isLiteral = YES;
+
+        NSUInteger length = _lowercasePattern.length;
+        tokens = malloc(length * sizeof(uint32_t));
+
+        for (NSUInteger i = 0; i < length; i++)
+        {
+            unichar character = [_lowercasePattern characterAtIndex:i];
+            switch (character)
+            {
+                case '*':
+                    // Consecutive stars are equivalent to one
+                    if (!tokensCount || tokens[tokensCount - 1] != kMXPushRuleGlobMatcherTokenAnySequence)
+                    {
+                        tokens[tokensCount++] = kMXPushRuleGlobMatcherTokenAnySequence;
+                    }
+                    _isLiteral = NO;
+                    break;
+
+                case '?':
+                case '.':
+                    tokens[tokensCount++] = kMXPushRuleGlobMatcherTokenAnyCharacter;
+                    _isLiteral = NO;
+                    break;
+
+                default:
+                    tokens[tokensCount++] = character;
+                    break;
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(tokens);
+}
+
+- (BOOL)matchesString:(NSString *)string
+{
+    NSString *lowercaseString = string.lowercaseString;
+    NSUInteger length = lowercaseString.length;
+
+    unichar *characters = malloc(MAX(1, length) * sizeof(unichar));
+    [lowercaseString getCharacters:characters range:NSMakeRange(0, length)];
+
+    BOOL matches = [self matchesLowercaseCharacters:characters length:length];
+
+    free(characters);
+    return matches;
+}
+
+- (BOOL)matchesLowercaseCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+    uint32_t firstToken = tokens[0];
+
+    for (NSUInteger start = 0; start <= length; start++)
+    {
+        // Fast skip of starts that cannot match
+        if (firstToken < kMXPushRuleGlobMatcherTokenAnyCharacter && (start == length || characters[start] != firstToken))
+        {
+            continue;
+        }
+
+        if ((start == 0 || !MXPushRuleIsWordCharacterAt(characters, length, start - 1))
+            && [self matchesCharacters:characters length:length from:start])
+        {
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+#pragma mark - Private methods
+
+/**
+ Match the pattern from a start position, with a trailing word delimiter.
+
+ When the pattern fails after a '*', it restarts just after it with one more character
+ consumed by the star. Backtracking to the last star only is enough because the
+ pattern after it has a fixed length.
+ */
+- (BOOL)matchesCharacters:(const unichar *)characters length:(NSUInteger)length from:(NSUInteger)start
+{
+    NSUInteger t = start;
+    NSUInteger p = 0;
+
+    NSUInteger starP = NSNotFound;
+    NSUInteger starT = 0;
+
+    while (YES)
+    {
+        if (p == tokensCount)
+        {
+            if (t == length || !MXPushRuleIsWordCharacterAt(characters, length, t))
+            {
+                return YES;
+            }
+        }
+        else if (tokens[p] == kMXPushRuleGlobMatcherTokenAnySequence)
+        {
+            starP = p++;
+            starT = t;
+            continue;
+        }
+        else if (t < length)
+        {
+            if (tokens[p] == kMXPushRuleGlobMatcherTokenAnyCharacter)
+            {
+                if (!MXPushRuleIsLineTerminator(characters[t]))
+                {
+                    t += MXPushRuleCodePointLength(characters, length, t);
+                    p++;
+                    continue;
+                }
+            }
+            else if (characters[t] == tokens[p])
+            {
+                t++;
+                p++;
+                continue;
+            }
+        }
+
+        // Let the last star consume one more character
+        if (starP != NSNotFound && starT < length && !MXPushRuleIsLineTerminator(characters[starT]))
+        {
+            starT += MXPushRuleCodePointLength(characters, length, starT);
+            t = starT;
+            p = starP + 1;
+            continue;
+        }
+
+        return NO;
+    }
+}
+
+@end
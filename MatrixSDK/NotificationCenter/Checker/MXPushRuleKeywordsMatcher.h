@@ -0,0 +1,58 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXPushRuleKeywordsMatcher` finds in one pass which of a set of keywords appear as words
+ in a string.
+
+ It is an Aho-Corasick automaton built from the keywords. A keyword matches like a
+ `MXPushRuleGlobMatcher` literal pattern: case insensitively, between word delimiters.
+ */
+@interface MXPushRuleKeywordsMatcher : NSObject
+
+/**
+ Build a matcher.
+
+ @param keywords the keywords. Empty keywords never match.
+ */
+- (instancetype)initWithKeywords:(NSArray<NSString*>*)keywords NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Find the keywords that appear in a lowercased string.
+
+ @param characters the UTF-16 characters of the lowercased string.
+ @param length the number of characters.
+ @return the indexes in `keywords` of the keywords found.
+ */
+- (NSIndexSet*)indexesOfKeywordsInLowercaseCharacters:(const unichar*)characters length:(NSUInteger)length;
+
+/**
+ Find the keywords that appear in a string.
+
+ @param string the string.
+ @return the indexes in `keywords` of the keywords found.
+ */
+- (NSIndexSet*)indexesOfKeywordsInString:(NSString*)string;
+
+@end
+
+NS_ASSUME_NONNULL_END
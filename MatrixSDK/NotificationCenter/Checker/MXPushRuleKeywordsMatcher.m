@@ -0,0 +1,266 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXPushRuleKeywordsMatcher.h"
+
+#import "MXPushRuleGlobMatcher.h"
+
+static uint32_t const kMXPushRuleKeywordsMatcherNone = UINT32_MAX;
+
+/**
+ A state of the automaton.
+ */
+typedef struct
+{
+    // The state to go to when no transition matches
+    uint32_t failure;
+
+    // The nearest state in the failure chain where a keyword ends
+    uint32_t output;
+
+    // The first keyword that ends at this state. Others are chained with `nextKeyword`
+    uint32_t keyword;
+
+    // The depth of the state, ie the length of the matched keyword prefix
+    uint32_t depth;
+
+    // Children, for the construction
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    unichar character;
+} MXPushRuleKeywordsMatcherState;
+
+
+@interface MXPushRuleKeywordsMatcher ()
+{
+    MXPushRuleKeywordsMatcherState *states;
+    uint32_t statesCount;
+
+    // Keywords that end at the same state
+    uint32_t *nextKeyword;
+    NSUInteger keywordsCount;
+
+    // Transitions: an open addressing hash table keyed by (state, character)
+    uint64_t *transitionKeys;
+    uint32_t *transitionStates;
+    NSUInteger transitionsMask;
+}
+@end
+
+@implementation MXPushRuleKeywordsMatcher
+
+// The transition from a state for a character. 0 marks empty slots of the table
+static inline uint32_t MXPushRuleKeywordsMatcherTransition(__unsafe_unretained MXPushRuleKeywordsMatcher *matcher, uint32_t state, unichar character)
+{
+    uint64_t key = (((uint64_t)state << 16) | character) + 1;
+
+    for (NSUInteger slot = ((key * 0x9E3779B97F4A7C15ULL) >> 32) & matcher->transitionsMask; matcher->transitionKeys[slot]; slot = (slot + 1) & matcher->transitionsMask)
+    {
+        if (matcher->transitionKeys[slot] == key)
+        {
+            return matcher->transitionStates[slot];
+        }
+    }
+    return kMXPushRuleKeywordsMatcherNone;
+}
+
+static void MXPushRuleKeywordsMatcherAddTransition(__unsafe_unretained MXPushRuleKeywordsMatcher *matcher, uint32_t state, unichar character, uint32_t toState)
+{
+    uint64_t key = (((uint64_t)state << 16) | character) + 1;
+
+    NSUInteger slot = ((key * 0x9E3779B97F4A7C15ULL) >> 32) & matcher->transitionsMask;
+    while (matcher->transitionKeys[slot])
+    {
+        slot = (slot + 1) & matcher->transitionsMask;
+    }
+
+    matcher->transitionKeys[slot] = key;
+    matcher->transitionStates[slot] = toState;
+}
+
+// The goto function of the automaton, following failure links
+static inline uint32_t MXPushRuleKeywordsMatcherNextState(__unsafe_unretained MXPushRuleKeywordsMatcher *matcher, uint32_t state, unichar character)
+{
+    while (YES)
+    {
+        uint32_t next = MXPushRuleKeywordsMatcherTransition(matcher, state, character);
+        if (next != kMXPushRuleKeywordsMatcherNone)
+        {
+            return next;
+        }
+        if (state == 0)
+        {
+            return 0;
+        }
+        state = matcher->states[state].failure;
+    }
+}
+
+- (instancetype)initWithKeywords:(NSArray<NSString *> *)keywords
+{
+    self = [super init];
+    if (self)
+    {
+        keywordsCount = keywords.count;
+        nextKeyword = malloc(MAX(1, keywordsCount) * sizeof(uint32_t));
+
+        NSUInteger maxStatesCount = 1;
+        for (NSString *keyword in keywords)
+        {
+            maxStatesCount += keyword.length;
+        }
+
+        states = calloc(maxStatesCount, sizeof(MXPushRuleKeywordsMatcherState));
+        statesCount = 1;
+        [self resetState:0 depth:0 character:0];
+
+        // Keep the load factor of the transitions table under 1/2
+        NSUInteger transitionsCapacity = 16;
+        while (transitionsCapacity < maxStatesCount * 2)
+        {
+            transitionsCapacity *= 2;
+        }
+        transitionsMask = transitionsCapacity - 1;
+        transitionKeys = calloc(transitionsCapacity, sizeof(uint64_t));
+        transitionStates = malloc(transitionsCapacity * sizeof(uint32_t));
+
+        // Build the trie
+        for (NSUInteger k = 0; k < keywordsCount; k++)
+        {
+            NSString *keyword = keywords[k].lowercaseString;
+            nextKeyword[k] = kMXPushRuleKeywordsMatcherNone;
+
+            if (!keyword.length)
+            {
+                continue;
+            }
+
+            uint32_t state = 0;
+            for (NSUInteger i = 0; i < keyword.length; i++)
+            {
+                unichar character = [keyword characterAtIndex:i];
+                uint32_t child = MXPushRuleKeywordsMatcherTransition(self, state, character);
+                if (child == kMXPushRuleKeywordsMatcherNone)
+                {
+                    child = statesCount++;
+                    [self resetState:child depth:states[state].depth + 1 character:character];
+                    MXPushRuleKeywordsMatcherAddTransition(self, state, character, child);
+
+                    states[child].nextSibling = states[state].firstChild;
+                    states[state].firstChild = child;
+                }
+                state = child;
+            }
+
+            nextKeyword[k] = states[state].keyword;
+            states[state].keyword = (uint32_t)k;
+        }
+
+        // Compute failure and output links in breadth first order
+        uint32_t *queue = malloc(statesCount * sizeof(uint32_t));
+        uint32_t queueHead = 0, queueTail = 0;
+
+        for (uint32_t child = states[0].firstChild; child != kMXPushRuleKeywordsMatcherNone; child = states[child].nextSibling)
+        {
+            states[child].failure = 0;
+            queue[queueTail++] = child;
+        }
+
+        while (queueHead < queueTail)
+        {
+            uint32_t state = queue[queueHead++];
+
+            for (uint32_t child = states[state].firstChild; child != kMXPushRuleKeywordsMatcherNone; child = states[child].nextSibling)
+            {
+                uint32_t failure = MXPushRuleKeywordsMatcherNextState(self, states[state].failure, states[child].character);
+                states[child].failure = failure;
+                states[child].output = (states[failure].keyword != kMXPushRuleKeywordsMatcherNone) ? failure : states[failure].output;
+
+                queue[queueTail++] = child;
+            }
+        }
+
+        free(queue);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(states);
+    free(nextKeyword);
+    free(transitionKeys);
+    free(transitionStates);
+}
+
+- (NSIndexSet *)indexesOfKeywordsInLowercaseCharacters:(const unichar *)characters length:(NSUInteger)length
+{
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+
+    uint32_t state = 0;
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        state = MXPushRuleKeywordsMatcherNextState(self, state, characters[i]);
+
+        uint32_t outputState = (states[state].keyword != kMXPushRuleKeywordsMatcherNone) ? state : states[state].output;
+        while (outputState != kMXPushRuleKeywordsMatcherNone)
+        {
+            NSUInteger end = i + 1;
+            NSUInteger start = end - states[outputState].depth;
+
+            if (MXPushRuleIsWordDelimited(characters, length, start, end))
+            {
+                for (uint32_t k = states[outputState].keyword; k != kMXPushRuleKeywordsMatcherNone; k = nextKeyword[k])
+                {
+                    [indexes addIndex:k];
+                }
+            }
+
+            outputState = states[outputState].output;
+        }
+    }
+
+    return indexes;
+}
+
+- (NSIndexSet *)indexesOfKeywordsInString:(NSString *)string
+{
+    NSString *lowercaseString = string.lowercaseString;
+    NSUInteger length = lowercaseString.length;
+
+    unichar *characters = malloc(MAX(1, length) * sizeof(unichar));
+    [lowercaseString getCharacters:characters range:NSMakeRange(0, length)];
+
+    NSIndexSet *indexes = [self indexesOfKeywordsInLowercaseCharacters:characters length:length];
+
+    free(characters);
+    return indexes;
+}
+
+#pragma mark - Private methods
+
+- (void)resetState:(uint32_t)state depth:(uint32_t)depth character:(unichar)character
+{
+    states[state].failure = 0;
+    states[state].output = kMXPushRuleKeywordsMatcherNone;
+    states[state].keyword = kMXPushRuleKeywordsMatcherNone;
+    states[state].depth = depth;
+    states[state].firstChild = kMXPushRuleKeywordsMatcherNone;
+    states[state].nextSibling = kMXPushRuleKeywordsMatcherNone;
+    states[state].character = character;
+}
+
+@end
@@ -0,0 +1,70 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "MXJSONModels.h"
+#import "MXEvent.h"
+#import "MXPushRuleConditionChecker.h"
+
+@class MXRoomState;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXCompiledPushRules` is a list of push rules prepared for a fast evaluation.
+
+ - Room and sender rules are looked up by room id and sender in hash tables.
+ - Content rules without wildcards are all searched in one pass over the event body.
+ - Other patterns are compiled into `MXPushRuleGlobMatcher` objects and the key paths of
+   "event_match" conditions are split once.
+
+ Patterns that a `MXPushRuleGlobMatcher` cannot handle are still checked with a
+ `MXPushRuleEventMatchConditionChecker`.
+
+ Rules are compiled as they are. Only their `enabled` property is read at evaluation time.
+ */
+@interface MXCompiledPushRules : NSObject
+
+/**
+ Compile push rules.
+
+ @param rules the push rules by priority order.
+ */
+- (instancetype)initWithRules:(NSArray<MXPushRule*>*)rules NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ The array of rules that has been compiled.
+ */
+@property (nonatomic, readonly) NSArray<MXPushRule*> *rules;
+
+/**
+ Find the first rule that matches an event.
+
+ @param event the event to check.
+ @param roomState the room state when the event occurred.
+ @param conditionCheckers the checkers by condition kind for conditions of override and underride rules.
+ @return the matching rule. nil if no rule matches.
+ */
+- (nullable MXPushRule*)ruleMatchingEvent:(MXEvent*)event
+                                roomState:(nullable MXRoomState*)roomState
+                        conditionCheckers:(NSDictionary<NSString*, id<MXPushRuleConditionChecker>>*)conditionCheckers;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,534 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXCompiledPushRules.h"
+
+#import "MXPushRuleGlobMatcher.h"
+#import "MXPushRuleKeywordsMatcher.h"
+#import "MXPushRuleEventMatchConditionChecker.h"
+
+/**
+ Event fields read without building the JSON dictionary of the event.
+ */
+typedef NS_ENUM(NSUInteger, MXCompiledPushRuleEventField)
+{
+    MXCompiledPushRuleEventFieldOther,
+    MXCompiledPushRuleEventFieldType,
+    MXCompiledPushRuleEventFieldRoomId,
+    MXCompiledPushRuleEventFieldSender,
+    MXCompiledPushRuleEventFieldStateKey,
+    MXCompiledPushRuleEventFieldEventId,
+    MXCompiledPushRuleEventFieldContent
+};
+
+
+#pragma mark - MXCompiledPushRuleCondition
+
+/**
+ A condition of an override or underride rule.
+ */
+@interface MXCompiledPushRuleCondition : NSObject
+{
+    @public
+    MXPushRuleCondition *condition;
+
+    // For "event_match" conditions with a pattern supported by MXPushRuleGlobMatcher
+    MXPushRuleGlobMatcher *matcher;
+    MXCompiledPushRuleEventField field;
+    NSArray<NSString*> *keyPath;
+    BOOL isBody;
+}
+@end
+
+@implementation MXCompiledPushRuleCondition
+@end
+
+
+#pragma mark - MXCompiledPushRule
+
+@interface MXCompiledPushRule : NSObject
+{
+    @public
+    MXPushRule *rule;
+
+    // The priority of the rule. 0 is the highest
+    NSUInteger index;
+
+    // Override and underride rules
+    NSArray<MXCompiledPushRuleCondition*> *conditions;
+
+    // Content rules: the index of the pattern in the keywords matcher of the group
+    NSUInteger keywordIndex;
+
+    // Content, room and sender rules with wildcards
+    MXPushRuleGlobMatcher *matcher;
+
+    // Content, room and sender rules that MXPushRuleGlobMatcher cannot handle
+    MXPushRuleCondition *equivalentCondition;
+}
+@end
+
+@implementation MXCompiledPushRule
+@end
+
+
+#pragma mark - MXCompiledPushRuleGroup
+
+/**
+ Consecutive content, room or sender rules.
+ */
+@interface MXCompiledPushRuleGroup : NSObject
+{
+    @public
+    MXPushRuleKind kind;
+
+    // Content rules by priority order
+    NSMutableArray<MXCompiledPushRule*> *rules;
+    MXPushRuleKeywordsMatcher *keywordsMatcher;
+
+    // Room and sender rules by lowercased id, by priority order
+    NSMutableDictionary<NSString*, NSMutableArray<MXCompiledPushRule*>*> *rulesById;
+
+    // Room and sender rules with wildcards in their id, by priority order
+    NSMutableArray<MXCompiledPushRule*> *otherRules;
+}
+@end
+
+@implementation MXCompiledPushRuleGroup
+@end
+
+
+#pragma mark - MXCompiledPushRulesEvaluation
+
+/**
+ Event data computed once during the evaluation of rules for an event.
+ */
+@interface MXCompiledPushRulesEvaluation : NSObject
+{
+    @public
+    MXEvent *event;
+
+    NSDictionary *JSONDictionary;
+
+    BOOL bodyComputed;
+    NSMutableData *bodyCharacters;
+}
+@end
+
+@implementation MXCompiledPushRulesEvaluation
+
+- (NSDictionary*)JSONDictionary
+{
+    if (!JSONDictionary)
+    {
+        JSONDictionary = event.JSONDictionary;
+    }
+    return JSONDictionary;
+}
+
+// The lowercased characters of content.body. nil if there is no body string
+- (NSData*)bodyCharacters
+{
+    if (!bodyComputed)
+    {
+        bodyComputed = YES;
+
+        NSString *body = event.wireContent[@"body"];
+        if ([body isKindOfClass:NSString.class])
+        {
+            body = body.lowercaseString;
+            bodyCharacters = [NSMutableData dataWithLength:body.length * sizeof(unichar)];
+            [body getCharacters:bodyCharacters.mutableBytes range:NSMakeRange(0, body.length)];
+        }
+    }
+    return bodyCharacters;
+}
+
+- (id)valueForField:(MXCompiledPushRuleEventField)field keyPath:(NSArray<NSString*>*)keyPath
+{
+    id value;
+    switch (field)
+    {
+        case MXCompiledPushRuleEventFieldType:
+            value = event.wireType;
+            break;
+        case MXCompiledPushRuleEventFieldRoomId:
+            value = event.roomId;
+            break;
+        case MXCompiledPushRuleEventFieldSender:
+            value = event.sender;
+            break;
+        case MXCompiledPushRuleEventFieldStateKey:
+            value = event.stateKey;
+            break;
+        case MXCompiledPushRuleEventFieldEventId:
+            value = event.eventId;
+            break;
+        case MXCompiledPushRuleEventFieldContent:
+            value = event.wireContent;
+            break;
+        case MXCompiledPushRuleEventFieldOther:
+            value = self.JSONDictionary[keyPath[0]];
+            break;
+    }
+
+    for (NSUInteger i = 1; i < keyPath.count && value; i++)
+    {
+        value = [value isKindOfClass:NSDictionary.class] ? ((NSDictionary*)value)[keyPath[i]] : nil;
+    }
+
+    return value;
+}
+
+@end
+
+
+#pragma mark - MXCompiledPushRules
+
+@interface MXCompiledPushRules ()
+{
+    // Compiled override and underride rules and groups of other rules, by priority order
+    NSArray *steps;
+
+    // Checker for patterns that MXPushRuleGlobMatcher cannot handle
+    MXPushRuleEventMatchConditionChecker *eventMatchConditionChecker;
+}
+@end
+
+@implementation MXCompiledPushRules
+
+- (instancetype)initWithRules:(NSArray<MXPushRule *> *)rules
+{
+    self = [super init];
+    if (self)
+    {
+        _rules = rules;
+        eventMatchConditionChecker = [[MXPushRuleEventMatchConditionChecker alloc] init];
+
+        NSMutableArray *theSteps = [NSMutableArray array];
+        MXCompiledPushRuleGroup *group;
+        NSMutableArray<NSString*> *keywords;
+
+        for (NSUInteger index = 0; index < rules.count; index++)
+        {
+            MXPushRule *rule = rules[index];
+
+            MXCompiledPushRule *compiledRule = [[MXCompiledPushRule alloc] init];
+            compiledRule->rule = rule;
+            compiledRule->index = index;
+            compiledRule->keywordIndex = NSNotFound;
+
+            if (rule.kind == MXPushRuleKindOverride || rule.kind == MXPushRuleKindUnderride)
+            {
+                NSMutableArray<MXCompiledPushRuleCondition*> *conditions = [NSMutableArray arrayWithCapacity:rule.conditions.count];
+                for (MXPushRuleCondition *condition in rule.conditions)
+                {
+                    [conditions addObject:[self compileCondition:condition]];
+                }
+                compiledRule->conditions = conditions;
+
+                group = nil;
+                [theSteps addObject:compiledRule];
+                continue;
+            }
+
+            if (!group || group->kind != rule.kind)
+            {
+                [self finalizeGroup:group keywords:keywords];
+
+                group = [[MXCompiledPushRuleGroup alloc] init];
+                group->kind = rule.kind;
+                group->rules = [NSMutableArray array];
+                group->rulesById = [NSMutableDictionary dictionary];
+                group->otherRules = [NSMutableArray array];
+                keywords = [NSMutableArray array];
+
+                [theSteps addObject:group];
+            }
+
+            [group->rules addObject:compiledRule];
+
+            if (rule.kind == MXPushRuleKindContent)
+            {
+                // Content rules are rules on the "content.body" field
+                MXPushRuleGlobMatcher *matcher = [MXPushRuleGlobMatcher matcherWithPattern:rule.pattern];
+                if (matcher.isLiteral)
+                {
+                    compiledRule->keywordIndex = keywords.count;
+                    [keywords addObject:matcher.lowercasePattern];
+                }
+                else if (matcher)
+                {
+                    compiledRule->matcher = matcher;
+                }
+                else if (rule.pattern.length)
+                {
+                    compiledRule->equivalentCondition = [self eventMatchConditionWithKey:@"content.body" pattern:rule.pattern];
+                }
+            }
+            else
+            {
+                // Room rules are rules on the "room_id" field, sender rules on the "sender" field.
+                // Their id is the room id or the user id.
+                NSString *ruleId = rule.ruleId;
+                if ([ruleId rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"*?"]].location == NSNotFound)
+                {
+                    NSString *key = ruleId.lowercaseString;
+                    if (!group->rulesById[key])
+                    {
+                        group->rulesById[key] = [NSMutableArray array];
+                    }
+                    [group->rulesById[key] addObject:compiledRule];
+                }
+                else
+                {
+                    compiledRule->matcher = [MXPushRuleGlobMatcher matcherWithPattern:ruleId];
+                    if (!compiledRule->matcher)
+                    {
+                        NSString *key = (rule.kind == MXPushRuleKindRoom) ? @"room_id" : @"sender";
+                        compiledRule->equivalentCondition = [self eventMatchConditionWithKey:key pattern:ruleId];
+                    }
+                    [group->otherRules addObject:compiledRule];
+                }
+            }
+        }
+
+        [self finalizeGroup:group keywords:keywords];
+
+        steps = theSteps;
+    }
+    return self;
+}
+
+- (MXPushRule *)ruleMatchingEvent:(MXEvent *)event roomState:(MXRoomState *)roomState conditionCheckers:(NSDictionary<NSString *,id<MXPushRuleConditionChecker>> *)conditionCheckers
+{
+    MXCompiledPushRulesEvaluation *evaluation = [[MXCompiledPushRulesEvaluation alloc] init];
+    evaluation->event = event;
+
+    for (id step in steps)
+    {
+        MXPushRule *rule;
+        if ([step isKindOfClass:MXCompiledPushRuleGroup.class])
+        {
+            rule = [self ruleInGroup:step matchingEvaluation:evaluation roomState:roomState];
+        }
+        else
+        {
+            MXCompiledPushRule *compiledRule = step;
+            if (compiledRule->rule.enabled && [self conditionsOfRule:compiledRule satisfiedByEvaluation:evaluation roomState:roomState conditionCheckers:conditionCheckers])
+            {
+                rule = compiledRule->rule;
+            }
+        }
+
+        if (rule)
+        {
+            return rule;
+        }
+    }
+
+    return nil;
+}
+
+
+#pragma mark - Private methods
+
+- (MXCompiledPushRuleCondition*)compileCondition:(MXPushRuleCondition*)condition
+{
+    MXCompiledPushRuleCondition *compiledCondition = [[MXCompiledPushRuleCondition alloc] init];
+    compiledCondition->condition = condition;
+
+    if ([condition.kind isEqualToString:kMXPushRuleConditionStringEventMatch])
+    {
+        NSString *key, *pattern;
+        MXJSONModelSetString(key, condition.parameters[@"key"]);
+        MXJSONModelSetString(pattern, condition.parameters[@"pattern"]);
+
+        // Keys starting with '@' have a special meaning for KVC. Let the checker manage them
+        if (key.length && ![key hasPrefix:@"@"])
+        {
+            compiledCondition->matcher = [MXPushRuleGlobMatcher matcherWithPattern:pattern];
+            compiledCondition->keyPath = [key componentsSeparatedByString:@"."];
+            compiledCondition->isBody = [key isEqualToString:@"content.body"];
+
+            NSDictionary<NSString*, NSNumber*> *fields = @{
+                                                           @"type": @(MXCompiledPushRuleEventFieldType),
+                                                           @"room_id": @(MXCompiledPushRuleEventFieldRoomId),
+                                                           @"sender": @(MXCompiledPushRuleEventFieldSender),
+                                                           @"state_key": @(MXCompiledPushRuleEventFieldStateKey),
+                                                           @"event_id": @(MXCompiledPushRuleEventFieldEventId),
+                                                           @"content": @(MXCompiledPushRuleEventFieldContent)
+                                                           };
+            compiledCondition->field = [fields[compiledCondition->keyPath[0]] unsignedIntegerValue];
+        }
+    }
+
+    return compiledCondition;
+}
+
+- (MXPushRuleCondition*)eventMatchConditionWithKey:(NSString*)key pattern:(NSString*)pattern
+{
+    MXPushRuleCondition *condition = [[MXPushRuleCondition alloc] init];
+    condition.kindType = MXPushRuleConditionTypeEventMatch;
+    condition.parameters = @{
+                             @"key": key,
+                             @"pattern": pattern
+                             };
+    return condition;
+}
+
+- (void)finalizeGroup:(MXCompiledPushRuleGroup*)group keywords:(NSArray<NSString*>*)keywords
+{
+    if (keywords.count)
+    {
+        group->keywordsMatcher = [[MXPushRuleKeywordsMatcher alloc] initWithKeywords:keywords];
+    }
+}
+
+- (BOOL)conditionsOfRule:(MXCompiledPushRule*)compiledRule
+   satisfiedByEvaluation:(MXCompiledPushRulesEvaluation*)evaluation
+               roomState:(MXRoomState*)roomState
+       conditionCheckers:(NSDictionary<NSString *,id<MXPushRuleConditionChecker>> *)conditionCheckers
+{
+    // If there is no condition, the rule must be applied
+    for (MXCompiledPushRuleCondition *compiledCondition in compiledRule->conditions)
+    {
+        MXPushRuleCondition *condition = compiledCondition->condition;
+
+        id<MXPushRuleConditionChecker> checker = conditionCheckers[condition.kind];
+        if (!checker)
+        {
+            NSLog(@"[MXCompiledPushRules] Warning: There is no MXPushRuleConditionChecker to check condition of kind: %@", condition.kind);
+            return NO;
+        }
+
+        BOOL conditionOk;
+        if (compiledCondition->matcher && [checker isMemberOfClass:MXPushRuleEventMatchConditionChecker.class])
+        {
+            if (compiledCondition->isBody)
+            {
+                NSData *bodyCharacters = evaluation.bodyCharacters;
+                conditionOk = bodyCharacters && [compiledCondition->matcher matchesLowercaseCharacters:bodyCharacters.bytes length:bodyCharacters.length / sizeof(unichar)];
+            }
+            else
+            {
+                id value = [evaluation valueForField:compiledCondition->field keyPath:compiledCondition->keyPath];
+                conditionOk = [value isKindOfClass:NSString.class] && [compiledCondition->matcher matchesString:value];
+            }
+        }
+        else
+        {
+            conditionOk = [checker isCondition:condition satisfiedBy:evaluation->event roomState:roomState withJsonDict:evaluation.JSONDictionary];
+        }
+
+        if (!conditionOk)
+        {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+- (MXPushRule*)ruleInGroup:(MXCompiledPushRuleGroup*)group matchingEvaluation:(MXCompiledPushRulesEvaluation*)evaluation roomState:(MXRoomState*)roomState
+{
+    if (group->kind == MXPushRuleKindContent)
+    {
+        NSData *bodyCharacters = evaluation.bodyCharacters;
+        NSIndexSet *keywordIndexes;
+
+        for (MXCompiledPushRule *compiledRule in group->rules)
+        {
+            if (!compiledRule->rule.enabled)
+            {
+                continue;
+            }
+
+            BOOL matches = NO;
+            if (compiledRule->keywordIndex != NSNotFound)
+            {
+                if (bodyCharacters && !keywordIndexes)
+                {
+                    // Search all keywords at once
+                    keywordIndexes = [group->keywordsMatcher indexesOfKeywordsInLowercaseCharacters:bodyCharacters.bytes length:bodyCharacters.length / sizeof(unichar)];
+                }
+                matches = [keywordIndexes containsIndex:compiledRule->keywordIndex];
+            }
+            else if (compiledRule->matcher)
+            {
+                matches = bodyCharacters && [compiledRule->matcher matchesLowercaseCharacters:bodyCharacters.bytes length:bodyCharacters.length / sizeof(unichar)];
+            }
+            else if (compiledRule->equivalentCondition)
+            {
+                matches = [eventMatchConditionChecker isCondition:compiledRule->equivalentCondition satisfiedBy:evaluation->event roomState:roomState withJsonDict:evaluation.JSONDictionary];
+            }
+
+            if (matches)
+            {
+                return compiledRule->rule;
+            }
+        }
+
+        return nil;
+    }
+
+    // Room and sender rules
+    NSString *value = (group->kind == MXPushRuleKindRoom) ? evaluation->event.roomId : evaluation->event.sender;
+
+    MXCompiledPushRule *matchingRule;
+    if (value)
+    {
+        for (MXCompiledPushRule *compiledRule in group->rulesById[value.lowercaseString])
+        {
+            if (compiledRule->rule.enabled)
+            {
+                matchingRule = compiledRule;
+                break;
+            }
+        }
+    }
+
+    for (MXCompiledPushRule *compiledRule in group->otherRules)
+    {
+        if (matchingRule && compiledRule->index > matchingRule->index)
+        {
+            break;
+        }
+
+        if (compiledRule->rule.enabled)
+        {
+            BOOL matches;
+            if (compiledRule->matcher)
+            {
+                matches = value && [compiledRule->matcher matchesString:value];
+            }
+            else
+            {
+                matches = [eventMatchConditionChecker isCondition:compiledRule->equivalentCondition satisfiedBy:evaluation->event roomState:roomState withJsonDict:evaluation.JSONDictionary];
+            }
+
+            if (matches)
+            {
+                matchingRule = compiledRule;
+                break;
+            }
+        }
+    }
+
+    return matchingRule ? matchingRule->rule : nil;
+}
+
+@end
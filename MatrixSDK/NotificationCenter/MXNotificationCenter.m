@@ -19,6 +19,7 @@
 
 #import "MXSession.h"
 #import "MXTools.h"
+#import "MXCompiledPushRules.h"
 #import "MXPushRuleEventMatchConditionChecker.h"
 #import "MXPushRuleDisplayNameCondtionChecker.h"
 #import "MXPushRuleRoomMemberCountConditionChecker.h"
@@ -63,6 +64,11 @@ NSString *const kMXNotificationCenterAllOtherRoomMessagesRuleID = @".m.rule.mess
      Keep the reference on the event_match condition as it can reuse to check Content, Room and Sender rules.
     */
     MXPushRuleEventMatchConditionChecker *eventMatchConditionChecker;
+
+    /**
+     `flatRules` compiled for a fast evaluation.
+     */
+    MXCompiledPushRules *compiledPushRules;
 }
 @end
 
@@ -146,6 +152,8 @@ NSString *const kMXNotificationCenterAllOtherRoomMessagesRuleID = @".m.rule.mess
         [flatRules addObjectsFromArray:pushRules.global.room];
         [flatRules addObjectsFromArray:pushRules.global.sender];
         [flatRules addObjectsFromArray:pushRules.global.underride];
+
+        compiledPushRules = [[MXCompiledPushRules alloc] initWithRules:flatRules];
     }
 }
 
@@ -161,109 +169,16 @@ NSString *const kMXNotificationCenterAllOtherRoomMessagesRuleID = @".m.rule.mess
     // Consider only events from other users
     if (NO == [event.sender isEqualToString:mxSession.matrixRestClient.credentials.userId])
     {
-        NSDictionary *JSONDictionary = nil;
-        
         @synchronized(self)
         {
-            // Check rules one by one according to their priorities
-            for (MXPushRule *rule in flatRules)
+            // Compile the rules again if they have been replaced
+            if (!compiledPushRules || compiledPushRules.rules != flatRules)
             {
-                // Skip disabled rules
-                if (!rule.enabled)
-                {
-                    continue;
-                }
-                
-                if (!JSONDictionary)
-                {
-                    JSONDictionary = event.JSONDictionary;
-                }
-                
-                BOOL conditionsOk = YES;
-                
-                // The test depends of the kind of the rule
-                switch (rule.kind)
-                {
-                    case MXPushRuleKindOverride:
-                    case MXPushRuleKindUnderride:
-                    {
-                        // Check all conditions described by the rule
-                        // If there is no condition, the rule must be applied
-                        conditionsOk = YES;
-                        
-                        for (MXPushRuleCondition *condition in rule.conditions)
-                        {
-                            id<MXPushRuleConditionChecker> checker = [conditionCheckers valueForKey:condition.kind];
-                            if (checker)
-                            {
-                                conditionsOk = [checker isCondition:condition satisfiedBy:event roomState:roomState withJsonDict:JSONDictionary];
-                                if (NO == conditionsOk)
-                                {
-                                    // Do not need to go further
-                                    break;
-                                }
-                            }
-                            else
-                            {
-                                NSLog(@"[MXNotificationCenter] Warning: There is no MXPushRuleConditionChecker to check condition of kind: %@", condition.kind);
-                                conditionsOk = NO;
-                            }
-                        }
-                        break;
-                    }
-                        
-                    case MXPushRuleKindContent:
-                    {
-                        // Content rules are rules on the "content.body" field
-                        // Tranlate this into a fake condition
-                        MXPushRuleCondition *equivalentCondition = [[MXPushRuleCondition alloc] init];
-                        equivalentCondition.kindType = MXPushRuleConditionTypeEventMatch;
-                        equivalentCondition.parameters = @{
-                                                           @"key": @"content.body",
-                                                           @"pattern": rule.pattern
-                                                           };
-                        
-                        conditionsOk = [eventMatchConditionChecker isCondition:equivalentCondition satisfiedBy:event roomState:roomState withJsonDict:JSONDictionary];
-                        break;
-                    }
-                        
-                    case MXPushRuleKindRoom:
-                    {
-                        // Room rules are rules on the "room_id" field
-                        // Translate this into a fake condition
-                        MXPushRuleCondition *equivalentCondition = [[MXPushRuleCondition alloc] init];
-                        equivalentCondition.kindType = MXPushRuleConditionTypeEventMatch;
-                        equivalentCondition.parameters = @{
-                                                           @"key": @"room_id",
-                                                           @"pattern": rule.ruleId
-                                                           };
-                        
-                        conditionsOk = [eventMatchConditionChecker isCondition:equivalentCondition satisfiedBy:event roomState:roomState withJsonDict:JSONDictionary];
-                        break;
-                    }
-                        
-                    case MXPushRuleKindSender:
-                    {
-                        // Sender rules are rules on the "user_id" field
-                        // Translate this into a fake condition
-                        MXPushRuleCondition *equivalentCondition = [[MXPushRuleCondition alloc] init];
-                        equivalentCondition.kindType = MXPushRuleConditionTypeEventMatch;
-                        equivalentCondition.parameters = @{
-                                                           @"key": @"user_id",
-                                                           @"pattern": rule.ruleId
-                                                           };
-                        
-                        conditionsOk = [eventMatchConditionChecker isCondition:equivalentCondition satisfiedBy:event roomState:roomState withJsonDict:JSONDictionary];
-                        break;
-                    }
-                }
-                
-                if (conditionsOk)
-                {
-                    theRule = rule;
-                    break;
-                }
+                compiledPushRules = [[MXCompiledPushRules alloc] initWithRules:flatRules];
             }
+
+            // Check rules according to their priorities
+            theRule = [compiledPushRules ruleMatchingEvent:event roomState:roomState conditionCheckers:conditionCheckers];
         }
     }
 
@@ -341,6 +256,7 @@ NSString *const kMXNotificationCenterAllOtherRoomMessagesRuleID = @".m.rule.mess
                     if ([rule.ruleId isEqualToString:pushRule.ruleId])
                     {
                         [self->flatRules removeObjectAtIndex:index];
+                        self->compiledPushRules = nil;
                         
                         NSMutableArray *updatedArray;
                         switch (rule.kind)
@@ -218,6 +218,30 @@ typedef NS_ENUM(NSUInteger, MXHTTPClientSSLPinningMode) {
                           failure:(void (^)(NSError *error))failure;
 
 
+/**
+ Make a HTTP request to the server and get the raw data of its response.
+
+ The data of successful responses is not parsed. This lets big responses be decoded
+ progressively. Error responses are handled like in other requests.
+ Note that successful responses of all requests to `path` are then provided as NSData.
+
+ @param httpMethod the HTTP method (GET, PUT, ...)
+ @param path the relative path of the server API to call.
+ @param parameters the parameters to be set as a query string for `GET` requests, or the request HTTP body.
+ @param timeoutInSeconds the timeout allocated for the request.
+
+ @param success A block object called when the operation succeeds. It provides the response data.
+ @param failure A block object called when the operation fails.
+
+ @return a MXHTTPOperation instance.
+ */
+- (MXHTTPOperation*)requestWithMethod:(NSString *)httpMethod
+                                 path:(NSString *)path
+                           parameters:(NSDictionary*)parameters
+                              timeout:(NSTimeInterval)timeoutInSeconds
+                          successData:(void (^)(NSData *responseData))success
+                              failure:(void (^)(NSError *error))failure;
+
 /**
  Make a HTTP request to the server.
  
@@ -48,6 +48,65 @@ NSString* const kMXHTTPClientMatrixErrorNotificationErrorKey = @"kMXHTTPClientMa
 static NSUInteger requestCount = 0;
 
 
+#pragma mark - MXHTTPClientResponseSerializer
+
+/**
+ The response serializer of `MXHTTPClient`.
+
+ Successful responses of paths registered with `addRawDataPath:` are provided as NSData.
+ Other responses are parsed as JSON.
+ */
+@interface MXHTTPClientResponseSerializer : AFJSONResponseSerializer
+{
+    NSMutableSet<NSString*> *rawDataPaths;
+}
+
+- (void)addRawDataPath:(NSString*)path;
+
+@end
+
+@implementation MXHTTPClientResponseSerializer
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        rawDataPaths = [NSMutableSet set];
+    }
+    return self;
+}
+
+- (void)addRawDataPath:(NSString *)path
+{
+    @synchronized (rawDataPaths)
+    {
+        [rawDataPaths addObject:path];
+    }
+}
+
+- (id)responseObjectForResponse:(NSURLResponse *)response data:(NSData *)data error:(NSError *__autoreleasing *)error
+{
+    BOOL rawData;
+    @synchronized (rawDataPaths)
+    {
+        rawData = [rawDataPaths containsObject:response.URL.path];
+    }
+
+    if (rawData && [self validateResponse:(NSHTTPURLResponse *)response data:data error:NULL])
+    {
+        return data;
+    }
+
+    return [super responseObjectForResponse:response data:data error:error];
+}
+
+@end
+
+
+#pragma mark - MXHTTPClient
+
+
 @interface MXHTTPClient ()
 {
     /**
@@ -118,6 +177,7 @@ static NSUInteger requestCount = 0;
     if (self)
     {
         httpManager = [[AFHTTPSessionManager alloc] initWithBaseURL:[NSURL URLWithString:baseURL]];
+        httpManager.responseSerializer = [MXHTTPClientResponseSerializer serializer];
 
         [self setDefaultSecurityPolicy];
 
@@ -195,6 +255,32 @@ static NSUInteger requestCount = 0;
     return mxHTTPOperation;
 }
 
+- (MXHTTPOperation*)requestWithMethod:(NSString *)httpMethod
+                                 path:(NSString *)path
+                           parameters:(NSDictionary*)parameters
+                              timeout:(NSTimeInterval)timeoutInSeconds
+                          successData:(void (^)(NSData *responseData))success
+                              failure:(void (^)(NSError *error))failure
+{
+    NSString *URLPath = [NSURL URLWithString:path relativeToURL:httpManager.baseURL].path;
+    [(MXHTTPClientResponseSerializer*)httpManager.responseSerializer addRawDataPath:URLPath];
+
+    return [self requestWithMethod:httpMethod path:path parameters:parameters timeout:timeoutInSeconds success:^(NSDictionary *JSONResponse) {
+
+        // The response serializer does not parse the data of this path
+        id response = JSONResponse;
+        if ([response isKindOfClass:NSData.class])
+        {
+            success(response);
+        }
+        else
+        {
+            success([NSJSONSerialization dataWithJSONObject:JSONResponse options:0 error:nil]);
+        }
+
+    } failure:failure];
+}
+
 - (MXHTTPOperation*)requestWithMethod:(NSString *)httpMethod
                                  path:(NSString *)path
                            parameters:(NSDictionary*)parameters
@@ -17,7 +17,10 @@
 #import <Foundation/Foundation.h>
 
 /**
- `MXLRUCache` is an LRU cache
+ `MXLRUCache` is an LRU cache.
+
+ It is a simple interface to `MXStripedLRUCache`, which also supports cost limits and
+ provides usage statistics.
  */
 @interface MXLRUCache : NSObject
 
@@ -16,40 +16,11 @@
 
 #import "MXLRUCache.h"
 
-@interface MXLRUCacheItem : NSObject
-
-/**
- The item counter
- */
-@property NSUInteger refCount;
-
-/**
- The cached object
- */
-@property NSObject* object;
-
-/**
- The object key
- */
-@property NSString* key;
-
-@end
-
-@implementation MXLRUCacheItem
-@end
-
+#import "MXStripedLRUCache.h"
 
 @interface MXLRUCache ()
 {
-    // the cached objects list
-    // sorted by regCount
-    NSMutableArray<MXLRUCacheItem *> *cachedObjects;
-    
-    // the cached objects keys
-    NSMutableArray<NSString*> *cachedKeys;
-    
-    //
-    NSUInteger capacity;
+    MXStripedLRUCache<NSString*, NSObject*> *cache;
 }
 @end
 
@@ -60,32 +31,11 @@
     self = [super init];
     if (self)
     {
-        capacity = aCapacity;
-        cachedObjects = [[NSMutableArray alloc] initWithCapacity:capacity];
-        cachedKeys = [[NSMutableArray alloc] initWithCapacity:capacity];
+        cache = [[MXStripedLRUCache alloc] initWithCountLimit:aCapacity totalCostLimit:0];
     }
     return self;
 }
 
-- (void)sortCachedItems
-{
-    cachedObjects = [[cachedObjects sortedArrayUsingComparator:^NSComparisonResult(id a, id b)
-     {
-         MXLRUCacheItem* item1 = (MXLRUCacheItem*)a;
-         MXLRUCacheItem* item2 = (MXLRUCacheItem*)b;
-         
-         return item2.refCount - item1.refCount;
-     }] mutableCopy];
-    
-    [cachedKeys removeAllObjects];
-    
-    for(MXLRUCacheItem* item in cachedObjects)
-    {
-        [cachedKeys addObject:item.key];
-    }
-}
-
-
 /**
  Retrieve an object from its key.
  @param key the object key
@@ -93,28 +43,7 @@
  */
 - (NSObject*)get:(NSString*)key
 {
-    NSObject* object = nil;
-    
-    if (key)
-    {
-        @synchronized(cachedObjects)
-        {
-            NSUInteger pos = [cachedKeys indexOfObject:key];
-            
-            if (pos != NSNotFound)
-            {
-                MXLRUCacheItem* item = [cachedObjects objectAtIndex:pos];
-                
-                object = item.object;
-                
-                // update the count order
-                item.refCount++;
-                [self sortCachedItems];
-            }
-        }
-    }
-    
-    return object;
+    return [cache objectForKey:key];
 }
 
 /**
@@ -124,33 +53,7 @@
  */
 - (void)put:(NSString*)key object:(NSObject*)object
 {
-    if (key)
-    {
-        @synchronized(cachedObjects)
-        {
-            NSUInteger pos = [cachedKeys indexOfObject:key];
-            
-            if (pos == NSNotFound)
-            {
-                MXLRUCacheItem* item = [[MXLRUCacheItem alloc] init];
-        
-                item.object = object;
-                item.refCount = 1;
-                item.key = key;
-
-                // remove the less used object
-                if (cachedKeys.count >= capacity)
-                {
-                    [cachedObjects removeLastObject];
-                    [cachedKeys removeLastObject];
-                    
-                }
-                
-                [cachedObjects addObject:item];
-                [cachedKeys addObject:key];
-            }
-        }
-    }
+    [cache setObject:object forKey:key];
 }
 
 /**
@@ -158,11 +61,7 @@
  */
 - (void)clear
 {
-    @synchronized(cachedObjects)
-    {
-        [cachedObjects removeAllObjects];
-        [cachedKeys removeAllObjects];
-    }
+    [cache removeAllObjects];
 }
 
 @end
@@ -0,0 +1,91 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXPersistentDictionary` is an immutable dictionary that shares its structure with
+ the dictionaries derived from it.
+
+ It is a hash array mapped trie: keys are spread by their hash over a tree of nodes
+ of up to 32 slots. Setting or removing a key creates a new dictionary that copies
+ only the nodes on the path to that key, which is O(log32(n)). The other nodes are
+ shared with the original dictionary, which is left unchanged.
+
+ Copying a `MXPersistentDictionary` is O(1): it returns the same instance.
+
+ This class is thread safe.
+ */
+@interface MXPersistentDictionary<KeyType, ObjectType> : NSObject <NSCopying>
+
+/**
+ Create an empty dictionary.
+ */
++ (instancetype)dictionary;
+
+/**
+ The number of entries.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Retrieve an object.
+
+ @param key the object key.
+ @return the object. nil if not found.
+ */
+- (nullable ObjectType)objectForKey:(KeyType)key;
+- (nullable ObjectType)objectForKeyedSubscript:(KeyType)key;
+
+/**
+ Create a dictionary with an additional or replaced entry.
+
+ @param object the object to store.
+ @param key the object key.
+ @return the new dictionary. self if the key already maps to this object.
+ */
+- (instancetype)dictionaryBySettingObject:(ObjectType)object forKey:(KeyType<NSCopying>)key;
+
+/**
+ Create a dictionary without an entry.
+
+ @param key the key of the entry to remove.
+ @return the new dictionary. self if the key is not present.
+ */
+- (instancetype)dictionaryByRemovingObjectForKey:(KeyType)key;
+
+/**
+ Enumerate all entries in no particular order.
+
+ @param block the block called for each entry.
+ */
+- (void)enumerateKeysAndObjectsUsingBlock:(void (NS_NOESCAPE ^)(KeyType key, ObjectType object, BOOL *stop))block;
+
+/**
+ All keys in no particular order.
+ */
+@property (nonatomic, readonly) NSArray<KeyType> *allKeys;
+
+/**
+ All objects in no particular order.
+ */
+@property (nonatomic, readonly) NSArray<ObjectType> *allValues;
+
+@end
+
+NS_ASSUME_NONNULL_END
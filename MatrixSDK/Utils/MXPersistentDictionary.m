@@ -0,0 +1,448 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXPersistentDictionary.h"
+
+// Number of hash bits consumed by each level of the trie
+static NSUInteger const kMXPersistentDictionaryBitsPerLevel = 5;
+static NSUInteger const kMXPersistentDictionaryLevelMask = 0x1f;
+
+// Number of bits of a hash. Keys with the same full hash end in a collision node
+static NSUInteger const kMXPersistentDictionaryHashBits = sizeof(NSUInteger) * 8;
+
+
+#pragma mark - MXPersistentDictionaryEntry
+
+/**
+ A key-object pair stored in a slot of a node.
+ */
+@interface MXPersistentDictionaryEntry : NSObject
+{
+    @public
+    id key;
+    id object;
+    NSUInteger hash;
+}
+@end
+
+@implementation MXPersistentDictionaryEntry
+@end
+
+
+#pragma mark - MXPersistentDictionaryNode
+
+/**
+ A node of the trie. Nodes are never modified once they are reachable from a dictionary.
+
+ A bitmap node has a slot for each bit set in `bitmap`. A slot is either an entry or
+ a child node for the next hash bits.
+ A collision node has only entries, which all have the same hash.
+ */
+@interface MXPersistentDictionaryNode : NSObject
+{
+    @public
+    BOOL collision;
+    uint32_t bitmap;
+    NSArray *slots;
+}
+@end
+
+@implementation MXPersistentDictionaryNode
+
++ (MXPersistentDictionaryNode*)nodeWithBitmap:(uint32_t)bitmap slots:(NSArray*)slots
+{
+    MXPersistentDictionaryNode *node = [[MXPersistentDictionaryNode alloc] init];
+    node->bitmap = bitmap;
+    node->slots = slots;
+    return node;
+}
+
++ (MXPersistentDictionaryNode*)collisionNodeWithEntries:(NSArray<MXPersistentDictionaryEntry*>*)entries
+{
+    MXPersistentDictionaryNode *node = [[MXPersistentDictionaryNode alloc] init];
+    node->collision = YES;
+    node->slots = entries;
+    return node;
+}
+
+/**
+ Build the smallest subtree that holds two entries with different keys.
+ */
++ (MXPersistentDictionaryNode*)nodeWithEntry:(MXPersistentDictionaryEntry*)entry1 entry:(MXPersistentDictionaryEntry*)entry2 shift:(NSUInteger)shift
+{
+    if (shift >= kMXPersistentDictionaryHashBits)
+    {
+        return [self collisionNodeWithEntries:@[entry1, entry2]];
+    }
+
+    NSUInteger index1 = (entry1->hash >> shift) & kMXPersistentDictionaryLevelMask;
+    NSUInteger index2 = (entry2->hash >> shift) & kMXPersistentDictionaryLevelMask;
+
+    if (index1 == index2)
+    {
+        MXPersistentDictionaryNode *child = [self nodeWithEntry:entry1 entry:entry2 shift:shift + kMXPersistentDictionaryBitsPerLevel];
+        return [self nodeWithBitmap:(1U << index1) slots:@[child]];
+    }
+
+    NSArray *slots = index1 < index2 ? @[entry1, entry2] : @[entry2, entry1];
+    return [self nodeWithBitmap:(1U << index1) | (1U << index2) slots:slots];
+}
+
+- (id)objectForKey:(id)key hash:(NSUInteger)hash shift:(NSUInteger)shift
+{
+    MXPersistentDictionaryNode *node = self;
+    while (node)
+    {
+        if (node->collision)
+        {
+            for (MXPersistentDictionaryEntry *entry in node->slots)
+            {
+                if ([entry->key isEqual:key])
+                {
+                    return entry->object;
+                }
+            }
+            return nil;
+        }
+
+        uint32_t bit = 1U << ((hash >> shift) & kMXPersistentDictionaryLevelMask);
+        if (!(node->bitmap & bit))
+        {
+            return nil;
+        }
+
+        id slot = node->slots[__builtin_popcount(node->bitmap & (bit - 1))];
+        if ([slot isKindOfClass:MXPersistentDictionaryNode.class])
+        {
+            node = slot;
+            shift += kMXPersistentDictionaryBitsPerLevel;
+        }
+        else
+        {
+            MXPersistentDictionaryEntry *entry = slot;
+            return (entry->hash == hash && [entry->key isEqual:key]) ? entry->object : nil;
+        }
+    }
+    return nil;
+}
+
+- (MXPersistentDictionaryNode*)nodeBySettingEntry:(MXPersistentDictionaryEntry*)newEntry shift:(NSUInteger)shift added:(BOOL*)added
+{
+    if (collision)
+    {
+        NSMutableArray *newSlots = [slots mutableCopy];
+        for (NSUInteger i = 0; i < slots.count; i++)
+        {
+            MXPersistentDictionaryEntry *entry = slots[i];
+            if ([entry->key isEqual:newEntry->key])
+            {
+                if (entry->object == newEntry->object)
+                {
+                    return self;
+                }
+                newSlots[i] = newEntry;
+                return [MXPersistentDictionaryNode collisionNodeWithEntries:newSlots];
+            }
+        }
+
+        [newSlots addObject:newEntry];
+        *added = YES;
+        return [MXPersistentDictionaryNode collisionNodeWithEntries:newSlots];
+    }
+
+    uint32_t bit = 1U << ((newEntry->hash >> shift) & kMXPersistentDictionaryLevelMask);
+    NSUInteger index = __builtin_popcount(bitmap & (bit - 1));
+
+    if (!(bitmap & bit))
+    {
+        NSMutableArray *newSlots = [slots mutableCopy];
+        [newSlots insertObject:newEntry atIndex:index];
+        *added = YES;
+        return [MXPersistentDictionaryNode nodeWithBitmap:(bitmap | bit) slots:newSlots];
+    }
+
+    id slot = slots[index];
+    id newSlot;
+    if ([slot isKindOfClass:MXPersistentDictionaryNode.class])
+    {
+        MXPersistentDictionaryNode *child = slot;
+        newSlot = [child nodeBySettingEntry:newEntry shift:shift + kMXPersistentDictionaryBitsPerLevel added:added];
+    }
+    else
+    {
+        MXPersistentDictionaryEntry *entry = slot;
+        if (entry->hash == newEntry->hash && [entry->key isEqual:newEntry->key])
+        {
+            newSlot = (entry->object == newEntry->object) ? entry : newEntry;
+        }
+        else
+        {
+            newSlot = [MXPersistentDictionaryNode nodeWithEntry:entry entry:newEntry shift:shift + kMXPersistentDictionaryBitsPerLevel];
+            *added = YES;
+        }
+    }
+
+    if (newSlot == slot)
+    {
+        return self;
+    }
+
+    NSMutableArray *newSlots = [slots mutableCopy];
+    newSlots[index] = newSlot;
+    return [MXPersistentDictionaryNode nodeWithBitmap:bitmap slots:newSlots];
+}
+
+/**
+ @return the node without the key, self if the key is not present, nil if the node becomes empty
+         or its single remaining entry if it can be inlined in the parent node.
+ */
+- (id)nodeByRemovingKey:(id)key hash:(NSUInteger)hash shift:(NSUInteger)shift removed:(BOOL*)removed
+{
+    if (collision)
+    {
+        for (NSUInteger i = 0; i < slots.count; i++)
+        {
+            MXPersistentDictionaryEntry *entry = slots[i];
+            if ([entry->key isEqual:key])
+            {
+                *removed = YES;
+
+                NSMutableArray *newSlots = [slots mutableCopy];
+                [newSlots removeObjectAtIndex:i];
+                if (newSlots.count == 1)
+                {
+                    return newSlots[0];
+                }
+                return [MXPersistentDictionaryNode collisionNodeWithEntries:newSlots];
+            }
+        }
+        return self;
+    }
+
+    uint32_t bit = 1U << ((hash >> shift) & kMXPersistentDictionaryLevelMask);
+    if (!(bitmap & bit))
+    {
+        return self;
+    }
+
+    NSUInteger index = __builtin_popcount(bitmap & (bit - 1));
+    id slot = slots[index];
+    id newSlot;
+    if ([slot isKindOfClass:MXPersistentDictionaryNode.class])
+    {
+        MXPersistentDictionaryNode *child = slot;
+        newSlot = [child nodeByRemovingKey:key hash:hash shift:shift + kMXPersistentDictionaryBitsPerLevel removed:removed];
+        if (newSlot == slot)
+        {
+            return self;
+        }
+    }
+    else
+    {
+        MXPersistentDictionaryEntry *entry = slot;
+        if (entry->hash != hash || ![entry->key isEqual:key])
+        {
+            return self;
+        }
+        *removed = YES;
+    }
+
+    NSMutableArray *newSlots = [slots mutableCopy];
+    uint32_t newBitmap = bitmap;
+    if (newSlot)
+    {
+        newSlots[index] = newSlot;
+    }
+    else
+    {
+        [newSlots removeObjectAtIndex:index];
+        newBitmap &= ~bit;
+    }
+
+    if (newSlots.count == 0)
+    {
+        return nil;
+    }
+    if (shift && newSlots.count == 1 && ![newSlots[0] isKindOfClass:MXPersistentDictionaryNode.class])
+    {
+        // Let the parent store the last entry directly
+        return newSlots[0];
+    }
+
+    return [MXPersistentDictionaryNode nodeWithBitmap:newBitmap slots:newSlots];
+}
+
+- (BOOL)enumerateEntriesUsingBlock:(void (NS_NOESCAPE ^)(MXPersistentDictionaryEntry *entry, BOOL *stop))block
+{
+    BOOL stop = NO;
+    for (id slot in slots)
+    {
+        if ([slot isKindOfClass:MXPersistentDictionaryNode.class])
+        {
+            stop = [(MXPersistentDictionaryNode*)slot enumerateEntriesUsingBlock:block];
+        }
+        else
+        {
+            block(slot, &stop);
+        }
+
+        if (stop)
+        {
+            break;
+        }
+    }
+    return stop;
+}
+
+@end
+
+
+#pragma mark - MXPersistentDictionary
+
+@interface MXPersistentDictionary ()
+{
+    MXPersistentDictionaryNode *root;
+    NSUInteger count;
+}
+@end
+
+@implementation MXPersistentDictionary
+
++ (instancetype)dictionary
+{
+    return [[self alloc] initWithRoot:nil count:0];
+}
+
+- (instancetype)init
+{
+    return [self initWithRoot:nil count:0];
+}
+
+- (instancetype)initWithRoot:(MXPersistentDictionaryNode*)theRoot count:(NSUInteger)theCount
+{
+    self = [super init];
+    if (self)
+    {
+        root = theRoot ? theRoot : [MXPersistentDictionaryNode nodeWithBitmap:0 slots:@[]];
+        count = theCount;
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return count;
+}
+
+- (id)objectForKey:(id)key
+{
+    if (!key || !count)
+    {
+        return nil;
+    }
+    return [root objectForKey:key hash:[key hash] shift:0];
+}
+
+- (id)objectForKeyedSubscript:(id)key
+{
+    return [self objectForKey:key];
+}
+
+- (instancetype)dictionaryBySettingObject:(id)object forKey:(id<NSCopying>)key
+{
+    if (!object)
+    {
+        return [self dictionaryByRemovingObjectForKey:key];
+    }
+    if (!key)
+    {
+        return self;
+    }
+
+    MXPersistentDictionaryEntry *entry = [[MXPersistentDictionaryEntry alloc] init];
+    entry->key = [(NSObject*)key copy];
+    entry->object = object;
+    entry->hash = [entry->key hash];
+
+    BOOL added = NO;
+    MXPersistentDictionaryNode *newRoot = [root nodeBySettingEntry:entry shift:0 added:&added];
+    if (newRoot == root)
+    {
+        return self;
+    }
+
+    return [[self.class alloc] initWithRoot:newRoot count:count + (added ? 1 : 0)];
+}
+
+- (instancetype)dictionaryByRemovingObjectForKey:(id)key
+{
+    if (!key || !count)
+    {
+        return self;
+    }
+
+    BOOL removed = NO;
+    id newRoot = [root nodeByRemovingKey:key hash:[key hash] shift:0 removed:&removed];
+    if (!removed)
+    {
+        return self;
+    }
+
+    return [[self.class alloc] initWithRoot:newRoot count:count - 1];
+}
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (NS_NOESCAPE ^)(id key, id object, BOOL *stop))block
+{
+    [root enumerateEntriesUsingBlock:^(MXPersistentDictionaryEntry *entry, BOOL *stop) {
+        block(entry->key, entry->object, stop);
+    }];
+}
+
+- (NSArray*)allKeys
+{
+    NSMutableArray *allKeys = [NSMutableArray arrayWithCapacity:count];
+    [root enumerateEntriesUsingBlock:^(MXPersistentDictionaryEntry *entry, BOOL *stop) {
+        [allKeys addObject:entry->key];
+    }];
+    return allKeys;
+}
+
+- (NSArray*)allValues
+{
+    NSMutableArray *allValues = [NSMutableArray arrayWithCapacity:count];
+    [root enumerateEntriesUsingBlock:^(MXPersistentDictionaryEntry *entry, BOOL *stop) {
+        [allValues addObject:entry->object];
+    }];
+    return allValues;
+}
+
+- (NSString *)description
+{
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:count];
+    [root enumerateEntriesUsingBlock:^(MXPersistentDictionaryEntry *entry, BOOL *stop) {
+        dictionary[entry->key] = entry->object;
+    }];
+    return [NSString stringWithFormat:@"<MXPersistentDictionary: %p> %@", self, dictionary];
+}
+
+#pragma mark - NSCopying
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable
+    return self;
+}
+
+@end
@@ -0,0 +1,123 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ `MXStripedLRUCache` is a thread safe LRU cache bounded by a number of objects and
+ by a total cost.
+
+ Get and put operations are O(1): each object is stored in a hash map and in a
+ doubly-linked list ordered by recency of use.
+
+ Keys are spread over several stripes that have their own lock, their own list and
+ their own share of the limits. Threads accessing keys of different stripes do not
+ wait for each other. The least recently used object is evicted from the stripe
+ that exceeds its limits.
+ */
+@interface MXStripedLRUCache<KeyType, ObjectType> : NSObject
+
+/**
+ Create a cache.
+
+ The number of stripes is chosen from `countLimit` so that small caches keep an
+ exact LRU order.
+
+ @param countLimit the maximum number of objects. 0 means no limit.
+ @param totalCostLimit the maximum total cost of objects. 0 means no limit.
+ */
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit;
+
+/**
+ Create a cache.
+
+ @param countLimit the maximum number of objects. 0 means no limit.
+ @param totalCostLimit the maximum total cost of objects. 0 means no limit.
+ @param stripesCount the number of independently locked stripes.
+ */
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit stripesCount:(NSUInteger)stripesCount NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Retrieve an object and mark it as the most recently used.
+
+ @param key the object key.
+ @return the cached object. nil if not found.
+ */
+- (nullable ObjectType)objectForKey:(KeyType)key;
+
+/**
+ Store an object with a cost of 0.
+
+ @param object the object to store.
+ @param key the object key. A previous object with the same key is replaced.
+ */
+- (void)setObject:(ObjectType)object forKey:(KeyType)key;
+
+/**
+ Store an object.
+
+ @param object the object to store.
+ @param key the object key. A previous object with the same key is replaced.
+ @param cost the cost of the object, e.g. its size in memory.
+ */
+- (void)setObject:(ObjectType)object forKey:(KeyType)key cost:(NSUInteger)cost;
+
+/**
+ Remove an object.
+
+ @param key the object key.
+ */
+- (void)removeObjectForKey:(KeyType)key;
+
+/**
+ Remove all objects.
+ */
+- (void)removeAllObjects;
+
+/**
+ The number of objects in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ The total cost of objects in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+#pragma mark - Statistics
+
+/**
+ The number of `objectForKey:` calls that found an object.
+ */
+@property (nonatomic, readonly) NSUInteger hitCount;
+
+/**
+ The number of `objectForKey:` calls that found nothing.
+ */
+@property (nonatomic, readonly) NSUInteger missCount;
+
+/**
+ The number of objects removed to respect the limits.
+ */
+@property (nonatomic, readonly) NSUInteger evictionCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
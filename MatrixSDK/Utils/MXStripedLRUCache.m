@@ -0,0 +1,376 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "MXStripedLRUCache.h"
+
+// Maximum number of stripes chosen by initWithCountLimit:totalCostLimit:
+static NSUInteger const kMXStripedLRUCacheMaxStripesCount = 8;
+
+// Minimum number of objects per stripe chosen by initWithCountLimit:totalCostLimit:
+static NSUInteger const kMXStripedLRUCacheMinStripeCountLimit = 32;
+
+
+#pragma mark - MXStripedLRUCacheNode
+
+/**
+ An entry of the cache. It is a node of the recency list of its stripe.
+ */
+@interface MXStripedLRUCacheNode : NSObject
+{
+    @public
+    id key;
+    id object;
+    NSUInteger cost;
+
+    // Nodes are retained by the stripe map
+    __unsafe_unretained MXStripedLRUCacheNode *previous;
+    __unsafe_unretained MXStripedLRUCacheNode *next;
+}
+@end
+
+@implementation MXStripedLRUCacheNode
+@end
+
+
+#pragma mark - MXStripedLRUCacheStripe
+
+/**
+ A part of the cache with its own lock and limits.
+
+ All methods must be called under `@synchronized` on the stripe.
+ */
+@interface MXStripedLRUCacheStripe : NSObject
+{
+    @public
+    NSMutableDictionary *nodes;
+
+    // The most recently used node and the least recently used one
+    __unsafe_unretained MXStripedLRUCacheNode *head;
+    __unsafe_unretained MXStripedLRUCacheNode *tail;
+
+    NSUInteger countLimit;
+    NSUInteger totalCostLimit;
+    NSUInteger totalCost;
+
+    NSUInteger hitCount;
+    NSUInteger missCount;
+    NSUInteger evictionCount;
+}
+@end
+
+@implementation MXStripedLRUCacheStripe
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        nodes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)unlinkNode:(MXStripedLRUCacheNode*)node
+{
+    if (node->previous)
+    {
+        node->previous->next = node->next;
+    }
+    else
+    {
+        head = node->next;
+    }
+
+    if (node->next)
+    {
+        node->next->previous = node->previous;
+    }
+    else
+    {
+        tail = node->previous;
+    }
+
+    node->previous = nil;
+    node->next = nil;
+}
+
+- (void)insertNodeAtHead:(MXStripedLRUCacheNode*)node
+{
+    node->next = head;
+    if (head)
+    {
+        head->previous = node;
+    }
+    head = node;
+
+    if (!tail)
+    {
+        tail = node;
+    }
+}
+
+- (void)removeNode:(MXStripedLRUCacheNode*)node
+{
+    // The map owns the node. Keep the key alive until the node is removed from it
+    id key = node->key;
+
+    [self unlinkNode:node];
+    totalCost -= node->cost;
+    [nodes removeObjectForKey:key];
+}
+
+- (void)evictIfNeeded
+{
+    while (tail
+           && ((countLimit && nodes.count > countLimit) || (totalCostLimit && totalCost > totalCostLimit)))
+    {
+        [self removeNode:tail];
+        evictionCount++;
+    }
+}
+
+@end
+
+
+#pragma mark - MXStripedLRUCache
+
+@interface MXStripedLRUCache ()
+{
+    NSArray<MXStripedLRUCacheStripe*> *stripes;
+}
+@end
+
+@implementation MXStripedLRUCache
+
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit
+{
+    NSUInteger stripesCount = kMXStripedLRUCacheMaxStripesCount;
+    if (countLimit)
+    {
+        stripesCount = MAX(1, MIN(kMXStripedLRUCacheMaxStripesCount, countLimit / kMXStripedLRUCacheMinStripeCountLimit));
+    }
+
+    return [self initWithCountLimit:countLimit totalCostLimit:totalCostLimit stripesCount:stripesCount];
+}
+
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit totalCostLimit:(NSUInteger)totalCostLimit stripesCount:(NSUInteger)stripesCount
+{
+    self = [super init];
+    if (self)
+    {
+        stripesCount = MAX(1, stripesCount);
+
+        NSMutableArray<MXStripedLRUCacheStripe*> *theStripes = [NSMutableArray arrayWithCapacity:stripesCount];
+        for (NSUInteger i = 0; i < stripesCount; i++)
+        {
+            MXStripedLRUCacheStripe *stripe = [[MXStripedLRUCacheStripe alloc] init];
+
+            // Share limits between stripes. Round up so that the global limits can be reached
+            stripe->countLimit = (countLimit + stripesCount - 1) / stripesCount;
+            stripe->totalCostLimit = (totalCostLimit + stripesCount - 1) / stripesCount;
+
+            [theStripes addObject:stripe];
+        }
+        stripes = theStripes;
+    }
+    return self;
+}
+
+- (id)objectForKey:(id)key
+{
+    id object;
+    if (!key)
+    {
+        return nil;
+    }
+
+    MXStripedLRUCacheStripe *stripe = [self stripeForKey:key];
+    @synchronized (stripe)
+    {
+        MXStripedLRUCacheNode *node = stripe->nodes[key];
+        if (node)
+        {
+            if (node != stripe->head)
+            {
+                [stripe unlinkNode:node];
+                [stripe insertNodeAtHead:node];
+            }
+
+            object = node->object;
+            stripe->hitCount++;
+        }
+        else
+        {
+            stripe->missCount++;
+        }
+    }
+
+    return object;
+}
+
+- (void)setObject:(id)object forKey:(id)key
+{
+    [self setObject:object forKey:key cost:0];
+}
+
+- (void)setObject:(id)object forKey:(id)key cost:(NSUInteger)cost
+{
+    if (!object)
+    {
+        [self removeObjectForKey:key];
+        return;
+    }
+    if (!key)
+    {
+        return;
+    }
+
+    MXStripedLRUCacheStripe *stripe = [self stripeForKey:key];
+    @synchronized (stripe)
+    {
+        MXStripedLRUCacheNode *node = stripe->nodes[key];
+        if (node)
+        {
+            [stripe unlinkNode:node];
+            stripe->totalCost -= node->cost;
+        }
+        else
+        {
+            node = [[MXStripedLRUCacheNode alloc] init];
+            node->key = [key copy];
+            stripe->nodes[node->key] = node;
+        }
+
+        node->object = object;
+        node->cost = cost;
+        stripe->totalCost += cost;
+        [stripe insertNodeAtHead:node];
+
+        [stripe evictIfNeeded];
+    }
+}
+
+- (void)removeObjectForKey:(id)key
+{
+    if (!key)
+    {
+        return;
+    }
+
+    MXStripedLRUCacheStripe *stripe = [self stripeForKey:key];
+    @synchronized (stripe)
+    {
+        MXStripedLRUCacheNode *node = stripe->nodes[key];
+        if (node)
+        {
+            [stripe removeNode:node];
+        }
+    }
+}
+
+- (void)removeAllObjects
+{
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            stripe->head = nil;
+            stripe->tail = nil;
+            stripe->totalCost = 0;
+            [stripe->nodes removeAllObjects];
+        }
+    }
+}
+
+- (NSUInteger)count
+{
+    NSUInteger count = 0;
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            count += stripe->nodes.count;
+        }
+    }
+    return count;
+}
+
+- (NSUInteger)totalCost
+{
+    NSUInteger totalCost = 0;
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            totalCost += stripe->totalCost;
+        }
+    }
+    return totalCost;
+}
+
+- (NSUInteger)hitCount
+{
+    NSUInteger hitCount = 0;
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            hitCount += stripe->hitCount;
+        }
+    }
+    return hitCount;
+}
+
+- (NSUInteger)missCount
+{
+    NSUInteger missCount = 0;
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            missCount += stripe->missCount;
+        }
+    }
+    return missCount;
+}
+
+- (NSUInteger)evictionCount
+{
+    NSUInteger evictionCount = 0;
+    for (MXStripedLRUCacheStripe *stripe in stripes)
+    {
+        @synchronized (stripe)
+        {
+            evictionCount += stripe->evictionCount;
+        }
+    }
+    return evictionCount;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<MXStripedLRUCache: %p> %tu objects - cost: %tu - hits: %tu - misses: %tu - evictions: %tu",
+            self, self.count, self.totalCost, self.hitCount, self.missCount, self.evictionCount];
+}
+
+#pragma mark - Private methods
+
+- (MXStripedLRUCacheStripe*)stripeForKey:(id)key
+{
+    return stripes[[key hash] % stripes.count];
+}
+
+@end
@@ -28,7 +28,7 @@
 
 #import "MXSDKOptions.h"
 
-#import "MXLRUCache.h"
+#import "MXStripedLRUCache.h"
 #import "MXTools.h"
 
 NSUInteger const kMXMediaCacheSDKVersion = 3;
@@ -104,7 +104,11 @@ static NSMutableDictionary* uploadTableById = nil;
     return NO;
 }
 
-static MXLRUCache* imagesCacheLruCache = nil;
+static MXStripedLRUCache<NSString*, id>* imagesCacheLruCache = nil;
+
+// Limits of the images memory cache. The cost of an image is its decoded size
+static NSUInteger const kMXMediaManagerImagesCacheCountLimit = 20;
+static NSUInteger const kMXMediaManagerImagesCacheCostLimit = 50 * 1024 * 1024;
 
 #if TARGET_OS_IPHONE
 + (UIImage*)loadThroughCacheWithFilePath:(NSString*)filePath
@@ -139,13 +143,14 @@ static MXLRUCache* imagesCacheLruCache = nil;
 {
     if (!imagesCacheLruCache)
     {
-        imagesCacheLruCache = [[MXLRUCache alloc] initWithCapacity:20];
+        imagesCacheLruCache = [[MXStripedLRUCache alloc] initWithCountLimit:kMXMediaManagerImagesCacheCountLimit
+                                                             totalCostLimit:kMXMediaManagerImagesCacheCostLimit];
     }
     
 #if TARGET_OS_IPHONE
-    return (UIImage*)[imagesCacheLruCache get:filePath];
+    return (UIImage*)[imagesCacheLruCache objectForKey:filePath];
 #elif TARGET_OS_OSX
-    return (NSImage*)[imagesCacheLruCache get:filePath];
+    return (NSImage*)[imagesCacheLruCache objectForKey:filePath];
 #endif
 }
 
@@ -155,7 +160,16 @@ static MXLRUCache* imagesCacheLruCache = nil;
 + (void)cacheImage:(NSImage *)image withCachePath:(NSString *)filePath
 #endif
 {
-    [imagesCacheLruCache put:filePath object:image];
+    // Use the decoded size as cost
+#if TARGET_OS_IPHONE
+    CGImageRef cgImage = image.CGImage;
+    NSUInteger cost = cgImage ? CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage) : 0;
+#elif TARGET_OS_OSX
+    NSImageRep *imageRep = image.representations.firstObject;
+    NSUInteger cost = (NSUInteger)(imageRep.pixelsWide * imageRep.pixelsHigh * 4);
+#endif
+
+    [imagesCacheLruCache setObject:image forKey:filePath cost:cost];
 }
 
 
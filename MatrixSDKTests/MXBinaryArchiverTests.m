@@ -0,0 +1,179 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXBinaryArchiver.h"
+#import "MXEvent.h"
+#import "MXReceiptData.h"
+
+@interface MXBinaryArchiverTests : XCTestCase
+
+@end
+
+@implementation MXBinaryArchiverTests
+
+- (MXEvent*)eventWithIndex:(NSUInteger)index
+{
+    return [MXEvent modelFromJSON:@{
+                                    @"event_id": [NSString stringWithFormat:@"$%tu-eventid:matrix.org", index],
+                                    @"room_id": @"!aRoomId:matrix.org",
+                                    @"sender": @"@alice:matrix.org",
+                                    @"type": kMXEventTypeStringRoomMessage,
+                                    @"origin_server_ts": @(1576000000000 + index),
+                                    @"content": @{
+                                            @"msgtype": kMXMessageTypeText,
+                                            @"body": [NSString stringWithFormat:@"Message #%tu. Lorem ipsum dolor sit amet, consectetur adipiscing elit", index],
+                                            @"ratio": @(0.5),
+                                            @"negative": @(-42),
+                                            @"flag": @YES,
+                                            @"nothing": [NSNull null]
+                                            },
+                                    @"unsigned": @{
+                                            @"transaction_id": @"aTransactionId"
+                                            }
+                                    }];
+}
+
+- (void)testEventRoundTrip
+{
+    MXEvent *event = [self eventWithIndex:1];
+
+    NSData *data = [MXBinaryArchiver archivedDataWithRootObject:event];
+    XCTAssertTrue([MXBinaryUnarchiver isBinaryArchive:data]);
+
+    MXEvent *decodedEvent = [MXBinaryUnarchiver unarchiveObjectWithData:data];
+
+    XCTAssertEqualObjects(decodedEvent.eventId, event.eventId);
+    XCTAssertEqualObjects(decodedEvent.roomId, event.roomId);
+    XCTAssertEqualObjects(decodedEvent.sender, event.sender);
+    XCTAssertEqual(decodedEvent.eventType, MXEventTypeRoomMessage);
+    XCTAssertEqual(decodedEvent.originServerTs, event.originServerTs);
+    XCTAssertEqualObjects(decodedEvent.content, event.content);
+    XCTAssertEqualObjects(decodedEvent.content[@"nothing"], [NSNull null]);
+    XCTAssertEqualObjects(decodedEvent.unsignedData.transactionId, @"aTransactionId");
+    XCTAssertNil(decodedEvent.stateKey);
+}
+
+- (void)testReceiptDataRoundTrip
+{
+    MXReceiptData *receiptData = [[MXReceiptData alloc] init];
+    receiptData.userId = @"@alice:matrix.org";
+    receiptData.eventId = @"$eventid:matrix.org";
+    receiptData.ts = UINT64_MAX - 1;
+
+    NSMutableDictionary *receipts = [NSMutableDictionary dictionary];
+    receipts[receiptData.userId] = receiptData;
+
+    NSMutableDictionary *decodedReceipts = [MXBinaryUnarchiver unarchiveObjectWithData:[MXBinaryArchiver archivedDataWithRootObject:receipts]];
+    XCTAssertTrue([decodedReceipts isKindOfClass:NSMutableDictionary.class]);
+
+    MXReceiptData *decodedReceiptData = decodedReceipts[receiptData.userId];
+    XCTAssertEqualObjects(decodedReceiptData.userId, receiptData.userId);
+    XCTAssertEqualObjects(decodedReceiptData.eventId, receiptData.eventId);
+    XCTAssertEqual(decodedReceiptData.ts, receiptData.ts);
+}
+
+- (void)testContainersMutability
+{
+    NSDictionary *object = @{
+                             @"array": @[@"a", @(1)],
+                             @"mutableArray": [NSMutableArray arrayWithObjects:@"b", @(2), nil],
+                             @"mutableString": [NSMutableString stringWithString:@"c"],
+                             @"set": [NSSet setWithObjects:@"d", @"e", nil],
+                             @"mutableSet": [NSMutableSet setWithObject:@"f"],
+                             @"data": [@"g" dataUsingEncoding:NSUTF8StringEncoding],
+                             @"date": [NSDate dateWithTimeIntervalSince1970:1576000000]
+                             };
+
+    NSDictionary *decodedObject = [MXBinaryUnarchiver unarchiveObjectWithData:[MXBinaryArchiver archivedDataWithRootObject:object]];
+
+    XCTAssertEqualObjects(decodedObject, object);
+    XCTAssertTrue([decodedObject[@"mutableArray"] isKindOfClass:NSMutableArray.class]);
+    XCTAssertTrue([decodedObject[@"mutableSet"] isKindOfClass:NSMutableSet.class]);
+    XCTAssertNoThrow([decodedObject[@"mutableString"] appendString:@"c"]);
+}
+
+- (void)testStringsWithNullCharacter
+{
+    NSString *nullCharacter = [NSString stringWithFormat:@"%C", (unichar)0];
+    NSString *shortString = [NSString stringWithFormat:@"a%@b", nullCharacter];
+    NSString *longString = [[NSString stringWithFormat:@"A body with a %@ character. ", nullCharacter] stringByPaddingToLength:200 withString:@"Lorem ipsum " startingAtIndex:0];
+    NSDictionary *object = @{
+                             shortString: shortString,
+                             @"long": longString,
+                             @"mutableString": [NSMutableString stringWithString:shortString],
+                             @"empty": @""
+                             };
+
+    NSDictionary *decodedObject = [MXBinaryUnarchiver unarchiveObjectWithData:[MXBinaryArchiver archivedDataWithRootObject:object]];
+
+    XCTAssertEqualObjects(decodedObject, object);
+    XCTAssertEqual([decodedObject[shortString] length], 3);
+    XCTAssertEqual([decodedObject[@"long"] length], 200);
+}
+
+- (void)testKeyedArchiverFallback
+{
+    NSData *keyedData = [NSKeyedArchiver archivedDataWithRootObject:@{@"key": @"value"}];
+
+    XCTAssertFalse([MXBinaryUnarchiver isBinaryArchive:keyedData]);
+    XCTAssertNil([MXBinaryUnarchiver unarchiveObjectWithData:keyedData]);
+    XCTAssertEqualObjects([MXBinaryUnarchiver unarchiveObjectWithBinaryOrKeyedData:keyedData], @{@"key": @"value"});
+}
+
+- (void)testTruncatedData
+{
+    NSData *data = [MXBinaryArchiver archivedDataWithRootObject:[self eventWithIndex:1]];
+    NSData *truncatedData = [data subdataWithRange:NSMakeRange(0, data.length - 10)];
+
+    XCTAssertThrowsSpecificNamed([MXBinaryUnarchiver unarchiveObjectWithData:truncatedData], NSException, NSInvalidUnarchiveOperationException);
+}
+
+- (void)testPerformanceVsKeyedArchiver
+{
+    NSUInteger eventsCount = 10000;
+    NSMutableArray<MXEvent*> *events = [NSMutableArray arrayWithCapacity:eventsCount];
+    for (NSUInteger i = 0; i < eventsCount; i++)
+    {
+        [events addObject:[self eventWithIndex:i]];
+    }
+
+    NSDate *startDate = [NSDate date];
+    NSData *keyedData = [NSKeyedArchiver archivedDataWithRootObject:events];
+    NSTimeInterval keyedEncodingDuration = -[startDate timeIntervalSinceNow];
+
+    startDate = [NSDate date];
+    [NSKeyedUnarchiver unarchiveObjectWithData:keyedData];
+    NSTimeInterval keyedDecodingDuration = -[startDate timeIntervalSinceNow];
+
+    startDate = [NSDate date];
+    NSData *binaryData = [MXBinaryArchiver archivedDataWithRootObject:events];
+    NSTimeInterval binaryEncodingDuration = -[startDate timeIntervalSinceNow];
+
+    startDate = [NSDate date];
+    NSArray<MXEvent*> *decodedEvents = [MXBinaryUnarchiver unarchiveObjectWithData:binaryData];
+    NSTimeInterval binaryDecodingDuration = -[startDate timeIntervalSinceNow];
+
+    NSLog(@"[MXBinaryArchiverTests] NSKeyedArchiver: %@ bytes. Encoding: %.0f events/s. Decoding: %.0f events/s", @(keyedData.length), eventsCount / keyedEncodingDuration, eventsCount / keyedDecodingDuration);
+    NSLog(@"[MXBinaryArchiverTests] MXBinaryArchiver: %@ bytes. Encoding: %.0f events/s. Decoding: %.0f events/s", @(binaryData.length), eventsCount / binaryEncodingDuration, eventsCount / binaryDecodingDuration);
+
+    XCTAssertEqual(decodedEvents.count, eventsCount);
+    XCTAssertEqualObjects(decodedEvents.lastObject.eventId, events.lastObject.eventId);
+    XCTAssertLessThan(binaryData.length, keyedData.length);
+}
+
+@end
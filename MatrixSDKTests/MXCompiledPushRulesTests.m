@@ -0,0 +1,289 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXCompiledPushRules.h"
+#import "MXPushRuleGlobMatcher.h"
+#import "MXPushRuleKeywordsMatcher.h"
+#import "MXPushRuleEventMatchConditionChecker.h"
+
+@interface MXCompiledPushRulesTests : XCTestCase
+{
+    MXPushRuleEventMatchConditionChecker *eventMatchConditionChecker;
+}
+@end
+
+@implementation MXCompiledPushRulesTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    eventMatchConditionChecker = [[MXPushRuleEventMatchConditionChecker alloc] init];
+}
+
+- (void)tearDown
+{
+    eventMatchConditionChecker = nil;
+
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (MXPushRule*)ruleWithKind:(MXPushRuleKind)kind ruleId:(NSString*)ruleId pattern:(NSString*)pattern conditions:(NSArray*)conditions
+{
+    NSMutableDictionary *JSONDictionary = [NSMutableDictionary dictionaryWithDictionary:@{
+                                                                                          @"rule_id": ruleId,
+                                                                                          @"enabled": @YES,
+                                                                                          @"actions": @[@"notify"]
+                                                                                          }];
+    if (pattern)
+    {
+        JSONDictionary[@"pattern"] = pattern;
+    }
+    if (conditions)
+    {
+        JSONDictionary[@"conditions"] = conditions;
+    }
+
+    MXPushRule *rule = [MXPushRule modelFromJSON:JSONDictionary];
+    rule.kind = kind;
+    return rule;
+}
+
+- (MXEvent*)messageEventWithBody:(NSString*)body roomId:(NSString*)roomId sender:(NSString*)sender
+{
+    return [MXEvent modelFromJSON:@{
+                                    @"type": @"m.room.message",
+                                    @"event_id": @"$anId",
+                                    @"room_id": roomId,
+                                    @"sender": sender,
+                                    @"origin_server_ts": @(1560000000000),
+                                    @"content": @{
+                                            @"body": body,
+                                            @"msgtype": @"m.text"
+                                            }
+                                    }];
+}
+
+// The result of the regular expression used by MXPushRuleEventMatchConditionChecker
+- (BOOL)regexMatchesPattern:(NSString*)pattern string:(NSString*)string
+{
+    MXPushRuleCondition *condition = [[MXPushRuleCondition alloc] init];
+    condition.kindType = MXPushRuleConditionTypeEventMatch;
+    condition.parameters = @{
+                             @"key": @"content.body",
+                             @"pattern": pattern
+                             };
+
+    return [eventMatchConditionChecker isCondition:condition satisfiedBy:nil roomState:nil withJsonDict:@{@"content": @{@"body": string}}];
+}
+
+// A rule set like the one of an active account
+- (NSArray<MXPushRule*>*)manyRules
+{
+    NSMutableArray<MXPushRule*> *rules = [NSMutableArray array];
+
+    [rules addObject:[self ruleWithKind:MXPushRuleKindOverride ruleId:@".m.rule.master" pattern:nil conditions:@[]]];
+    rules.lastObject.enabled = NO;
+    [rules addObject:[self ruleWithKind:MXPushRuleKindOverride ruleId:@".m.rule.suppress_notices" pattern:nil conditions:@[
+                                                                                                                          @{@"kind": @"event_match", @"key": @"content.msgtype", @"pattern": @"m.notice"}
+                                                                                                                          ]]];
+    [rules addObject:[self ruleWithKind:MXPushRuleKindOverride ruleId:@".m.rule.invite_for_me" pattern:nil conditions:@[
+                                                                                                                       @{@"kind": @"event_match", @"key": @"type", @"pattern": @"m.room.member"},
+                                                                                                                       @{@"kind": @"event_match", @"key": @"content.membership", @"pattern": @"invite"},
+                                                                                                                       @{@"kind": @"event_match", @"key": @"state_key", @"pattern": @"@me:matrix.org"}
+                                                                                                                       ]]];
+
+    for (NSUInteger i = 0; i < 100; i++)
+    {
+        [rules addObject:[self ruleWithKind:MXPushRuleKindContent ruleId:[NSString stringWithFormat:@"keyword%@", @(i)] pattern:[NSString stringWithFormat:@"keyword%@", @(i)] conditions:nil]];
+    }
+    [rules addObject:[self ruleWithKind:MXPushRuleKindContent ruleId:@".m.rule.contains_user_name" pattern:@"me" conditions:nil]];
+    [rules addObject:[self ruleWithKind:MXPushRuleKindContent ruleId:@"prefix" pattern:@"deploy*" conditions:nil]];
+
+    for (NSUInteger i = 0; i < 200; i++)
+    {
+        [rules addObject:[self ruleWithKind:MXPushRuleKindRoom ruleId:[NSString stringWithFormat:@"!room%@:matrix.org", @(i)] pattern:nil conditions:nil]];
+    }
+    for (NSUInteger i = 0; i < 100; i++)
+    {
+        [rules addObject:[self ruleWithKind:MXPushRuleKindSender ruleId:[NSString stringWithFormat:@"@user%@:matrix.org", @(i)] pattern:nil conditions:nil]];
+    }
+
+    [rules addObject:[self ruleWithKind:MXPushRuleKindUnderride ruleId:@".m.rule.call" pattern:nil conditions:@[
+                                                                                                               @{@"kind": @"event_match", @"key": @"type", @"pattern": @"m.call.invite"}
+                                                                                                               ]]];
+    [rules addObject:[self ruleWithKind:MXPushRuleKindUnderride ruleId:@".m.rule.encrypted" pattern:nil conditions:@[
+                                                                                                                    @{@"kind": @"event_match", @"key": @"type", @"pattern": @"m.room.encrypted"}
+                                                                                                                    ]]];
+    [rules addObject:[self ruleWithKind:MXPushRuleKindUnderride ruleId:@".m.rule.message" pattern:nil conditions:@[
+                                                                                                                  @{@"kind": @"event_match", @"key": @"type", @"pattern": @"m.room.message"}
+                                                                                                                  ]]];
+
+    return rules;
+}
+
+#pragma mark - Matchers
+
+- (void)testGlobMatcherLikeRegex
+{
+    NSArray<NSString*> *patterns = @[@"foo", @"foo*", @"*foo*", @"f?o", @"f.o", @"*", @"foo*bar", @"FoO", @"é", @"@alice:matrix.org", @"foo bar"];
+    NSArray<NSString*> *strings = @[@"foo", @"foo bar", @"bar.foo!bar", @"foobar", @"barfoo", @"fo", @"FOO", @"fxo", @"f\no", @"foo\nbar", @"é!", @"cé", @"hi @alice:matrix.org", @"foo  bar", @"a_foo", @"", @"foo baz bar", @"foo-barfoo"];
+
+    for (NSString *pattern in patterns)
+    {
+        MXPushRuleGlobMatcher *matcher = [MXPushRuleGlobMatcher matcherWithPattern:pattern];
+        XCTAssertNotNil(matcher, @"%@", pattern);
+
+        for (NSString *string in strings)
+        {
+            XCTAssertEqual([matcher matchesString:string], [self regexMatchesPattern:pattern string:string], @"pattern: %@ - string: %@", pattern, string);
+        }
+    }
+}
+
+- (void)testGlobMatcherUnsupportedPatterns
+{
+    XCTAssertNil([MXPushRuleGlobMatcher matcherWithPattern:@""]);
+    XCTAssertNil([MXPushRuleGlobMatcher matcherWithPattern:@"[fb]oo"]);
+    XCTAssertNil([MXPushRuleGlobMatcher matcherWithPattern:@"foo|bar"]);
+
+    XCTAssertTrue([MXPushRuleGlobMatcher matcherWithPattern:@"Foo"].isLiteral);
+    XCTAssertEqualObjects([MXPushRuleGlobMatcher matcherWithPattern:@"Foo"].lowercasePattern, @"foo");
+    XCTAssertFalse([MXPushRuleGlobMatcher matcherWithPattern:@"f.o"].isLiteral);
+}
+
+- (void)testKeywordsMatcher
+{
+    NSArray<NSString*> *keywords = @[@"foo", @"bar", @"foobar", @"oba", @"", @"new york"];
+    MXPushRuleKeywordsMatcher *matcher = [[MXPushRuleKeywordsMatcher alloc] initWithKeywords:keywords];
+
+    NSArray<NSString*> *strings = @[@"foo", @"Foo, BAR!", @"foobar", @"xfoobar", @"foo obar", @"I love New York", @"new  york", @"", @"bar.foo!foobar"];
+    for (NSString *string in strings)
+    {
+        NSMutableIndexSet *expected = [NSMutableIndexSet indexSet];
+        [keywords enumerateObjectsUsingBlock:^(NSString *keyword, NSUInteger idx, BOOL *stop) {
+            if (keyword.length && [self regexMatchesPattern:keyword string:string])
+            {
+                [expected addIndex:idx];
+            }
+        }];
+
+        XCTAssertEqualObjects([matcher indexesOfKeywordsInString:string], expected, @"%@", string);
+    }
+}
+
+#pragma mark - Rules
+
+- (void)testRulesPriority
+{
+    MXPushRule *disabledRoomRule = [self ruleWithKind:MXPushRuleKindRoom ruleId:@"!room:matrix.org" pattern:nil conditions:nil];
+    disabledRoomRule.enabled = NO;
+    MXPushRule *roomRule = [self ruleWithKind:MXPushRuleKindRoom ruleId:@"!ROOM:matrix.org" pattern:nil conditions:nil];
+    MXPushRule *senderRule = [self ruleWithKind:MXPushRuleKindSender ruleId:@"@alice:matrix.org" pattern:nil conditions:nil];
+    MXPushRule *keywordRule = [self ruleWithKind:MXPushRuleKindContent ruleId:@"lunch" pattern:@"lunch" conditions:nil];
+    MXPushRule *globRule = [self ruleWithKind:MXPushRuleKindContent ruleId:@"deploy" pattern:@"deploy*" conditions:nil];
+    MXPushRule *underrideRule = [self ruleWithKind:MXPushRuleKindUnderride ruleId:@".m.rule.message" pattern:nil conditions:@[
+                                                                                                                             @{@"kind": @"event_match", @"key": @"type", @"pattern": @"m.room.message"}
+                                                                                                                             ]];
+
+    NSArray *rules = @[globRule, keywordRule, disabledRoomRule, roomRule, senderRule, underrideRule];
+    MXCompiledPushRules *compiledPushRules = [[MXCompiledPushRules alloc] initWithRules:rules];
+    NSDictionary *conditionCheckers = @{kMXPushRuleConditionStringEventMatch: eventMatchConditionChecker};
+
+    MXEvent *event = [self messageEventWithBody:@"Lunch? deployed" roomId:@"!room:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], globRule);
+
+    event = [self messageEventWithBody:@"Lunch?" roomId:@"!room:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], keywordRule);
+
+    event = [self messageEventWithBody:@"hello" roomId:@"!room:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], roomRule);
+
+    event = [self messageEventWithBody:@"hello" roomId:@"!other:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], senderRule);
+
+    event = [self messageEventWithBody:@"hello" roomId:@"!other:matrix.org" sender:@"@bob:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], underrideRule);
+
+    // Rules are enabled or disabled after their compilation
+    roomRule.enabled = NO;
+    event = [self messageEventWithBody:@"hello" roomId:@"!room:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], senderRule);
+
+    // Without checker, a condition cannot be satisfied
+    event = [self messageEventWithBody:@"hello" roomId:@"!other:matrix.org" sender:@"@bob:matrix.org"];
+    XCTAssertNil([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:@{}]);
+}
+
+- (void)testRoomAndSenderRulesNotMatching
+{
+    MXPushRule *roomRule = [self ruleWithKind:MXPushRuleKindRoom ruleId:@"!room:matrix.org" pattern:nil conditions:nil];
+    MXPushRule *globRoomRule = [self ruleWithKind:MXPushRuleKindRoom ruleId:@"!room*:example.org" pattern:nil conditions:nil];
+    MXPushRule *senderRule = [self ruleWithKind:MXPushRuleKindSender ruleId:@"@alice:matrix.org" pattern:nil conditions:nil];
+    MXPushRule *globSenderRule = [self ruleWithKind:MXPushRuleKindSender ruleId:@"@alice*" pattern:nil conditions:nil];
+
+    MXCompiledPushRules *compiledPushRules = [[MXCompiledPushRules alloc] initWithRules:@[roomRule, globRoomRule, senderRule, globSenderRule]];
+    NSDictionary *conditionCheckers = @{kMXPushRuleConditionStringEventMatch: eventMatchConditionChecker};
+
+    // Neither the room group nor the sender group matches
+    MXEvent *event = [self messageEventWithBody:@"hello" roomId:@"!other:matrix.org" sender:@"@bob:matrix.org"];
+    XCTAssertNil([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers]);
+
+    // Disabled rules do not match either
+    roomRule.enabled = NO;
+    senderRule.enabled = NO;
+    event = [self messageEventWithBody:@"hello" roomId:@"!room:matrix.org" sender:@"@alice:matrix.org"];
+    XCTAssertEqual([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers], globSenderRule);
+
+    globSenderRule.enabled = NO;
+    XCTAssertNil([compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers]);
+}
+
+- (void)testEvaluationPerformance
+{
+    MXCompiledPushRules *compiledPushRules = [[MXCompiledPushRules alloc] initWithRules:self.manyRules];
+    NSDictionary *conditionCheckers = @{kMXPushRuleConditionStringEventMatch: eventMatchConditionChecker};
+
+    NSMutableArray<MXEvent*> *events = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 1000; i++)
+    {
+        NSString *body = [NSString stringWithFormat:@"Message %@ about the release of the next version. Who is around for keyword%@?", @(i), @(i % 300)];
+        [events addObject:[self messageEventWithBody:body
+                                              roomId:[NSString stringWithFormat:@"!room%@:matrix.org", @(200 + i % 50)]
+                                              sender:[NSString stringWithFormat:@"@user%@:matrix.org", @(100 + i % 20)]]];
+    }
+
+    [self measureBlock:^{
+        NSUInteger keywordsCount = 0;
+        for (MXEvent *event in events)
+        {
+            MXPushRule *rule = [compiledPushRules ruleMatchingEvent:event roomState:nil conditionCheckers:conditionCheckers];
+            if (rule.kind == MXPushRuleKindContent)
+            {
+                keywordsCount++;
+            }
+        }
+
+        // keyword0 to keyword99 are content rules
+        XCTAssertEqual(keywordsCount, 400);
+    }];
+}
+
+@end
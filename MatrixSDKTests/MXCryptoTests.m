@@ -22,8 +22,10 @@
 
 #import "MXSession.h"
 #import "MXCrypto_Private.h"
+#import "MXRealmCryptoStore.h"
 #import "MXMegolmExportEncryption.h"
 #import "MXDeviceListOperation.h"
+#import "MXDeviceListOperationsPool.h"
 #import "MXFileStore.h"
 
 #import "MXSDKOptions.h"
@@ -73,6 +75,8 @@
     [bobSessionToClose close];
     bobSessionToClose = nil;
 
+    [MXSDKOptions sharedInstance].decryptSyncResponsesInBackground = NO;
+
     matrixSDKTestsData = nil;
     matrixSDKTestsE2EData = nil;
 
@@ -370,6 +374,76 @@
 }
 
 
+// Benchmark the handling of a /keys/query response for 1000 users with 2 devices each
+- (void)testHandleKeysQueryResponsePerformance
+{
+    [matrixSDKTestsE2EData doE2ETestWithAliceInARoom:self readyToTest:^(MXSession *aliceSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+
+        MXOlmDevice *olmDevice = aliceSession.crypto.olmDevice;
+        MXDeviceListOperationsPool *pool = [[MXDeviceListOperationsPool alloc] initWithCrypto:aliceSession.crypto];
+
+        // Build a response with devices signed by Alice's device key
+        MXKeysQueryResponse* (^keysQueryResponse)(NSString *prefix, NSMutableArray<NSString*> *userIds) = ^(NSString *prefix, NSMutableArray<NSString*> *userIds) {
+
+            MXKeysQueryResponse *response = [MXKeysQueryResponse new];
+            response.deviceKeys = [[MXUsersDevicesMap alloc] init];
+
+            for (NSUInteger u = 0; u < 1000; u++)
+            {
+                NSString *userId = [NSString stringWithFormat:@"@%@%tu:matrix.org", prefix, u];
+                [userIds addObject:userId];
+
+                for (NSUInteger d = 0; d < 2; d++)
+                {
+                    NSString *deviceId = [NSString stringWithFormat:@"DEVICE%tu", d];
+                    NSString *signKeyId = [NSString stringWithFormat:@"ed25519:%@", deviceId];
+
+                    MXDeviceInfo *device = [[MXDeviceInfo alloc] initWithDeviceId:deviceId];
+                    device.userId = userId;
+                    device.algorithms = @[kMXCryptoOlmAlgorithm, kMXCryptoMegolmAlgorithm];
+                    device.keys = @{
+                                    signKeyId: olmDevice.deviceEd25519Key,
+                                    [NSString stringWithFormat:@"curve25519:%@", deviceId]: olmDevice.deviceCurve25519Key
+                                    };
+                    device.signatures = @{
+                                          userId: @{
+                                                  signKeyId: [olmDevice signJSON:device.signalableJSONDictionary]
+                                                  }
+                                          };
+
+                    [response.deviceKeys setObject:device forUser:userId andDevice:deviceId];
+                }
+            }
+
+            return response;
+        };
+
+        __block NSUInteger iteration = 0;
+        [self measureMetrics:@[XCTPerformanceMetric_WallClockTime] automaticallyStartMeasuring:NO forBlock:^{
+
+            // Use new users at each iteration so that all devices must be stored
+            NSMutableArray<NSString*> *userIds = [NSMutableArray array];
+            MXKeysQueryResponse *response = keysQueryResponse([NSString stringWithFormat:@"user%tu_", iteration++], userIds);
+
+            [self startMeasuring];
+            NSDictionary *updatedUsersDevices = [pool handleKeysQueryResponse:response forUsers:userIds];
+            [self stopMeasuring];
+
+            XCTAssertEqual(updatedUsersDevices.count, 1000);
+            XCTAssertEqual([aliceSession.crypto.store devicesForUser:userIds.lastObject].count, 2);
+
+            // The same response must not lead to any change
+            updatedUsersDevices = [pool handleKeysQueryResponse:response forUsers:userIds];
+            XCTAssertEqual(updatedUsersDevices.count, 0);
+        }];
+
+        [expectation fulfill];
+    }];
+}
+
+
 #pragma mark - MXRoom
 - (void)testRoomIsEncrypted
 {
@@ -1702,6 +1776,296 @@
     }];
 }
 
+- (void)testDecryptEventsAsynchronously
+{
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoom:self cryptedBob:YES warnOnUnknowDevices:NO readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+        bobSessionToClose = bobSession;
+
+        NSString *messageFromAlice = @"Hello I'm Alice!";
+
+        MXRoom *roomFromBobPOV = [bobSession roomWithRoomId:roomId];
+        MXRoom *roomFromAlicePOV = [aliceSession roomWithRoomId:roomId];
+
+        [roomFromBobPOV liveTimeline:^(MXEventTimeline *liveTimeline) {
+            [liveTimeline listenToEventsOfTypes:@[kMXEventTypeStringRoomMessage] onEvent:^(MXEvent *event, MXTimelineDirection direction, MXRoomState *roomState) {
+
+                // Decrypt the event again, asynchronously
+                [event setClearData:nil];
+                XCTAssertEqual(event.eventType, MXEventTypeRoomEncrypted);
+
+                [bobSession decryptEvents:@[event] inTimeline:nil onComplete:^(NSArray<MXEvent *> *failedEvents) {
+
+                    XCTAssertTrue([NSThread isMainThread]);
+                    XCTAssertEqual(failedEvents.count, 0);
+                    XCTAssertEqual(0, [self checkEncryptedEvent:event roomId:roomId clearMessage:messageFromAlice senderSession:aliceSession]);
+
+                    // Replay attacks must still be detected
+                    [event setClearData:nil];
+                    [bobSession decryptEvents:@[event] inTimeline:liveTimeline.timelineId onComplete:^(NSArray<MXEvent *> *failedEvents) {
+
+                        XCTAssertEqual(failedEvents.count, 1);
+                        XCTAssertEqual(event.decryptionError.code, MXDecryptingErrorDuplicateMessageIndexCode);
+                        XCTAssertNil(event.clearEvent);
+
+                        [expectation fulfill];
+                    }];
+                }];
+            }];
+        }];
+
+        [roomFromAlicePOV sendTextMessage:messageFromAlice success:nil failure:^(NSError *error) {
+            XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+            [expectation fulfill];
+        }];
+    }];
+}
+
+- (void)testDecryptSyncResponsesInBackground
+{
+    [MXSDKOptions sharedInstance].decryptSyncResponsesInBackground = YES;
+
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoom:self cryptedBob:YES warnOnUnknowDevices:NO readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+        bobSessionToClose = bobSession;
+
+        NSString *messageFromAlice = @"Hello I'm Alice!";
+
+        MXRoom *roomFromBobPOV = [bobSession roomWithRoomId:roomId];
+        MXRoom *roomFromAlicePOV = [aliceSession roomWithRoomId:roomId];
+
+        [roomFromBobPOV liveTimeline:^(MXEventTimeline *liveTimeline) {
+            [liveTimeline listenToEventsOfTypes:@[kMXEventTypeStringRoomMessage] onEvent:^(MXEvent *event, MXTimelineDirection direction, MXRoomState *roomState) {
+
+                XCTAssertEqual(0, [self checkEncryptedEvent:event roomId:roomId clearMessage:messageFromAlice senderSession:aliceSession]);
+
+                // The event has been decrypted with the live timeline id
+                [event setClearData:nil];
+                XCTAssertFalse([bobSession decryptEvent:event inTimeline:liveTimeline.timelineId]);
+                XCTAssertEqual(event.decryptionError.code, MXDecryptingErrorDuplicateMessageIndexCode);
+
+                [expectation fulfill];
+            }];
+        }];
+
+        [roomFromAlicePOV sendTextMessage:messageFromAlice success:nil failure:^(NSError *error) {
+            XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+            [expectation fulfill];
+        }];
+    }];
+}
+
+// Pause and resume bob while the /sync response with the room key is handled.
+// The response must be fully handled and not be received again
+- (void)testPauseWhileDecryptingSyncResponseInBackground
+{
+    [MXSDKOptions sharedInstance].decryptSyncResponsesInBackground = YES;
+
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoom:self cryptedBob:YES warnOnUnknowDevices:NO readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+        bobSessionToClose = bobSession;
+
+        NSString *messageFromAlice = @"Hello I'm Alice!";
+
+        MXRoom *roomFromBobPOV = [bobSession roomWithRoomId:roomId];
+        MXRoom *roomFromAlicePOV = [aliceSession roomWithRoomId:roomId];
+
+        __block BOOL paused = NO;
+        __block BOOL resumed = NO;
+        __block BOOL messageReceived = NO;
+
+        void (^checkDone)(void) = ^{
+            if (resumed && messageReceived)
+            {
+                [expectation fulfill];
+            }
+        };
+
+        observer = [[NSNotificationCenter defaultCenter] addObserverForName:nil object:bobSession queue:nil usingBlock:^(NSNotification *notif) {
+
+            if ([notif.name isEqualToString:kMXSessionOnToDeviceEventNotification] && !paused)
+            {
+                paused = YES;
+
+                [bobSession pause];
+                XCTAssertEqual(bobSession.state, MXSessionStatePaused);
+
+                [bobSession resume:^{
+
+                    // Let the sync notification of the resumed session be posted
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        resumed = YES;
+                        checkDone();
+                    });
+                }];
+            }
+            else if ([notif.name isEqualToString:kMXSessionDidSyncNotification] && paused)
+            {
+                // The room key must not be received again
+                MXSyncResponse *syncResponse = notif.userInfo[kMXSessionNotificationSyncResponseKey];
+                for (MXEvent *toDeviceEvent in syncResponse.toDevice.events)
+                {
+                    XCTAssertNotEqualObjects(toDeviceEvent.sender, aliceSession.myUser.userId);
+                }
+            }
+        }];
+
+        [roomFromBobPOV liveTimeline:^(MXEventTimeline *liveTimeline) {
+            [liveTimeline listenToEventsOfTypes:@[kMXEventTypeStringRoomMessage] onEvent:^(MXEvent *event, MXTimelineDirection direction, MXRoomState *roomState) {
+
+                XCTAssertEqual(0, [self checkEncryptedEvent:event roomId:roomId clearMessage:messageFromAlice senderSession:aliceSession]);
+                messageReceived = YES;
+                checkDone();
+            }];
+        }];
+
+        [roomFromAlicePOV sendTextMessage:messageFromAlice success:nil failure:^(NSError *error) {
+            XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+            [expectation fulfill];
+        }];
+    }];
+}
+
+// Check that the in-memory index of olm sessions of MXOlmDevice matches the store
+- (void)testOlmSessionsIndex
+{
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoomWithCryptedMessages:self cryptedBob:YES readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+        bobSessionToClose = bobSession;
+
+        NSString *bobDeviceKey = bobSession.crypto.olmDevice.deviceCurve25519Key;
+        NSArray<MXOlmSession*> *storedSessions = [aliceSession.crypto.store sessionsWithDevice:bobDeviceKey];
+        XCTAssertGreaterThan(storedSessions.count, 0);
+
+        NSMutableArray<NSString*> *storedSessionIds = [NSMutableArray array];
+        for (MXOlmSession *session in storedSessions)
+        {
+            [storedSessionIds addObject:session.session.sessionIdentifier];
+        }
+
+        XCTAssertEqualObjects([aliceSession.crypto.olmDevice sessionIdsForDevice:bobDeviceKey], storedSessionIds);
+        XCTAssertEqualObjects([aliceSession.crypto.olmDevice sessionIdForDevice:bobDeviceKey], storedSessionIds.firstObject);
+
+        // Encrypting must use and persist the indexed session
+        NSString *sessionId = storedSessionIds.firstObject;
+        NSDictionary *message = [aliceSession.crypto.olmDevice encryptMessage:bobDeviceKey sessionId:sessionId payloadString:@"payload"];
+        XCTAssertNotNil(message[@"body"]);
+
+        XCTAssertEqualObjects([aliceSession.crypto.olmDevice sessionIdForDevice:bobDeviceKey], sessionId);
+
+        [expectation fulfill];
+    }];
+}
+
+// Check that decrypting several messages from the same megolm session does not unpickle it again
+// - Alice and Bob are in an e2e room
+// - Alice sends a message
+// - Bob decrypts it once more
+// -> The inbound group session must come from the cache
+// -> It must not need to be saved again
+- (void)testInboundGroupSessionsCache
+{
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoom:self cryptedBob:YES warnOnUnknowDevices:NO readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        aliceSessionToClose = aliceSession;
+        bobSessionToClose = bobSession;
+
+        NSString *messageFromAlice = @"Hello I'm Alice!";
+
+        MXRoom *roomFromBobPOV = [bobSession roomWithRoomId:roomId];
+        MXRoom *roomFromAlicePOV = [aliceSession roomWithRoomId:roomId];
+
+        [roomFromBobPOV liveTimeline:^(MXEventTimeline *liveTimeline) {
+            [liveTimeline listenToEventsOfTypes:@[kMXEventTypeStringRoomMessage] onEvent:^(MXEvent *event, MXTimelineDirection direction, MXRoomState *roomState) {
+
+                MXRealmCryptoStore *bobCryptoStore = (MXRealmCryptoStore*)bobSession.crypto.store;
+                XCTAssert([bobCryptoStore isKindOfClass:MXRealmCryptoStore.class]);
+
+                NSUInteger hitCount = bobCryptoStore.inboundGroupSessionsCacheHitCount;
+                NSUInteger missCount = bobCryptoStore.inboundGroupSessionsCacheMissCount;
+
+                [event setClearData:nil];
+                XCTAssertTrue([bobSession decryptEvent:event inTimeline:nil]);
+                XCTAssertEqual(0, [self checkEncryptedEvent:event roomId:roomId clearMessage:messageFromAlice senderSession:aliceSession]);
+
+                XCTAssertGreaterThan(bobCryptoStore.inboundGroupSessionsCacheHitCount, hitCount);
+                XCTAssertEqual(bobCryptoStore.inboundGroupSessionsCacheMissCount, missCount);
+
+                // The decryption must not leave changes to persist
+                MXOlmInboundGroupSession *session = [bobCryptoStore inboundGroupSessionWithId:event.wireContent[@"session_id"] andSenderKey:event.wireContent[@"sender_key"]];
+                XCTAssertNotNil(session);
+                XCTAssertFalse(session.isDirty);
+
+                [expectation fulfill];
+            }];
+        }];
+
+        [roomFromAlicePOV sendTextMessage:messageFromAlice success:nil failure:^(NSError *error) {
+            XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+            [expectation fulfill];
+        }];
+    }];
+}
+
+// Check that the megolm outbound session is resumed after a restart
+// - Alice and Bob are in an e2e room with messages
+// - Alice restarts her session
+// - Alice sends a new message
+// -> It must be encrypted with the same megolm session as before
+- (void)testMegolmOutboundSessionResumedAfterRestart
+{
+    [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoomWithCryptedMessages:self cryptedBob:YES readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
+
+        MXOlmOutboundGroupSession *outboundSession = [aliceSession.crypto.store outboundGroupSessionWithRoomId:roomId];
+        XCTAssertNotNil(outboundSession);
+        XCTAssertGreaterThan(outboundSession.useCount, 0);
+        XCTAssertGreaterThan(outboundSession.sharedWithDevices.count, 0);
+
+        MXRestClient *aliceRestClient = aliceSession.matrixRestClient;
+        [aliceSession close];
+
+        MXSession *aliceSession2 = [[MXSession alloc] initWithMatrixRestClient:aliceRestClient];
+
+        aliceSessionToClose = aliceSession2;
+        bobSessionToClose = bobSession;
+
+        [aliceSession2 setStore:[[MXMemoryStore alloc] init] success:^{
+            [aliceSession2 start:^{
+
+                MXRoom *roomFromAlicePOV = [aliceSession2 roomWithRoomId:roomId];
+                [roomFromAlicePOV liveTimeline:^(MXEventTimeline *liveTimeline) {
+                    [liveTimeline listenToEventsOfTypes:@[kMXEventTypeStringRoomMessage] onEvent:^(MXEvent *event, MXTimelineDirection direction, MXRoomState *roomState) {
+
+                        XCTAssertEqualObjects(event.wireContent[@"session_id"], outboundSession.sessionId);
+
+                        MXOlmOutboundGroupSession *outboundSession2 = [aliceSession2.crypto.store outboundGroupSessionWithRoomId:roomId];
+                        XCTAssertEqualObjects(outboundSession2.sessionId, outboundSession.sessionId);
+                        XCTAssertEqual(outboundSession2.useCount, outboundSession.useCount + 1);
+
+                        [expectation fulfill];
+                    }];
+
+                    [roomFromAlicePOV sendTextMessage:@"Hello again" success:nil failure:^(NSError *error) {
+                        XCTFail(@"The request should not fail - NSError: %@", error);
+                        [expectation fulfill];
+                    }];
+                }];
+
+            } failure:^(NSError *error) {
+                XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+                [expectation fulfill];
+            }];
+        } failure:^(NSError *error) {
+            XCTFail(@"Cannot set up intial test conditions - error: %@", error);
+            [expectation fulfill];
+        }];
+    }];
+}
+
 - (void)testRoomKeyReshare
 {
     [matrixSDKTestsE2EData doE2ETestWithAliceAndBobInARoom:self cryptedBob:YES warnOnUnknowDevices:NO readyToTest:^(MXSession *aliceSession, MXSession *bobSession, NSString *roomId, XCTestExpectation *expectation) {
@@ -1828,6 +2192,14 @@
     }];
 }
 
+// Make the stored megolm outbound session of a room too old to be resumed after a restart
+- (void)expireOutboundGroupSessionInRoom:(NSString*)roomId ofSession:(MXSession*)session
+{
+    MXOlmOutboundGroupSession *outboundSession = [session.crypto.store outboundGroupSessionWithRoomId:roomId];
+    outboundSession.creationTime = 0;
+    [session.crypto.store storeOutboundGroupSession:outboundSession];
+}
+
 // Test the restart of broken Olm sessions (https://github.com/vector-im/riot-ios/issues/2129)
 // Inspired from https://github.com/poljar/matrix-nio/blob/0.7.1/tests/encryption_test.py#L872
 //
@@ -1857,8 +2229,9 @@
             MXOlmSession *olmSession = [aliceSession.crypto.store sessionsWithDevice:bobSession.crypto.deviceCurve25519Key].firstObject;
             
             // Relaunch Alice
-            // This forces her to use a new megolm session for sending message "11"
+            // Expire her megolm session so that she uses a new one for sending message "11"
             // This will move the olm session ratchet to share this new megolm session
+            [self expireOutboundGroupSessionInRoom:roomId ofSession:aliceSession];
             MXSession *aliceSession1 = [[MXSession alloc] initWithMatrixRestClient:aliceSession.matrixRestClient];
             [aliceSession close];
             [aliceSession1 setStore:[[MXFileStore alloc] init] success:^{
@@ -1872,6 +2245,7 @@
                         
                         // - Simulate Alice using a backup of her OS and make her crypto state like after the first message
                         // Relaunch again alice
+                        [self expireOutboundGroupSessionInRoom:roomId ofSession:aliceSession1];
                         MXSession *aliceSession2 = [[MXSession alloc] initWithMatrixRestClient:aliceSession1.matrixRestClient];
                         [aliceSession1 close];
                         [aliceSession2 setStore:[[MXFileStore alloc] init] success:^{
@@ -0,0 +1,158 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXCryptoTools.h"
+#import "NSObject+sortedKeys.h"
+
+@interface MXCryptoToolsTests : XCTestCase
+
+@end
+
+@implementation MXCryptoToolsTests
+
+- (void)checkCanonicalJSON:(NSString*)JSONString expected:(NSString*)expected
+{
+    NSDictionary *JSONDictionary = [NSJSONSerialization JSONObjectWithData:[JSONString dataUsingEncoding:NSUTF8StringEncoding] options:0 error:nil];
+    XCTAssertNotNil(JSONDictionary, @"%@", JSONString);
+
+    XCTAssertEqualObjects([MXCryptoTools canonicalJSONStringForJSON:JSONDictionary], expected);
+    XCTAssertEqualObjects([MXCryptoTools canonicalJSONDataForJSON:JSONDictionary], [expected dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+// Test vectors from https://matrix.org/docs/spec/appendices#canonical-json
+- (void)testSpecVectors
+{
+    [self checkCanonicalJSON:@"{}" expected:@"{}"];
+
+    [self checkCanonicalJSON:@"{\"one\": 1, \"two\": \"Two\"}"
+                    expected:@"{\"one\":1,\"two\":\"Two\"}"];
+
+    [self checkCanonicalJSON:@"{\"b\": \"2\", \"a\": \"1\"}"
+                    expected:@"{\"a\":\"1\",\"b\":\"2\"}"];
+
+    [self checkCanonicalJSON:@"{\"b\":\"2\",\"a\":\"1\"}"
+                    expected:@"{\"a\":\"1\",\"b\":\"2\"}"];
+
+    [self checkCanonicalJSON:@"{\"auth\": {\"success\": true, \"mxid\": \"@john.doe:example.com\", \"profile\": {\"display_name\": \"John Doe\", \"three_pids\": [{\"medium\": \"email\", \"address\": \"john.doe@example.org\"}, {\"medium\": \"msisdn\", \"address\": \"123456789\"}]}}}"
+                    expected:@"{\"auth\":{\"mxid\":\"@john.doe:example.com\",\"profile\":{\"display_name\":\"John Doe\",\"three_pids\":[{\"address\":\"john.doe@example.org\",\"medium\":\"email\"},{\"address\":\"123456789\",\"medium\":\"msisdn\"}]},\"success\":true}}"];
+
+    [self checkCanonicalJSON:@"{\"a\": \"日本語\"}"
+                    expected:@"{\"a\":\"日本語\"}"];
+
+    [self checkCanonicalJSON:@"{\"本\": 2, \"日\": 1}"
+                    expected:@"{\"日\":1,\"本\":2}"];
+
+    [self checkCanonicalJSON:@"{\"a\": \"\\u65E5\"}"
+                    expected:@"{\"a\":\"日\"}"];
+
+    [self checkCanonicalJSON:@"{\"a\": null}"
+                    expected:@"{\"a\":null}"];
+}
+
+- (void)testEscaping
+{
+    // '/' is not escaped. '"', '\' and control characters are
+    [self checkCanonicalJSON:@"{\"a\": \"a/b \\\" \\\\ \\n\\t\\r\\b\\f \\u0001\\u001f\"}"
+                    expected:@"{\"a\":\"a/b \\\" \\\\ \\n\\t\\r\\b\\f \\u0001\\u001f\"}"];
+}
+
+- (void)testValues
+{
+    NSDictionary *JSONDictionary = @{
+                                     @"false": @NO,
+                                     @"negative": @(-42),
+                                     @"big": @(9007199254740991),
+                                     @"array": @[@1, [NSNull null], @{@"b": @"", @"a": @[]}],
+                                     @"emoji": @"😀"
+                                     };
+
+    XCTAssertEqualObjects([MXCryptoTools canonicalJSONStringForJSON:JSONDictionary],
+                          @"{\"array\":[1,null,{\"a\":[],\"b\":\"\"}],\"big\":9007199254740991,\"emoji\":\"😀\",\"false\":false,\"negative\":-42}");
+}
+
+- (void)testKeysSortedByCodePoint
+{
+    // U+FF61 is before U+1F600 in code point order but after it in UTF-16
+    NSDictionary *JSONDictionary = @{
+                                     @"😀": @1,
+                                     @"｡": @2
+                                     };
+
+    XCTAssertEqualObjects([MXCryptoTools canonicalJSONStringForJSON:JSONDictionary], @"{\"｡\":2,\"😀\":1}");
+}
+
+- (void)testInvalidJSON
+{
+    XCTAssertNil([MXCryptoTools canonicalJSONStringForJSON:@{@"date": [NSDate date]}]);
+    XCTAssertNil([MXCryptoTools canonicalJSONDataForJSON:@{@1: @"not a string key"}]);
+}
+
+
+#pragma mark - Benchmarks
+
+- (NSDictionary*)benchmarkJSON
+{
+    NSMutableDictionary *devices = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < 50; i++)
+    {
+        NSString *deviceId = [NSString stringWithFormat:@"DEVICE%tu", i];
+        devices[deviceId] = @{
+                              @"user_id": @"@alice:matrix.org",
+                              @"device_id": deviceId,
+                              @"algorithms": @[@"m.olm.v1.curve25519-aes-sha2", @"m.megolm.v1.aes-sha2"],
+                              @"keys": @{
+                                      [NSString stringWithFormat:@"curve25519:%@", deviceId]: @"3MnyJBy/oNbfmGjDtFrVJNTxWeYgp5AKBl9l7PPpzWQ",
+                                      [NSString stringWithFormat:@"ed25519:%@", deviceId]: @"FIM5ZnL0tCgzN1Uxq6JomYJ/Hz9CUNIUtXyCzRfyTPs"
+                                      },
+                              @"unsigned": @{
+                                      @"device_display_name": @"Alice's \"phone\" 📱"
+                                      }
+                              };
+    }
+    return devices;
+}
+
+- (void)testCanonicalJSONPerformance
+{
+    NSDictionary *JSONDictionary = [self benchmarkJSON];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++)
+        {
+            XCTAssertNotNil([MXCryptoTools canonicalJSONDataForJSON:JSONDictionary]);
+        }
+    }];
+}
+
+// The reference: the previous implementation based on NSJSONSerialization and CbxSortedKeyWrapper
+- (void)testSortedKeysJSONSerializationPerformance
+{
+    NSDictionary *JSONDictionary = [self benchmarkJSON];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++)
+        {
+            NSData *data = [NSJSONSerialization dataWithJSONObject:[JSONDictionary objectWithSortedKeys] options:0 error:nil];
+            NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+            string = [string stringByReplacingOccurrencesOfString:@"\\/" withString:@"/"];
+            XCTAssertNotNil([string dataUsingEncoding:NSUTF8StringEncoding]);
+        }
+    }];
+}
+
+@end
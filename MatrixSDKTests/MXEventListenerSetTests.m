@@ -0,0 +1,131 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXEventListenerSet.h"
+
+@interface MXEventListenerSetTests : XCTestCase
+@end
+
+@implementation MXEventListenerSetTests
+
+- (MXEvent*)eventOfType:(MXEventTypeString)type
+{
+    return [MXEvent modelFromJSON:@{
+                                    @"type": type,
+                                    @"event_id": @"$anId",
+                                    @"room_id": @"!room:matrix.org",
+                                    @"sender": @"@alice:matrix.org",
+                                    @"content": @{}
+                                    }];
+}
+
+- (MXEventListener*)listenerOfTypes:(NSArray<MXEventTypeString>*)types name:(NSString*)name calls:(NSMutableArray<NSString*>*)calls
+{
+    return [[MXEventListener alloc] initWithSender:self andEventTypes:types andListenerBlock:^(MXEvent *event, MXTimelineDirection direction, id customObject) {
+        [calls addObject:name];
+    }];
+}
+
+- (void)testDispatchByEventType
+{
+    NSMutableArray<NSString*> *calls = [NSMutableArray array];
+    MXEventListenerSet *listenerSet = [[MXEventListenerSet alloc] init];
+
+    [listenerSet addListener:[self listenerOfTypes:@[kMXEventTypeStringRoomMessage] name:@"message" calls:calls]];
+    [listenerSet addListener:[self listenerOfTypes:nil name:@"all" calls:calls]];
+    [listenerSet addListener:[self listenerOfTypes:@[kMXEventTypeStringRoomMember, kMXEventTypeStringRoomMessage, kMXEventTypeStringRoomMessage] name:@"member-message" calls:calls]];
+    [listenerSet addListener:[self listenerOfTypes:@[kMXEventTypeStringRoomMember] name:@"member" calls:calls]];
+
+    [listenerSet notifyListeners:[self eventOfType:kMXEventTypeStringRoomMessage] direction:MXTimelineDirectionForwards customObject:nil];
+    XCTAssertEqualObjects(calls, (@[@"message", @"all", @"member-message"]));
+
+    [calls removeAllObjects];
+    [listenerSet notifyListeners:[self eventOfType:kMXEventTypeStringRoomMember] direction:MXTimelineDirectionForwards customObject:nil];
+    XCTAssertEqualObjects(calls, (@[@"all", @"member-message", @"member"]));
+
+    [calls removeAllObjects];
+    [listenerSet notifyListeners:[self eventOfType:kMXEventTypeStringRoomTopic] direction:MXTimelineDirectionForwards customObject:nil];
+    XCTAssertEqualObjects(calls, (@[@"all"]));
+
+    XCTAssertEqual(listenerSet.listeners.count, 4);
+    [listenerSet removeAllListeners];
+    XCTAssertEqual(listenerSet.listeners.count, 0);
+}
+
+- (void)testUpdateWhileNotifying
+{
+    NSMutableArray<NSString*> *calls = [NSMutableArray array];
+    MXEventListenerSet *listenerSet = [[MXEventListenerSet alloc] init];
+
+    MXEventListener *second = [self listenerOfTypes:nil name:@"second" calls:calls];
+    MXEventListener *added = [self listenerOfTypes:nil name:@"added" calls:calls];
+
+    __weak MXEventListenerSet *weakListenerSet = listenerSet;
+    __block BOOL firstCall = YES;
+    MXEventListener *first = [[MXEventListener alloc] initWithSender:self andEventTypes:nil andListenerBlock:^(MXEvent *event, MXTimelineDirection direction, id customObject) {
+        [calls addObject:@"first"];
+        if (firstCall)
+        {
+            firstCall = NO;
+            [weakListenerSet removeListener:second];
+            [weakListenerSet addListener:added];
+        }
+    }];
+
+    [listenerSet addListener:first];
+    [listenerSet addListener:second];
+
+    // A removed listener is not called anymore. An added one is called from the next event
+    [listenerSet notifyListeners:[self eventOfType:kMXEventTypeStringRoomMessage] direction:MXTimelineDirectionForwards customObject:nil];
+    XCTAssertEqualObjects(calls, (@[@"first"]));
+
+    [calls removeAllObjects];
+    [listenerSet notifyListeners:[self eventOfType:kMXEventTypeStringRoomMessage] direction:MXTimelineDirectionForwards customObject:nil];
+    XCTAssertEqualObjects(calls, (@[@"first", @"added"]));
+}
+
+- (void)testNotifyPerformance
+{
+    MXEventListenerSet *listenerSet = [[MXEventListenerSet alloc] init];
+
+    // Like the listeners of the SDK and of an application
+    __block NSUInteger callsCount = 0;
+    NSArray<MXEventTypeString> *types = @[kMXEventTypeStringRoomMember, kMXEventTypeStringRoomTopic, kMXEventTypeStringRoomName, kMXEventTypeStringReaction, kMXEventTypeStringReceipt, kMXEventTypeStringTypingNotification];
+    for (NSUInteger i = 0; i < 60; i++)
+    {
+        NSArray *eventTypes = (i % 10) ? @[types[i % types.count]] : nil;
+        [listenerSet addListener:[[MXEventListener alloc] initWithSender:self andEventTypes:eventTypes andListenerBlock:^(MXEvent *event, MXTimelineDirection direction, id customObject) {
+            callsCount++;
+        }]];
+    }
+
+    MXEvent *event = [self eventOfType:kMXEventTypeStringRoomMessage];
+
+    [self measureBlock:^{
+        callsCount = 0;
+        for (NSUInteger i = 0; i < 100000; i++)
+        {
+            [listenerSet notifyListeners:event direction:MXTimelineDirectionForwards customObject:nil];
+        }
+
+        // Only the 6 listeners to all events are called
+        XCTAssertEqual(callsCount, 600000);
+    }];
+}
+
+@end
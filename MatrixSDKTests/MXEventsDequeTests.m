@@ -0,0 +1,149 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXEventsDeque.h"
+
+@interface MXEventsDequeTests : XCTestCase
+
+@end
+
+@implementation MXEventsDequeTests
+
+- (MXEvent*)eventWithId:(NSString*)eventId relatedTo:(NSString*)relatedEventId
+{
+    NSMutableDictionary *content = [NSMutableDictionary dictionaryWithDictionary:@{
+                                                                                    @"msgtype": kMXMessageTypeText,
+                                                                                    @"body": eventId
+                                                                                    }];
+    if (relatedEventId)
+    {
+        content[@"m.relates_to"] = @{
+                                     @"rel_type": MXEventRelationTypeReference,
+                                     @"event_id": relatedEventId
+                                     };
+    }
+
+    return [MXEvent modelFromJSON:@{
+                                    @"event_id": eventId,
+                                    @"room_id": @"!aRoomId:matrix.org",
+                                    @"sender": @"@alice:matrix.org",
+                                    @"type": kMXEventTypeStringRoomMessage,
+                                    @"origin_server_ts": @(1576000000000),
+                                    @"content": content
+                                    }];
+}
+
+- (void)testOrderAcrossChunks
+{
+    MXEventsDeque *deque = [[MXEventsDeque alloc] init];
+
+    // Go beyond a chunk size in both directions
+    for (NSUInteger i = 1000; i < 2000; i++)
+    {
+        [deque appendEvent:[self eventWithId:[NSString stringWithFormat:@"$%tu", i] relatedTo:nil]];
+    }
+    for (NSUInteger i = 999; i >= 500; i--)
+    {
+        [deque prependEvent:[self eventWithId:[NSString stringWithFormat:@"$%tu", i] relatedTo:nil]];
+    }
+
+    XCTAssertEqual(deque.count, 1500);
+
+    NSArray<MXEvent*> *events = deque.allEvents;
+    XCTAssertEqual(events.count, 1500);
+    for (NSUInteger i = 0; i < events.count; i++)
+    {
+        XCTAssertEqualObjects(events[i].eventId, ([NSString stringWithFormat:@"$%tu", 500 + i]));
+    }
+
+    XCTAssertEqualObjects([deque eventWithEventId:@"$500"].eventId, @"$500");
+    XCTAssertEqualObjects([deque eventWithEventId:@"$1999"].eventId, @"$1999");
+    XCTAssertNil([deque eventWithEventId:@"$2000"]);
+
+    NSMutableArray<NSString*> *eventIdsAfter = [NSMutableArray array];
+    [deque enumerateEventsAfter:@"$1996" usingBlock:^(MXEvent * _Nonnull event) {
+        [eventIdsAfter addObject:event.eventId];
+    }];
+    XCTAssertEqualObjects(eventIdsAfter, (@[@"$1997", @"$1998", @"$1999"]));
+
+    [deque removeAllEvents];
+    XCTAssertEqual(deque.count, 0);
+    XCTAssertNil([deque eventWithEventId:@"$500"]);
+}
+
+- (void)testReplaceAndRelations
+{
+    MXEventsDeque *deque = [[MXEventsDeque alloc] init];
+
+    [deque appendEvent:[self eventWithId:@"$root" relatedTo:nil]];
+    [deque appendEvent:[self eventWithId:@"$ref2" relatedTo:@"$root"]];
+    [deque prependEvent:[self eventWithId:@"$ref1" relatedTo:@"$root"]];
+
+    NSArray<MXEvent*> *relations = [deque eventsRelatedToEvent:@"$root"];
+    XCTAssertEqualObjects([relations valueForKey:@"eventId"], (@[@"$ref1", @"$ref2"]));
+
+    // A redacted event does not relate to anything anymore
+    MXEvent *redactedEvent = [[deque eventWithEventId:@"$ref2"] prune];
+    XCTAssertTrue([deque replaceEvent:redactedEvent]);
+    XCTAssertEqual([deque eventWithEventId:@"$ref2"], redactedEvent);
+
+    relations = [deque eventsRelatedToEvent:@"$root"];
+    XCTAssertEqualObjects([relations valueForKey:@"eventId"], (@[@"$ref1"]));
+
+    XCTAssertFalse([deque replaceEvent:[self eventWithId:@"$unknown" relatedTo:nil]]);
+}
+
+// allEvents is called by MXFileStore from another thread while events are added or removed
+- (void)testAllEventsWhileMutating
+{
+    MXEventsDeque *deque = [[MXEventsDeque alloc] init];
+
+    NSMutableArray<MXEvent*> *events = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 1000; i++)
+    {
+        [events addObject:[self eventWithId:[NSString stringWithFormat:@"$%tu", i] relatedTo:nil]];
+    }
+
+    __block BOOL done = NO;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"snapshots"];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        while (!done)
+        {
+            for (id event in deque.allEvents)
+            {
+                XCTAssertTrue([event isKindOfClass:MXEvent.class]);
+            }
+        }
+        [expectation fulfill];
+    });
+
+    for (NSUInteger round = 0; round < 20; round++)
+    {
+        // Prepending creates chunks and moves positions before setting the event
+        for (MXEvent *event in events)
+        {
+            [deque prependEvent:event];
+        }
+        [deque removeAllEvents];
+    }
+    done = YES;
+
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+@end
@@ -0,0 +1,270 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXMegolmEncryption.h"
+#import "MXUsersDevicesMap.h"
+
+#if 1 // MX_CRYPTO autamatic definiton does not work well for tests so force it
+//#ifdef MX_CRYPTO
+
+// Private methods of MXMegolmEncryption
+@interface MXMegolmEncryption (Testing)
+
+- (NSArray<MXUsersDevicesMap<NSDictionary*>*>*)splitToDeviceContentMap:(MXUsersDevicesMap<NSDictionary*>*)contentMap;
+
+- (void)sendToDeviceContentMap:(MXUsersDevicesMap<NSDictionary*>*)contentMap
+                     operation:(MXHTTPOperation*)operation
+                   onChunkSent:(void (^)(MXUsersDevicesMap<NSDictionary*> *chunk))onChunkSent
+                    onComplete:(void (^)(NSError *error))onComplete;
+
+@end
+
+
+/**
+ MXMegolmEncryption with its /sendToDevice requests intercepted.
+ */
+@interface MXMegolmEncryptionWithMockedRequests : MXMegolmEncryption
+
+// Chunks requested so far
+@property (nonatomic) NSMutableArray<MXUsersDevicesMap<NSDictionary*>*> *requestedChunks;
+
+// The operations of the requests
+@property (nonatomic) NSMutableArray<MXHTTPOperation*> *requestOperations;
+
+// The index of the request to fail. NSNotFound for none
+@property (nonatomic) NSUInteger failingRequestIndex;
+
+// NO to leave requests pending
+@property (nonatomic) BOOL completeRequests;
+
+@end
+
+@implementation MXMegolmEncryptionWithMockedRequests
+
+- (MXHTTPOperation*)sendToDeviceChunk:(MXUsersDevicesMap<NSDictionary*>*)chunk
+                              success:(void (^)(void))success
+                              failure:(void (^)(NSError *error))failure
+{
+    NSUInteger requestIndex = _requestedChunks.count;
+    [_requestedChunks addObject:chunk];
+
+    MXHTTPOperation *operation = [[MXHTTPOperation alloc] init];
+    [_requestOperations addObject:operation];
+
+    if (_completeRequests)
+    {
+        // Like real requests, complete asynchronously
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (requestIndex == self.failingRequestIndex)
+            {
+                failure([NSError errorWithDomain:@"MXMegolmEncryptionTests" code:0 userInfo:nil]);
+            }
+            else
+            {
+                success();
+            }
+        });
+    }
+
+    return operation;
+}
+
+@end
+
+
+@interface MXMegolmEncryptionTests : XCTestCase
+
+@end
+
+@implementation MXMegolmEncryptionTests
+
+- (MXMegolmEncryptionWithMockedRequests*)encryption
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [[MXMegolmEncryptionWithMockedRequests alloc] initWithCrypto:nil andRoom:@"!room:matrix.org"];
+    encryption.requestedChunks = [NSMutableArray array];
+    encryption.requestOperations = [NSMutableArray array];
+    encryption.failingRequestIndex = NSNotFound;
+    encryption.completeRequests = YES;
+    return encryption;
+}
+
+- (MXHTTPOperation*)shareKeyOperation
+{
+    return [[NSClassFromString(@"MXMegolmShareKeyOperation") alloc] init];
+}
+
+// A content map of `devicesCount` devices whose olm ciphertext is `bodyLength` long
+- (MXUsersDevicesMap<NSDictionary*>*)contentMapWithDevicesCount:(NSUInteger)devicesCount bodyLength:(NSUInteger)bodyLength
+{
+    NSString *body = [@"" stringByPaddingToLength:bodyLength withString:@"a" startingAtIndex:0];
+
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [[MXUsersDevicesMap alloc] init];
+    for (NSUInteger i = 0; i < devicesCount; i++)
+    {
+        NSDictionary *content = @{
+                                  @"algorithm": @"m.olm.v1.curve25519-aes-sha2",
+                                  @"ciphertext": @{
+                                          @"identityKey": @{
+                                                  @"type": @(0),
+                                                  @"body": body
+                                                  }
+                                          }
+                                  };
+        [contentMap setObject:content forUser:[NSString stringWithFormat:@"@user%@:matrix.org", @(i / 2)] andDevice:[NSString stringWithFormat:@"DEVICE%@", @(i)]];
+    }
+    return contentMap;
+}
+
+- (void)testSplitToDeviceContentMapInOneChunk
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:10 bodyLength:1000];
+
+    NSArray<MXUsersDevicesMap<NSDictionary*>*> *chunks = [encryption splitToDeviceContentMap:contentMap];
+
+    XCTAssertEqual(chunks.count, 1);
+    XCTAssertEqual(chunks.firstObject.count, 10);
+}
+
+- (void)testSplitToDeviceContentMapChunkBoundaries
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+
+    // A chunk is bounded to 100kB. About 20 devices fit in a chunk with 5kB ciphertexts
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:100 bodyLength:5000];
+
+    NSArray<MXUsersDevicesMap<NSDictionary*>*> *chunks = [encryption splitToDeviceContentMap:contentMap];
+
+    XCTAssertEqual(chunks.count, 6);
+
+    NSUInteger devicesCount = 0;
+    NSMutableSet<NSString*> *deviceIds = [NSMutableSet set];
+    for (MXUsersDevicesMap<NSDictionary*> *chunk in chunks)
+    {
+        XCTAssertGreaterThan(chunk.count, 0);
+        XCTAssertLessThanOrEqual(chunk.count * 5000, 100 * 1024);
+
+        devicesCount += chunk.count;
+        for (NSString *userId in chunk.userIds)
+        {
+            for (NSString *deviceId in [chunk deviceIdsForUser:userId])
+            {
+                XCTAssertNotNil([contentMap objectForDevice:deviceId forUser:userId]);
+                [deviceIds addObject:deviceId];
+            }
+        }
+    }
+
+    // Every device is in exactly one chunk
+    XCTAssertEqual(devicesCount, 100);
+    XCTAssertEqual(deviceIds.count, 100);
+}
+
+- (void)testSplitToDeviceContentMapWithOversizedContent
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+
+    // A content bigger than the chunk limit still gets its own chunk
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:2 bodyLength:200 * 1024];
+
+    NSArray<MXUsersDevicesMap<NSDictionary*>*> *chunks = [encryption splitToDeviceContentMap:contentMap];
+
+    XCTAssertEqual(chunks.count, 2);
+    XCTAssertEqual(chunks[0].count, 1);
+    XCTAssertEqual(chunks[1].count, 1);
+}
+
+- (void)testSendToDeviceContentMap
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:100 bodyLength:5000];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"complete"];
+    __block NSUInteger sentDevicesCount = 0;
+    [encryption sendToDeviceContentMap:contentMap operation:[self shareKeyOperation] onChunkSent:^(MXUsersDevicesMap<NSDictionary *> *chunk) {
+        sentDevicesCount += chunk.count;
+    } onComplete:^(NSError *error) {
+
+        XCTAssertNil(error);
+        XCTAssertEqual(encryption.requestedChunks.count, 6);
+        XCTAssertEqual(sentDevicesCount, 100);
+
+        [expectation fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+- (void)testSendToDeviceContentMapWithOneChunkFailing
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:100 bodyLength:5000];
+
+    // The 3 lanes start with the 3 first chunks. Make the second one fail
+    encryption.failingRequestIndex = 1;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"complete"];
+    NSMutableArray<MXUsersDevicesMap<NSDictionary*>*> *sentChunks = [NSMutableArray array];
+    [encryption sendToDeviceContentMap:contentMap operation:[self shareKeyOperation] onChunkSent:^(MXUsersDevicesMap<NSDictionary *> *chunk) {
+        [sentChunks addObject:chunk];
+    } onComplete:^(NSError *error) {
+
+        XCTAssertNotNil(error);
+
+        // The first lane has sent its second chunk before the failure. Then, lanes stop
+        // but chunks sent by other lanes are still reported
+        XCTAssertEqual(encryption.requestedChunks.count, 4);
+        XCTAssertEqual(sentChunks.count, 3);
+        XCTAssertTrue([sentChunks containsObject:encryption.requestedChunks[0]]);
+        XCTAssertFalse([sentChunks containsObject:encryption.requestedChunks[1]]);
+        XCTAssertTrue([sentChunks containsObject:encryption.requestedChunks[2]]);
+        XCTAssertTrue([sentChunks containsObject:encryption.requestedChunks[3]]);
+
+        [expectation fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+- (void)testCancelSendToDeviceContentMap
+{
+    MXMegolmEncryptionWithMockedRequests *encryption = [self encryption];
+    MXUsersDevicesMap<NSDictionary*> *contentMap = [self contentMapWithDevicesCount:100 bodyLength:5000];
+    encryption.completeRequests = NO;
+
+    MXHTTPOperation *operation = [self shareKeyOperation];
+    [encryption sendToDeviceContentMap:contentMap operation:operation onChunkSent:^(MXUsersDevicesMap<NSDictionary *> *chunk) {
+        XCTFail(@"No chunk must be sent");
+    } onComplete:^(NSError *error) {
+        XCTFail(@"Requests are pending");
+    }];
+
+    XCTAssertEqual(encryption.requestOperations.count, 3);
+
+    [operation cancel];
+
+    // The request of every lane is cancelled
+    for (MXHTTPOperation *requestOperation in encryption.requestOperations)
+    {
+        XCTAssertTrue(requestOperation.isCancelled);
+    }
+}
+
+@end
+
+#endif
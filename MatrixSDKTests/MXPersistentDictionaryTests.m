@@ -0,0 +1,185 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXPersistentDictionary.h"
+
+/**
+ A key with a chosen hash to create hash collisions.
+ */
+@interface MXPersistentDictionaryTestsKey : NSObject <NSCopying>
+@property (nonatomic) NSString *name;
+@property (nonatomic) NSUInteger keyHash;
+@end
+
+@implementation MXPersistentDictionaryTestsKey
+
++ (instancetype)keyWithName:(NSString*)name hash:(NSUInteger)hash
+{
+    MXPersistentDictionaryTestsKey *key = [MXPersistentDictionaryTestsKey new];
+    key.name = name;
+    key.keyHash = hash;
+    return key;
+}
+
+- (NSUInteger)hash
+{
+    return _keyHash;
+}
+
+- (BOOL)isEqual:(id)object
+{
+    return [object isKindOfClass:MXPersistentDictionaryTestsKey.class] && [((MXPersistentDictionaryTestsKey*)object).name isEqualToString:_name];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+@end
+
+
+@interface MXPersistentDictionaryTests : XCTestCase
+
+@end
+
+@implementation MXPersistentDictionaryTests
+
+- (void)testSetAndRemove
+{
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary = [MXPersistentDictionary dictionary];
+    XCTAssertEqual(dictionary.count, 0);
+    XCTAssertNil(dictionary[@"a"]);
+
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary1 = [dictionary dictionaryBySettingObject:@1 forKey:@"a"];
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary2 = [dictionary1 dictionaryBySettingObject:@2 forKey:@"b"];
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary3 = [dictionary2 dictionaryBySettingObject:@3 forKey:@"a"];
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary4 = [dictionary3 dictionaryByRemovingObjectForKey:@"b"];
+
+    // Previous versions are unchanged
+    XCTAssertEqual(dictionary.count, 0);
+    XCTAssertEqual(dictionary1.count, 1);
+    XCTAssertEqualObjects(dictionary1[@"a"], @1);
+    XCTAssertNil(dictionary1[@"b"]);
+
+    XCTAssertEqual(dictionary2.count, 2);
+    XCTAssertEqualObjects(dictionary2[@"a"], @1);
+    XCTAssertEqualObjects(dictionary2[@"b"], @2);
+
+    XCTAssertEqual(dictionary3.count, 2);
+    XCTAssertEqualObjects(dictionary3[@"a"], @3);
+
+    XCTAssertEqual(dictionary4.count, 1);
+    XCTAssertEqualObjects(dictionary4[@"a"], @3);
+    XCTAssertNil(dictionary4[@"b"]);
+
+    // No-op updates return the same instance
+    XCTAssertEqual([dictionary4 dictionaryByRemovingObjectForKey:@"b"], dictionary4);
+    XCTAssertEqual([dictionary4 dictionaryBySettingObject:dictionary4[@"a"] forKey:@"a"], dictionary4);
+    XCTAssertEqual([dictionary4 copy], dictionary4);
+}
+
+- (void)testHashCollisions
+{
+    MXPersistentDictionaryTestsKey *key1 = [MXPersistentDictionaryTestsKey keyWithName:@"1" hash:42];
+    MXPersistentDictionaryTestsKey *key2 = [MXPersistentDictionaryTestsKey keyWithName:@"2" hash:42];
+    MXPersistentDictionaryTestsKey *key3 = [MXPersistentDictionaryTestsKey keyWithName:@"3" hash:42];
+    MXPersistentDictionaryTestsKey *key4 = [MXPersistentDictionaryTestsKey keyWithName:@"4" hash:42 + 32];
+
+    MXPersistentDictionary *dictionary = [MXPersistentDictionary dictionary];
+    dictionary = [dictionary dictionaryBySettingObject:@1 forKey:key1];
+    dictionary = [dictionary dictionaryBySettingObject:@2 forKey:key2];
+    dictionary = [dictionary dictionaryBySettingObject:@3 forKey:key3];
+    dictionary = [dictionary dictionaryBySettingObject:@4 forKey:key4];
+
+    XCTAssertEqual(dictionary.count, 4);
+    XCTAssertEqualObjects(dictionary[key1], @1);
+    XCTAssertEqualObjects(dictionary[key2], @2);
+    XCTAssertEqualObjects(dictionary[key3], @3);
+    XCTAssertEqualObjects(dictionary[key4], @4);
+    XCTAssertNil(dictionary[[MXPersistentDictionaryTestsKey keyWithName:@"5" hash:42]]);
+
+    dictionary = [dictionary dictionaryByRemovingObjectForKey:key2];
+    dictionary = [dictionary dictionaryByRemovingObjectForKey:key1];
+
+    XCTAssertEqual(dictionary.count, 2);
+    XCTAssertNil(dictionary[key1]);
+    XCTAssertNil(dictionary[key2]);
+    XCTAssertEqualObjects(dictionary[key3], @3);
+    XCTAssertEqualObjects(dictionary[key4], @4);
+
+    dictionary = [dictionary dictionaryByRemovingObjectForKey:key3];
+    dictionary = [dictionary dictionaryByRemovingObjectForKey:key4];
+    XCTAssertEqual(dictionary.count, 0);
+    XCTAssertEqual(dictionary.allKeys.count, 0);
+}
+
+// Compare random operations with NSMutableDictionary
+- (void)testRandomOperations
+{
+    NSMutableDictionary<NSString*, NSNumber*> *expected = [NSMutableDictionary dictionary];
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary = [MXPersistentDictionary dictionary];
+
+    srand48(42);
+    for (NSUInteger i = 0; i < 20000; i++)
+    {
+        NSString *key = [NSString stringWithFormat:@"@user%@:matrix.org", @(lrand48() % 3000)];
+        if (lrand48() % 3)
+        {
+            expected[key] = @(i);
+            dictionary = [dictionary dictionaryBySettingObject:@(i) forKey:key];
+        }
+        else
+        {
+            [expected removeObjectForKey:key];
+            dictionary = [dictionary dictionaryByRemovingObjectForKey:key];
+        }
+    }
+
+    XCTAssertEqual(dictionary.count, expected.count);
+    XCTAssertEqualObjects([NSSet setWithArray:dictionary.allKeys], [NSSet setWithArray:expected.allKeys]);
+
+    __block NSUInteger enumerated = 0;
+    [dictionary enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *object, BOOL *stop) {
+        XCTAssertEqualObjects(object, expected[key]);
+        enumerated++;
+    }];
+    XCTAssertEqual(enumerated, expected.count);
+}
+
+- (void)testUpdatePerformance
+{
+    MXPersistentDictionary<NSString*, NSNumber*> *dictionary = [MXPersistentDictionary dictionary];
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        dictionary = [dictionary dictionaryBySettingObject:@(i) forKey:[NSString stringWithFormat:@"@user%@:matrix.org", @(i)]];
+    }
+
+    // Like a room state cloned for each of 2000 membership events in a 10k members room
+    [self measureBlock:^{
+        MXPersistentDictionary<NSString*, NSNumber*> *state = dictionary;
+        for (NSUInteger i = 0; i < 2000; i++)
+        {
+            MXPersistentDictionary<NSString*, NSNumber*> *previousState = state;
+            state = [[previousState copy] dictionaryBySettingObject:@(i) forKey:[NSString stringWithFormat:@"@user%@:matrix.org", @(i * 5)]];
+        }
+        XCTAssertEqual(state.count, 10000);
+    }];
+}
+
+@end
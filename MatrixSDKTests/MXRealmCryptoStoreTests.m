@@ -0,0 +1,178 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import <Realm/Realm.h>
+#import <Realm/RLMRealm_Dynamic.h>
+
+#import "MXRealmCryptoStore.h"
+#import "MXDeviceList.h"
+
+#if 1 // MX_CRYPTO autamatic definiton does not work well for tests so force it
+//#ifdef MX_CRYPTO
+
+// Private methods of MXRealmCryptoStore
+@interface MXRealmCryptoStore (Testing)
+
+- (RLMRealm*)realm;
+
++ (NSDictionary<NSString*, NSNumber*>*)deviceTrackingStatusFromLegacyData:(NSData*)deviceTrackingStatusData;
+
+@end
+
+
+@interface MXRealmCryptoStoreTests : XCTestCase
+{
+    MXCredentials *credentials;
+}
+
+@end
+
+@implementation MXRealmCryptoStoreTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    credentials = [[MXCredentials alloc] initWithHomeServer:@"http://localhost:8008"
+                                                     userId:@"@mxrealmcryptostoretests:localhost"
+                                                accessToken:@"accessToken"];
+    credentials.deviceId = @"MXREALMCRYPTOSTORETESTS";
+
+    [MXRealmCryptoStore deleteStoreWithCredentials:credentials];
+}
+
+- (void)tearDown
+{
+    [MXRealmCryptoStore deleteStoreWithCredentials:credentials];
+    credentials = nil;
+
+    [super tearDown];
+}
+
+- (NSUInteger)deviceTrackingStatusRowsCountInStore:(MXRealmCryptoStore*)store
+{
+    return [store.realm allObjects:@"MXRealmDeviceTrackingStatus"].count;
+}
+
+- (NSInteger)deviceTrackingStatusRowOfUser:(NSString*)userId inStore:(MXRealmCryptoStore*)store
+{
+    RLMObject *row = [store.realm objects:@"MXRealmDeviceTrackingStatus" where:@"userId = %@", userId].firstObject;
+    return row ? [row[@"status"] integerValue] : NSNotFound;
+}
+
+// Check the decoding of MXRealmOlmAccount.deviceTrackingStatusData done by the
+// schema #13 -> #14 migration
+- (void)testDeviceTrackingStatusFromLegacyData
+{
+    NSDictionary<NSString*, NSNumber*> *statusMap = @{
+                                                      @"@alice:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                      @"@bob:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                                      @"@charlie:matrix.org": @(MXDeviceTrackingStatusNotTracked),
+                                                      };
+
+    // This is how schemas #5 to #13 stored it
+    NSData *deviceTrackingStatusData = [NSKeyedArchiver archivedDataWithRootObject:statusMap];
+
+    XCTAssertEqualObjects([MXRealmCryptoStore deviceTrackingStatusFromLegacyData:deviceTrackingStatusData], statusMap);
+
+    // An account without tracking status
+    XCTAssertNil([MXRealmCryptoStore deviceTrackingStatusFromLegacyData:nil]);
+
+    // A corrupted blob must not make the migration crash
+    NSData *corruptedData = [@"corrupted" dataUsingEncoding:NSUTF8StringEncoding];
+    XCTAssertNil([MXRealmCryptoStore deviceTrackingStatusFromLegacyData:corruptedData]);
+
+    // An archive of something else
+    XCTAssertNil([MXRealmCryptoStore deviceTrackingStatusFromLegacyData:[NSKeyedArchiver archivedDataWithRootObject:@[@"@alice:matrix.org"]]]);
+}
+
+- (void)testStoreDeviceTrackingStatus
+{
+    MXRealmCryptoStore *store = [MXRealmCryptoStore createStoreWithCredentials:credentials];
+    XCTAssertEqual(store.deviceTrackingStatus.count, 0);
+
+    NSDictionary<NSString*, NSNumber*> *statusMap = @{
+                                                      @"@alice:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                      @"@bob:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                                      };
+    [store storeDeviceTrackingStatus:statusMap];
+    XCTAssertEqualObjects(store.deviceTrackingStatus, statusMap);
+
+    // A full update replaces all rows
+    NSDictionary<NSString*, NSNumber*> *newStatusMap = @{
+                                                         @"@bob:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                         @"@charlie:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                                         };
+    [store storeDeviceTrackingStatus:newStatusMap];
+    XCTAssertEqualObjects(store.deviceTrackingStatus, newStatusMap);
+
+    // Reload the store
+    store = [[MXRealmCryptoStore alloc] initWithCredentials:credentials];
+
+    XCTAssertEqualObjects(store.deviceTrackingStatus, newStatusMap);
+    XCTAssertEqual([self deviceTrackingStatusRowsCountInStore:store], 2);
+}
+
+- (void)testStoreDeviceTrackingStatusOfUsers
+{
+    MXRealmCryptoStore *store = [MXRealmCryptoStore createStoreWithCredentials:credentials];
+
+    NSDictionary<NSString*, NSNumber*> *statusMap = @{
+                                                      @"@alice:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                      @"@bob:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                                      @"@charlie:matrix.org": @(MXDeviceTrackingStatusUnreachableServer),
+                                                      };
+    [store storeDeviceTrackingStatus:statusMap];
+
+    // Update bob and add dave
+    [store storeDeviceTrackingStatusOfUsers:@{
+                                              @"@bob:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                              @"@dave:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                              }];
+
+    NSDictionary<NSString*, NSNumber*> *expectedStatusMap = @{
+                                                              @"@alice:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                              @"@bob:matrix.org": @(MXDeviceTrackingStatusUpToDate),
+                                                              @"@charlie:matrix.org": @(MXDeviceTrackingStatusUnreachableServer),
+                                                              @"@dave:matrix.org": @(MXDeviceTrackingStatusPendingDownload),
+                                                              };
+    XCTAssertEqualObjects(store.deviceTrackingStatus, expectedStatusMap);
+
+    // Reload the store. The status now comes from the db
+    store = [[MXRealmCryptoStore alloc] initWithCredentials:credentials];
+
+    XCTAssertEqualObjects(store.deviceTrackingStatus, expectedStatusMap);
+
+    // There is still one row per user and rows of other users are intact
+    XCTAssertEqual([self deviceTrackingStatusRowsCountInStore:store], 4);
+    XCTAssertEqual([self deviceTrackingStatusRowOfUser:@"@alice:matrix.org" inStore:store], MXDeviceTrackingStatusUpToDate);
+    XCTAssertEqual([self deviceTrackingStatusRowOfUser:@"@bob:matrix.org" inStore:store], MXDeviceTrackingStatusUpToDate);
+    XCTAssertEqual([self deviceTrackingStatusRowOfUser:@"@charlie:matrix.org" inStore:store], MXDeviceTrackingStatusUnreachableServer);
+    XCTAssertEqual([self deviceTrackingStatusRowOfUser:@"@dave:matrix.org" inStore:store], MXDeviceTrackingStatusPendingDownload);
+
+    // An empty partial update changes nothing
+    [store storeDeviceTrackingStatusOfUsers:@{}];
+    store = [[MXRealmCryptoStore alloc] initWithCredentials:credentials];
+
+    XCTAssertEqualObjects(store.deviceTrackingStatus, expectedStatusMap);
+    XCTAssertEqual([self deviceTrackingStatusRowsCountInStore:store], 4);
+}
+
+@end
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXReplayAttackIndex.h"
+
+@interface MXReplayAttackIndexTests : XCTestCase
+
+@end
+
+@implementation MXReplayAttackIndexTests
+
+- (void)testDuplicateMessageIndex
+{
+    MXReplayAttackIndex *index = [[MXReplayAttackIndex alloc] init];
+
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    XCTAssertTrue([index addMessageIndex:1 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    XCTAssertFalse([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+
+    // The same index is fine in another session, for another sender or in another timeline
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session2" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey2" inTimeline:@"timeline"]);
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline2"]);
+
+    XCTAssertEqual(index.timelinesCount, 2);
+    XCTAssertEqual([index sessionsCountInTimeline:@"timeline"], 3);
+    XCTAssertEqual([index sessionsCountInTimeline:@"timeline2"], 1);
+}
+
+- (void)testRemoveTimeline
+{
+    MXReplayAttackIndex *index = [[MXReplayAttackIndex alloc] init];
+
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    [index removeTimeline:@"timeline"];
+
+    XCTAssertEqual(index.timelinesCount, 0);
+    XCTAssertEqual([index sessionsCountInTimeline:@"timeline"], 0);
+    XCTAssertTrue([index addMessageIndex:0 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+}
+
+- (void)testOpenTimelinesAndSessionsAreNotForgotten
+{
+    MXReplayAttackIndex *index = [[MXReplayAttackIndex alloc] init];
+
+    // Many open timelines with many sessions must all keep their replay attack check
+    for (NSUInteger timelineIndex = 0; timelineIndex < 100; timelineIndex++)
+    {
+        NSString *timeline = [NSString stringWithFormat:@"timeline%@", @(timelineIndex)];
+        for (NSUInteger sessionIndex = 0; sessionIndex < 2000; sessionIndex++)
+        {
+            [index addMessageIndex:0 ofSession:[NSString stringWithFormat:@"session%@", @(sessionIndex)] senderKey:@"senderKey" inTimeline:timeline];
+        }
+    }
+
+    XCTAssertEqual(index.timelinesCount, 100);
+    XCTAssertEqual([index sessionsCountInTimeline:@"timeline0"], 2000);
+    XCTAssertFalse([index addMessageIndex:0 ofSession:@"session0" senderKey:@"senderKey" inTimeline:@"timeline0"]);
+    XCTAssertFalse([index addMessageIndex:0 ofSession:@"session1999" senderKey:@"senderKey" inTimeline:@"timeline99"]);
+}
+
+- (void)testMemoryCompactness
+{
+    MXReplayAttackIndex *index = [[MXReplayAttackIndex alloc] init];
+
+    // Consecutive indexes of a session all live in a single index set
+    for (NSUInteger messageIndex = 0; messageIndex < 100000; messageIndex++)
+    {
+        XCTAssertTrue([index addMessageIndex:messageIndex ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    }
+
+    XCTAssertFalse([index addMessageIndex:4242 ofSession:@"session" senderKey:@"senderKey" inTimeline:@"timeline"]);
+    XCTAssertEqual([index sessionsCountInTimeline:@"timeline"], 1);
+}
+
+@end
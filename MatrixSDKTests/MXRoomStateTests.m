@@ -1248,6 +1248,62 @@
     }];
 }
 
+- (MXEvent*)memberEventForUser:(NSString*)userId membership:(MXMembershipString)membership ts:(uint64_t)ts
+{
+    return [MXEvent modelFromJSON:@{
+                                    @"event_id": [NSString stringWithFormat:@"$%@-%@", userId, @(ts)],
+                                    @"type": kMXEventTypeStringRoomMember,
+                                    @"state_key": userId,
+                                    @"sender": userId,
+                                    @"origin_server_ts": @(ts),
+                                    @"content": @{@"membership": membership}
+                                    }];
+}
+
+- (void)testMembersIndex
+{
+    MXRoomState *roomState = [[MXRoomState alloc] initWithRoomId:@"!room:matrix.org" andMatrixSession:nil andDirection:YES];
+
+    [roomState handleStateEvents:@[
+                                   [self memberEventForUser:@"@alice:matrix.org" membership:kMXMembershipStringJoin ts:3],
+                                   [self memberEventForUser:@"@bob:matrix.org" membership:kMXMembershipStringInvite ts:1],
+                                   [self memberEventForUser:@"@charlie:matrix.org" membership:kMXMembershipStringJoin ts:2],
+                                   [self memberEventForUser:@"@dave:matrix.org" membership:kMXMembershipStringBan ts:4]
+                                   ]];
+
+    XCTAssertEqual(roomState.members.membersCount, 4);
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipJoin], 2);
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipInvite], 1);
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipBan], 1);
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipLeave], 0);
+    XCTAssertEqual([roomState.members membersWithMembership:MXMembershipLeave].count, 0);
+    XCTAssertEqual(roomState.membersCount.joined, 2);
+    XCTAssertEqual(roomState.membersCount.invited, 1);
+
+    NSArray<NSString*> *sortedUserIds = [roomState.members.joinedOrInvitedMembersSortedByDate valueForKey:@"userId"];
+    NSArray<NSString*> *expectedSortedUserIds = @[@"@bob:matrix.org", @"@charlie:matrix.org", @"@alice:matrix.org"];
+    XCTAssertEqualObjects(sortedUserIds, expectedSortedUserIds);
+
+    // Bob joins in a copy of the state
+    MXRoomState *previousState = roomState;
+    roomState = [roomState copy];
+    [roomState handleStateEvents:@[[self memberEventForUser:@"@bob:matrix.org" membership:kMXMembershipStringJoin ts:5]]];
+
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipJoin], 3);
+    XCTAssertEqual([roomState.members membersCountWithMembership:MXMembershipInvite], 0);
+    XCTAssertEqual([roomState.members memberWithUserId:@"@bob:matrix.org"].membership, MXMembershipJoin);
+
+    sortedUserIds = [roomState.members.joinedOrInvitedMembersSortedByDate valueForKey:@"userId"];
+    expectedSortedUserIds = @[@"@charlie:matrix.org", @"@alice:matrix.org", @"@bob:matrix.org"];
+    XCTAssertEqualObjects(sortedUserIds, expectedSortedUserIds);
+
+    // The previous state is unchanged
+    XCTAssertEqual([previousState.members membersCountWithMembership:MXMembershipJoin], 2);
+    XCTAssertEqual([previousState.members membersCountWithMembership:MXMembershipInvite], 1);
+    XCTAssertEqual([previousState.members memberWithUserId:@"@bob:matrix.org"].membership, MXMembershipInvite);
+    XCTAssertEqual(previousState.members.joinedOrInvitedMembersSortedByDate.count, 3);
+}
+
 #pragma clang diagnostic pop
 
 @end
@@ -17,7 +17,9 @@
 
 #import <XCTest/XCTest.h>
 
+#import "MXBinaryArchiver.h"
 #import "MXFileStore.h"
+#import "MXFileStoreMetaData.h"
 #import "MXStoreTests.h"
 
 // Do not bother with retain cycles warnings in tests
@@ -218,6 +220,202 @@
     }];
 }
 
+// Benchmark of [MXFileStore commit] with a growing number of rooms.
+// It checks also that the committed data can be read back.
+- (void)testMXFileStoreCommitLatencyVsRoomsCount
+{
+    MXCredentials *credentials = [[MXCredentials alloc] initWithHomeServer:@"http://localhost:8008"
+                                                                    userId:@"@mxfilestorebenchmark:localhost"
+                                                               accessToken:@"accessToken"];
+    NSUInteger eventsPerRoom = 20;
+
+    for (NSNumber *roomsCountNumber in @[@10, @100, @300, @1000])
+    {
+        NSUInteger roomsCount = roomsCountNumber.unsignedIntegerValue;
+
+        // Start from an empty store
+        MXFileStore *store = [[MXFileStore alloc] initWithCredentials:credentials];
+        [store deleteAllData];
+
+        XCTestExpectation *openExpectation = [self expectationWithDescription:@"open"];
+        [store openWithCredentials:credentials onComplete:^{
+            [openExpectation fulfill];
+        } failure:^(NSError *error) {
+            XCTFail(@"The operation should not fail - NSError: %@", error);
+            [openExpectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:10 handler:nil];
+
+        for (NSUInteger roomIndex = 0; roomIndex < roomsCount; roomIndex++)
+        {
+            NSString *roomId = [NSString stringWithFormat:@"!room%tu:localhost", roomIndex];
+            for (NSUInteger eventIndex = 0; eventIndex < eventsPerRoom; eventIndex++)
+            {
+                MXEvent *event = [MXEvent modelFromJSON:@{
+                                                          @"event_id": [NSString stringWithFormat:@"$%tu_%tu", roomIndex, eventIndex],
+                                                          @"type": kMXEventTypeStringRoomMessage,
+                                                          @"room_id": roomId,
+                                                          @"sender": @"@alice:localhost",
+                                                          @"origin_server_ts": @(eventIndex),
+                                                          @"content": @{
+                                                                  @"msgtype": kMXMessageTypeText,
+                                                                  @"body": @"Hello"
+                                                                  }
+                                                          }];
+                [store storeEventForRoom:roomId event:event direction:MXTimelineDirectionForwards];
+            }
+        }
+        store.eventStreamToken = @"token1";
+
+        // First commit: full snapshot of every room
+        NSDate *startDate = [NSDate date];
+        [store commit];
+        [store close];
+        NSTimeInterval snapshotDuration = [[NSDate date] timeIntervalSinceDate:startDate];
+
+        // Second commit: one new event per room
+        store = [[MXFileStore alloc] initWithCredentials:credentials];
+        openExpectation = [self expectationWithDescription:@"reopen"];
+        [store openWithCredentials:credentials onComplete:^{
+            [openExpectation fulfill];
+        } failure:^(NSError *error) {
+            XCTFail(@"The operation should not fail - NSError: %@", error);
+            [openExpectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:10 handler:nil];
+
+        for (NSUInteger roomIndex = 0; roomIndex < roomsCount; roomIndex++)
+        {
+            NSString *roomId = [NSString stringWithFormat:@"!room%tu:localhost", roomIndex];
+            MXEvent *event = [MXEvent modelFromJSON:@{
+                                                      @"event_id": [NSString stringWithFormat:@"$%tu_new", roomIndex],
+                                                      @"type": kMXEventTypeStringRoomMessage,
+                                                      @"room_id": roomId,
+                                                      @"sender": @"@alice:localhost",
+                                                      @"content": @{
+                                                              @"msgtype": kMXMessageTypeText,
+                                                              @"body": @"Hello again"
+                                                              }
+                                                      }];
+            [store storeEventForRoom:roomId event:event direction:MXTimelineDirectionForwards];
+        }
+        store.eventStreamToken = @"token2";
+
+        startDate = [NSDate date];
+        [store commit];
+        [store close];
+        NSTimeInterval appendDuration = [[NSDate date] timeIntervalSinceDate:startDate];
+
+        NSLog(@"[MXStoreFileStoreTests] Commit of %tu rooms: %.0fms (snapshots) - %.0fms (1 event per room)", roomsCount, snapshotDuration * 1000, appendDuration * 1000);
+
+        // Check data is correctly read back
+        store = [[MXFileStore alloc] initWithCredentials:credentials];
+        openExpectation = [self expectationWithDescription:@"check"];
+        [store openWithCredentials:credentials onComplete:^{
+            [openExpectation fulfill];
+        } failure:^(NSError *error) {
+            XCTFail(@"The operation should not fail - NSError: %@", error);
+            [openExpectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:10 handler:nil];
+
+        XCTAssertEqual(store.rooms.count, roomsCount);
+        XCTAssertEqualObjects(store.eventStreamToken, @"token2");
+
+        NSString *lastRoomId = [NSString stringWithFormat:@"!room%tu:localhost", roomsCount - 1];
+        XCTAssertEqual([store messagesEnumeratorForRoom:lastRoomId].remaining, eventsPerRoom + 1);
+        XCTAssertNotNil([store eventWithEventId:[NSString stringWithFormat:@"$%tu_new", roomsCount - 1] inRoom:lastRoomId]);
+
+        [store deleteAllData];
+        [store close];
+    }
+}
+
+// A store written by MXFileStore version 66, ie with NSKeyedArchiver files and no messages log,
+// must be kept on upgrade
+- (void)testMXFileStoreMigrationFromVersion66
+{
+    MXCredentials *credentials = [[MXCredentials alloc] initWithHomeServer:@"http://localhost:8008"
+                                                                    userId:@"@mxfilestoremigration:localhost"
+                                                               accessToken:@"accessToken"];
+    NSString *roomId = @"!room:localhost";
+    NSUInteger eventsCount = 5;
+
+    MXFileStore *store = [[MXFileStore alloc] initWithCredentials:credentials];
+    [store deleteAllData];
+
+    XCTestExpectation *openExpectation = [self expectationWithDescription:@"open"];
+    [store openWithCredentials:credentials onComplete:^{
+        [openExpectation fulfill];
+    } failure:^(NSError *error) {
+        XCTFail(@"The operation should not fail - NSError: %@", error);
+        [openExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    for (NSUInteger eventIndex = 0; eventIndex < eventsCount; eventIndex++)
+    {
+        MXEvent *event = [MXEvent modelFromJSON:@{
+                                                  @"event_id": [NSString stringWithFormat:@"$%tu", eventIndex],
+                                                  @"type": kMXEventTypeStringRoomMessage,
+                                                  @"room_id": roomId,
+                                                  @"sender": @"@alice:localhost",
+                                                  @"origin_server_ts": @(eventIndex),
+                                                  @"content": @{
+                                                          @"msgtype": kMXMessageTypeText,
+                                                          @"body": @"Hello"
+                                                          }
+                                                  }];
+        [store storeEventForRoom:roomId event:event direction:MXTimelineDirectionForwards];
+    }
+    store.eventStreamToken = @"token";
+    [store commit];
+    [store close];
+
+    // Rewrite the store as version 66 did: every file with NSKeyedArchiver and the room messages as a single file
+    NSString *cachePath = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject;
+    NSString *storePath = [[cachePath stringByAppendingPathComponent:@"MXFileStore"] stringByAppendingPathComponent:credentials.userId];
+
+    NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:storePath];
+    for (NSString *relativePath in enumerator)
+    {
+        if ([enumerator.fileAttributes.fileType isEqualToString:NSFileTypeDirectory])
+        {
+            continue;
+        }
+
+        XCTAssertFalse([relativePath.lastPathComponent hasPrefix:@"messagesLog"], @"A new room must be stored as a snapshot: %@", relativePath);
+
+        NSString *file = [storePath stringByAppendingPathComponent:relativePath];
+        id object = [MXBinaryUnarchiver unarchiveObjectWithFile:file];
+        if ([object isKindOfClass:MXFileStoreMetaData.class])
+        {
+            ((MXFileStoreMetaData*)object).version = 66;
+        }
+        XCTAssertNotNil(object, @"Cannot read %@", relativePath);
+        [NSKeyedArchiver archiveRootObject:object toFile:file];
+    }
+
+    // Open it with the current version
+    store = [[MXFileStore alloc] initWithCredentials:credentials];
+    openExpectation = [self expectationWithDescription:@"migrate"];
+    [store openWithCredentials:credentials onComplete:^{
+        [openExpectation fulfill];
+    } failure:^(NSError *error) {
+        XCTFail(@"The operation should not fail - NSError: %@", error);
+        [openExpectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(store.eventStreamToken, @"token");
+    XCTAssertEqualObjects(store.rooms, @[roomId]);
+    XCTAssertEqual([store messagesEnumeratorForRoom:roomId].remaining, eventsCount);
+    XCTAssertNotNil([store eventWithEventId:[NSString stringWithFormat:@"$%tu", eventsCount - 1] inRoom:roomId]);
+
+    [store deleteAllData];
+    [store close];
+}
+
 - (void)testMXFileStoreUserDisplaynameAndAvatarUrl
 {
     [self checkUserDisplaynameAndAvatarUrl:MXFileStore.class];
@@ -199,6 +199,108 @@
 
 
 #pragma mark - MXMemoryStore specific tests
+- (MXEvent*)unreadCountTestEventWithId:(NSString*)eventId sender:(NSString*)sender
+{
+    return [MXEvent modelFromJSON:@{
+                                    @"event_id": eventId,
+                                    @"room_id": @"!aRoomId:localhost",
+                                    @"sender": sender,
+                                    @"type": kMXEventTypeStringRoomMessage,
+                                    @"origin_server_ts": @(1576000000000),
+                                    @"content": @{
+                                            @"msgtype": kMXMessageTypeText,
+                                            @"body": eventId
+                                            }
+                                    }];
+}
+
+- (void)testMXMemoryStoreLocalUnreadEventCount
+{
+    [MXMemoryStore setUnreadCountsConsistencyCheckEnabled:YES];
+
+    MXCredentials *credentials = [[MXCredentials alloc] initWithHomeServer:@"http://localhost:8008"
+                                                                    userId:@"@me:localhost"
+                                                               accessToken:@"accessToken"];
+    NSString *roomId = @"!aRoomId:localhost";
+    NSArray *types = @[kMXEventTypeStringRoomMessage];
+
+    MXMemoryStore *store = [[MXMemoryStore alloc] init];
+    [store openWithCredentials:credentials onComplete:nil failure:nil];
+
+    for (NSUInteger i = 0; i < 10; i++)
+    {
+        NSString *sender = (i % 5) ? @"@bob:localhost" : credentials.userId;
+        [store storeEventForRoom:roomId event:[self unreadCountTestEventWithId:[NSString stringWithFormat:@"$%tu", i] sender:sender] direction:MXTimelineDirectionForwards];
+    }
+
+    MXReceiptData *receipt = [[MXReceiptData alloc] init];
+    receipt.userId = credentials.userId;
+    receipt.eventId = @"$4";
+    receipt.ts = 1;
+    [store storeReceipt:receipt inRoom:roomId];
+
+    // $5 is mine
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:types], 4);
+
+    // Live events are counted
+    [store storeEventForRoom:roomId event:[self unreadCountTestEventWithId:@"$10" sender:@"@bob:localhost"] direction:MXTimelineDirectionForwards];
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:types], 5);
+
+    // Redacted events are not
+    MXEvent *redactedEvent = [[store eventWithEventId:@"$7" inRoom:roomId] prune];
+    redactedEvent.redactedBecause = @{@"event_id": @"$redaction"};
+    [store replaceEvent:redactedEvent inRoom:roomId];
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:types], 4);
+
+    // Nor past events
+    [store storeEventForRoom:roomId event:[self unreadCountTestEventWithId:@"$-1" sender:@"@bob:localhost"] direction:MXTimelineDirectionBackwards];
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:types], 4);
+
+    // Nor events of other types
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:@[kMXEventTypeStringRoomMember]], 0);
+
+    // Moving the read receipt updates the count
+    receipt = [[MXReceiptData alloc] init];
+    receipt.userId = credentials.userId;
+    receipt.eventId = @"$8";
+    receipt.ts = 2;
+    [store storeReceipt:receipt inRoom:roomId];
+    XCTAssertEqual([store localUnreadEventCount:roomId withTypeIn:types], 2);
+
+    [MXMemoryStore setUnreadCountsConsistencyCheckEnabled:NO];
+}
+
+- (void)testMXMemoryStoreEventsReceipts
+{
+    NSString *roomId = @"!aRoomId:localhost";
+    MXMemoryStore *store = [[MXMemoryStore alloc] init];
+
+    for (NSUInteger i = 0; i < 10; i++)
+    {
+        MXReceiptData *receipt = [[MXReceiptData alloc] init];
+        receipt.userId = [NSString stringWithFormat:@"@user%tu:localhost", i];
+        receipt.eventId = (i % 2) ? @"$odd" : @"$even";
+        receipt.ts = i;
+        [store storeReceipt:receipt inRoom:roomId];
+    }
+
+    NSArray<MXReceiptData*> *receipts = [store getEventReceipts:roomId eventId:@"$odd" sorted:YES];
+    XCTAssertEqualObjects([receipts valueForKey:@"userId"], (@[@"@user9:localhost", @"@user7:localhost", @"@user5:localhost", @"@user3:localhost", @"@user1:localhost"]));
+
+    // Move a receipt
+    MXReceiptData *receipt = [[MXReceiptData alloc] init];
+    receipt.userId = @"@user1:localhost";
+    receipt.eventId = @"$even";
+    receipt.ts = 100;
+    [store storeReceipt:receipt inRoom:roomId];
+
+    NSDictionary<NSString*, NSArray<MXReceiptData*>*> *receiptsByEventId = [store getEventsReceipts:roomId eventIds:@[@"$odd", @"$even", @"$none"] sorted:YES];
+    XCTAssertEqual(receiptsByEventId[@"$odd"].count, 4);
+    XCTAssertEqual(receiptsByEventId[@"$even"].count, 6);
+    XCTAssertEqualObjects(receiptsByEventId[@"$even"].firstObject.userId, @"@user1:localhost");
+    XCTAssertNil(receiptsByEventId[@"$none"]);
+}
+
 - (void)testMXMemoryStorePaginate
 {
     [self doTestWithMXMemoryStoreAndMessagesLimit:0 readyToTest:^(MXRoom *room) {
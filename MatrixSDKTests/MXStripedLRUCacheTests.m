@@ -0,0 +1,111 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "MXStripedLRUCache.h"
+#import "MXLRUCache.h"
+
+@interface MXStripedLRUCacheTests : XCTestCase
+
+@end
+
+@implementation MXStripedLRUCacheTests
+
+- (void)testCountLimit
+{
+    MXStripedLRUCache<NSString*, NSNumber*> *cache = [[MXStripedLRUCache alloc] initWithCountLimit:3 totalCostLimit:0];
+
+    [cache setObject:@1 forKey:@"1"];
+    [cache setObject:@2 forKey:@"2"];
+    [cache setObject:@3 forKey:@"3"];
+
+    // "1" becomes the most recently used
+    XCTAssertEqualObjects([cache objectForKey:@"1"], @1);
+
+    // So "2" is evicted
+    [cache setObject:@4 forKey:@"4"];
+
+    XCTAssertEqual(cache.count, 3);
+    XCTAssertNil([cache objectForKey:@"2"]);
+    XCTAssertEqualObjects([cache objectForKey:@"1"], @1);
+    XCTAssertEqualObjects([cache objectForKey:@"3"], @3);
+    XCTAssertEqualObjects([cache objectForKey:@"4"], @4);
+
+    XCTAssertEqual(cache.hitCount, 4);
+    XCTAssertEqual(cache.missCount, 1);
+    XCTAssertEqual(cache.evictionCount, 1);
+}
+
+- (void)testCostLimit
+{
+    MXStripedLRUCache<NSString*, NSNumber*> *cache = [[MXStripedLRUCache alloc] initWithCountLimit:0 totalCostLimit:100 stripesCount:1];
+
+    [cache setObject:@1 forKey:@"1" cost:40];
+    [cache setObject:@2 forKey:@"2" cost:40];
+    XCTAssertEqual(cache.totalCost, 80);
+
+    // Replacing an object updates the cost
+    [cache setObject:@22 forKey:@"2" cost:50];
+    XCTAssertEqual(cache.totalCost, 90);
+
+    [cache setObject:@3 forKey:@"3" cost:30];
+    XCTAssertNil([cache objectForKey:@"1"]);
+    XCTAssertEqualObjects([cache objectForKey:@"2"], @22);
+    XCTAssertEqual(cache.totalCost, 80);
+
+    [cache removeObjectForKey:@"2"];
+    XCTAssertEqual(cache.count, 1);
+    XCTAssertEqual(cache.totalCost, 30);
+
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.count, 0);
+    XCTAssertEqual(cache.totalCost, 0);
+}
+
+- (void)testConcurrentAccess
+{
+    MXStripedLRUCache<NSString*, NSNumber*> *cache = [[MXStripedLRUCache alloc] initWithCountLimit:256 totalCostLimit:0];
+
+    dispatch_apply(10000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSString *key = [NSString stringWithFormat:@"%zu", i % 512];
+        if (![cache objectForKey:key])
+        {
+            [cache setObject:@(i) forKey:key];
+        }
+    });
+
+    XCTAssertLessThanOrEqual(cache.count, 256);
+    XCTAssertEqual(cache.hitCount + cache.missCount, 10000);
+}
+
+- (void)testMXLRUCache
+{
+    MXLRUCache *cache = [[MXLRUCache alloc] initWithCapacity:2];
+
+    [cache put:@"1" object:@1];
+    [cache put:@"2" object:@2];
+    [cache get:@"1"];
+    [cache put:@"3" object:@3];
+
+    XCTAssertEqualObjects([cache get:@"1"], @1);
+    XCTAssertNil([cache get:@"2"]);
+
+    [cache clear];
+    XCTAssertNil([cache get:@"1"]);
+}
+
+@end
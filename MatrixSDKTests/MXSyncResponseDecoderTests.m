@@ -0,0 +1,388 @@
+/*
+ Copyright 2019 The Matrix.org Foundation C.I.C
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import <mach/mach.h>
+
+#import "MXSyncResponseDecoder.h"
+#import "MXEvent.h"
+
+@interface MXSyncResponseDecoderTests : XCTestCase
+
+@end
+
+@implementation MXSyncResponseDecoderTests
+
+#pragma mark - Fixtures
+
+- (NSDictionary*)messageEventWithIndex:(NSUInteger)index inRoom:(NSString*)roomId
+{
+    return @{
+             @"event_id": [NSString stringWithFormat:@"$%@:%@", @(index), roomId],
+             @"type": kMXEventTypeStringRoomMessage,
+             @"sender": @"@alice:matrix.org",
+             @"origin_server_ts": @(1570000000000 + index),
+             @"content": @{
+                     @"msgtype": kMXMessageTypeText,
+                     @"body": [NSString stringWithFormat:@"Message #%@ with \"quotes\", a\nnew line and an émoji 😀", @(index)],
+                     @"format": [NSNull null]
+                     },
+             @"unsigned": @{
+                     @"age": @(index * 1000)
+                     }
+             };
+}
+
+/**
+ Build a /sync response with `roomsCount` joined rooms of `eventsCount` messages each,
+ one invited room and one left room.
+ */
+- (NSDictionary*)syncResponseJSONWithRoomsCount:(NSUInteger)roomsCount eventsCount:(NSUInteger)eventsCount
+{
+    NSMutableDictionary *join = [NSMutableDictionary dictionary];
+    for (NSUInteger r = 0; r < roomsCount; r++)
+    {
+        NSString *roomId = [NSString stringWithFormat:@"!room%@:matrix.org", @(r)];
+
+        NSMutableArray *events = [NSMutableArray arrayWithCapacity:eventsCount];
+        for (NSUInteger e = 0; e < eventsCount; e++)
+        {
+            [events addObject:[self messageEventWithIndex:e inRoom:roomId]];
+        }
+
+        join[roomId] = @{
+                         @"state": @{
+                                 @"events": @[
+                                         @{
+                                             @"event_id": [NSString stringWithFormat:@"$name:%@", roomId],
+                                             @"type": kMXEventTypeStringRoomName,
+                                             @"state_key": @"",
+                                             @"sender": @"@alice:matrix.org",
+                                             @"origin_server_ts": @1570000000000,
+                                             @"content": @{@"name": roomId}
+                                             }
+                                         ]
+                                 },
+                         @"timeline": @{
+                                 @"events": events,
+                                 @"limited": @YES,
+                                 @"prev_batch": @"t1-prev"
+                                 },
+                         @"unread_notifications": @{
+                                 @"notification_count": @(r),
+                                 @"highlight_count": @0
+                                 }
+                         };
+    }
+
+    return @{
+             @"next_batch": @"s72595_4483_1934",
+             @"account_data": @{
+                     @"events": @[]
+                     },
+             @"to_device": @{
+                     @"events": @[
+                             @{
+                                 @"type": @"m.new_device",
+                                 @"sender": @"@bob:matrix.org",
+                                 @"content": @{@"device_id": @"XYZABCDE"}
+                                 }
+                             ]
+                     },
+             @"device_one_time_keys_count": @{
+                     @"signed_curve25519": @50
+                     },
+             @"presence": [NSNull null],
+             @"rooms": @{
+                     @"join": join,
+                     @"invite": @{
+                             @"!invite:matrix.org": @{
+                                     @"invite_state": @{
+                                             @"events": @[
+                                                     @{
+                                                         @"type": kMXEventTypeStringRoomMember,
+                                                         @"state_key": @"@me:matrix.org",
+                                                         @"sender": @"@bob:matrix.org",
+                                                         @"content": @{@"membership": @"invite"}
+                                                         }
+                                                     ]
+                                             }
+                                     }
+                             },
+                     @"leave": @{
+                             @"!left:matrix.org": @{
+                                     @"timeline": @{
+                                             @"events": @[[self messageEventWithIndex:0 inRoom:@"!left:matrix.org"]]
+                                             }
+                                     }
+                             }
+                     }
+             };
+}
+
+
+#pragma mark - Tests
+
+- (void)testDecodeLikeMXJSONModel
+{
+    NSDictionary *JSONResponse = [self syncResponseJSONWithRoomsCount:5 eventsCount:10];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:JSONResponse options:0 error:nil];
+
+    NSError *error;
+    MXSyncResponse *syncResponse = [MXSyncResponseDecoder syncResponseFromData:data error:&error];
+    MXSyncResponse *expectedSyncResponse = [MXSyncResponse modelFromJSON:JSONResponse];
+
+    XCTAssertNil(error);
+    XCTAssertNotNil(syncResponse);
+
+    XCTAssertEqualObjects(syncResponse.nextBatch, expectedSyncResponse.nextBatch);
+    XCTAssertEqualObjects(syncResponse.deviceOneTimeKeysCount, expectedSyncResponse.deviceOneTimeKeysCount);
+    XCTAssertEqual(syncResponse.toDevice.events.count, 1);
+    XCTAssertEqualObjects(syncResponse.toDevice.events[0].content, expectedSyncResponse.toDevice.events[0].content);
+    XCTAssertNil(syncResponse.presence);
+
+    XCTAssertEqualObjects([NSSet setWithArray:syncResponse.rooms.join.allKeys], [NSSet setWithArray:expectedSyncResponse.rooms.join.allKeys]);
+    XCTAssertEqualObjects(syncResponse.rooms.invite.allKeys, @[@"!invite:matrix.org"]);
+    XCTAssertEqualObjects(syncResponse.rooms.leave.allKeys, @[@"!left:matrix.org"]);
+
+    for (NSString *roomId in expectedSyncResponse.rooms.join)
+    {
+        MXRoomSync *roomSync = syncResponse.rooms.join[roomId];
+        MXRoomSync *expectedRoomSync = expectedSyncResponse.rooms.join[roomId];
+
+        XCTAssertTrue(roomSync.timeline.limited);
+        XCTAssertEqualObjects(roomSync.timeline.prevBatch, expectedRoomSync.timeline.prevBatch);
+        XCTAssertEqual(roomSync.unreadNotifications.notificationCount, expectedRoomSync.unreadNotifications.notificationCount);
+        XCTAssertEqualObjects(roomSync.state.events[0].content, expectedRoomSync.state.events[0].content);
+
+        XCTAssertEqual(roomSync.timeline.events.count, expectedRoomSync.timeline.events.count);
+        for (NSUInteger i = 0; i < expectedRoomSync.timeline.events.count; i++)
+        {
+            MXEvent *event = roomSync.timeline.events[i];
+            MXEvent *expectedEvent = expectedRoomSync.timeline.events[i];
+
+            XCTAssertEqualObjects(event.eventId, expectedEvent.eventId);
+            XCTAssertEqual(event.originServerTs, expectedEvent.originServerTs);
+
+            // Null values have been removed
+            XCTAssertEqualObjects(event.content, expectedEvent.content);
+            XCTAssertNil(event.content[@"format"]);
+        }
+    }
+
+    MXInvitedRoomSync *invitedRoomSync = syncResponse.rooms.invite[@"!invite:matrix.org"];
+    XCTAssertEqualObjects(invitedRoomSync.inviteState.events[0].content[@"membership"], @"invite");
+}
+
+- (void)testOnRoomSync
+{
+    NSDictionary *JSONResponse = [self syncResponseJSONWithRoomsCount:3 eventsCount:2];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:JSONResponse options:0 error:nil];
+
+    NSMutableDictionary<NSString*, NSNumber*> *memberships = [NSMutableDictionary dictionary];
+
+    MXSyncResponseDecoder *decoder = [[MXSyncResponseDecoder alloc] initWithData:data];
+    decoder.onRoomSync = ^(NSString *roomId, MXMembership membership, MXJSONModel *roomSync) {
+        memberships[roomId] = @(membership);
+
+        if (membership == MXMembershipInvite)
+        {
+            XCTAssertTrue([roomSync isKindOfClass:MXInvitedRoomSync.class]);
+        }
+        else
+        {
+            XCTAssertTrue([roomSync isKindOfClass:MXRoomSync.class]);
+        }
+    };
+
+    MXSyncResponse *syncResponse = [decoder decode:nil];
+
+    XCTAssertEqual(memberships.count, 5);
+    XCTAssertEqualObjects(memberships[@"!room0:matrix.org"], @(MXMembershipJoin));
+    XCTAssertEqualObjects(memberships[@"!invite:matrix.org"], @(MXMembershipInvite));
+    XCTAssertEqualObjects(memberships[@"!left:matrix.org"], @(MXMembershipLeave));
+    XCTAssertEqual(syncResponse.rooms.join.count, 3);
+}
+
+- (void)testJSONValues
+{
+    NSString *JSONString = @"{\"next_batch\": \"s1\", \"rooms\": {\"join\": {\"!a:b\": {\"timeline\": {\"events\": [{"
+        "\"event_id\": \"$1\", \"type\": \"m.room.message\", \"sender\": \"@a:b\", \"origin_server_ts\": 1570000000000,"
+        "\"content\": {"
+            "\"escaped\": \"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\ud83d\\ude00\","
+            "\"utf8\": \"é😀\","
+            "\"integer\": -42, \"big\": 12345678901234567890, \"double\": 1.5e3,"
+            "\"true\": true, \"false\": false, \"null\": null,"
+            "\"array\": [1, null, {\"a\": null}], \"empty\": {}, \"emptyArray\": []"
+        "}}]}}}}}";
+
+    MXSyncResponse *syncResponse = [MXSyncResponseDecoder syncResponseFromData:[JSONString dataUsingEncoding:NSUTF8StringEncoding] error:nil];
+    NSDictionary *content = syncResponse.rooms.join[@"!a:b"].timeline.events[0].content;
+
+    XCTAssertEqualObjects(content[@"escaped"], @"\"\\/\b\f\n\r\té😀");
+    XCTAssertEqualObjects(content[@"utf8"], @"é😀");
+    XCTAssertEqualObjects(content[@"integer"], @(-42));
+    XCTAssertEqualWithAccuracy([content[@"big"] doubleValue], 12345678901234567890.0, 1e5);
+    XCTAssertEqualObjects(content[@"double"], @(1500));
+    XCTAssertEqualObjects(content[@"true"], @YES);
+    XCTAssertEqualObjects(content[@"false"], @NO);
+    XCTAssertNil(content[@"null"]);
+    NSArray *expectedArray = @[@1, [NSNull null], @{}];
+    XCTAssertEqualObjects(content[@"array"], expectedArray);
+    XCTAssertEqualObjects(content[@"empty"], @{});
+    XCTAssertEqualObjects(content[@"emptyArray"], @[]);
+}
+
+- (void)testInvalidData
+{
+    NSArray<NSString*> *invalidJSONs = @[
+                                         @"",
+                                         @"[]",
+                                         @"{\"next_batch\": \"s1\"",
+                                         @"{\"next_batch\": \"s1\",}",
+                                         @"{\"rooms\": {\"join\": {\"!a:b\": {\"timeline\": tru}}}}",
+                                         @"{\"next_batch\": \"s1\"} {}",
+                                         @"{\"next_batch\": \"\\x\"}"
+                                         ];
+
+    for (NSString *JSONString in invalidJSONs)
+    {
+        NSError *error;
+        MXSyncResponse *syncResponse = [MXSyncResponseDecoder syncResponseFromData:[JSONString dataUsingEncoding:NSUTF8StringEncoding] error:&error];
+
+        XCTAssertNil(syncResponse, @"%@", JSONString);
+        XCTAssertEqualObjects(error.domain, kMXSyncResponseDecoderErrorDomain, @"%@", JSONString);
+    }
+}
+
+
+#pragma mark - Benchmarks
+
+- (NSData*)benchmarkSyncResponseData
+{
+    NSDictionary *JSONResponse = [self syncResponseJSONWithRoomsCount:200 eventsCount:100];
+    return [NSJSONSerialization dataWithJSONObject:JSONResponse options:0 error:nil];
+}
+
+- (void)testDecoderPerformance
+{
+    NSData *data = [self benchmarkSyncResponseData];
+
+    [self measureBlock:^{
+        @autoreleasepool
+        {
+            MXSyncResponse *syncResponse = [MXSyncResponseDecoder syncResponseFromData:data error:nil];
+            XCTAssertEqual(syncResponse.rooms.join.count, 200);
+        }
+    }];
+}
+
+// The reference: NSJSONSerialization, then MXJSONModel
+- (void)testJSONSerializationPerformance
+{
+    NSData *data = [self benchmarkSyncResponseData];
+
+    [self measureBlock:^{
+        @autoreleasepool
+        {
+            NSDictionary *JSONResponse = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+            MXSyncResponse *syncResponse = [MXSyncResponse modelFromJSON:JSONResponse];
+            XCTAssertEqual(syncResponse.rooms.join.count, 200);
+        }
+    }];
+}
+
+/**
+ The current resident size of the process, in bytes.
+ */
+- (mach_vm_size_t)residentSize
+{
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+    {
+        return 0;
+    }
+    return info.resident_size;
+}
+
+/**
+ Run a block and measure the peak growth of the resident size while it runs.
+
+ The resident size is sampled every millisecond from another thread.
+
+ @param block the block to measure.
+ @return the peak growth in bytes.
+ */
+- (mach_vm_size_t)peakResidentSizeGrowthOfBlock:(dispatch_block_t)block
+{
+    mach_vm_size_t baseline = [self residentSize];
+    __block mach_vm_size_t peak = baseline;
+
+    dispatch_queue_t samplingQueue = dispatch_queue_create("MXSyncResponseDecoderTests.sampling", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+    dispatch_source_set_timer(timer, DISPATCH_TIME_NOW, NSEC_PER_MSEC, 0);
+    dispatch_source_set_event_handler(timer, ^{
+        peak = MAX(peak, [self residentSize]);
+    });
+    dispatch_resume(timer);
+
+    @autoreleasepool
+    {
+        block();
+    }
+
+    // Take a last sample, then stop sampling
+    dispatch_sync(samplingQueue, ^{
+        peak = MAX(peak, [self residentSize]);
+        dispatch_source_cancel(timer);
+    });
+
+    return peak - baseline;
+}
+
+// Compare the peak memory of the decoder with the one of the reference on the same data
+- (void)testPeakMemory
+{
+    NSData *data = [self benchmarkSyncResponseData];
+
+    // Warm up both paths so that one-time allocations (classes, caches) are not measured
+    @autoreleasepool
+    {
+        [MXSyncResponseDecoder syncResponseFromData:data error:nil];
+        [MXSyncResponse modelFromJSON:[NSJSONSerialization JSONObjectWithData:data options:0 error:nil]];
+    }
+
+    // The decoder is measured first: the memory it frees may stay resident, which can only
+    // lower the figure of the reference
+    mach_vm_size_t decoderPeak = [self peakResidentSizeGrowthOfBlock:^{
+        MXSyncResponse *syncResponse = [MXSyncResponseDecoder syncResponseFromData:data error:nil];
+        XCTAssertEqual(syncResponse.rooms.join.count, 200);
+    }];
+
+    mach_vm_size_t JSONSerializationPeak = [self peakResidentSizeGrowthOfBlock:^{
+        NSDictionary *JSONResponse = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+        MXSyncResponse *syncResponse = [MXSyncResponse modelFromJSON:JSONResponse];
+        XCTAssertEqual(syncResponse.rooms.join.count, 200);
+    }];
+
+    NSLog(@"[MXSyncResponseDecoderTests] testPeakMemory: %@ of data. Peak resident size growth: decoder: %@ - NSJSONSerialization + MXJSONModel: %@",
+          [NSByteCountFormatter stringFromByteCount:data.length countStyle:NSByteCountFormatterCountStyleMemory],
+          [NSByteCountFormatter stringFromByteCount:decoderPeak countStyle:NSByteCountFormatterCountStyleMemory],
+          [NSByteCountFormatter stringFromByteCount:JSONSerializationPeak countStyle:NSByteCountFormatterCountStyleMemory]);
+}
+
+@end